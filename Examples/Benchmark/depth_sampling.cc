@@ -0,0 +1,111 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <opencv2/core/core.hpp>
+#include "Frame.h"
+#include "extra/timer.h"
+
+using namespace std;
+
+// Synthetic depth in TUM units (5000 per meter): a slanted plane with invalid pixels
+cv::Mat CreateDepth(int width, int height, cv::RNG &rng) {
+  cv::Mat depth(height, width, CV_16U);
+  for (int v = 0; v < height; v++) {
+    for (int u = 0; u < width; u++) {
+      if (rng.uniform(0, 10) == 0)
+        depth.at<ushort>(v, u) = 0;
+      else
+        depth.at<ushort>(v, u) = 5000 + 10*u + 5*v + rng.uniform(0, 50);
+    }
+  }
+  return depth;
+}
+
+int main(int argc, char **argv) {
+  const int nKeys = 1000;
+  const float depthScale = 1.0f/5000.0f;
+  int nFrames = 200;
+
+  if (argc > 1)
+    nFrames = atoi(argv[1]);
+
+  const cv::Size sizes[] = {cv::Size(640, 480), cv::Size(1280, 720)};
+
+  cv::RNG rng(0);
+  SD_SLAM::Timer timer(false);
+
+  for (const cv::Size &size : sizes) {
+    cv::Mat raw = CreateDepth(size.width, size.height, rng);
+
+    // Only keypoints and baseline are needed to compute depth
+    SD_SLAM::Frame frame;
+    frame.N = nKeys;
+    frame.mbf = 40.0f;
+    frame.mvKeys.resize(nKeys);
+    for (int i = 0; i < nKeys; i++)
+      frame.mvKeys[i].pt = cv::Point2f(rng.uniform(0.f, static_cast<float>(size.width)),
+                                       rng.uniform(0.f, static_cast<float>(size.height)));
+    frame.mvKeysUn = frame.mvKeys;
+
+    // Reference: whole image converted to meters on each frame
+    vector<float> depthFloat;
+    cv::Mat imDepth;
+    timer.Start();
+    for (int it = 0; it < nFrames; it++) {
+      raw.convertTo(imDepth, CV_32F, depthScale);
+      frame.ComputeStereoFromRGBD(imDepth);
+    }
+    timer.Stop();
+    const double tFloat = timer.GetMsTime();
+    depthFloat = frame.mvDepth;
+
+    timer.Start();
+    for (int it = 0; it < nFrames; it++)
+      frame.ComputeStereoFromRGBD(raw, depthScale);
+    timer.Stop();
+    const double tRaw = timer.GetMsTime();
+
+    int nValid = 0, nDifferent = 0;
+    float maxError = 0;
+    for (int i = 0; i < nKeys; i++) {
+      if (frame.mvDepth[i] > 0)
+        nValid++;
+      if ((frame.mvDepth[i] > 0) != (depthFloat[i] > 0))
+        nDifferent++;
+      else
+        maxError = max(maxError, fabs(frame.mvDepth[i]-depthFloat[i]));
+    }
+
+    // Depth held by each frame and keyframe: the float copy before, the input buffer now
+    const double floatMB = imDepth.total()*imDepth.elemSize()/(1024.0*1024.0);
+    const double rawMB = raw.total()*raw.elemSize()/(1024.0*1024.0);
+
+    cout << "Depth " << size.width << "x" << size.height << " (" << nKeys << " keypoints, "
+         << nValid << " with depth):" << endl;
+    cout << "  Float conversion: " << tFloat/nFrames << " ms/frame, " << floatMB << " MB/frame" << endl;
+    cout << "  Raw sampling:     " << tRaw/nFrames << " ms/frame, " << rawMB << " MB/frame (input buffer, no copy)" << endl;
+    cout << "  Differences: " << nDifferent << " validity, max " << maxError << " m" << endl;
+  }
+
+  return 0;
+}
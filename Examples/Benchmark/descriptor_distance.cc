@@ -0,0 +1,118 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+#include "ORBmatcher.h"
+#include "extra/timer.h"
+
+using namespace std;
+
+// Previous implementation, used as reference
+int ScalarDistance(const cv::Mat &a, const cv::Mat &b) {
+  const int *pa = a.ptr<int32_t>();
+  const int *pb = b.ptr<int32_t>();
+
+  int dist = 0;
+
+  for (int i = 0; i<8; i++, pa++, pb++) {
+    unsigned  int v = *pa ^ *pb;
+    v = v - ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
+  }
+
+  return dist;
+}
+
+int main(int argc, char **argv) {
+  int nDescriptors = 2000;
+  int nCandidates = 50;
+  int nIterations = 200;
+
+  if (argc > 1)
+    nIterations = atoi(argv[1]);
+
+  // Random descriptors and candidate indices
+  cv::Mat descriptors(nDescriptors, 32, CV_8U);
+  cv::randu(descriptors, cv::Scalar::all(0), cv::Scalar::all(256));
+
+  vector<vector<size_t>> indices(nDescriptors);
+  for (int i = 0; i < nDescriptors; i++) {
+    for (int j = 0; j < nCandidates; j++)
+      indices[i].push_back(rand() % nDescriptors);
+  }
+
+  long long checksum[3] = {0, 0, 0};
+  SD_SLAM::Timer timer(false);
+  double times[3];
+
+  // Reference
+  timer.Start();
+  for (int it = 0; it < nIterations; it++) {
+    for (int i = 0; i < nDescriptors; i++) {
+      const cv::Mat d1 = descriptors.row(i);
+      for (size_t idx : indices[i])
+        checksum[0] += ScalarDistance(d1, descriptors.row(idx));
+    }
+  }
+  timer.Stop();
+  times[0] = timer.GetMsTime();
+
+  // One to one
+  timer.Start();
+  for (int it = 0; it < nIterations; it++) {
+    for (int i = 0; i < nDescriptors; i++) {
+      const cv::Mat d1 = descriptors.row(i);
+      for (size_t idx : indices[i])
+        checksum[1] += SD_SLAM::ORBmatcher::DescriptorDistance(d1, descriptors.row(idx));
+    }
+  }
+  timer.Stop();
+  times[1] = timer.GetMsTime();
+
+  // One to many
+  vector<int> dists;
+  timer.Start();
+  for (int it = 0; it < nIterations; it++) {
+    for (int i = 0; i < nDescriptors; i++) {
+      SD_SLAM::ORBmatcher::DescriptorDistances(descriptors.ptr<uchar>(i), descriptors, indices[i], dists);
+      for (int d : dists)
+        checksum[2] += d;
+    }
+  }
+  timer.Stop();
+  times[2] = timer.GetMsTime();
+
+  if (checksum[0] != checksum[1] || checksum[0] != checksum[2]) {
+    cerr << "Error: distances don't match" << endl;
+    return 1;
+  }
+
+  double n = static_cast<double>(nIterations)*nDescriptors*nCandidates;
+  cout << "Distances computed: " << n << endl;
+  cout << "Scalar:      " << times[0] << " ms (" << times[0]*1e6/n << " ns/distance)" << endl;
+  cout << "One to one:  " << times[1] << " ms (" << times[1]*1e6/n << " ns/distance)" << endl;
+  cout << "One to many: " << times[2] << " ms (" << times[2]*1e6/n << " ns/distance)" << endl;
+
+  return 0;
+}
@@ -0,0 +1,212 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <opencv2/core/core.hpp>
+#include <Eigen/Dense>
+#include "FeatureGrid.h"
+#include "ORBmatcher.h"
+#include "extra/timer.h"
+
+using namespace std;
+
+// Keypoints and descriptors of a synthetic keyframe
+struct View {
+  vector<cv::KeyPoint> keys;
+  cv::Mat descriptors;
+};
+
+static bool Inside(const cv::Point2f &pt, float width, float height) {
+  return pt.x >= 0 && pt.x < width && pt.y >= 0 && pt.y < height;
+}
+
+// Same tests as ORBmatcher::SearchForTriangulation for a pair of keypoints
+static bool AcceptPair(const cv::KeyPoint &kp1, const cv::KeyPoint &kp2, const Eigen::Matrix3d &F12,
+                       const vector<float> &sigma2, const vector<float> &scales, float ex, float ey) {
+  const float a = kp1.pt.x*F12(0, 0)+kp1.pt.y*F12(1, 0)+F12(2, 0);
+  const float b = kp1.pt.x*F12(0, 1)+kp1.pt.y*F12(1, 1)+F12(2, 1);
+  const float c = kp1.pt.x*F12(0, 2)+kp1.pt.y*F12(1, 2)+F12(2, 2);
+  const float num = a*kp2.pt.x+b*kp2.pt.y+c;
+  const float den = a*a+b*b;
+  if (den == 0 || num*num/den >= 3.84*sigma2[kp2.octave])
+    return false;
+
+  const float distex = ex-kp2.pt.x;
+  const float distey = ey-kp2.pt.y;
+  return distex*distex+distey*distey >= 100*scales[kp2.octave];
+}
+
+// Previous implementation (all pairs), used as reference
+static void MatchExhaustive(const View &v1, const View &v2, const Eigen::Matrix3d &F12, const vector<float> &sigma2,
+                            const vector<float> &scales, float ex, float ey, vector<int> &matches, long long &tests) {
+  matches.assign(v1.keys.size(), -1);
+  for (size_t i1 = 0; i1 < v1.keys.size(); i1++) {
+    int bestDist = SD_SLAM::ORBmatcher::TH_LOW;
+    for (size_t i2 = 0; i2 < v2.keys.size(); i2++) {
+      tests++;
+      if (!AcceptPair(v1.keys[i1], v2.keys[i2], F12, sigma2, scales, ex, ey))
+        continue;
+
+      const int dist = SD_SLAM::ORBmatcher::DescriptorDistance(v1.descriptors.ptr<uchar>(i1), v2.descriptors.ptr<uchar>(i2));
+      if (dist > bestDist)
+        continue;
+
+      matches[i1] = i2;
+      bestDist = dist;
+    }
+  }
+}
+
+// Candidates from the cells crossed by the epipolar band
+static void MatchBand(const View &v1, const View &v2, const SD_SLAM::FeatureGrid &grid, const Eigen::Matrix3d &F12,
+                      const vector<float> &sigma2, const vector<float> &scales, float ex, float ey,
+                      vector<int> &matches, long long &tests) {
+  const float maxDist = sqrt(3.84*sigma2.back())+1.0f;
+  matches.assign(v1.keys.size(), -1);
+  for (size_t i1 = 0; i1 < v1.keys.size(); i1++) {
+    const cv::KeyPoint &kp1 = v1.keys[i1];
+    const float a = kp1.pt.x*F12(0, 0)+kp1.pt.y*F12(1, 0)+F12(2, 0);
+    const float b = kp1.pt.x*F12(0, 1)+kp1.pt.y*F12(1, 1)+F12(2, 1);
+    const float c = kp1.pt.x*F12(0, 2)+kp1.pt.y*F12(1, 2)+F12(2, 2);
+
+    int bestDist = SD_SLAM::ORBmatcher::TH_LOW;
+    int bestIdx = -1;
+    grid.ForEachNearLine(a, b, c, maxDist, [&](size_t i2) {
+      tests++;
+      if (!AcceptPair(kp1, v2.keys[i2], F12, sigma2, scales, ex, ey))
+        return;
+
+      const int dist = SD_SLAM::ORBmatcher::DescriptorDistance(v1.descriptors.ptr<uchar>(i1), v2.descriptors.ptr<uchar>(i2));
+      if (dist > bestDist || (dist == bestDist && static_cast<int>(i2) < bestIdx))
+        return;
+
+      bestIdx = i2;
+      bestDist = dist;
+    });
+    matches[i1] = bestIdx;
+  }
+}
+
+int main(int argc, char **argv) {
+  const int nPoints = 1000;
+  const int nLevels = 8;
+  const float scaleFactor = 1.2f;
+  const float width = 640, height = 480;
+  const double fx = 525, fy = 525, cx = 319.5, cy = 239.5;
+  int nPairs = 20;
+
+  if (argc > 1)
+    nPairs = atoi(argv[1]);
+
+  vector<float> scales(nLevels), sigma2(nLevels);
+  for (int l = 0; l < nLevels; l++) {
+    scales[l] = pow(scaleFactor, l);
+    sigma2[l] = scales[l]*scales[l];
+  }
+
+  Eigen::Matrix3d K;
+  K << fx, 0, cx, 0, fy, cy, 0, 0, 1;
+
+  cv::RNG rng(0);
+  double times[2] = {0, 0};
+  long long tests[2] = {0, 0};
+  int nMatches = 0;
+  SD_SLAM::Timer timer(false);
+
+  // Each pair has the same scene seen from a different baseline, as the neighbors of a new keyframe
+  for (int p = 0; p < nPairs; p++) {
+    const Eigen::Vector3d t2w(rng.uniform(-0.3, 0.3), rng.uniform(-0.1, 0.1), rng.uniform(-0.2, 0.2));
+    const Eigen::Matrix3d R2w = Eigen::AngleAxisd(rng.uniform(-0.1, 0.1), Eigen::Vector3d::UnitY()).toRotationMatrix();
+
+    // Random points seen by both cameras. Keyframe 1 is at the origin.
+    // Points seen in both views share descriptors up to a few flipped bits.
+    View v1, v2;
+    v1.descriptors.create(nPoints, 32, CV_8U);
+    v2.descriptors.create(nPoints, 32, CV_8U);
+    for (int i = 0; i < nPoints; i++) {
+      cv::KeyPoint kp1, kp2;
+      do {
+        Eigen::Vector3d x3Dw(rng.uniform(-2.0, 2.0), rng.uniform(-1.5, 1.5), rng.uniform(2.0, 6.0));
+        Eigen::Vector3d x3D2 = R2w*x3Dw+t2w;
+        kp1.pt = cv::Point2f(fx*x3Dw(0)/x3Dw(2)+cx, fy*x3Dw(1)/x3Dw(2)+cy);
+        kp2.pt = cv::Point2f(fx*x3D2(0)/x3D2(2)+cx+rng.gaussian(0.5), fy*x3D2(1)/x3D2(2)+cy+rng.gaussian(0.5));
+      } while (!Inside(kp1.pt, width, height) || !Inside(kp2.pt, width, height));
+      kp1.octave = rng.uniform(0, nLevels);
+      kp2.octave = kp1.octave;
+
+      uchar *d1 = v1.descriptors.ptr<uchar>(i);
+      uchar *d2 = v2.descriptors.ptr<uchar>(i);
+      for (int j = 0; j < 32; j++) {
+        d1[j] = rng.uniform(0, 256);
+        d2[j] = d1[j] ^ (rng.uniform(0, 8) == 0 ? 1 << rng.uniform(0, 8) : 0);
+      }
+
+      // A third of the points of the second view are unrelated
+      if (i % 3 == 0) {
+        kp2.pt = cv::Point2f(rng.uniform(0.f, width), rng.uniform(0.f, height));
+        for (int j = 0; j < 32; j++)
+          d2[j] = rng.uniform(0, 256);
+      }
+
+      v1.keys.push_back(kp1);
+      v2.keys.push_back(kp2);
+    }
+
+    // Fundamental matrix and epipole as in LocalMapping::CreateNewMapPoints
+    Eigen::Vector3d t12 = -R2w.transpose()*t2w;
+    Eigen::Matrix3d R12 = R2w.transpose();
+    Eigen::Matrix3d t12x;
+    t12x << 0, -t12(2), t12(1), t12(2), 0, -t12(0), -t12(1), t12(0), 0;
+    Eigen::Matrix3d F12 = K.transpose().inverse()*t12x*R12*K.inverse();
+    const float ex = fx*t2w(0)/t2w(2)+cx;
+    const float ey = fy*t2w(1)/t2w(2)+cy;
+
+    SD_SLAM::FeatureGrid grid(v2.keys, nLevels, 0, 0, width, height);
+
+    vector<int> reference, matches;
+    timer.Start();
+    MatchExhaustive(v1, v2, F12, sigma2, scales, ex, ey, reference, tests[0]);
+    timer.Stop();
+    times[0] += timer.GetMsTime();
+
+    timer.Start();
+    MatchBand(v1, v2, grid, F12, sigma2, scales, ex, ey, matches, tests[1]);
+    timer.Stop();
+    times[1] += timer.GetMsTime();
+
+    if (matches != reference) {
+      cerr << "Error: matches of pair " << p << " don't match" << endl;
+      return 1;
+    }
+
+    for (int m : matches)
+      nMatches += m >= 0;
+  }
+
+  cout << "Keypoints: " << nPoints << ", keyframe pairs: " << nPairs << ", matches: " << nMatches << endl;
+  cout << "Exhaustive:     " << times[0] << " ms (" << times[0]/nPairs << " ms/pair, "
+       << tests[0]/nPairs << " tests/pair)" << endl;
+  cout << "Epipolar band:  " << times[1] << " ms (" << times[1]/nPairs << " ms/pair, "
+       << tests[1]/nPairs << " tests/pair)" << endl;
+
+  return 0;
+}
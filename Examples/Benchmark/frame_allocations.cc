@@ -0,0 +1,220 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <Eigen/Dense>
+#include "System.h"
+#include "Frame.h"
+#include "ORBextractor.h"
+#include "Config.h"
+
+using namespace std;
+
+// Heap allocations of all threads since the start of the program
+static std::atomic<size_t> gAllocations(0);
+static std::atomic<size_t> gAllocatedBytes(0);
+
+void* operator new(size_t size) {
+  gAllocations++;
+  gAllocatedBytes += size;
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p) noexcept {
+  free(p);
+}
+
+// Allocations and bytes allocated between Start and Stop
+struct AllocationCounter {
+  size_t allocations = 0;
+  size_t bytes = 0;
+
+  inline void Start() {
+    allocations = gAllocations;
+    bytes = gAllocatedBytes;
+  }
+
+  inline void Stop() {
+    allocations = gAllocations-allocations;
+    bytes = gAllocatedBytes-bytes;
+  }
+};
+
+// Reference: frame copy cloning image pyramid, depth and descriptors, as it was done before
+SD_SLAM::Frame DeepCopy(const SD_SLAM::Frame &frame) {
+  SD_SLAM::Frame copy(frame);
+  for (size_t i = 0; i < copy.mvImagePyramid.size(); i++)
+    copy.mvImagePyramid[i] = frame.mvImagePyramid[i].clone();
+  copy.mDepthImage = frame.mDepthImage.clone();
+  copy.mDescriptors = frame.mDescriptors.clone();
+  return copy;
+}
+
+// Association file: timestamp rgb_file [timestamp depth_file]
+bool LoadAssociations(const string &filename, vector<double> &vTimestamps, vector<string> &vFilenamesRGB,
+                      vector<string> &vFilenamesD) {
+  ifstream f(filename.c_str());
+  if (!f.is_open())
+    return false;
+
+  string s;
+  while (getline(f, s)) {
+    if (s.empty() || s[0] == '#')
+      continue;
+
+    stringstream ss(s);
+    double t, td;
+    string sRGB, sD;
+    ss >> t >> sRGB >> td >> sD;
+    vTimestamps.push_back(t);
+    vFilenamesRGB.push_back(sRGB);
+    vFilenamesD.push_back(sD);
+  }
+
+  return true;
+}
+
+// Count heap allocations of a frame copy (synthetic RGB-D frame), and optionally of each
+// Track() call over a sequence. The sequence part runs unchanged on older revisions.
+int main(int argc, char **argv) {
+  bool mono = false;
+  vector<string> args;
+  for (int i = 1; i < argc; i++) {
+    const string arg = argv[i];
+    if (arg == "--mono")
+      mono = true;
+    else
+      args.push_back(arg);
+  }
+
+  if (!args.empty() && args.size() != 3) {
+    cerr << endl << "Usage: ./frame_allocations [path_to_settings path_to_sequence path_to_association [--mono]]" << endl;
+    return 1;
+  }
+
+  // Textured synthetic image with TUM size
+  cv::Mat im(480, 640, CV_8U);
+  cv::randu(im, cv::Scalar::all(0), cv::Scalar::all(256));
+  cv::GaussianBlur(im, im, cv::Size(7, 7), 2.0);
+  cv::Mat imDepth(im.rows, im.cols, CV_32F, cv::Scalar(2.0f));
+
+  Eigen::Matrix3d K;
+  K << 525.0, 0.0, im.cols/2.0, 0.0, 525.0, im.rows/2.0, 0.0, 0.0, 1.0;
+  cv::Mat distCoef = cv::Mat::zeros(4, 1, CV_32F);
+  SD_SLAM::ORBextractor extractor(1000, 1.2, 8, 20);
+  SD_SLAM::Frame frame(im, imDepth, &extractor, K, distCoef, 40.0, 40.0);
+
+  AllocationCounter counter;
+  {
+    counter.Start();
+    SD_SLAM::Frame copy(DeepCopy(frame));
+    counter.Stop();
+  }
+  cout << "Frame copy (cloned buffers): " << counter.allocations << " allocations, "
+       << counter.bytes/1024.0 << " KB" << endl;
+
+  {
+    counter.Start();
+    SD_SLAM::Frame copy(frame);
+    counter.Stop();
+  }
+  cout << "Frame copy (shared buffers): " << counter.allocations << " allocations, "
+       << counter.bytes/1024.0 << " KB" << endl;
+
+  if (args.empty())
+    return 0;
+
+  SD_SLAM::Config &config = SD_SLAM::Config::GetInstance();
+  if (!config.ReadParameters(args[0])) {
+    cerr << "[ERROR] Config file contains errors" << endl;
+    return 1;
+  }
+
+  // Local mapping runs inside each Track() call, so its allocations are counted with the frame
+  config.SetSynchronousMapping(true);
+
+  vector<double> vTimestamps;
+  vector<string> vFilenamesRGB, vFilenamesD;
+  if (!LoadAssociations(args[2], vTimestamps, vFilenamesRGB, vFilenamesD) || vFilenamesRGB.empty()) {
+    cerr << "[ERROR] Couldn't find images in " << args[2] << endl;
+    return 1;
+  }
+
+  SD_SLAM::System SLAM(mono ? SD_SLAM::System::MONOCULAR : SD_SLAM::System::RGBD, false);
+
+  vector<size_t> vAllocations;
+  size_t totalBytes = 0;
+  for (size_t i = 0; i < vFilenamesRGB.size(); i++) {
+    // Images are decoded before counting
+    cv::Mat imGray = cv::imread(args[1]+"/"+vFilenamesRGB[i], CV_LOAD_IMAGE_GRAYSCALE);
+    cv::Mat imD;
+    if (!mono)
+      imD = cv::imread(args[1]+"/"+vFilenamesD[i], CV_LOAD_IMAGE_UNCHANGED);
+    if (imGray.empty() || (!mono && imD.empty())) {
+      cerr << "[ERROR] Failed to load image at: " << args[1] << "/" << vFilenamesRGB[i] << endl;
+      return 1;
+    }
+
+    counter.Start();
+    if (mono)
+      SLAM.TrackMonocular(imGray, vFilenamesRGB[i]);
+    else
+      SLAM.TrackRGBD(imGray, imD, vFilenamesRGB[i]);
+    counter.Stop();
+
+    vAllocations.push_back(counter.allocations);
+    totalBytes += counter.bytes;
+  }
+
+  SLAM.Shutdown();
+
+  const size_t nImages = vAllocations.size();
+  size_t sum = 0;
+  for (size_t n : vAllocations)
+    sum += n;
+  std::sort(vAllocations.begin(), vAllocations.end());
+
+  cout << "Frames: " << nImages << endl;
+  cout << "Allocations per Track(): mean " << sum/nImages << ", p50 " << vAllocations[nImages/2]
+       << ", max " << vAllocations.back() << ", " << totalBytes/1024.0/nImages << " KB/frame" << endl;
+
+  return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "ImageAlign.h"
+#include "ORBextractor.h"
+#include "Frame.h"
+#include "MapPoint.h"
+#include "Map.h"
+#include "extra/timer.h"
+
+using namespace std;
+
+// Align current frame against last frame and return ms per alignment
+double Align(SD_SLAM::Frame &current, const SD_SLAM::Frame &last, bool useFloat, int nIterations,
+             Eigen::Matrix4d &pose) {
+  SD_SLAM::Timer timer(true);
+
+  for (int i = 0; i < nIterations; i++) {
+    SD_SLAM::ImageAlign align;
+    align.SetFloat(useFloat);
+    current.SetPose(Eigen::Matrix4d::Identity());
+    align.ComputePose(current, last);
+  }
+
+  timer.Stop();
+  pose = current.GetPose();
+  return timer.GetMsTime()/nIterations;
+}
+
+int main(int argc, char **argv) {
+  int nIterations = 100;
+  const float depth = 2.0;
+  const float shift = 3.0;
+  cv::Mat im;
+
+  if (argc > 1) {
+    im = cv::imread(argv[1], CV_LOAD_IMAGE_GRAYSCALE);
+    if (im.empty()) {
+      cerr << "Error: Couldn't load image " << argv[1] << endl;
+      return 1;
+    }
+  } else {
+    // Textured synthetic image with TUM size
+    im = cv::Mat(480, 640, CV_8U);
+    cv::randu(im, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::GaussianBlur(im, im, cv::Size(7, 7), 2.0);
+  }
+
+  if (argc > 2)
+    nIterations = atoi(argv[2]);
+
+  // Fronto-parallel plane seen by a camera moving along x axis
+  Eigen::Matrix3d K;
+  K << 525.0, 0.0, im.cols/2.0, 0.0, 525.0, im.rows/2.0, 0.0, 0.0, 1.0;
+  cv::Mat distCoef = cv::Mat::zeros(4, 1, CV_32F);
+  cv::Mat imDepth(im.rows, im.cols, CV_32F, cv::Scalar(depth));
+  cv::Mat imShifted;
+  cv::Mat M = (cv::Mat_<double>(2, 3) << 1.0, 0.0, -shift, 0.0, 1.0, 0.0);
+  cv::warpAffine(im, imShifted, M, im.size(), cv::INTER_LINEAR, cv::BORDER_REFLECT);
+
+  SD_SLAM::ORBextractor extractor(1000, 2.0, 5, 20);
+  SD_SLAM::Map map;
+
+  SD_SLAM::Frame last(im, imDepth, &extractor, K, distCoef, 40.0, 40.0);
+  last.SetPose(Eigen::Matrix4d::Identity());
+  for (int i = 0; i < last.N; i++) {
+    if (last.mvDepth[i] <= 0)
+      continue;
+    last.mvpMapPoints[i] = new SD_SLAM::MapPoint(last.UnprojectStereo(i), &map, &last, i);
+  }
+
+  SD_SLAM::Frame current(imShifted, imDepth, &extractor, K, distCoef, 40.0, 40.0);
+
+  // Camera center moves right, so points move left in the image
+  const double expected = shift*depth/K(0, 0);
+
+  Eigen::Matrix4d poseDouble, poseFloat;
+  double msDouble = Align(current, last, false, nIterations, poseDouble);
+  double msFloat = Align(current, last, true, nIterations, poseFloat);
+
+  double diff = (poseDouble - poseFloat).cwiseAbs().maxCoeff();
+
+  cout << "Expected x translation: " << -expected << endl;
+  cout << "  double: " << msDouble << " ms/align, x translation " << poseDouble(0, 3) << endl;
+  cout << "  float:  " << msFloat << " ms/align, x translation " << poseFloat(0, 3) << endl;
+  cout << "Max pose difference: " << diff << endl;
+
+  for (int i = 0; i < last.N; i++)
+    delete last.mvpMapPoints[i];
+
+  if (diff > 1e-3) {
+    cerr << "Error: float alignment differs from double alignment" << endl;
+    return 1;
+  }
+
+  return 0;
+}
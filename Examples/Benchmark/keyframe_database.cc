@@ -0,0 +1,183 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <opencv2/core/core.hpp>
+#include <Eigen/Dense>
+#include "Map.h"
+#include "Frame.h"
+#include "KeyFrame.h"
+#include "KeyFrameDatabase.h"
+#include "ORBextractor.h"
+#include "extra/timer.h"
+
+using namespace std;
+
+// Random descriptors with a different bias per bit, as ORB bits are not balanced
+static void RandomDescriptor(cv::RNG &rng, const vector<float> &bias, uchar *d) {
+  for (int j = 0; j < 32; j++) {
+    d[j] = 0;
+    for (int b = 0; b < 8; b++)
+      d[j] |= (rng.uniform(0.f, 1.f) < bias[j*8+b]) << b;
+  }
+}
+
+// Keyframe with the given descriptors and random monocular keypoints
+static SD_SLAM::KeyFrame* CreateKeyFrame(cv::RNG &rng, const cv::Mat &descriptors, SD_SLAM::ORBextractor *extractor,
+                                         const Eigen::Matrix3d &K, cv::Mat &distCoef, SD_SLAM::Map *pMap) {
+  vector<cv::KeyPoint> keys(descriptors.rows);
+  vector<float> depths(descriptors.rows, -1.f);
+  for (int j = 0; j < descriptors.rows; j++)
+    keys[j] = cv::KeyPoint(rng.uniform(0.f, 640.f), rng.uniform(0.f, 480.f), 31, -1, 0, rng.uniform(0, 4));
+
+  SD_SLAM::Frame frame(keys, keys, depths, descriptors, cv::Size(640, 480), extractor, K, distCoef, 40.0, 40.0);
+  frame.SetPose(Eigen::Matrix4d::Identity());
+  return new SD_SLAM::KeyFrame(frame, pMap);
+}
+
+// Reference: score every keyframe of the map, cost is linear in map size
+static vector<SD_SLAM::KeyFrame*> DetectLinear(SD_SLAM::KeyFrame *pKF, const vector<SD_SLAM::KeyFrame*> &vpKFs,
+                                               int maxCandidates) {
+  const vector<unsigned int> &words = pKF->mvWords;
+  vector<pair<float, SD_SLAM::KeyFrame*> > vScoreAndMatch;
+  vScoreAndMatch.reserve(vpKFs.size());
+
+  for (SD_SLAM::KeyFrame *pKFi : vpKFs) {
+    const vector<unsigned int> &wordsi = pKFi->mvWords;
+    int shared = 0;
+    vector<unsigned int>::const_iterator it1 = words.begin(), it2 = wordsi.begin();
+    while (it1 != words.end() && it2 != wordsi.end()) {
+      if (*it1 < *it2) {
+        it1++;
+      } else if (*it2 < *it1) {
+        it2++;
+      } else {
+        shared++;
+        it1++;
+        it2++;
+      }
+    }
+
+    if (shared > 0)
+      vScoreAndMatch.push_back(make_pair(shared/sqrt(static_cast<float>(words.size()*wordsi.size())), pKFi));
+  }
+
+  const int nCandidates = min(maxCandidates, static_cast<int>(vScoreAndMatch.size()));
+  partial_sort(vScoreAndMatch.begin(), vScoreAndMatch.begin()+nCandidates, vScoreAndMatch.end(),
+               [](const pair<float, SD_SLAM::KeyFrame*> &a, const pair<float, SD_SLAM::KeyFrame*> &b) {
+                 return a.first > b.first; });
+
+  vector<SD_SLAM::KeyFrame*> vpCandidates;
+  for (int i = 0; i < nCandidates; i++)
+    vpCandidates.push_back(vScoreAndMatch[i].second);
+  return vpCandidates;
+}
+
+// Loop detection latency as the database grows. Each query revisits a keyframe of the map:
+// part of its descriptors are seen again with a few bits changed.
+int main(int argc, char **argv) {
+  const int nKeys = 500;
+  const int maxCandidates = 10;
+  const int sizes[] = {250, 500, 1000, 2000, 4000};
+  int nQueries = 50;
+
+  if (argc > 1)
+    nQueries = atoi(argv[1]);
+
+  SD_SLAM::ORBextractor extractor(nKeys, 1.2, 8, 20);
+  Eigen::Matrix3d K;
+  K << 500, 0, 320, 0, 500, 240, 0, 0, 1;
+  cv::Mat distCoef = cv::Mat::zeros(4, 1, CV_32F);
+  cv::RNG rng(0);
+
+  vector<float> bias(256);
+  for (int b = 0; b < 256; b++)
+    bias[b] = rng.uniform(0.3f, 0.7f);
+
+  SD_SLAM::Map *pMap = new SD_SLAM::Map();
+  SD_SLAM::KeyFrameDatabase *pDB = pMap->GetKeyFrameDatabase();
+  vector<SD_SLAM::KeyFrame*> vpKFs;
+  SD_SLAM::Timer timer(false);
+
+  for (int n : sizes) {
+    // Keyframes are added to the database by the map
+    while (static_cast<int>(vpKFs.size()) < n) {
+      cv::Mat descriptors(nKeys, 32, CV_8U);
+      for (int j = 0; j < nKeys; j++)
+        RandomDescriptor(rng, bias, descriptors.ptr<uchar>(j));
+
+      SD_SLAM::KeyFrame *pKF = CreateKeyFrame(rng, descriptors, &extractor, K, distCoef, pMap);
+      pMap->AddKeyFrame(pKF);
+      vpKFs.push_back(pKF);
+    }
+
+    double times[2] = {0, 0};
+    int found[2] = {0, 0};
+    for (int q = 0; q < nQueries; q++) {
+      SD_SLAM::KeyFrame *pTarget = vpKFs[rng.uniform(0, n)];
+      cv::Mat descriptors(nKeys, 32, CV_8U);
+      for (int j = 0; j < nKeys; j++) {
+        uchar *d = descriptors.ptr<uchar>(j);
+        if (j % 2 == 0) {
+          RandomDescriptor(rng, bias, d);
+          continue;
+        }
+
+        const uchar *dt = pTarget->mDescriptors.ptr<uchar>(rng.uniform(0, nKeys));
+        for (int k = 0; k < 32; k++) {
+          d[k] = dt[k];
+          for (int b = 0; b < 8; b++)
+            d[k] ^= (rng.uniform(0.f, 1.f) < 0.05f) << b;
+        }
+      }
+
+      // Query keyframe is not added to the map
+      SD_SLAM::KeyFrame *pQuery = CreateKeyFrame(rng, descriptors, &extractor, K, distCoef, pMap);
+
+      timer.Start();
+      vector<SD_SLAM::KeyFrame*> vpCandidates = pDB->DetectLoopCandidates(pQuery, maxCandidates);
+      timer.Stop();
+      times[0] += timer.GetMsTime();
+      found[0] += !vpCandidates.empty() && vpCandidates[0] == pTarget;
+
+      timer.Start();
+      vpCandidates = DetectLinear(pQuery, vpKFs, maxCandidates);
+      timer.Stop();
+      times[1] += timer.GetMsTime();
+      found[1] += !vpCandidates.empty() && vpCandidates[0] == pTarget;
+
+      delete pQuery;
+    }
+
+    cout << "Keyframes: " << n << ", " << nKeys << " features each" << endl;
+    cout << "  Database: " << times[0]/nQueries << " ms/query, " << found[0] << "/" << nQueries
+         << " revisited keyframes ranked first" << endl;
+    cout << "  Linear:   " << times[1]/nQueries << " ms/query, " << found[1] << "/" << nQueries
+         << " revisited keyframes ranked first" << endl;
+  }
+
+  pMap->clear();
+  delete pMap;
+
+  return 0;
+}
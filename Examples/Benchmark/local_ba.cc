@@ -0,0 +1,319 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#ifdef G2O_OPENMP
+#include <omp.h>
+#endif
+#include "System.h"
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "LocalBA.h"
+#include "Converter.h"
+#include "Config.h"
+#include "extra/timer.h"
+#include "extra/g2o/core/block_solver.h"
+#include "extra/g2o/core/optimization_algorithm_levenberg.h"
+#include "extra/g2o/core/batch_stats.h"
+#include "extra/g2o/solvers/linear_solver_eigen.h"
+#include "extra/g2o/types/types_six_dof_expmap.h"
+#include "extra/g2o/core/robust_kernel_impl.h"
+
+using namespace std;
+
+// Keyframes and points of the local BA of a keyframe, selected as in Optimizer::LocalBundleAdjustment:
+// the keyframe and its covisible keyframes are optimized, other observers are fixed.
+struct LocalProblem {
+  vector<SD_SLAM::KeyFrame*> vpLocalKFs;
+  vector<SD_SLAM::KeyFrame*> vpFixedKFs;
+  vector<SD_SLAM::MapPoint*> vpMPs;
+};
+
+void CollectLocalBA(SD_SLAM::KeyFrame *pKF, LocalProblem &problem) {
+  set<SD_SLAM::KeyFrame*> sLocalKFs;
+  sLocalKFs.insert(pKF);
+  for (SD_SLAM::KeyFrame *pKFi : pKF->GetVectorCovisibleKeyFrames()) {
+    if (!pKFi->isBad())
+      sLocalKFs.insert(pKFi);
+  }
+
+  set<SD_SLAM::MapPoint*> sLocalMPs;
+  for (SD_SLAM::KeyFrame *pKFi : sLocalKFs) {
+    for (SD_SLAM::MapPoint *pMP : pKFi->GetMapPointMatches()) {
+      if (pMP && !pMP->isBad())
+        sLocalMPs.insert(pMP);
+    }
+  }
+
+  set<SD_SLAM::KeyFrame*> sFixedKFs;
+  for (SD_SLAM::MapPoint *pMP : sLocalMPs) {
+    for (const SD_SLAM::MapPoint::Observation &obs : pMP->GetObservations()) {
+      if (!obs.first->isBad() && !sLocalKFs.count(obs.first))
+        sFixedKFs.insert(obs.first);
+    }
+  }
+
+  problem.vpLocalKFs.assign(sLocalKFs.begin(), sLocalKFs.end());
+  problem.vpFixedKFs.assign(sFixedKFs.begin(), sFixedKFs.end());
+  problem.vpMPs.assign(sLocalMPs.begin(), sLocalMPs.end());
+}
+
+// Same problem with the specialized solver, poses in the order of the problem
+void BuildSchurBA(const LocalProblem &problem, SD_SLAM::LocalBA &ba) {
+  map<SD_SLAM::KeyFrame*, int> poseIndex;
+  for (int fixed = 0; fixed < 2; fixed++) {
+    for (SD_SLAM::KeyFrame *pKFi : fixed ? problem.vpFixedKFs : problem.vpLocalKFs) {
+      poseIndex[pKFi] = ba.AddPose(pKFi->GetPose(), fixed || pKFi->mnId == 0, pKFi->fx, pKFi->fy,
+                                   pKFi->cx, pKFi->cy, pKFi->mbf);
+    }
+  }
+
+  for (SD_SLAM::MapPoint *pMP : problem.vpMPs) {
+    ba.AddPoint(pMP->GetWorldPos());
+    for (const SD_SLAM::MapPoint::Observation &obs : pMP->GetObservations()) {
+      SD_SLAM::KeyFrame *pKFi = obs.first;
+      if (pKFi->isBad())
+        continue;
+
+      const cv::KeyPoint &kpUn = pKFi->mvKeysUn[obs.second];
+      ba.AddObservation(poseIndex[pKFi], kpUn.pt.x, kpUn.pt.y, pKFi->mvuRight[obs.second],
+                        pKFi->mvInvLevelSigma2[kpUn.octave]);
+    }
+  }
+}
+
+// Same problem with g2o, return the number of edges
+int BuildG2OBA(const LocalProblem &problem, g2o::SparseOptimizer &optimizer, long unsigned int &maxKFid) {
+  g2o::BlockSolver_6_3::LinearSolverType *linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+  g2o::BlockSolver_6_3 *solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+  optimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(solver_ptr));
+
+  maxKFid = 0;
+  for (int fixed = 0; fixed < 2; fixed++) {
+    for (SD_SLAM::KeyFrame *pKFi : fixed ? problem.vpFixedKFs : problem.vpLocalKFs) {
+      g2o::VertexSE3Expmap *vSE3 = new g2o::VertexSE3Expmap();
+      vSE3->setEstimate(SD_SLAM::Converter::toSE3Quat(pKFi->GetPose()));
+      vSE3->setId(pKFi->mnId);
+      vSE3->setFixed(fixed || pKFi->mnId == 0);
+      optimizer.addVertex(vSE3);
+      maxKFid = std::max(maxKFid, pKFi->mnId);
+    }
+  }
+
+  const float thHuber2D = sqrt(5.991);
+  const float thHuber3D = sqrt(7.815);
+  int nEdges = 0;
+
+  for (SD_SLAM::MapPoint *pMP : problem.vpMPs) {
+    g2o::VertexSBAPointXYZ *vPoint = new g2o::VertexSBAPointXYZ();
+    vPoint->setEstimate(pMP->GetWorldPos());
+    const int id = pMP->mnId+maxKFid+1;
+    vPoint->setId(id);
+    vPoint->setMarginalized(true);
+    optimizer.addVertex(vPoint);
+
+    for (const SD_SLAM::MapPoint::Observation &obs : pMP->GetObservations()) {
+      SD_SLAM::KeyFrame *pKFi = obs.first;
+      if (pKFi->isBad())
+        continue;
+
+      const cv::KeyPoint &kpUn = pKFi->mvKeysUn[obs.second];
+      const float invSigma2 = pKFi->mvInvLevelSigma2[kpUn.octave];
+
+      if (pKFi->mvuRight[obs.second] < 0) {
+        g2o::EdgeSE3ProjectXYZ *e = new g2o::EdgeSE3ProjectXYZ();
+        e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(id)));
+        e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(pKFi->mnId)));
+        e->setMeasurement(Eigen::Vector2d(kpUn.pt.x, kpUn.pt.y));
+        e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+        g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+        rk->setDelta(thHuber2D);
+        e->setRobustKernel(rk);
+        e->fx = pKFi->fx;
+        e->fy = pKFi->fy;
+        e->cx = pKFi->cx;
+        e->cy = pKFi->cy;
+        optimizer.addEdge(e);
+      } else {
+        g2o::EdgeStereoSE3ProjectXYZ *e = new g2o::EdgeStereoSE3ProjectXYZ();
+        e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(id)));
+        e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(pKFi->mnId)));
+        e->setMeasurement(Eigen::Vector3d(kpUn.pt.x, kpUn.pt.y, pKFi->mvuRight[obs.second]));
+        e->setInformation(Eigen::Matrix3d::Identity()*invSigma2);
+        g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+        rk->setDelta(thHuber3D);
+        e->setRobustKernel(rk);
+        e->fx = pKFi->fx;
+        e->fy = pKFi->fy;
+        e->cx = pKFi->cx;
+        e->cy = pKFi->cy;
+        e->bf = pKFi->mbf;
+        optimizer.addEdge(e);
+      }
+      nEdges++;
+    }
+  }
+
+  cout << "Local BA: " << problem.vpLocalKFs.size() << " keyframes, " << problem.vpFixedKFs.size() << " fixed, "
+       << problem.vpMPs.size() << " points, " << nEdges << " edges" << endl;
+
+  return nEdges;
+}
+
+// Time local BA of a keyframe from a recorded map with an increasing number of threads,
+// and with the specialized solver
+int main(int argc, char **argv) {
+  if (argc < 3 || argc > 5) {
+    cerr << endl << "Usage: ./local_ba path_to_settings path_to_map [keyframe_id] [rgbd]" << endl;
+    return 1;
+  }
+
+  SD_SLAM::Config &config = SD_SLAM::Config::GetInstance();
+  if (!config.ReadParameters(argv[1])) {
+    cerr << "[ERROR] Config file contains errors" << endl;
+    return 1;
+  }
+
+  SD_SLAM::System::eSensor sensor = SD_SLAM::System::MONOCULAR;
+  if (argc == 5 && string(argv[4]) == "rgbd")
+    sensor = SD_SLAM::System::RGBD;
+
+  SD_SLAM::System SLAM(sensor, false);
+
+  // Maps can be given in YAML or binary format
+  const string filename(argv[2]);
+  const bool yaml = filename.size() > 5 && filename.substr(filename.size()-5) == ".yaml";
+  if (!(yaml ? SLAM.LoadTrajectory(filename) : SLAM.LoadMap(filename))) {
+    cerr << "[ERROR] Couldn't load map " << filename << endl;
+    return 1;
+  }
+
+  SD_SLAM::Map *pMap = SLAM.GetMap();
+  SD_SLAM::KeyFrame *pKF = pMap->GetKeyFrame(argc >= 4 ? atoi(argv[3]) : pMap->GetMaxKFid());
+  if (!pKF) {
+    cerr << "[ERROR] Keyframe not found" << endl;
+    return 1;
+  }
+
+  LocalProblem problem;
+  CollectLocalBA(pKF, problem);
+  SLAM.Shutdown();
+
+  g2o::SparseOptimizer optimizer;
+  long unsigned int maxKFid;
+  if (BuildG2OBA(problem, optimizer, maxKFid) == 0) {
+    cerr << "[ERROR] Empty local BA" << endl;
+    return 1;
+  }
+
+  optimizer.setComputeBatchStatistics(true);
+  optimizer.initializeOptimization();
+
+#ifdef G2O_OPENMP
+  const int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+#else
+  const int maxThreads = 1;
+  cout << "Built without OpenMP (USE_OPENMP=OFF), only one thread is used" << endl;
+#endif
+
+  const int nIterations = 10;
+  const int nRuns = 5;
+  double baseTime = 0.0;
+
+  // Powers of two up to the number of cores, plus all cores
+  vector<int> vThreads;
+  for (int threads = 1; threads < maxThreads; threads *= 2)
+    vThreads.push_back(threads);
+  vThreads.push_back(maxThreads);
+
+  for (int threads : vThreads) {
+#ifdef G2O_OPENMP
+    omp_set_num_threads(threads);
+#endif
+    double total = 0.0, quadratic = 0.0;
+
+    for (int r = 0; r < nRuns; r++) {
+      // Same starting point for every run
+      optimizer.push();
+
+      SD_SLAM::Timer t(true);
+      optimizer.optimize(nIterations);
+      t.Stop();
+      total += t.GetMsTime();
+
+      for (const g2o::G2OBatchStatistics &stats : optimizer.batchStatistics())
+        quadratic += stats.timeQuadraticForm*1e3;
+
+      optimizer.pop();
+    }
+
+    total /= nRuns;
+    quadratic /= nRuns;
+    if (threads == 1)
+      baseTime = total;
+
+    cout << threads << " threads: " << total << " ms (build system " << quadratic << " ms), speedup "
+         << baseTime/total << "x" << endl;
+  }
+
+  // Specialized Schur complement solver, problem built outside the timer as with g2o
+  double schurTime = 0.0;
+  for (int r = 0; r < nRuns; r++) {
+    SD_SLAM::LocalBA ba;
+    BuildSchurBA(problem, ba);
+
+    SD_SLAM::Timer t(true);
+    ba.Optimize(nIterations);
+    t.Stop();
+    schurTime += t.GetMsTime();
+  }
+  schurTime /= nRuns;
+
+  cout << "Schur solver: " << schurTime << " ms, speedup " << baseTime/schurTime << "x" << endl;
+
+  // Both solvers must reach the same estimate
+  SD_SLAM::LocalBA ba;
+  BuildSchurBA(problem, ba);
+  ba.Optimize(nIterations);
+  optimizer.optimize(nIterations);
+
+  double maxPoseDiff = 0.0, maxPointDiff = 0.0;
+  for (size_t i = 0; i < problem.vpLocalKFs.size(); i++) {
+    g2o::VertexSE3Expmap *v = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(problem.vpLocalKFs[i]->mnId));
+    const double diff = (SD_SLAM::Converter::toMatrix4d(v->estimate()) - ba.GetPose(i)).norm();
+    maxPoseDiff = std::max(maxPoseDiff, diff);
+  }
+
+  for (size_t i = 0; i < problem.vpMPs.size(); i++) {
+    g2o::VertexSBAPointXYZ *v = static_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex(problem.vpMPs[i]->mnId+maxKFid+1));
+    maxPointDiff = std::max(maxPointDiff, (v->estimate() - ba.GetPoint(i)).norm());
+  }
+
+  cout << "Max difference with g2o: poses " << maxPoseDiff << ", points " << maxPointDiff << endl;
+
+  return 0;
+}
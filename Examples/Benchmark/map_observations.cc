@@ -0,0 +1,207 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <list>
+#include <map>
+#include <cstdlib>
+#include <opencv2/core/core.hpp>
+#include <Eigen/Dense>
+#include "Map.h"
+#include "Frame.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "ORBextractor.h"
+#include "extra/timer.h"
+
+using namespace std;
+
+// Reference: observations copied to a tree under the point lock, as they were returned before
+map<SD_SLAM::KeyFrame*, size_t> GetObservationTree(SD_SLAM::MapPoint *pMP) {
+  map<SD_SLAM::KeyFrame*, size_t> observations;
+  pMP->ForEachObservation([&](SD_SLAM::KeyFrame* pKF, size_t idx) {
+    observations.emplace_hint(observations.end(), pKF, idx);
+  });
+  return observations;
+}
+
+// Keyframe votes of Tracking::UpdateLocalKeyFrames
+void VoteKeyFrames(const vector<SD_SLAM::MapPoint*> &vpMPs, bool tree, map<SD_SLAM::KeyFrame*, int> &keyframeCounter) {
+  keyframeCounter.clear();
+  for (SD_SLAM::MapPoint *pMP : vpMPs) {
+    if (pMP->isBad())
+      continue;
+
+    if (tree) {
+      const map<SD_SLAM::KeyFrame*, size_t> observations = GetObservationTree(pMP);
+      for (map<SD_SLAM::KeyFrame*, size_t>::const_iterator it = observations.begin(); it != observations.end(); it++)
+        keyframeCounter[it->first]++;
+    } else {
+      pMP->ForEachObservation([&](SD_SLAM::KeyFrame* pKF, size_t) { keyframeCounter[pKF]++; });
+    }
+  }
+}
+
+// Keyframes and points of Optimizer::LocalBundleAdjustment, before the optimizer is built
+size_t CollectLocalBA(SD_SLAM::KeyFrame *pKF, long unsigned int token, bool tree) {
+  list<SD_SLAM::KeyFrame*> lLocalKeyFrames;
+  lLocalKeyFrames.push_back(pKF);
+  pKF->mnBALocalForKF = token;
+
+  for (SD_SLAM::KeyFrame *pKFi : pKF->GetVectorCovisibleKeyFrames()) {
+    pKFi->mnBALocalForKF = token;
+    if (!pKFi->isBad())
+      lLocalKeyFrames.push_back(pKFi);
+  }
+
+  list<SD_SLAM::MapPoint*> lLocalMapPoints;
+  for (SD_SLAM::KeyFrame *pKFi : lLocalKeyFrames) {
+    for (SD_SLAM::MapPoint *pMP : pKFi->GetMapPointMatches()) {
+      if (pMP && !pMP->isBad() && pMP->mnBALocalForKF != token) {
+        lLocalMapPoints.push_back(pMP);
+        pMP->mnBALocalForKF = token;
+      }
+    }
+  }
+
+  list<SD_SLAM::KeyFrame*> lFixedCameras;
+  for (SD_SLAM::MapPoint *pMP : lLocalMapPoints) {
+    auto visit = [&](SD_SLAM::KeyFrame* pKFi, size_t) {
+      if (pKFi->mnBALocalForKF != token && pKFi->mnBAFixedForKF != token) {
+        pKFi->mnBAFixedForKF = token;
+        if (!pKFi->isBad())
+          lFixedCameras.push_back(pKFi);
+      }
+    };
+
+    if (tree) {
+      const map<SD_SLAM::KeyFrame*, size_t> observations = GetObservationTree(pMP);
+      for (map<SD_SLAM::KeyFrame*, size_t>::const_iterator it = observations.begin(); it != observations.end(); it++)
+        visit(it->first, it->second);
+    } else {
+      pMP->ForEachObservation(visit);
+    }
+  }
+
+  return lLocalKeyFrames.size()+lFixedCameras.size()+lLocalMapPoints.size();
+}
+
+// Synthetic map: points observed by a few consecutive keyframes
+int main(int argc, char **argv) {
+  const int nKFs = 250;
+  const int nKeys = 2000;
+  int nPoints = 50000;
+
+  if (argc > 1)
+    nPoints = atoi(argv[1]);
+
+  SD_SLAM::ORBextractor extractor(nKeys, 1.2, 8, 20);
+  Eigen::Matrix3d K;
+  K << 500, 0, 320, 0, 500, 240, 0, 0, 1;
+  cv::Mat distCoef = cv::Mat::zeros(4, 1, CV_32F);
+  cv::RNG rng(0);
+
+  SD_SLAM::Map *pMap = new SD_SLAM::Map();
+  vector<SD_SLAM::KeyFrame*> vpKFs;
+  for (int i = 0; i < nKFs; i++) {
+    vector<cv::KeyPoint> keys(nKeys);
+    vector<float> depths(nKeys);
+    for (int j = 0; j < nKeys; j++) {
+      keys[j] = cv::KeyPoint(rng.uniform(0.f, 640.f), rng.uniform(0.f, 480.f), 31, -1, 0, rng.uniform(0, 4));
+      depths[j] = rng.uniform(0.5f, 5.f);
+    }
+
+    cv::Mat descriptors = cv::Mat::zeros(nKeys, 32, CV_8U);
+    SD_SLAM::Frame frame(keys, keys, depths, descriptors, cv::Size(640, 480), &extractor, K, distCoef, 40.0, 40.0);
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    pose(0, 3) = -0.05*i;
+    frame.SetPose(pose);
+
+    SD_SLAM::KeyFrame *pKF = new SD_SLAM::KeyFrame(frame, pMap);
+    pKF->SetID(i);
+    pMap->AddKeyFrame(pKF);
+    vpKFs.push_back(pKF);
+  }
+
+  vector<int> vNextKey(nKFs, 0);
+  size_t nObservations = 0;
+  for (int i = 0; i < nPoints; i++) {
+    const int first = rng.uniform(0, nKFs);
+    const int nObs = rng.uniform(3, 9);
+    Eigen::Vector3d pos(0.05*first+rng.uniform(-1.0, 1.0), rng.uniform(-1.0, 1.0), rng.uniform(1.0, 4.0));
+
+    SD_SLAM::MapPoint *pMP = new SD_SLAM::MapPoint(pos, vpKFs[first], pMap);
+    for (int k = first; k < first+nObs && k < nKFs; k++) {
+      if (vNextKey[k] >= nKeys)
+        continue;
+      const int idx = vNextKey[k]++;
+      vpKFs[k]->AddMapPoint(pMP, idx);
+      pMP->AddObservation(vpKFs[k], idx);
+      nObservations++;
+    }
+    pMap->AddMapPoint(pMP);
+  }
+
+  SD_SLAM::Timer timer(false);
+  timer.Start();
+  for (SD_SLAM::KeyFrame *pKF : vpKFs)
+    pKF->UpdateConnections();
+  timer.Stop();
+
+  cout << "Map: " << nKFs << " keyframes, " << nPoints << " points, " << nObservations << " observations" << endl;
+  cout << "UpdateConnections: " << timer.GetMsTime()/nKFs << " ms/keyframe" << endl;
+
+  // Points tracked in a frame: those of a keyframe
+  for (int tree = 1; tree >= 0; tree--) {
+    map<SD_SLAM::KeyFrame*, int> keyframeCounter;
+    size_t nVotes = 0;
+    timer.Start();
+    for (SD_SLAM::KeyFrame *pKF : vpKFs) {
+      vector<SD_SLAM::MapPoint*> vpMPs;
+      for (SD_SLAM::MapPoint *pMP : pKF->GetMapPointMatches()) {
+        if (pMP)
+          vpMPs.push_back(pMP);
+      }
+      VoteKeyFrames(vpMPs, tree, keyframeCounter);
+      nVotes += keyframeCounter.size();
+    }
+    timer.Stop();
+
+    cout << "UpdateLocalKeyFrames votes (" << (tree ? "tree copies" : "visitor") << "): "
+         << timer.GetMsTime()/nKFs << " ms/frame, " << nVotes/nKFs << " keyframes" << endl;
+  }
+
+  long unsigned int token = nKFs;
+  for (int tree = 1; tree >= 0; tree--) {
+    size_t nElements = 0;
+    timer.Start();
+    for (SD_SLAM::KeyFrame *pKF : vpKFs)
+      nElements += CollectLocalBA(pKF, ++token, tree);
+    timer.Stop();
+
+    cout << "LocalBundleAdjustment setup (" << (tree ? "tree copies" : "visitor") << "): "
+         << timer.GetMsTime()/nKFs << " ms/keyframe, " << nElements/nKFs << " keyframes and points" << endl;
+  }
+
+  pMap->clear();
+  delete pMap;
+
+  return 0;
+}
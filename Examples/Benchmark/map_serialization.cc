@@ -0,0 +1,111 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include "System.h"
+#include "Map.h"
+#include "KeyFrame.h"
+#include "Config.h"
+#include "extra/timer.h"
+
+using namespace std;
+
+// Check that keyframes, poses and observations are the same in both maps
+bool Equal(SD_SLAM::Map *map1, SD_SLAM::Map *map2) {
+  if (map1->KeyFramesInMap() != map2->KeyFramesInMap() || map1->MapPointsInMap() != map2->MapPointsInMap())
+    return false;
+
+  for (SD_SLAM::KeyFrame *pKF1 : map1->GetAllKeyFrames()) {
+    SD_SLAM::KeyFrame *pKF2 = map2->GetKeyFrame(pKF1->GetID());
+    if (!pKF2 || pKF1->N != pKF2->N)
+      return false;
+    if ((pKF1->GetPose()-pKF2->GetPose()).cwiseAbs().maxCoeff() > 1e-9)
+      return false;
+    if (pKF1->GetMapPoints().size() != pKF2->GetMapPoints().size())
+      return false;
+    if (cv::countNonZero(pKF1->mDescriptors != pKF2->mDescriptors) != 0)
+      return false;
+  }
+
+  return true;
+}
+
+// Time YAML map loading against a binary save and load of the same map
+int main(int argc, char **argv) {
+  if (argc != 3 && argc != 4) {
+    cerr << endl << "Usage: ./map_serialization path_to_settings path_to_yaml_map [rgbd]" << endl;
+    return 1;
+  }
+
+  SD_SLAM::Config &config = SD_SLAM::Config::GetInstance();
+  if (!config.ReadParameters(argv[1])) {
+    cerr << "[ERROR] Config file contains errors" << endl;
+    return 1;
+  }
+
+  SD_SLAM::System::eSensor sensor = SD_SLAM::System::MONOCULAR;
+  if (argc == 4 && string(argv[3]) == "rgbd")
+    sensor = SD_SLAM::System::RGBD;
+
+  const string binary = "map_serialization.map";
+
+  SD_SLAM::System SLAM1(sensor, false);
+  SD_SLAM::System SLAM2(sensor, false);
+
+  SD_SLAM::Timer tyaml(true);
+  if (!SLAM1.LoadTrajectory(string(argv[2]))) {
+    cerr << "[ERROR] Couldn't load map " << argv[2] << endl;
+    return 1;
+  }
+  tyaml.Stop();
+
+  SD_SLAM::Timer tsave(true);
+  bool ok = SLAM1.SaveMap(binary);
+  tsave.Stop();
+
+  SD_SLAM::Timer tload(true);
+  ok = ok && SLAM2.LoadMap(binary);
+  tload.Stop();
+
+  SLAM1.Shutdown();
+  SLAM2.Shutdown();
+
+  if (!ok) {
+    cerr << "[ERROR] Binary round trip failed" << endl;
+    return 1;
+  }
+
+  cout << "Map: " << SLAM1.GetMap()->KeyFramesInMap() << " keyframes, "
+       << SLAM1.GetMap()->MapPointsInMap() << " points" << endl;
+  cout << "  YAML load:   " << tyaml.GetMsTime() << " ms" << endl;
+  cout << "  Binary save: " << tsave.GetMsTime() << " ms" << endl;
+  cout << "  Binary load: " << tload.GetMsTime() << " ms" << endl;
+
+  std::remove(binary.c_str());
+
+  if (!Equal(SLAM1.GetMap(), SLAM2.GetMap())) {
+    cerr << "[ERROR] Loaded map differs from saved map" << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,227 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <unistd.h>
+#include "System.h"
+#include "Map.h"
+#include "MapUpdate.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "Optimizer.h"
+#include "Config.h"
+#include "extra/timer.h"
+
+using namespace std;
+
+// Global BA map update as it was done before staged publication: corrections are
+// propagated and normals updated while the map update mutex is held.
+void LockedUpdate(SD_SLAM::Map *pMap, unsigned long nLoopKF) {
+  unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+
+  list<SD_SLAM::KeyFrame*> lpKFtoCheck(pMap->mvpKeyFrameOrigins.begin(), pMap->mvpKeyFrameOrigins.end());
+  while (!lpKFtoCheck.empty()) {
+    SD_SLAM::KeyFrame* pKF = lpKFtoCheck.front();
+    const set<SD_SLAM::KeyFrame*> sChilds = pKF->GetChilds();
+    Eigen::Matrix4d Twc = pKF->GetPoseInverse();
+    for (SD_SLAM::KeyFrame* pChild : sChilds) {
+      if (pChild->mnBAGlobalForKF != nLoopKF) {
+        pChild->mTcwGBA = pChild->GetPose()*Twc*pKF->mTcwGBA;
+        pChild->mnBAGlobalForKF = nLoopKF;
+      }
+      lpKFtoCheck.push_back(pChild);
+    }
+
+    pKF->mTcwBefGBA = pKF->GetPose();
+    pKF->SetPose(pKF->mTcwGBA);
+    lpKFtoCheck.pop_front();
+  }
+
+  for (SD_SLAM::MapPoint* pMP : pMap->GetAllMapPoints()) {
+    if (pMP->isBad())
+      continue;
+
+    if (pMP->mnBAGlobalForKF == nLoopKF) {
+      pMP->SetWorldPos(pMP->mPosGBA);
+    } else {
+      SD_SLAM::KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+      if (pRefKF->mnBAGlobalForKF != nLoopKF)
+        continue;
+
+      Eigen::Vector3d Xc = pRefKF->mTcwBefGBA.block<3, 3>(0, 0)*pMP->GetWorldPos()+pRefKF->mTcwBefGBA.block<3, 1>(0, 3);
+      Eigen::Matrix4d Twc = pRefKF->GetPoseInverse();
+      pMP->SetWorldPos(Twc.block<3, 3>(0, 0)*Xc+Twc.block<3, 1>(0, 3));
+    }
+    pMP->UpdateNormalAndDepth();
+  }
+}
+
+struct Result {
+  int frames;
+  int updates;
+  double update_ms;
+  double max_wait_ms;
+  double p99_wait_ms;
+  double max_frame_ms;
+};
+
+// Tracking-like thread reading the local map once per frame while the
+// back-end applies global BA corrections repeatedly
+Result Run(SD_SLAM::Map *pMap, unsigned long nLoopKF, bool staged, double seconds) {
+  const vector<SD_SLAM::KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+  const vector<SD_SLAM::MapPoint*> vpMPs = pMap->GetAllMapPoints();
+  const size_t nLocalKFs = std::min<size_t>(vpKFs.size(), 20);
+  const size_t nLocalMPs = std::min<size_t>(vpMPs.size(), 2000);
+
+  atomic<bool> finished(false);
+  vector<double> waits;
+  double max_frame = 0.0;
+  Eigen::Vector3d checksum = Eigen::Vector3d::Zero();
+
+  thread tracking([&] {
+    size_t offset = 0;
+    while (!finished) {
+      SD_SLAM::Timer tframe(true);
+      SD_SLAM::Timer twait(true);
+      unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+      twait.Stop();
+
+      for (size_t i = 0; i < nLocalKFs; i++)
+        checksum += vpKFs[(offset+i) % vpKFs.size()]->GetCameraCenter();
+      for (size_t i = 0; i < nLocalMPs; i++)
+        checksum += vpMPs[(offset+i) % vpMPs.size()]->GetWorldPos();
+      lock.unlock();
+      tframe.Stop();
+
+      waits.push_back(twait.GetMsTime());
+      max_frame = std::max(max_frame, tframe.GetMsTime());
+      offset += nLocalKFs;
+      usleep(5000);
+    }
+  });
+
+  Result res;
+  res.updates = 0;
+  res.update_ms = 0.0;
+
+  SD_SLAM::Timer ttotal(true);
+  while (true) {
+    ttotal.Stop();
+    if (ttotal.GetTime() > seconds)
+      break;
+
+    SD_SLAM::Timer tupdate(true);
+    if (staged) {
+      SD_SLAM::MapUpdate update;
+      SD_SLAM::MapUpdate::FromGlobalBA(pMap, nLoopKF, update);
+      update.Apply(pMap);
+    } else {
+      LockedUpdate(pMap, nLoopKF);
+    }
+    tupdate.Stop();
+
+    res.updates++;
+    res.update_ms += tupdate.GetMsTime();
+    usleep(20000);
+  }
+
+  finished = true;
+  tracking.join();
+
+  std::sort(waits.begin(), waits.end());
+  res.frames = waits.size();
+  res.update_ms /= std::max(res.updates, 1);
+  res.max_wait_ms = waits.empty() ? 0.0 : waits.back();
+  res.p99_wait_ms = waits.empty() ? 0.0 : waits[std::min(waits.size()-1, waits.size()*99/100)];
+  res.max_frame_ms = max_frame;
+
+  if (checksum.hasNaN())
+    cerr << "[WARNING] Invalid poses read by tracking" << endl;
+
+  return res;
+}
+
+void Print(const string &name, const Result &res) {
+  cout << name << ": " << res.updates << " updates (" << res.update_ms << " ms), "
+       << res.frames << " frames" << endl;
+  cout << "  Tracking wait: max " << res.max_wait_ms << " ms, p99 " << res.p99_wait_ms << " ms" << endl;
+  cout << "  Frame latency: max " << res.max_frame_ms << " ms" << endl;
+}
+
+// Worst-case tracking latency while global BA corrections are applied to a loaded map
+int main(int argc, char **argv) {
+  if (argc < 3 || argc > 5) {
+    cerr << endl << "Usage: ./map_update_latency path_to_settings path_to_map [seconds] [rgbd]" << endl;
+    return 1;
+  }
+
+  SD_SLAM::Config &config = SD_SLAM::Config::GetInstance();
+  if (!config.ReadParameters(argv[1])) {
+    cerr << "[ERROR] Config file contains errors" << endl;
+    return 1;
+  }
+
+  const double seconds = argc >= 4 ? atof(argv[3]) : 5.0;
+  SD_SLAM::System::eSensor sensor = SD_SLAM::System::MONOCULAR;
+  if (argc == 5 && string(argv[4]) == "rgbd")
+    sensor = SD_SLAM::System::RGBD;
+
+  SD_SLAM::System SLAM(sensor, false);
+
+  // Maps can be given in YAML or binary format
+  const string filename(argv[2]);
+  const bool yaml = filename.size() > 5 && filename.substr(filename.size()-5) == ".yaml";
+  if (!(yaml ? SLAM.LoadTrajectory(filename) : SLAM.LoadMap(filename))) {
+    cerr << "[ERROR] Couldn't load map " << filename << endl;
+    return 1;
+  }
+
+  SD_SLAM::Map *pMap = SLAM.GetMap();
+  if (pMap->KeyFramesInMap() == 0 || pMap->MapPointsInMap() == 0) {
+    cerr << "[ERROR] Map is empty" << endl;
+    return 1;
+  }
+
+  cout << "Map: " << pMap->KeyFramesInMap() << " keyframes, " << pMap->MapPointsInMap() << " points" << endl;
+
+  // Optimized poses are kept apart, as done by loop closing
+  const unsigned long nLoopKF = pMap->GetMaxKFid();
+  SD_SLAM::Timer tgba(true);
+  SD_SLAM::Optimizer::GlobalBundleAdjustemnt(pMap, 10, NULL, nLoopKF, false);
+  tgba.Stop();
+  cout << "Global BA: " << tgba.GetMsTime() << " ms" << endl;
+
+  Result locked = Run(pMap, nLoopKF, false, seconds);
+  Result staged = Run(pMap, nLoopKF, true, seconds);
+
+  SLAM.Shutdown();
+
+  Print("Locked update", locked);
+  Print("Staged update", staged);
+
+  return 0;
+}
@@ -0,0 +1,213 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <thread>
+#include <cstdlib>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "System.h"
+#include "Tracking.h"
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "Config.h"
+#include "extra/timer.h"
+
+using namespace std;
+
+// Independent SLAM session. Even sessions use RGB-D input at full resolution,
+// odd ones are monocular cameras with lower resolutions, so every session has its own calibration.
+struct Session {
+  int id;
+  double scale;
+  SD_SLAM::System::eSensor sensor;
+  SD_SLAM::Config config;
+
+  int frames;
+  int tracked;
+  long unsigned int keyframes;
+  long unsigned int points;
+  double time;
+  bool valid;
+};
+
+bool LoadImages(const string &strAssociationFilename, vector<string> &vFilenamesRGB,
+                vector<string> &vFilenamesD) {
+  ifstream fAssociation(strAssociationFilename.c_str());
+  if (!fAssociation.is_open())
+    return false;
+
+  string s;
+  while (getline(fAssociation, s)) {
+    if (s.empty())
+      continue;
+
+    stringstream ss(s);
+    double t;
+    string sRGB, sD;
+    ss >> t >> sRGB >> t >> sD;
+    vFilenamesRGB.push_back(sRGB);
+    vFilenamesD.push_back(sD);
+  }
+
+  return true;
+}
+
+// Check that ids are unique inside the map and that points are only observed by keyframes of the same map
+bool CheckMap(SD_SLAM::Map *pMap) {
+  vector<SD_SLAM::KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
+  set<SD_SLAM::KeyFrame*> spKFs(vpKFs.begin(), vpKFs.end());
+
+  set<long unsigned int> kfIds;
+  for (SD_SLAM::KeyFrame* pKF : vpKFs) {
+    if (!kfIds.insert(pKF->mnId).second)
+      return false;
+  }
+
+  set<long unsigned int> mpIds;
+  for (SD_SLAM::MapPoint* pMP : pMap->GetAllMapPoints()) {
+    if (!mpIds.insert(pMP->mnId).second)
+      return false;
+    if (pMP->isBad())
+      continue;
+
+    vector<SD_SLAM::MapPoint::Observation> observations = pMP->GetObservations();
+    for (auto &obs : observations) {
+      if (!obs.first->isBad() && !spKFs.count(obs.first))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+void RunSession(Session *session, const string &path, const vector<string> &vFilenamesRGB,
+                const vector<string> &vFilenamesD) {
+  SD_SLAM::Timer timer(true);
+
+  SD_SLAM::System SLAM(session->sensor, session->config, true);
+
+  for (size_t i = 0; i < vFilenamesRGB.size(); i++) {
+    cv::Mat im = cv::imread(path+"/"+vFilenamesRGB[i], CV_LOAD_IMAGE_GRAYSCALE);
+    if (im.empty())
+      break;
+
+    if (session->scale != 1.0)
+      cv::resize(im, im, cv::Size(), session->scale, session->scale, cv::INTER_AREA);
+
+    if (session->sensor == SD_SLAM::System::RGBD) {
+      cv::Mat imD = cv::imread(path+"/"+vFilenamesD[i], CV_LOAD_IMAGE_UNCHANGED);
+      SLAM.TrackRGBD(im, imD);
+    } else {
+      SLAM.TrackMonocular(im);
+    }
+
+    session->frames++;
+    if (SLAM.GetTrackingState() == SD_SLAM::Tracking::OK)
+      session->tracked++;
+  }
+
+  SLAM.Shutdown();
+
+  timer.Stop();
+  session->time = timer.GetTime();
+  session->keyframes = SLAM.GetMap()->KeyFramesInMap();
+  session->points = SLAM.GetMap()->MapPointsInMap();
+  session->valid = CheckMap(SLAM.GetMap());
+}
+
+// Run several SLAM sessions with different cameras on separate threads of the same process
+int main(int argc, char **argv) {
+  if (argc != 4 && argc != 5) {
+    cerr << endl << "Usage: ./multi_session path_to_settings path_to_sequence path_to_association [num_sessions]" << endl;
+    return 1;
+  }
+
+  SD_SLAM::Config base;
+  if (!base.ReadParameters(argv[1])) {
+    cerr << "[ERROR] Config file contains errors" << endl;
+    return 1;
+  }
+
+  int nSessions = 4;
+  if (argc == 5)
+    nSessions = max(1, atoi(argv[4]));
+
+  vector<string> vFilenamesRGB, vFilenamesD;
+  if (!LoadImages(argv[3], vFilenamesRGB, vFilenamesD) || vFilenamesRGB.empty()) {
+    cerr << "[ERROR] Couldn't find images in " << argv[3] << endl;
+    return 1;
+  }
+
+  // Each session has its own configuration, with intrinsics scaled to its resolution.
+  // Static getters read the configuration bound to this thread.
+  SD_SLAM::ConfigScope scope(&base);
+  vector<Session> sessions(nSessions);
+  for (int i = 0; i < nSessions; i++) {
+    Session &session = sessions[i];
+    session.id = i;
+    session.sensor = i % 2 == 0 ? SD_SLAM::System::RGBD : SD_SLAM::System::MONOCULAR;
+    session.scale = i % 2 == 0 ? 1.0 : (i % 4 == 1 ? 0.75 : 0.5);
+    session.config = base;
+    session.config.SetCameraIntrinsics(SD_SLAM::Config::Width()*session.scale, SD_SLAM::Config::Height()*session.scale,
+                                       SD_SLAM::Config::fx()*session.scale, SD_SLAM::Config::fy()*session.scale,
+                                       SD_SLAM::Config::cx()*session.scale, SD_SLAM::Config::cy()*session.scale);
+    session.frames = 0;
+    session.tracked = 0;
+    session.keyframes = 0;
+    session.points = 0;
+    session.time = 0;
+    session.valid = false;
+  }
+
+  SD_SLAM::Timer timer(true);
+
+  vector<thread> threads;
+  for (int i = 0; i < nSessions; i++)
+    threads.emplace_back(RunSession, &sessions[i], string(argv[2]), cref(vFilenamesRGB), cref(vFilenamesD));
+  for (thread &t : threads)
+    t.join();
+
+  timer.Stop();
+
+  bool valid = true;
+  for (const Session &session : sessions) {
+    cout << "Session " << session.id << " (" << (session.sensor == SD_SLAM::System::RGBD ? "RGB-D" : "Monocular")
+         << ", scale " << session.scale << "): " << session.tracked << "/" << session.frames << " frames tracked, "
+         << session.keyframes << " keyframes, " << session.points << " points, " << session.time << " s"
+         << (session.valid ? "" : " [INVALID MAP]") << endl;
+    valid = valid && session.valid;
+  }
+
+  cout << "Total time: " << timer.GetTime() << " s for " << nSessions << " sessions" << endl;
+
+  if (!valid) {
+    cerr << "Error: sessions are not independent" << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <thread>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "ORBextractor.h"
+#include "extra/timer.h"
+
+using namespace std;
+
+// Run extractor over the image and return ms per frame
+double Extract(SD_SLAM::ORBextractor &extractor, const cv::Mat &im, int nIterations,
+               vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors) {
+  vector<cv::Mat> pyramid;
+  SD_SLAM::Timer timer(true);
+
+  for (int i = 0; i < nIterations; i++)
+    extractor(im, cv::Mat(), keypoints, descriptors, pyramid);
+
+  timer.Stop();
+  return timer.GetMsTime()/nIterations;
+}
+
+bool Equal(const vector<cv::KeyPoint> &k1, const cv::Mat &d1, const vector<cv::KeyPoint> &k2, const cv::Mat &d2) {
+  if (k1.size() != k2.size() || d1.rows != d2.rows)
+    return false;
+
+  for (size_t i = 0; i < k1.size(); i++) {
+    if (k1[i].pt != k2[i].pt || k1[i].angle != k2[i].angle || k1[i].octave != k2[i].octave)
+      return false;
+  }
+
+  return d1.rows == 0 || cv::countNonZero(d1 != d2) == 0;
+}
+
+int main(int argc, char **argv) {
+  int nIterations = 50;
+  int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  vector<cv::Mat> images;
+  vector<string> names;
+
+  if (argc > 1) {
+    cv::Mat im = cv::imread(argv[1], CV_LOAD_IMAGE_GRAYSCALE);
+    if (im.empty()) {
+      cerr << "Error: Couldn't load image " << argv[1] << endl;
+      return 1;
+    }
+    images.push_back(im);
+    names.push_back(argv[1]);
+  } else {
+    // Textured synthetic images with TUM and EuRoC sizes
+    cv::Mat noise(480, 752, CV_8U);
+    cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::GaussianBlur(noise, noise, cv::Size(5, 5), 1.5);
+
+    images.push_back(noise.colRange(0, 640).clone());
+    names.push_back("TUM (640x480)");
+    images.push_back(noise);
+    names.push_back("EuRoC (752x480)");
+  }
+
+  if (argc > 2)
+    nIterations = atoi(argv[2]);
+
+  for (size_t i = 0; i < images.size(); i++) {
+    vector<cv::KeyPoint> refKeypoints;
+    cv::Mat refDescriptors;
+
+    cout << names[i] << ":" << endl;
+
+    for (int nThreads = 1; nThreads <= maxThreads; nThreads++) {
+      SD_SLAM::ORBextractor extractor(1000, 2.0, 5, 20, nThreads);
+      vector<cv::KeyPoint> keypoints;
+      cv::Mat descriptors;
+
+      double ms = Extract(extractor, images[i], nIterations, keypoints, descriptors);
+
+      if (nThreads == 1) {
+        refKeypoints = keypoints;
+        refDescriptors = descriptors.clone();
+      } else if (!Equal(refKeypoints, refDescriptors, keypoints, descriptors)) {
+        cerr << "Error: results with " << nThreads << " threads differ from serial extraction" << endl;
+        return 1;
+      }
+
+      cout << "  " << nThreads << " threads: " << ms << " ms/frame (" << keypoints.size() << " keypoints)" << endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,214 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+#include "PoseOptimizer.h"
+#include "extra/timer.h"
+#include "extra/g2o/core/block_solver.h"
+#include "extra/g2o/core/optimization_algorithm_levenberg.h"
+#include "extra/g2o/solvers/linear_solver_dense.h"
+#include "extra/g2o/types/types_six_dof_expmap.h"
+#include "extra/g2o/core/robust_kernel_impl.h"
+
+using namespace std;
+
+const double fx = 517.3, fy = 516.5, cx = 318.6, cy = 255.3, bf = 40.0;
+
+// Synthetic frame: points seen from a known pose, noisy observations and outliers
+struct Problem {
+  Eigen::Matrix4d Tcw;
+  vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > vXw;
+  vector<double> vU, vV, vUr, vInfo;
+};
+
+void Generate(int N, bool bStereo, mt19937 &rng, Problem &problem) {
+  normal_distribution<double> noise(0.0, 1.0);
+  uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+  // True pose and initial guess from a motion model
+  Eigen::Matrix<double, 6, 1> d;
+  d << 0.2*uniform(rng), 0.2*uniform(rng), 0.2*uniform(rng), uniform(rng), uniform(rng), uniform(rng);
+  const g2o::SE3Quat Tcw = g2o::SE3Quat::exp(d);
+  d << 0.01*noise(rng), 0.01*noise(rng), 0.01*noise(rng), 0.03*noise(rng), 0.03*noise(rng), 0.03*noise(rng);
+  problem.Tcw = (g2o::SE3Quat::exp(d)*Tcw).to_homogeneous_matrix();
+
+  problem.vXw.clear();
+  problem.vU.clear();
+  problem.vV.clear();
+  problem.vUr.clear();
+  problem.vInfo.clear();
+
+  const g2o::SE3Quat Twc = Tcw.inverse();
+  for (int i = 0; i < N; i++) {
+    const int octave = i % 8;
+    const double sigma = pow(1.2, octave);
+    const Eigen::Vector3d Xc(3.0*uniform(rng), 2.0*uniform(rng), 4.0+2.0*uniform(rng));
+
+    double u = fx*Xc(0)/Xc(2) + cx + sigma*noise(rng);
+    double v = fy*Xc(1)/Xc(2) + cy + sigma*noise(rng);
+    const double ur = bStereo && i % 2 == 0 ? u - bf/Xc(2) + sigma*noise(rng) : -1.0;
+
+    // 10% of wrong matches
+    if (i % 10 == 0) {
+      u += 40.0*uniform(rng);
+      v += 40.0*uniform(rng);
+    }
+
+    problem.vXw.push_back(Twc.map(Xc));
+    problem.vU.push_back(u);
+    problem.vV.push_back(v);
+    problem.vUr.push_back(ur);
+    problem.vInfo.push_back(1.0/(sigma*sigma));
+  }
+}
+
+// Previous implementation, used as reference
+int G2OPoseOptimization(const Problem &problem, Eigen::Matrix4d &Tcw, vector<bool> &vbOutlier) {
+  g2o::SparseOptimizer optimizer;
+  g2o::BlockSolver_6_3::LinearSolverType *linearSolver = new g2o::LinearSolverDense<g2o::BlockSolver_6_3::PoseMatrixType>();
+  g2o::BlockSolver_6_3 *solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+  optimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(solver_ptr));
+
+  const g2o::SE3Quat Tini(problem.Tcw.block<3, 3>(0, 0), problem.Tcw.block<3, 1>(0, 3));
+
+  g2o::VertexSE3Expmap *vSE3 = new g2o::VertexSE3Expmap();
+  vSE3->setEstimate(Tini);
+  vSE3->setId(0);
+  optimizer.addVertex(vSE3);
+
+  const int N = problem.vU.size();
+  vector<g2o::OptimizableGraph::Edge*> vpEdges(N);
+  vbOutlier.assign(N, false);
+
+  for (int i = 0; i < N; i++) {
+    if (problem.vUr[i] < 0) {
+      g2o::EdgeSE3ProjectXYZOnlyPose *e = new g2o::EdgeSE3ProjectXYZOnlyPose();
+      e->setVertex(0, vSE3);
+      e->setMeasurement(Eigen::Vector2d(problem.vU[i], problem.vV[i]));
+      e->setInformation(Eigen::Matrix2d::Identity()*problem.vInfo[i]);
+      g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+      rk->setDelta(sqrt(5.991));
+      e->setRobustKernel(rk);
+      e->fx = fx;
+      e->fy = fy;
+      e->cx = cx;
+      e->cy = cy;
+      e->Xw = problem.vXw[i];
+      optimizer.addEdge(e);
+      vpEdges[i] = e;
+    } else {
+      g2o::EdgeStereoSE3ProjectXYZOnlyPose *e = new g2o::EdgeStereoSE3ProjectXYZOnlyPose();
+      e->setVertex(0, vSE3);
+      e->setMeasurement(Eigen::Vector3d(problem.vU[i], problem.vV[i], problem.vUr[i]));
+      e->setInformation(Eigen::Matrix3d::Identity()*problem.vInfo[i]);
+      g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+      rk->setDelta(sqrt(7.815));
+      e->setRobustKernel(rk);
+      e->fx = fx;
+      e->fy = fy;
+      e->cx = cx;
+      e->cy = cy;
+      e->bf = bf;
+      e->Xw = problem.vXw[i];
+      optimizer.addEdge(e);
+      vpEdges[i] = e;
+    }
+  }
+
+  int nBad = 0;
+  for (int it = 0; it < 4; it++) {
+    vSE3->setEstimate(Tini);
+    optimizer.initializeOptimization(0);
+    optimizer.optimize(10);
+
+    nBad = 0;
+    for (int i = 0; i < N; i++) {
+      g2o::OptimizableGraph::Edge *e = vpEdges[i];
+      if (vbOutlier[i])
+        e->computeError();
+
+      const double th = problem.vUr[i] < 0 ? 5.991 : 7.815;
+      vbOutlier[i] = e->chi2() > th;
+      e->setLevel(vbOutlier[i] ? 1 : 0);
+      if (vbOutlier[i])
+        nBad++;
+
+      if (it == 2)
+        e->setRobustKernel(0);
+    }
+  }
+
+  Tcw = vSE3->estimate().to_homogeneous_matrix();
+  return N-nBad;
+}
+
+int main(int argc, char **argv) {
+  int nRuns = 200;
+  if (argc > 1)
+    nRuns = atoi(argv[1]);
+
+  mt19937 rng(0);
+  Problem problem;
+  SD_SLAM::PoseOptimizer optimizer;
+
+  const int sizes[4] = {200, 400, 700, 1000};
+
+  for (int stereo = 0; stereo < 2; stereo++) {
+    cout << (stereo ? "Stereo/RGB-D" : "Monocular") << endl;
+
+    for (int N : sizes) {
+      double times[2] = {0.0, 0.0};
+      double maxDiff = 0.0;
+      int inlierDiff = 0;
+
+      for (int r = 0; r < nRuns; r++) {
+        Generate(N, stereo, rng, problem);
+
+        SD_SLAM::Timer timer(true);
+        Eigen::Matrix4d Tcw;
+        vector<bool> vbOutlier;
+        const int nInliersG2O = G2OPoseOptimization(problem, Tcw, vbOutlier);
+        timer.Stop();
+        times[0] += timer.GetMsTime();
+
+        timer.Start();
+        optimizer.Reset(problem.Tcw, fx, fy, cx, cy, bf);
+        for (int i = 0; i < N; i++)
+          optimizer.AddObservation(problem.vXw[i], problem.vU[i], problem.vV[i], problem.vUr[i], problem.vInfo[i]);
+        const int nInliers = optimizer.Optimize();
+        timer.Stop();
+        times[1] += timer.GetMsTime();
+
+        maxDiff = max(maxDiff, (optimizer.GetPose() - Tcw).norm());
+        inlierDiff = max(inlierDiff, abs(nInliers - nInliersG2O));
+      }
+
+      cout << "  " << N << " correspondences: g2o " << times[0]*1e3/nRuns << " us, PoseOptimizer "
+           << times[1]*1e3/nRuns << " us, speedup " << times[0]/times[1] << "x (max pose difference "
+           << maxDiff << ", max inlier difference " << inlierDiff << ")" << endl;
+    }
+  }
+
+  return 0;
+}
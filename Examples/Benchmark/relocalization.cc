@@ -0,0 +1,147 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include "System.h"
+#include "Tracking.h"
+#include "Map.h"
+#include "Config.h"
+#include "extra/profiler.h"
+
+using namespace std;
+
+// Association file: timestamp rgb_file [timestamp depth_file]
+bool LoadAssociations(const string &filename, vector<string> &vFilenamesRGB, vector<string> &vFilenamesD) {
+  ifstream f(filename.c_str());
+  if (!f.is_open())
+    return false;
+
+  string s;
+  while (getline(f, s)) {
+    if (s.empty() || s[0] == '#')
+      continue;
+
+    stringstream ss(s);
+    double t, td;
+    string sRGB, sD;
+    ss >> t >> sRGB >> td >> sD;
+    vFilenamesRGB.push_back(sRGB);
+    vFilenamesD.push_back(sD);
+  }
+
+  return true;
+}
+
+double Percentile(vector<double> values, double p) {
+  if (values.empty())
+    return 0.0;
+  std::sort(values.begin(), values.end());
+  return values[std::min(static_cast<size_t>(p*values.size()), values.size()-1)];
+}
+
+// Relocalize frames of a sequence in a saved map. Tracking is reset to lost before each frame,
+// so every frame is relocalized from scratch, and the map is not modified.
+int main(int argc, char **argv) {
+  bool mono = false;
+  int step = 10;
+  vector<string> args;
+  for (int i = 1; i < argc; i++) {
+    const string arg = argv[i];
+    if (arg == "--mono")
+      mono = true;
+    else if (arg == "--step" && i+1 < argc)
+      step = max(1, atoi(argv[++i]));
+    else
+      args.push_back(arg);
+  }
+
+  if (args.size() != 4) {
+    cerr << endl << "Usage: ./relocalization path_to_settings path_to_map path_to_sequence path_to_association "
+         << "[--mono] [--step frames]" << endl;
+    return 1;
+  }
+
+  SD_SLAM::Config &config = SD_SLAM::Config::GetInstance();
+  if (!config.ReadParameters(args[0])) {
+    cerr << "[ERROR] Config file contains errors" << endl;
+    return 1;
+  }
+
+  vector<string> vFilenamesRGB, vFilenamesD;
+  if (!LoadAssociations(args[3], vFilenamesRGB, vFilenamesD) || vFilenamesRGB.empty()) {
+    cerr << "[ERROR] Couldn't find images in " << args[3] << endl;
+    return 1;
+  }
+
+  SD_SLAM::System SLAM(mono ? SD_SLAM::System::MONOCULAR : SD_SLAM::System::RGBD, false);
+  if (!SLAM.LoadMap(args[1])) {
+    cerr << "[ERROR] Couldn't load map from " << args[1] << endl;
+    return 1;
+  }
+  SLAM.ActivateLocalizationMode();
+
+  // Relocalization time of each frame is read from the profiler
+  SLAM.GetProfiler()->SetEnabled(true);
+  SD_SLAM::Tracking *pTracker = SLAM.GetTracker();
+
+  vector<double> vTimes;
+  int nRelocalized = 0;
+  for (size_t i = 0; i < vFilenamesRGB.size(); i += step) {
+    cv::Mat im = cv::imread(args[2]+"/"+vFilenamesRGB[i], CV_LOAD_IMAGE_GRAYSCALE);
+    cv::Mat imD;
+    if (!mono)
+      imD = cv::imread(args[2]+"/"+vFilenamesD[i], CV_LOAD_IMAGE_UNCHANGED);
+    if (im.empty() || (!mono && imD.empty())) {
+      cerr << "[ERROR] Failed to load image at: " << args[2] << "/" << vFilenamesRGB[i] << endl;
+      return 1;
+    }
+
+    pTracker->ForceRelocalization();
+    const SD_SLAM::Profiler::Stats before = SLAM.GetStageStats(SD_SLAM::Profiler::RELOCALIZATION);
+
+    if (mono)
+      SLAM.TrackMonocular(im, vFilenamesRGB[i]);
+    else
+      SLAM.TrackRGBD(im, imD, vFilenamesRGB[i]);
+
+    const SD_SLAM::Profiler::Stats after = SLAM.GetStageStats(SD_SLAM::Profiler::RELOCALIZATION);
+    if (after.count > before.count)
+      vTimes.push_back(after.total-before.total);
+    if (SLAM.GetTrackingState() == SD_SLAM::Tracking::OK)
+      nRelocalized++;
+  }
+
+  SLAM.Shutdown();
+
+  cout << "Map: " << SLAM.GetMap()->KeyFramesInMap() << " keyframes, " << SLAM.GetMap()->MapPointsInMap()
+       << " points" << endl;
+  cout << "Frames: " << vTimes.size() << " (" << nRelocalized << " relocalized)" << endl;
+  cout << "Relocalization time (ms): p50 " << Percentile(vTimes, 0.5) << ", p90 " << Percentile(vTimes, 0.9)
+       << ", p99 " << Percentile(vTimes, 0.99) << ", max " << Percentile(vTimes, 1.0) << endl;
+
+  return 0;
+}
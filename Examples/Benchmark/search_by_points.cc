@@ -0,0 +1,167 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <opencv2/core/core.hpp>
+#include "DescriptorIndex.h"
+#include "ORBmatcher.h"
+#include "extra/timer.h"
+
+using namespace std;
+
+// Random descriptors with a different bias per bit, as ORB bits are not balanced
+static void RandomDescriptor(cv::RNG &rng, const vector<float> &bias, uchar *d) {
+  for (int j = 0; j < 32; j++) {
+    d[j] = 0;
+    for (int b = 0; b < 8; b++)
+      d[j] |= (rng.uniform(0.f, 1.f) < bias[j*8+b]) << b;
+  }
+}
+
+// Best and second best search with ratio test, as in ORBmatcher::SearchByPoints.
+// Exhaustive if no index is given.
+static int Match(const cv::Mat &desc1, const cv::Mat &desc2, float ratio, const SD_SLAM::DescriptorIndex *index,
+                 vector<int> &matches) {
+  int nmatches = 0;
+  vector<bool> vbMatched2(desc2.rows, false);
+  vector<unsigned char> counts(desc2.rows, 0);
+  matches.assign(desc1.rows, -1);
+
+  for (int i1 = 0; i1 < desc1.rows; i1++) {
+    const uchar *d1 = desc1.ptr<uchar>(i1);
+    int bestDist1 = 256, bestDist2 = 256, bestIdx2 = -1;
+
+    auto visit = [&](size_t i2) {
+      if (vbMatched2[i2])
+        return;
+
+      const int dist = SD_SLAM::ORBmatcher::DescriptorDistance(d1, desc2.ptr<uchar>(i2));
+      if (dist < bestDist1) {
+        bestDist2 = bestDist1;
+        bestDist1 = dist;
+        bestIdx2 = i2;
+      } else if (dist < bestDist2) {
+        bestDist2 = dist;
+      }
+    };
+
+    if (index) {
+      index->ForEachCandidate(d1, SD_SLAM::DescriptorIndex::MIN_SHARED, counts, visit);
+
+      // Confirm tentative matches against every descriptor sharing a single byte
+      if (bestDist1 < SD_SLAM::ORBmatcher::TH_LOW && bestDist1 < ratio*bestDist2) {
+        bestDist1 = 256;
+        bestDist2 = 256;
+        bestIdx2 = -1;
+        index->ForEachCandidate(d1, 1, counts, visit);
+      }
+    } else {
+      for (int i2 = 0; i2 < desc2.rows; i2++)
+        visit(i2);
+    }
+
+    if (bestDist1 < SD_SLAM::ORBmatcher::TH_LOW && bestDist1 < ratio*bestDist2) {
+      matches[i1] = bestIdx2;
+      vbMatched2[bestIdx2] = true;
+      nmatches++;
+    }
+  }
+
+  return nmatches;
+}
+
+int main(int argc, char **argv) {
+  const float ratio = 0.75f;
+  int nPairs = 10;
+
+  if (argc > 1)
+    nPairs = atoi(argv[1]);
+
+  cv::RNG rng(0);
+  vector<float> bias(256);
+  for (int b = 0; b < 256; b++)
+    bias[b] = rng.uniform(0.3f, 0.7f);
+
+  const int sizes[] = {1000, 2000};
+  for (int n : sizes) {
+    double times[3] = {0, 0, 0};
+    int nmatches[2] = {0, 0};
+    int same = 0, correct[2] = {0, 0};
+    SD_SLAM::Timer timer(false);
+
+    for (int p = 0; p < nPairs; p++) {
+      // Half of the points of the current keyframe are seen in the candidate,
+      // with 2-15% of their bits changed
+      cv::Mat desc1(n, 32, CV_8U), desc2(n, 32, CV_8U);
+      vector<int> truth(n, -1);
+      for (int i = 0; i < n; i++)
+        RandomDescriptor(rng, bias, desc2.ptr<uchar>(i));
+      for (int i = 0; i < n; i++) {
+        uchar *d1 = desc1.ptr<uchar>(i);
+        if (i % 2 == 0) {
+          RandomDescriptor(rng, bias, d1);
+          continue;
+        }
+
+        truth[i] = rng.uniform(0, n);
+        const float flip = rng.uniform(0.02f, 0.15f);
+        const uchar *d2 = desc2.ptr<uchar>(truth[i]);
+        for (int j = 0; j < 32; j++) {
+          d1[j] = d2[j];
+          for (int b = 0; b < 8; b++)
+            d1[j] ^= (rng.uniform(0.f, 1.f) < flip) << b;
+        }
+      }
+
+      vector<int> reference, matches;
+      timer.Start();
+      nmatches[0] += Match(desc1, desc2, ratio, NULL, reference);
+      timer.Stop();
+      times[0] += timer.GetMsTime();
+
+      // Index is built once per keyframe and reused by later queries
+      timer.Start();
+      SD_SLAM::DescriptorIndex index(desc2);
+      timer.Stop();
+      times[1] += timer.GetMsTime();
+
+      timer.Start();
+      nmatches[1] += Match(desc1, desc2, ratio, &index, matches);
+      timer.Stop();
+      times[2] += timer.GetMsTime();
+
+      for (int i = 0; i < n; i++) {
+        same += reference[i] >= 0 && matches[i] == reference[i];
+        correct[0] += reference[i] >= 0 && reference[i] == truth[i];
+        correct[1] += matches[i] >= 0 && matches[i] == truth[i];
+      }
+    }
+
+    cout << "Points: " << n << ", keyframe pairs: " << nPairs << endl;
+    cout << "  Exhaustive:   " << times[0]/nPairs << " ms/pair, " << nmatches[0] << " matches ("
+         << correct[0] << " correct)" << endl;
+    cout << "  Index build:  " << times[1]/nPairs << " ms/keyframe" << endl;
+    cout << "  Index search: " << times[2]/nPairs << " ms/pair, " << nmatches[1] << " matches ("
+         << correct[1] << " correct, " << same << " shared with exhaustive)" << endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,179 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <opencv2/core/core.hpp>
+#include "FeatureGrid.h"
+#include "extra/timer.h"
+
+using namespace std;
+
+// Previous implementation (one vector per cell, copied on each query), used as reference
+class VectorGrid {
+ public:
+  VectorGrid(const vector<cv::KeyPoint> &keys, float width, float height): keys_(keys) {
+    width_inv_ = FRAME_GRID_COLS/width;
+    height_inv_ = FRAME_GRID_ROWS/height;
+
+    for (size_t i = 0; i < keys.size(); i++) {
+      int posX = round(keys[i].pt.x*width_inv_);
+      int posY = round(keys[i].pt.y*height_inv_);
+      if (posX < 0 || posX >= FRAME_GRID_COLS || posY < 0 || posY >= FRAME_GRID_ROWS)
+        continue;
+      grid_[posX][posY].push_back(i);
+    }
+  }
+
+  vector<size_t> GetFeaturesInArea(float x, float y, float r, int minLevel, int maxLevel) const {
+    vector<size_t> vIndices;
+    vIndices.reserve(keys_.size());
+
+    const int nMinCellX = max(0, static_cast<int>(floor((x-r)*width_inv_)));
+    const int nMaxCellX = min(FRAME_GRID_COLS-1, static_cast<int>(ceil((x+r)*width_inv_)));
+    const int nMinCellY = max(0, static_cast<int>(floor((y-r)*height_inv_)));
+    const int nMaxCellY = min(FRAME_GRID_ROWS-1, static_cast<int>(ceil((y+r)*height_inv_)));
+    if (nMinCellX >= FRAME_GRID_COLS || nMaxCellX < 0 || nMinCellY >= FRAME_GRID_ROWS || nMaxCellY < 0)
+      return vIndices;
+
+    for (int ix = nMinCellX; ix <= nMaxCellX; ix++) {
+      for (int iy = nMinCellY; iy <= nMaxCellY; iy++) {
+        const vector<size_t> vCell = grid_[ix][iy];
+        for (size_t j = 0; j < vCell.size(); j++) {
+          const cv::KeyPoint &kp = keys_[vCell[j]];
+          if (kp.octave < minLevel || (maxLevel >= 0 && kp.octave > maxLevel))
+            continue;
+          if (fabs(kp.pt.x-x) < r && fabs(kp.pt.y-y) < r)
+            vIndices.push_back(vCell[j]);
+        }
+      }
+    }
+
+    return vIndices;
+  }
+
+ private:
+  const vector<cv::KeyPoint> &keys_;
+  float width_inv_;
+  float height_inv_;
+  vector<size_t> grid_[FRAME_GRID_COLS][FRAME_GRID_ROWS];
+};
+
+int main(int argc, char **argv) {
+  const int nFeatures = 1000;
+  const int nPoints = 1000;
+  const int nLevels = 8;
+  const float scaleFactor = 1.2f;
+  const float width = 640, height = 480;
+  int nIterations = 200;
+
+  if (argc > 1)
+    nIterations = atoi(argv[1]);
+
+  // Random keypoints over the image and projected map points close to them,
+  // with the radius used by SearchLocalPoints (4 pixels scaled by level)
+  cv::RNG rng(0);
+  vector<cv::KeyPoint> keys(nFeatures);
+  for (int i = 0; i < nFeatures; i++) {
+    keys[i].pt = cv::Point2f(rng.uniform(0.f, width), rng.uniform(0.f, height));
+    keys[i].octave = rng.uniform(0, nLevels);
+  }
+
+  vector<cv::Point2f> points(nPoints);
+  vector<int> levels(nPoints);
+  vector<float> radius(nPoints);
+  for (int i = 0; i < nPoints; i++) {
+    const cv::KeyPoint &kp = keys[rng.uniform(0, nFeatures)];
+    points[i] = kp.pt + cv::Point2f(rng.gaussian(3.0), rng.gaussian(3.0));
+    levels[i] = kp.octave;
+    radius[i] = 4.0f*pow(scaleFactor, levels[i]);
+  }
+
+  SD_SLAM::Timer timer(false);
+  double times[5];
+  long long checksum[3] = {0, 0, 0};
+
+  // Grid construction
+  timer.Start();
+  for (int it = 0; it < nIterations; it++)
+    VectorGrid reference(keys, width, height);
+  timer.Stop();
+  times[0] = timer.GetMsTime();
+
+  timer.Start();
+  for (int it = 0; it < nIterations; it++)
+    SD_SLAM::FeatureGrid grid(keys, nLevels, 0, 0, width, height);
+  timer.Stop();
+  times[1] = timer.GetMsTime();
+
+  VectorGrid reference(keys, width, height);
+  SD_SLAM::FeatureGrid grid(keys, nLevels, 0, 0, width, height);
+
+  // Queries
+  timer.Start();
+  for (int it = 0; it < nIterations; it++) {
+    for (int i = 0; i < nPoints; i++) {
+      vector<size_t> vIndices = reference.GetFeaturesInArea(points[i].x, points[i].y, radius[i], levels[i]-1, levels[i]);
+      for (size_t idx : vIndices)
+        checksum[0] += idx+1;
+    }
+  }
+  timer.Stop();
+  times[2] = timer.GetMsTime();
+
+  vector<size_t> vIndices;
+  timer.Start();
+  for (int it = 0; it < nIterations; it++) {
+    for (int i = 0; i < nPoints; i++) {
+      grid.GetFeaturesInArea(points[i].x, points[i].y, radius[i], levels[i]-1, levels[i], vIndices);
+      for (size_t idx : vIndices)
+        checksum[1] += idx+1;
+    }
+  }
+  timer.Stop();
+  times[3] = timer.GetMsTime();
+
+  timer.Start();
+  for (int it = 0; it < nIterations; it++) {
+    for (int i = 0; i < nPoints; i++) {
+      grid.ForEachInArea(points[i].x, points[i].y, radius[i], levels[i]-1, levels[i],
+                         [&checksum](size_t idx) { checksum[2] += idx+1; });
+    }
+  }
+  timer.Stop();
+  times[4] = timer.GetMsTime();
+
+  if (checksum[0] != checksum[1] || checksum[0] != checksum[2]) {
+    cerr << "Error: query results don't match" << endl;
+    return 1;
+  }
+
+  double n = static_cast<double>(nIterations)*nPoints;
+  cout << "Features: " << nFeatures << ", queries: " << n << endl;
+  cout << "Build vector grid: " << times[0]/nIterations << " ms" << endl;
+  cout << "Build CSR grid:    " << times[1]/nIterations << " ms" << endl;
+  cout << "Vector grid query: " << times[2] << " ms (" << times[2]*1e6/n << " ns/query)" << endl;
+  cout << "CSR grid buffer:   " << times[3] << " ms (" << times[3]*1e6/n << " ns/query)" << endl;
+  cout << "CSR grid visitor:  " << times[4] << " ms (" << times[4]*1e6/n << " ns/query)" << endl;
+
+  return 0;
+}
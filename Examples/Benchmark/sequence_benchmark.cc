@@ -0,0 +1,376 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sys/resource.h>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include "System.h"
+#include "Tracking.h"
+#include "Map.h"
+#include "Config.h"
+#include "extra/timer.h"
+#include "extra/replay.h"
+#include "extra/profiler.h"
+
+using namespace std;
+
+// Timestamped pose (camera to world)
+struct StampedPose {
+  double t;
+  Eigen::Matrix4d Twc;
+};
+
+// Timestamps in nanoseconds (EuRoC) are converted to seconds
+inline double ToSeconds(double t) {
+  return t > 1e12 ? t*1e-9 : t;
+}
+
+// Association file: timestamp rgb_file [timestamp depth_file]
+bool LoadAssociations(const string &filename, vector<double> &vTimestamps, vector<string> &vFilenamesRGB,
+                      vector<string> &vFilenamesD) {
+  ifstream f(filename.c_str());
+  if (!f.is_open())
+    return false;
+
+  string s;
+  while (getline(f, s)) {
+    if (s.empty() || s[0] == '#')
+      continue;
+
+    stringstream ss(s);
+    double t, td;
+    string sRGB, sD;
+    ss >> t >> sRGB >> td >> sD;
+    vTimestamps.push_back(ToSeconds(t));
+    vFilenamesRGB.push_back(sRGB);
+    vFilenamesD.push_back(sD);
+  }
+
+  return true;
+}
+
+// Ground truth in TUM format (timestamp tx ty tz qx qy qz qw) or EuRoC csv (timestamp,px,py,pz,qw,qx,qy,qz,...)
+bool LoadGroundTruth(const string &filename, vector<StampedPose> &poses) {
+  ifstream f(filename.c_str());
+  if (!f.is_open())
+    return false;
+
+  string s;
+  while (getline(f, s)) {
+    if (s.empty() || s[0] == '#')
+      continue;
+
+    const bool euroc = s.find(',') != string::npos;
+    std::replace(s.begin(), s.end(), ',', ' ');
+
+    stringstream ss(s);
+    double t, v[7];
+    ss >> t;
+    for (int i = 0; i < 7; i++)
+      ss >> v[i];
+    if (ss.fail())
+      continue;
+
+    Eigen::Quaterniond q = euroc ? Eigen::Quaterniond(v[3], v[4], v[5], v[6]) : Eigen::Quaterniond(v[6], v[3], v[4], v[5]);
+
+    StampedPose pose;
+    pose.t = ToSeconds(t);
+    pose.Twc.setIdentity();
+    pose.Twc.block<3, 3>(0, 0) = q.normalized().toRotationMatrix();
+    pose.Twc.block<3, 1>(0, 3) = Eigen::Vector3d(v[0], v[1], v[2]);
+    poses.push_back(pose);
+  }
+
+  std::sort(poses.begin(), poses.end(), [](const StampedPose &a, const StampedPose &b) { return a.t < b.t; });
+  return !poses.empty();
+}
+
+// Ground truth pose closest in time, if it is closer than maxDiff seconds
+const StampedPose* FindGroundTruth(const vector<StampedPose> &poses, double t, double maxDiff) {
+  auto it = std::lower_bound(poses.begin(), poses.end(), t, [](const StampedPose &p, double t) { return p.t < t; });
+
+  const StampedPose* best = nullptr;
+  if (it != poses.end())
+    best = &(*it);
+  if (it != poses.begin() && (!best || fabs((it-1)->t - t) < fabs(best->t - t)))
+    best = &(*(it-1));
+
+  if (!best || fabs(best->t - t) > maxDiff)
+    return nullptr;
+  return best;
+}
+
+double Percentile(vector<double> values, double p) {
+  if (values.empty())
+    return 0.0;
+  std::sort(values.begin(), values.end());
+  return values[std::min(static_cast<size_t>(p*values.size()), values.size()-1)];
+}
+
+// Absolute trajectory error (RMSE of positions after alignment) and relative pose error over delta seconds
+// (RMSE of translation and mean rotation in degrees). Monocular trajectories are aligned with scale.
+void TrajectoryErrors(const vector<StampedPose> &estimated, const vector<StampedPose> &groundtruth, bool scale,
+                      double delta, double &ate, double &rpeTrans, double &rpeRot, int &nAssociated) {
+  ate = rpeTrans = rpeRot = 0.0;
+
+  vector<Eigen::Matrix4d> vEst, vGt;
+  vector<double> vTimes;
+  for (const StampedPose &pose : estimated) {
+    const StampedPose* gt = FindGroundTruth(groundtruth, pose.t, 0.02);
+    if (!gt)
+      continue;
+    vEst.push_back(pose.Twc);
+    vGt.push_back(gt->Twc);
+    vTimes.push_back(pose.t);
+  }
+
+  nAssociated = vEst.size();
+  if (nAssociated < 3)
+    return;
+
+  // Align estimated positions to ground truth
+  Eigen::Matrix3Xd src(3, nAssociated), dst(3, nAssociated);
+  for (int i = 0; i < nAssociated; i++) {
+    src.col(i) = vEst[i].block<3, 1>(0, 3);
+    dst.col(i) = vGt[i].block<3, 1>(0, 3);
+  }
+
+  const Eigen::Matrix4d S = Eigen::umeyama(src, dst, scale);
+  const double s = S.block<3, 3>(0, 0).col(0).norm();
+
+  double sum = 0.0;
+  for (int i = 0; i < nAssociated; i++)
+    sum += ((S.block<3, 3>(0, 0)*src.col(i) + S.block<3, 1>(0, 3)) - dst.col(i)).squaredNorm();
+  ate = sqrt(sum/nAssociated);
+
+  // Relative errors, with estimated translations in ground truth scale
+  double sumTrans = 0.0, sumRot = 0.0;
+  int nPairs = 0;
+  for (int i = 0, j = 0; i < nAssociated; i++) {
+    while (j < nAssociated && vTimes[j] < vTimes[i] + delta)
+      j++;
+    if (j == nAssociated)
+      break;
+
+    Eigen::Matrix4d dEst = vEst[i].inverse()*vEst[j];
+    dEst.block<3, 1>(0, 3) *= s;
+    const Eigen::Matrix4d dGt = vGt[i].inverse()*vGt[j];
+    const Eigen::Matrix4d E = dGt.inverse()*dEst;
+
+    sumTrans += E.block<3, 1>(0, 3).squaredNorm();
+    const double c = std::max(-1.0, std::min(1.0, (E.block<3, 3>(0, 0).trace() - 1.0)/2.0));
+    sumRot += acos(c)*180.0/M_PI;
+    nPairs++;
+  }
+
+  if (nPairs > 0) {
+    rpeTrans = sqrt(sumTrans/nPairs);
+    rpeRot = sumRot/nPairs;
+  }
+}
+
+// Replay a recorded sequence with synchronous local mapping and without loop closing, so results are
+// deterministic, and save tracking times, map size, memory usage and trajectory errors as JSON.
+int main(int argc, char **argv) {
+  bool mono = false, loopClosing = false;
+  vector<string> args;
+  for (int i = 1; i < argc; i++) {
+    const string arg = argv[i];
+    if (arg == "--mono")
+      mono = true;
+    else if (arg == "--loop")
+      loopClosing = true;
+    else
+      args.push_back(arg);
+  }
+
+  if (args.size() != 4 && args.size() != 5) {
+    cerr << endl << "Usage: ./sequence_benchmark path_to_settings path_to_sequence path_to_association "
+         << "path_to_groundtruth [output.json] [--mono] [--loop]" << endl;
+    return 1;
+  }
+
+  const string path = args[1];
+  const string output = args.size() == 5 ? args[4] : "benchmark.json";
+
+  SD_SLAM::Config &config = SD_SLAM::Config::GetInstance();
+  if (!config.ReadParameters(args[0])) {
+    cerr << "[ERROR] Config file contains errors" << endl;
+    return 1;
+  }
+  config.SetSynchronousMapping(true);
+
+  vector<double> vTimestamps;
+  vector<string> vFilenamesRGB, vFilenamesD;
+  if (!LoadAssociations(args[2], vTimestamps, vFilenamesRGB, vFilenamesD) || vFilenamesRGB.empty()) {
+    cerr << "[ERROR] Couldn't find images in " << args[2] << endl;
+    return 1;
+  }
+
+  vector<StampedPose> groundtruth;
+  if (!LoadGroundTruth(args[3], groundtruth)) {
+    cerr << "[ERROR] Couldn't read ground truth from " << args[3] << endl;
+    return 1;
+  }
+
+  const int nImages = vFilenamesRGB.size();
+  vector<string> vPathsRGB, vPathsD;
+  for (int i = 0; i < nImages; i++) {
+    vPathsRGB.push_back(path+"/"+vFilenamesRGB[i]);
+    if (!mono)
+      vPathsD.push_back(path+"/"+vFilenamesD[i]);
+  }
+
+  // Images are decoded ahead, so only tracking is measured
+  const int nthreads = SD_SLAM::ReplayThreads();
+  SD_SLAM::ImageLoader loader(vPathsRGB, CV_LOAD_IMAGE_GRAYSCALE, vPathsD, CV_LOAD_IMAGE_UNCHANGED,
+                              nthreads, 4*nthreads);
+
+  // Same random sequence in every run
+  srand(0);
+
+  SD_SLAM::System SLAM(mono ? SD_SLAM::System::MONOCULAR : SD_SLAM::System::RGBD, loopClosing);
+
+  // Stage latencies are reported even if disabled in settings
+  SLAM.GetProfiler()->SetEnabled(true);
+
+  vector<double> vTimes;
+  vector<StampedPose> estimated;
+  int nTracked = 0;
+
+  SD_SLAM::Timer total(true);
+
+  for (int i = 0; i < nImages; i++) {
+    cv::Mat im, imD;
+    if (!loader.Get(i, im, imD)) {
+      cerr << "[ERROR] Failed to load image at: " << vPathsRGB[i] << endl;
+      return 1;
+    }
+
+    SD_SLAM::Timer timer(true);
+    Eigen::Matrix4d Tcw;
+    if (mono)
+      Tcw = SLAM.TrackMonocular(im, vTimestamps[i], vFilenamesRGB[i]);
+    else
+      Tcw = SLAM.TrackRGBD(im, imD, vTimestamps[i], vFilenamesRGB[i]);
+    timer.Stop();
+    vTimes.push_back(timer.GetMsTime());
+
+    if (SLAM.GetTrackingState() == SD_SLAM::Tracking::OK && !Tcw.isZero()) {
+      StampedPose pose;
+      pose.t = vTimestamps[i];
+      pose.Twc.setIdentity();
+      pose.Twc.block<3, 3>(0, 0) = Tcw.block<3, 3>(0, 0).transpose();
+      pose.Twc.block<3, 1>(0, 3) = -Tcw.block<3, 3>(0, 0).transpose()*Tcw.block<3, 1>(0, 3);
+      estimated.push_back(pose);
+      nTracked++;
+    }
+  }
+
+  total.Stop();
+
+  SLAM.Shutdown();
+
+  const long unsigned int nKeyFrames = SLAM.GetMap()->KeyFramesInMap();
+  const long unsigned int nPoints = SLAM.GetMap()->MapPointsInMap();
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  const long maxRSS = usage.ru_maxrss;  // KB
+
+  double ate, rpeTrans, rpeRot;
+  int nAssociated;
+  TrajectoryErrors(estimated, groundtruth, mono, 1.0, ate, rpeTrans, rpeRot, nAssociated);
+
+  // Mapping stages reported per call
+  const vector<pair<SD_SLAM::Profiler::Stage, string> > stages = {
+    {SD_SLAM::Profiler::CREATE_MAP_POINTS, "create_map_points"},
+    {SD_SLAM::Profiler::KEYFRAME_QUEUE_WAIT, "keyframe_queue_wait"}
+  };
+  vector<SD_SLAM::Profiler::Stats> vStageStats;
+  for (const pair<SD_SLAM::Profiler::Stage, string> &stage : stages)
+    vStageStats.push_back(SLAM.GetStageStats(stage.first));
+
+  double sum = 0.0;
+  for (double t : vTimes)
+    sum += t;
+  const double mean = sum/nImages;
+
+  cout << "Frames: " << nImages << " (" << nTracked << " tracked, " << nAssociated << " with ground truth)" << endl;
+  cout << "Tracking time (ms): mean " << mean << ", p50 " << Percentile(vTimes, 0.5) << ", p90 "
+       << Percentile(vTimes, 0.9) << ", p99 " << Percentile(vTimes, 0.99) << ", max " << Percentile(vTimes, 1.0) << endl;
+  for (size_t i = 0; i < stages.size(); i++) {
+    const SD_SLAM::Profiler::Stats &stats = vStageStats[i];
+    cout << "Stage " << stages[i].second << " (ms): " << stats.count << " calls, mean " << stats.mean << ", p50 "
+         << stats.p50 << ", p90 " << stats.p90 << ", p99 " << stats.p99 << ", max " << stats.max << endl;
+  }
+  cout << "Total time: " << total.GetTime() << " s (" << nImages/total.GetTime() << " fps)" << endl;
+  cout << "Map: " << nKeyFrames << " keyframes, " << nPoints << " points" << endl;
+  cout << "Max RSS: " << maxRSS/1024.0 << " MB" << endl;
+  cout << "ATE RMSE: " << ate << " m" << endl;
+  cout << "RPE (1s): " << rpeTrans << " m, " << rpeRot << " deg" << endl;
+
+  ofstream f(output.c_str());
+  if (!f.is_open()) {
+    cerr << "[ERROR] Couldn't write " << output << endl;
+    return 1;
+  }
+
+  f << "{" << endl;
+  f << "  \"sensor\": \"" << (mono ? "monocular" : "rgbd") << "\"," << endl;
+  f << "  \"loop_closing\": " << (loopClosing ? "true" : "false") << "," << endl;
+  f << "  \"frames\": " << nImages << "," << endl;
+  f << "  \"tracked\": " << nTracked << "," << endl;
+  f << "  \"associated\": " << nAssociated << "," << endl;
+  f << "  \"keyframes\": " << nKeyFrames << "," << endl;
+  f << "  \"map_points\": " << nPoints << "," << endl;
+  f << "  \"max_rss_kb\": " << maxRSS << "," << endl;
+  f << "  \"total_s\": " << total.GetTime() << "," << endl;
+  f << "  \"tracking_ms\": {\"mean\": " << mean << ", \"p50\": " << Percentile(vTimes, 0.5)
+    << ", \"p90\": " << Percentile(vTimes, 0.9) << ", \"p99\": " << Percentile(vTimes, 0.99)
+    << ", \"max\": " << Percentile(vTimes, 1.0) << "}," << endl;
+  for (size_t i = 0; i < stages.size(); i++) {
+    const SD_SLAM::Profiler::Stats &stats = vStageStats[i];
+    f << "  \"" << stages[i].second << "_ms\": {\"count\": " << stats.count << ", \"mean\": " << stats.mean
+      << ", \"p50\": " << stats.p50 << ", \"p90\": " << stats.p90 << ", \"p99\": " << stats.p99
+      << ", \"max\": " << stats.max << "}," << endl;
+  }
+  f << "  \"ate_rmse_m\": " << ate << "," << endl;
+  f << "  \"rpe_trans_rmse_m\": " << rpeTrans << "," << endl;
+  f << "  \"rpe_rot_mean_deg\": " << rpeRot << "," << endl;
+  f << "  \"frame_ms\": [";
+  for (int i = 0; i < nImages; i++)
+    f << (i > 0 ? ", " : "") << vTimes[i];
+  f << "]" << endl;
+  f << "}" << endl;
+
+  cout << "Results saved in " << output << endl;
+
+  return 0;
+}
@@ -0,0 +1,251 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <Eigen/Dense>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+using namespace std;
+
+// Synthetic RGB-D sequence in TUM format: a textured room with two pillars, rendered by ray casting.
+// Output folder gets rgb/ and depth/ images, associations.txt, groundtruth.txt and settings.yaml,
+// so it can be processed by the rgbd example or the sequence benchmark without downloading datasets.
+
+const int kWidth = 640;
+const int kHeight = 480;
+const double kFx = 525.0;
+const double kFy = 525.0;
+const double kCx = 319.5;
+const double kCy = 239.5;
+const double kFps = 30.0;
+const double kDepthFactor = 5000.0;
+
+// Axis aligned rectangle: coordinate axis is fixed to pos, the other two are inside [min, max]
+struct Quad {
+  int axis;
+  double pos;
+  Eigen::Vector2d min;
+  Eigen::Vector2d max;
+  int id;
+};
+
+// Coordinates of p on the plane of axis
+inline Eigen::Vector2d PlaneCoords(const Eigen::Vector3d &p, int axis) {
+  return Eigen::Vector2d(p((axis+1)%3), p((axis+2)%3));
+}
+
+// Walls, floor and ceiling of the room and sides of an axis aligned box
+void AddBox(const Eigen::Vector3d &bmin, const Eigen::Vector3d &bmax, vector<Quad> &quads) {
+  for (int axis = 0; axis < 3; axis++) {
+    Quad q;
+    q.axis = axis;
+    q.min = PlaneCoords(bmin, axis);
+    q.max = PlaneCoords(bmax, axis);
+
+    q.pos = bmin(axis);
+    q.id = quads.size();
+    quads.push_back(q);
+
+    q.pos = bmax(axis);
+    q.id = quads.size();
+    quads.push_back(q);
+  }
+}
+
+inline unsigned int Hash(int id, int x, int y) {
+  unsigned int h = id*374761393u + x*668265263u + y*2246822519u;
+  h = (h ^ (h >> 13))*1274126177u;
+  return h ^ (h >> 16);
+}
+
+// Random gray cells at two scales, so corners are found in every pyramid level
+inline double Texture(int id, const Eigen::Vector2d &uv) {
+  const double coarse = (Hash(id, floor(uv(0)/0.3), floor(uv(1)/0.3)) & 0xFF)/255.0;
+  const double fine = (Hash(id+101, floor(uv(0)/0.07), floor(uv(1)/0.07)) & 0xFF)/255.0;
+  return 30.0 + 200.0*(0.6*coarse + 0.4*fine);
+}
+
+// Distance along the ray to the closest surface, and its intensity
+bool CastRay(const vector<Quad> &quads, const Eigen::Vector3d &o, const Eigen::Vector3d &d,
+             double &tmin, double &intensity) {
+  tmin = 1e10;
+  bool hit = false;
+
+  for (const Quad &q : quads) {
+    if (fabs(d(q.axis)) < 1e-12)
+      continue;
+
+    const double t = (q.pos - o(q.axis))/d(q.axis);
+    if (t <= 1e-6 || t >= tmin)
+      continue;
+
+    const Eigen::Vector2d uv = PlaneCoords(o + t*d, q.axis);
+    if (uv(0) < q.min(0) || uv(0) > q.max(0) || uv(1) < q.min(1) || uv(1) > q.max(1))
+      continue;
+
+    tmin = t;
+    intensity = Texture(q.id, uv);
+    hit = true;
+  }
+
+  return hit;
+}
+
+// Camera to world pose at time t. Camera looks along +z, with y pointing to the floor.
+Eigen::Matrix4d CameraPose(double t) {
+  const double yaw = 0.45*sin(0.35*t);
+  const double pitch = 0.12*sin(0.5*t);
+  const double roll = 0.05*sin(0.8*t);
+
+  Eigen::Matrix3d R = (Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitY())*
+                       Eigen::AngleAxisd(pitch, Eigen::Vector3d::UnitX())*
+                       Eigen::AngleAxisd(roll, Eigen::Vector3d::UnitZ())).toRotationMatrix();
+
+  Eigen::Matrix4d Twc = Eigen::Matrix4d::Identity();
+  Twc.block<3, 3>(0, 0) = R;
+  Twc.block<3, 1>(0, 3) = Eigen::Vector3d(1.2*sin(0.3*t), 0.15*sin(0.6*t), -0.8 + 0.6*sin(0.2*t));
+  return Twc;
+}
+
+void Render(const vector<Quad> &quads, const Eigen::Matrix4d &Twc, cv::Mat &im, cv::Mat &depth) {
+  const Eigen::Matrix3d R = Twc.block<3, 3>(0, 0);
+  const Eigen::Vector3d o = Twc.block<3, 1>(0, 3);
+
+  im.create(kHeight, kWidth, CV_8U);
+  depth.create(kHeight, kWidth, CV_16U);
+
+  for (int y = 0; y < kHeight; y++) {
+    for (int x = 0; x < kWidth; x++) {
+      // 2x2 samples per pixel for the image, depth from the center
+      double sum = 0.0;
+      for (int s = 0; s < 4; s++) {
+        const Eigen::Vector3d ray((x - 0.25 + 0.5*(s%2) - kCx)/kFx, (y - 0.25 + 0.5*(s/2) - kCy)/kFy, 1.0);
+        double t, intensity = 0.0;
+        CastRay(quads, o, R*ray, t, intensity);
+        sum += intensity;
+      }
+      im.at<uchar>(y, x) = cv::saturate_cast<uchar>(sum/4.0);
+
+      // Ray has unit z, so distance along it is depth
+      const Eigen::Vector3d ray((x - kCx)/kFx, (y - kCy)/kFy, 1.0);
+      double t, intensity;
+      if (CastRay(quads, o, R*ray, t, intensity))
+        depth.at<uint16_t>(y, x) = cv::saturate_cast<uint16_t>(t*kDepthFactor);
+      else
+        depth.at<uint16_t>(y, x) = 0;
+    }
+  }
+}
+
+bool WriteSettings(const string &filename) {
+  cv::FileStorage fs(filename, cv::FileStorage::WRITE);
+  if (!fs.isOpened())
+    return false;
+
+  fs << "Camera.Width" << kWidth;
+  fs << "Camera.Height" << kHeight;
+  fs << "Camera.fx" << kFx;
+  fs << "Camera.fy" << kFy;
+  fs << "Camera.cx" << kCx;
+  fs << "Camera.cy" << kCy;
+  fs << "Camera.k1" << 0.0;
+  fs << "Camera.k2" << 0.0;
+  fs << "Camera.p1" << 0.0;
+  fs << "Camera.p2" << 0.0;
+  fs << "Camera.k3" << 0.0;
+  fs << "Camera.fps" << kFps;
+  fs << "Camera.bf" << 40.0;
+  fs << "ThDepth" << 40.0;
+  fs << "DepthMapFactor" << kDepthFactor;
+  fs << "ORBextractor.nFeatures" << 1000;
+  fs << "ORBextractor.scaleFactor" << 1.2;
+  fs << "ORBextractor.nLevels" << 8;
+  fs << "ORBextractor.thresholdFAST" << 20;
+  fs << "System.SynchronousMapping" << 1;
+
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2 && argc != 3) {
+    cerr << endl << "Usage: ./synthetic_sequence output_folder [num_frames]" << endl;
+    return 1;
+  }
+
+  const string path = argv[1];
+  int nFrames = 300;
+  if (argc == 3)
+    nFrames = max(1, atoi(argv[2]));
+
+  mkdir(path.c_str(), 0755);
+  mkdir((path+"/rgb").c_str(), 0755);
+  mkdir((path+"/depth").c_str(), 0755);
+
+  // Room of 7x3x8 meters and two pillars standing on the floor (y = 1.5)
+  vector<Quad> quads;
+  AddBox(Eigen::Vector3d(-3.5, -1.5, -3.0), Eigen::Vector3d(3.5, 1.5, 5.0), quads);
+  AddBox(Eigen::Vector3d(-1.4, -0.5, 2.0), Eigen::Vector3d(-0.8, 1.5, 2.6), quads);
+  AddBox(Eigen::Vector3d(0.8, 0.2, 2.8), Eigen::Vector3d(1.6, 1.5, 3.6), quads);
+
+  if (!WriteSettings(path+"/settings.yaml")) {
+    cerr << "[ERROR] Couldn't write " << path << "/settings.yaml" << endl;
+    return 1;
+  }
+
+  ofstream fAssociation((path+"/associations.txt").c_str());
+  ofstream fGroundtruth((path+"/groundtruth.txt").c_str());
+  fGroundtruth << "# timestamp tx ty tz qx qy qz qw" << endl;
+  fAssociation.precision(6);
+  fGroundtruth.precision(6);
+  fAssociation << fixed;
+  fGroundtruth << fixed;
+
+  cv::Mat im, depth;
+  for (int i = 0; i < nFrames; i++) {
+    const double t = i/kFps;
+    const Eigen::Matrix4d Twc = CameraPose(t);
+    Render(quads, Twc, im, depth);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%06d.png", i);
+    cv::imwrite(path+"/rgb/"+name, im);
+    cv::imwrite(path+"/depth/"+name, depth);
+
+    fAssociation << t << " rgb/" << name << " " << t << " depth/" << name << endl;
+
+    const Eigen::Quaterniond q(Twc.block<3, 3>(0, 0));
+    fGroundtruth << t << " " << Twc(0, 3) << " " << Twc(1, 3) << " " << Twc(2, 3) << " "
+                 << q.x() << " " << q.y() << " " << q.z() << " " << q.w() << endl;
+
+    if ((i+1) % 50 == 0)
+      cout << "[INFO] Rendered " << i+1 << "/" << nFrames << " frames" << endl;
+  }
+
+  cout << "[INFO] Sequence saved in " << path << endl;
+
+  return 0;
+}
@@ -0,0 +1,109 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <opencv2/core/core.hpp>
+#include <Eigen/Dense>
+#include "Undistorter.h"
+#include "extra/timer.h"
+
+using namespace std;
+
+struct Camera {
+  const char *name;
+  int width;
+  int height;
+  double fx, fy, cx, cy;
+  float k1, k2, p1, p2, k3;
+};
+
+int main(int argc, char **argv) {
+  const int nKeys = 2000;
+  int nIterations = 100;
+
+  if (argc > 1)
+    nIterations = atoi(argv[1]);
+
+  const Camera cameras[] = {
+    {"TUM1", 640, 480, 517.306408, 516.469215, 318.643040, 255.313989, 0.262383, -0.953104, -0.005358, 0.002628, 1.163314},
+    {"EuRoC", 752, 480, 458.654, 457.296, 367.215, 248.375, -0.28340811, 0.07395907, 0.00019359, 1.76187114e-05, 0},
+    {"Wide angle", 1280, 720, 600, 600, 640, 360, -0.30, 0.09, 0.001, -0.0005, 0},
+  };
+
+  cv::RNG rng(0);
+  SD_SLAM::Timer timer(false);
+
+  for (const Camera &c : cameras) {
+    Eigen::Matrix3d K;
+    K << c.fx, 0, c.cx, 0, c.fy, c.cy, 0, 0, 1;
+    cv::Mat distCoef(c.k3 != 0 ? 5 : 4, 1, CV_32F);
+    distCoef.at<float>(0) = c.k1;
+    distCoef.at<float>(1) = c.k2;
+    distCoef.at<float>(2) = c.p1;
+    distCoef.at<float>(3) = c.p2;
+    if (c.k3 != 0)
+      distCoef.at<float>(4) = c.k3;
+
+    timer.Start();
+    SD_SLAM::Undistorter undistorter(K, distCoef, cv::Size(c.width, c.height));
+    timer.Stop();
+    const double tBuild = timer.GetMsTime();
+
+    vector<cv::KeyPoint> keys(nKeys), keysUn;
+    for (int i = 0; i < nKeys; i++)
+      keys[i].pt = cv::Point2f(rng.uniform(0.f, static_cast<float>(c.width)), rng.uniform(0.f, static_cast<float>(c.height)));
+
+    // Reference: cv::undistortPoints on each frame
+    vector<cv::Point2f> points;
+    timer.Start();
+    for (int it = 0; it < nIterations; it++) {
+      points.resize(nKeys);
+      for (int i = 0; i < nKeys; i++)
+        points[i] = keys[i].pt;
+      SD_SLAM::Undistorter::UndistortPoints(K, distCoef, points);
+    }
+    timer.Stop();
+    const double tExact = timer.GetMsTime();
+
+    timer.Start();
+    for (int it = 0; it < nIterations; it++)
+      undistorter.UndistortKeyPoints(keys, keysUn);
+    timer.Stop();
+    const double tLookup = timer.GetMsTime();
+
+    double maxError = 0, meanError = 0;
+    for (int i = 0; i < nKeys; i++) {
+      const double e = hypot(keysUn[i].pt.x-points[i].x, keysUn[i].pt.y-points[i].y);
+      maxError = max(maxError, e);
+      meanError += e/nKeys;
+    }
+
+    cout << c.name << " (" << c.width << "x" << c.height << "): grid step " << undistorter.Step()
+         << " px, built in " << tBuild << " ms" << (undistorter.UsesGrid() ? "" : " (not used)") << endl;
+    cout << "  undistortPoints: " << tExact*1000/nIterations << " us/frame" << endl;
+    cout << "  Lookup:          " << tLookup*1000/nIterations << " us/frame" << endl;
+    cout << "  Error: max " << maxError << " px, mean " << meanError << " px (bound "
+         << SD_SLAM::Undistorter::MAX_ERROR << " px)" << endl;
+  }
+
+  return 0;
+}
@@ -28,6 +28,7 @@
 #include "Map.h"
 #include "Config.h"
 #include "extra/timer.h"
+#include "extra/replay.h"
 #ifdef PANGOLIN
 #include "ui/Viewer.h"
 #include "ui/FrameDrawer.h"
@@ -48,9 +49,13 @@ int main(int argc, char **argv) {
   int nImages, nValues, nAssociated, ni = 0;
   bool useViewer = true;
   double freq = 1.0/30.0;
+  SD_SLAM::ImageLoader * loader = nullptr;
+
+  // Replay mode: images decoded ahead, no pacing nor per frame output
+  bool replay = SD_SLAM::ParseReplay(argc, argv);
 
   if(argc != 4) {
-    cerr << endl << "Usage: ./monocular_imu path_to_settings path_to_sequence path_to_IMU_data" << endl;
+    cerr << endl << "Usage: ./monocular_imu path_to_settings path_to_sequence path_to_IMU_data [--replay]" << endl;
     return 1;
   }
 
@@ -82,6 +87,16 @@ int main(int argc, char **argv) {
   nAssociated = vIdxValues.size();
   cout << "[INFO] Associated " << nAssociated << " values" << endl;
 
+  if (replay) {
+    vector<string> vPaths;
+    for (const string &f : vFilenames)
+      vPaths.push_back(string(argv[2])+"/"+f);
+
+    int nthreads = SD_SLAM::ReplayThreads();
+    loader = new SD_SLAM::ImageLoader(vPaths, CV_LOAD_IMAGE_GRAYSCALE, nthreads, 4*nthreads);
+    useViewer = false;
+  }
+
   // Create SLAM system. It initializes all system threads and gets ready to process frames.
   SD_SLAM::System SLAM(SD_SLAM::System::MONOCULAR_IMU, true);
 
@@ -102,11 +117,17 @@ int main(int argc, char **argv) {
   }
 #endif
 
+  SD_SLAM::ReplayStats stats;
+
   // Main loop
   while (ni<nImages && !SLAM.StopRequested()) {
     // Read image from file
-    cout << "[INFO] Reading Frame " << string(argv[2])+"/"+vFilenames[ni] << endl;
-    im = cv::imread(string(argv[2])+"/"+vFilenames[ni], CV_LOAD_IMAGE_GRAYSCALE);
+    if (replay) {
+      loader->Get(ni, im);
+    } else {
+      cout << "[INFO] Reading Frame " << string(argv[2])+"/"+vFilenames[ni] << endl;
+      im = cv::imread(string(argv[2])+"/"+vFilenames[ni], CV_LOAD_IMAGE_GRAYSCALE);
+    }
 
     if(im.empty()) {
       cerr << endl << "[ERROR] Failed to load image at: "  << string(argv[2]) << "/" << vFilenames[ni] << endl;
@@ -115,13 +136,22 @@ int main(int argc, char **argv) {
 
     // Get values
     vector<double> values = vIMUValues[vIdxValues[ni]];
-    cout << "[INFO] Reading IMU values for timestamp "  << (long) values[0] << endl;
+    if (!replay)
+      cout << "[INFO] Reading IMU values for timestamp "  << (long) values[0] << endl;
+    double timestamp = values[0]*1e-9;  // Nanoseconds
     values.erase(values.begin()); // Remove timestamp
 
     SD_SLAM::Timer ttracking(true);
 
     // Pass the image and measurements to the SLAM system
-    Eigen::Matrix4d pose = SLAM.TrackFusion(im, values);
+    Eigen::Matrix4d pose = SLAM.TrackFusion(im, values, timestamp);
+
+    if (replay) {
+      ttracking.Stop();
+      stats.Add(ttracking.GetTime());
+      ni++;
+      continue;
+    }
 
     // Set data to UI
 #ifdef PANGOLIN
@@ -144,6 +174,11 @@ int main(int argc, char **argv) {
     ni++;
   }
 
+  if (replay) {
+    stats.Print();
+    delete loader;
+  }
+
   // Stop all threads
   SLAM.Shutdown();
 
@@ -0,0 +1,59 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include "System.h"
+#include "Config.h"
+
+using namespace std;
+
+// Convert a map saved in YAML (SaveTrajectory) to the binary format (SaveMap)
+int main(int argc, char **argv) {
+  if (argc != 4 && argc != 5) {
+    cerr << endl << "Usage: ./convert_map path_to_settings path_to_yaml_map path_to_binary_map [rgbd]" << endl;
+    return 1;
+  }
+
+  // Read parameters
+  SD_SLAM::Config &config = SD_SLAM::Config::GetInstance();
+  if (!config.ReadParameters(argv[1])) {
+    cerr << "[ERROR] Config file contains errors" << endl;
+    return 1;
+  }
+
+  bool rgbd = argc == 5 && string(argv[4]) == "rgbd";
+  SD_SLAM::System SLAM(rgbd ? SD_SLAM::System::RGBD : SD_SLAM::System::MONOCULAR, false);
+
+  if (!SLAM.LoadTrajectory(string(argv[2]))) {
+    cerr << "[ERROR] Couldn't load map " << argv[2] << endl;
+    SLAM.Shutdown();
+    return 1;
+  }
+
+  SLAM.Shutdown();
+
+  if (!SLAM.SaveMap(string(argv[3]))) {
+    cerr << "[ERROR] Couldn't save map " << argv[3] << endl;
+    return 1;
+  }
+
+  cout << "[INFO] Map converted to " << argv[3] << endl;
+  return 0;
+}
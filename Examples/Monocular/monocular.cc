@@ -28,6 +28,7 @@
 #include "Map.h"
 #include "Config.h"
 #include "extra/timer.h"
+#include "extra/replay.h"
 #ifdef PANGOLIN
 #include "ui/Viewer.h"
 #include "ui/FrameDrawer.h"
@@ -58,9 +59,13 @@ int main(int argc, char **argv) {
   bool live = false;
   double freq = 1.0/30.0;
   std::string src, fname;
+  SD_SLAM::ImageLoader * loader = nullptr;
+
+  // Replay mode: images decoded ahead, no pacing nor per frame output
+  bool replay = SD_SLAM::ParseReplay(argc, argv);
 
   if(argc != 3 && argc !=4) {
-    cerr << endl << "Usage: ./monocular path_to_settings path_to_sequence/device_number [path_to_saved_map]" << endl;
+    cerr << endl << "Usage: ./monocular path_to_settings path_to_sequence/device_number [path_to_saved_map] [--replay]" << endl;
     return 1;
   }
 
@@ -73,6 +78,11 @@ int main(int argc, char **argv) {
 
   // Check if live mode is activated
   if (isdigit(argv[2][0])) {
+    if (replay) {
+      cerr << "[ERROR] Replay mode needs a recorded sequence" << endl;
+      return 1;
+    }
+
     live = true;
     string sdevice = string(argv[2]);
     int device;
@@ -101,6 +111,16 @@ int main(int argc, char **argv) {
 
     nImages = vFilenames.size();
     cout << "[INFO] Sequence has " << nImages << " images" << endl;
+
+    if (replay) {
+      vector<string> vPaths;
+      for (const string &f : vFilenames)
+        vPaths.push_back(string(argv[2]) + "/" + f);
+
+      int nthreads = SD_SLAM::ReplayThreads();
+      loader = new SD_SLAM::ImageLoader(vPaths, CV_LOAD_IMAGE_GRAYSCALE, nthreads, 4*nthreads);
+      useViewer = false;
+    }
   }
 
   // Create SLAM system. It initializes all system threads and gets ready to process frames.
@@ -108,7 +128,11 @@ int main(int argc, char **argv) {
 
   // Check if a saved map is provided
   if (argc == 4) {
-    SLAM.LoadTrajectory(string(argv[3]));
+    string map = string(argv[3]);
+    if (map.size() > 5 && map.compare(map.size()-5, 5, ".yaml") == 0)
+      SLAM.LoadTrajectory(map);
+    else
+      SLAM.LoadMap(map);
   }
 
 #ifdef PANGOLIN
@@ -128,6 +152,8 @@ int main(int argc, char **argv) {
   }
 #endif
 
+  SD_SLAM::ReplayStats stats;
+
   // Main loop
   while (ni<nImages && !SLAM.StopRequested()) {
     if (live) {
@@ -138,8 +164,12 @@ int main(int argc, char **argv) {
       // Read image from file
       fname = vFilenames[ni];
       src = string(argv[2]) + "/" + fname;
-      cout << "[INFO] Reading Frame " << src << endl;
-      im = cv::imread(src, CV_LOAD_IMAGE_GRAYSCALE);
+      if (replay) {
+        loader->Get(ni, im);
+      } else {
+        cout << "[INFO] Reading Frame " << src << endl;
+        im = cv::imread(src, CV_LOAD_IMAGE_GRAYSCALE);
+      }
 
       if(im.empty()) {
         cerr << endl << "[ERROR] Failed to load image at: "  << string(argv[2]) << "/" << vFilenames[ni] << endl;
@@ -149,8 +179,19 @@ int main(int argc, char **argv) {
 
     SD_SLAM::Timer ttracking(true);
 
-    // Pass the image to the SLAM system
-    Eigen::Matrix4d pose = SLAM.TrackMonocular(im, fname);
+    // Pass the image to the SLAM system. Recorded frames are stamped at the nominal rate.
+    Eigen::Matrix4d pose;
+    if (live)
+      pose = SLAM.TrackMonocular(im, fname);
+    else
+      pose = SLAM.TrackMonocular(im, ni*freq, fname);
+
+    if (replay) {
+      ttracking.Stop();
+      stats.Add(ttracking.GetTime());
+      ni++;
+      continue;
+    }
 
     // Show world pose
     ShowPose(pose);
@@ -176,11 +217,17 @@ int main(int argc, char **argv) {
     ni++;
   }
 
+  if (replay) {
+    stats.Print();
+    delete loader;
+  }
+
   // Stop all threads
   SLAM.Shutdown();
 
   // Save data
   SLAM.SaveTrajectory("trajectory.yaml", "trajectory");
+  SLAM.SaveMap("trajectory.map");
 
 #ifdef PANGOLIN
   if (useViewer) {
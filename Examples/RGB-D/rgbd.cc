@@ -29,6 +29,7 @@
 #include "Map.h"
 #include "Config.h"
 #include "extra/timer.h"
+#include "extra/replay.h"
 #ifdef PANGOLIN
 #include "ui/Viewer.h"
 #include "ui/FrameDrawer.h"
@@ -38,19 +39,24 @@
 using namespace std;
 
 bool LoadImages(const string &strAssociationFilename, vector<string> &vFilenamesRGB,
-                vector<string> &vFilenamesD);
+                vector<string> &vFilenamesD, vector<double> &vTimestamps);
 
 int main(int argc, char **argv) {
   vector<string> vFilenamesRGB;
   vector<string> vFilenamesD;
+  vector<double> vTimestamps;
   cv::Mat im, imD;
   int nImages, ni = 0;
   bool useViewer = true;
   double freq = 1.0/30.0;
   std::string fname;
+  SD_SLAM::ImageLoader * loader = nullptr;
+
+  // Replay mode: images decoded ahead, no pacing nor per frame output
+  bool replay = SD_SLAM::ParseReplay(argc, argv);
 
   if(argc != 4 && argc != 5) {
-      cerr << endl << "Usage: ./rgbd path_to_settings path_to_sequence path_to_association [path_to_saved_map]" << endl;
+      cerr << endl << "Usage: ./rgbd path_to_settings path_to_sequence path_to_association [path_to_saved_map] [--replay]" << endl;
       return 1;
   }
 
@@ -63,7 +69,7 @@ int main(int argc, char **argv) {
 
   // Retrieve paths to images
   string strAssociationFilename = string(argv[3]);
-  bool ok = LoadImages(strAssociationFilename, vFilenamesRGB, vFilenamesD);
+  bool ok = LoadImages(strAssociationFilename, vFilenamesRGB, vFilenamesD, vTimestamps);
   if (!ok) {
     cerr << "[ERROR] Couldn't find images, does " << strAssociationFilename << " exist?" << endl;
     return 1;
@@ -81,12 +87,29 @@ int main(int argc, char **argv) {
 
   cout << "[INFO] Sequence has " << nImages << " images" << endl;
 
+  if (replay) {
+    vector<string> vPathsRGB, vPathsD;
+    for (int i = 0; i < nImages; i++) {
+      vPathsRGB.push_back(string(argv[2])+"/"+vFilenamesRGB[i]);
+      vPathsD.push_back(string(argv[2])+"/"+vFilenamesD[i]);
+    }
+
+    int nthreads = SD_SLAM::ReplayThreads();
+    loader = new SD_SLAM::ImageLoader(vPathsRGB, CV_LOAD_IMAGE_GRAYSCALE, vPathsD, CV_LOAD_IMAGE_UNCHANGED,
+                                      nthreads, 4*nthreads);
+    useViewer = false;
+  }
+
   // Create SLAM system. It initializes all system threads and gets ready to process frames.
   SD_SLAM::System SLAM(SD_SLAM::System::RGBD, true);
 
   // Check if a saved map is provided
   if (argc == 5) {
-    SLAM.LoadTrajectory(string(argv[4]));
+    string map = string(argv[4]);
+    if (map.size() > 5 && map.compare(map.size()-5, 5, ".yaml") == 0)
+      SLAM.LoadTrajectory(map);
+    else
+      SLAM.LoadMap(map);
   }
 
 #ifdef PANGOLIN
@@ -106,13 +129,19 @@ int main(int argc, char **argv) {
   }
 #endif
 
+  SD_SLAM::ReplayStats stats;
+
   // Main loop
   while (ni<nImages && !SLAM.StopRequested()) {
     // Read image and depthmap from file
-    cout << "[INFO] Reading Frame " << string(argv[2])+"/"+vFilenamesRGB[ni] << endl;
     fname = vFilenamesRGB[ni];
-    im = cv::imread(string(argv[2])+"/"+vFilenamesRGB[ni], CV_LOAD_IMAGE_GRAYSCALE);
-    imD = cv::imread(string(argv[2])+"/"+vFilenamesD[ni], CV_LOAD_IMAGE_UNCHANGED);
+    if (replay) {
+      loader->Get(ni, im, imD);
+    } else {
+      cout << "[INFO] Reading Frame " << string(argv[2])+"/"+vFilenamesRGB[ni] << endl;
+      im = cv::imread(string(argv[2])+"/"+vFilenamesRGB[ni], CV_LOAD_IMAGE_GRAYSCALE);
+      imD = cv::imread(string(argv[2])+"/"+vFilenamesD[ni], CV_LOAD_IMAGE_UNCHANGED);
+    }
 
     if(im.empty()) {
       cerr << endl << "[ERROR] Failed to load image at: " << string(argv[2]) << "/" << vFilenamesRGB[ni] << endl;
@@ -122,7 +151,14 @@ int main(int argc, char **argv) {
     SD_SLAM::Timer ttracking(true);
 
     // Pass the image to the SLAM system
-    Eigen::Matrix4d pose = SLAM.TrackRGBD(im, imD, fname);
+    Eigen::Matrix4d pose = SLAM.TrackRGBD(im, imD, vTimestamps[ni], fname);
+
+    if (replay) {
+      ttracking.Stop();
+      stats.Add(ttracking.GetTime());
+      ni++;
+      continue;
+    }
 
     // Set data to UI
 #ifdef PANGOLIN
@@ -145,11 +181,17 @@ int main(int argc, char **argv) {
     ni++;
   }
 
+  if (replay) {
+    stats.Print();
+    delete loader;
+  }
+
   // Stop all threads
   SLAM.Shutdown();
 
   // Save data
   SLAM.SaveTrajectory("trajectoryRGBD.yaml", "trajectoryRGBD");
+  SLAM.SaveMap("trajectoryRGBD.map");
 
 #ifdef PANGOLIN
   if (useViewer) {
@@ -165,7 +207,7 @@ int main(int argc, char **argv) {
 }
 
 bool LoadImages(const string &strAssociationFilename, vector<string> &vFilenamesRGB,
-                vector<string> &vFilenamesD) {
+                vector<string> &vFilenamesD, vector<double> &vTimestamps) {
   ifstream fAssociation;
   fAssociation.open(strAssociationFilename.c_str());
   if(!fAssociation.is_open())
@@ -180,6 +222,7 @@ bool LoadImages(const string &strAssociationFilename, vector<string> &vFilenames
       double t;
       string sRGB, sD;
       ss >> t;
+      vTimestamps.push_back(t);
       ss >> sRGB;
       vFilenamesRGB.push_back(sRGB);
       ss >> t;
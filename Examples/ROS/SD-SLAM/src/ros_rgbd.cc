@@ -78,7 +78,8 @@ class ImageReader {
   void GetImage(cv::Mat &imgRGB, cv::Mat &imgD) {
     std::unique_lock<mutex> lock(imgMutex_);
     imgRGB_.copyTo(imgRGB);
-    imgD_.copyTo(imgD);
+    // Depth is kept by the tracking, so each frame needs its own buffer
+    imgD = imgD_.clone();
     updated_ = false;
   }
 
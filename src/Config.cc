@@ -25,6 +25,8 @@ using std::endl;
 
 namespace SD_SLAM {
 
+thread_local Config *Config::current_ = nullptr;
+
 Config::Config() {
   // Default values
   camera_params_.w = 640;
@@ -49,6 +51,22 @@ Config::Config() {
   kScaleFactor_ = 2.0;
   kNumLevels_ = 5;
   kThresholdFAST_ = 20;
+  kExtractorThreads_ = 1;
+
+  kKeyFrameImageBudget_ = 0;
+
+  kAlignFloat_ = false;
+
+  kQueueSize_ = 2;
+
+  kSynchronousMapping_ = false;
+
+  kSchurLocalBA_ = false;
+
+  kIndexedLoopSearch_ = false;
+
+  kProfilerEnabled_ = true;
+  kProfilerOutput_ = "";
 
   kKeyFrameSize_ = 0.05;
   kKeyFrameLineWidth_ = 1.0;
@@ -105,6 +123,29 @@ bool Config::ReadParameters(std::string filename) {
   if (fs["ORBextractor.scaleFactor"].isNamed()) fs["ORBextractor.scaleFactor"] >> kScaleFactor_;
   if (fs["ORBextractor.nLevels"].isNamed()) fs["ORBextractor.nLevels"] >> kNumLevels_;
   if (fs["ORBextractor.thresholdFAST"].isNamed()) fs["ORBextractor.thresholdFAST"] >> kThresholdFAST_;
+  if (fs["ORBextractor.nThreads"].isNamed()) fs["ORBextractor.nThreads"] >> kExtractorThreads_;
+
+  // Keyframe images
+  if (fs["KeyFrame.ImageBudget"].isNamed()) fs["KeyFrame.ImageBudget"] >> kKeyFrameImageBudget_;
+
+  // Image align
+  if (fs["ImageAlign.Float"].isNamed()) fs["ImageAlign.Float"] >> kAlignFloat_;
+
+  // Asynchronous submission
+  if (fs["System.QueueSize"].isNamed()) fs["System.QueueSize"] >> kQueueSize_;
+
+  // Synchronous mapping
+  if (fs["System.SynchronousMapping"].isNamed()) fs["System.SynchronousMapping"] >> kSynchronousMapping_;
+
+  // Local BA
+  if (fs["LocalBA.Schur"].isNamed()) fs["LocalBA.Schur"] >> kSchurLocalBA_;
+
+  // Loop closing
+  if (fs["LoopClosing.IndexedSearch"].isNamed()) fs["LoopClosing.IndexedSearch"] >> kIndexedLoopSearch_;
+
+  // Profiler
+  if (fs["Profiler.Enabled"].isNamed()) fs["Profiler.Enabled"] >> kProfilerEnabled_;
+  if (fs["Profiler.Output"].isNamed()) fs["Profiler.Output"] >> kProfilerOutput_;
 
   // UI
   if (fs["Viewer.KeyFrameSize"].isNamed()) fs["Viewer.KeyFrameSize"] >> kKeyFrameSize_;
@@ -145,4 +186,8 @@ void Config::SetCameraDistortion(double k1, double k2, double p1, double p2, dou
   camera_params_.k3 = k3;
 }
 
+void Config::SetSynchronousMapping(bool synchronous) {
+  kSynchronousMapping_ = synchronous;
+}
+
 }  // namespace SD_SLAM
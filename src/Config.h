@@ -43,8 +43,17 @@ struct CameraParameters {
 
 class Config {
  public:
-  // Singleton
+  // Default parameters
+  Config();
+
+  // Configuration of the calling thread: the one bound with ConfigScope,
+  // or the process-wide instance if none is bound.
   static Config& GetInstance() {
+    return current_ ? *current_ : Global();
+  }
+
+  // Process-wide instance
+  static Config& Global() {
     static Config instance;
     return instance;
   }
@@ -55,6 +64,7 @@ class Config {
   // Set parameters
   void SetCameraIntrinsics(double w, double h, double fx, double fy, double cx, double cy);
   void SetCameraDistortion(double k1, double k2, double p1, double p2, double k3);
+  void SetSynchronousMapping(bool synchronous);
 
   // Get parameters
   static double Width() { return GetInstance().camera_params_.w; }
@@ -79,6 +89,22 @@ class Config {
   static double ScaleFactor() { return GetInstance().kScaleFactor_; }
   static int NumLevels() { return GetInstance().kNumLevels_; }
   static int ThresholdFAST() { return GetInstance().kThresholdFAST_; }
+  static int ExtractorThreads() { return GetInstance().kExtractorThreads_; }
+
+  static int KeyFrameImageBudget() { return GetInstance().kKeyFrameImageBudget_; }
+
+  static bool AlignFloat() { return GetInstance().kAlignFloat_; }
+
+  static int QueueSize() { return GetInstance().kQueueSize_; }
+
+  static bool SynchronousMapping() { return GetInstance().kSynchronousMapping_; }
+
+  static bool SchurLocalBA() { return GetInstance().kSchurLocalBA_; }
+
+  static bool IndexedLoopSearch() { return GetInstance().kIndexedLoopSearch_; }
+
+  static bool ProfilerEnabled() { return GetInstance().kProfilerEnabled_; }
+  static std::string ProfilerOutput() { return GetInstance().kProfilerOutput_; }
 
   static double KeyFrameSize() { return GetInstance().kKeyFrameSize_; }
   static double KeyFrameLineWidth() { return GetInstance().kKeyFrameLineWidth_; }
@@ -96,7 +122,10 @@ class Config {
   static std::string IMUTopic() { return GetInstance().kIMUTopic_; }
 
  private:
-  Config();
+  friend class ConfigScope;
+
+  // Configuration bound to the calling thread
+  static thread_local Config *current_;
 
   // Camera
   CameraParameters camera_params_;
@@ -110,6 +139,29 @@ class Config {
   double kScaleFactor_;
   int kNumLevels_;
   int kThresholdFAST_;
+  int kExtractorThreads_;
+
+  // Keyframe images (MB, 0 is unlimited and keeps them uncompressed)
+  int kKeyFrameImageBudget_;
+
+  // Image alignment in single precision
+  bool kAlignFloat_;
+
+  // Frames waiting in the asynchronous submission queue
+  int kQueueSize_;
+
+  // Tracking waits for local mapping after each frame, so results don't depend on timing
+  bool kSynchronousMapping_;
+
+  // Local BA with the specialized Schur complement solver instead of g2o
+  bool kSchurLocalBA_;
+
+  // Loop candidates matched through a descriptor index instead of exhaustively (approximate)
+  bool kIndexedLoopSearch_;
+
+  // Stage latencies, saved at shutdown if output is set (.json or .csv)
+  bool kProfilerEnabled_;
+  std::string kProfilerOutput_;
 
   // UI
   double kKeyFrameSize_;
@@ -129,6 +181,23 @@ class Config {
   std::string kIMUTopic_;
 };
 
+// Bind a configuration to the calling thread while the scope is alive.
+// Each System binds its own copy to its threads, so several systems
+// with different parameters can run in the same process.
+class ConfigScope {
+ public:
+  explicit ConfigScope(Config *config): previous_(Config::current_) {
+    Config::current_ = config;
+  }
+
+  ~ConfigScope() {
+    Config::current_ = previous_;
+  }
+
+ private:
+  Config *previous_;
+};
+
 }  // namespace SD_SLAM
 
 
@@ -0,0 +1,54 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "DescriptorIndex.h"
+
+using std::vector;
+
+namespace SD_SLAM {
+
+const int DescriptorIndex::NUM_TABLES;
+const int DescriptorIndex::NUM_BUCKETS;
+const int DescriptorIndex::MIN_SHARED;
+
+DescriptorIndex::DescriptorIndex(const cv::Mat &descriptors): size_(descriptors.rows) {
+  const int nBuckets = NUM_TABLES*NUM_BUCKETS;
+
+  // Counting sort by (table, byte value)
+  offsets_.assign(nBuckets+1, 0);
+  for (int i = 0; i < descriptors.rows; i++) {
+    const uchar *d = descriptors.ptr<uchar>(i);
+    for (int t = 0; t < NUM_TABLES; t++)
+      offsets_[t*NUM_BUCKETS + d[t] + 1]++;
+  }
+
+  for (int b = 0; b < nBuckets; b++)
+    offsets_[b+1] += offsets_[b];
+
+  // Rows are inserted in order, so each bucket is sorted by index
+  vector<unsigned int> next(offsets_.begin(), offsets_.end()-1);
+  entries_.resize(offsets_[nBuckets]);
+  for (int i = 0; i < descriptors.rows; i++) {
+    const uchar *d = descriptors.ptr<uchar>(i);
+    for (int t = 0; t < NUM_TABLES; t++)
+      entries_[next[t*NUM_BUCKETS + d[t]]++] = i;
+  }
+}
+
+}  // namespace SD_SLAM
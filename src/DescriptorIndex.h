@@ -0,0 +1,87 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SD_SLAM_DESCRIPTORINDEX_H_
+#define SD_SLAM_DESCRIPTORINDEX_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace SD_SLAM {
+
+// Multi-index hashing over 256 bits ORB descriptors. Each byte of the descriptor
+// indexes its own table, and a query gets the descriptors sharing at least
+// minShared bytes with it. With independent bits, two descriptors at distance d
+// share a byte in each table with probability (1-d/256)^8. With MIN_SHARED,
+// candidates include 98% of the descriptors closer than the matching threshold (50)
+// and 80% of those at the distance checked by the ratio test (66), while an
+// unrelated descriptor is a candidate with probability under 1% if bytes are
+// uniformly distributed. Sharing a single byte raises these to 99.8%, 95% and 12%.
+// Search is approximate. Tables are stored in compressed rows and never modified.
+class DescriptorIndex {
+ public:
+  static const int NUM_TABLES = 32;
+  static const int NUM_BUCKETS = 256;
+  static const int MIN_SHARED = 2;
+
+  // Index the rows of a CV_8U descriptor matrix (32 bytes per row)
+  explicit DescriptorIndex(const cv::Mat &descriptors);
+
+  // Call visit(index) once for each indexed descriptor sharing minShared bytes with d.
+  // counts is a buffer with a zero for each indexed descriptor, zeroed again on return.
+  template<typename Visitor>
+  void ForEachCandidate(const uchar *d, int minShared, std::vector<unsigned char> &counts,
+                        Visitor &&visit) const;
+
+  inline size_t size() const { return size_; }
+
+ private:
+  size_t size_;
+
+  // Entries of bucket v of table t are in [offsets_[b], offsets_[b+1]) with b = t*NUM_BUCKETS+v
+  std::vector<unsigned int> offsets_;
+  std::vector<unsigned int> entries_;
+};
+
+template<typename Visitor>
+void DescriptorIndex::ForEachCandidate(const uchar *d, int minShared, std::vector<unsigned char> &counts,
+                                       Visitor &&visit) const {
+  for (int t = 0; t < NUM_TABLES; t++) {
+    const int b = t*NUM_BUCKETS + d[t];
+    const unsigned int *e = entries_.data() + offsets_[b];
+    const unsigned int *end = entries_.data() + offsets_[b+1];
+    for (; e != end; e++) {
+      if (++counts[*e] == minShared)
+        visit(static_cast<size_t>(*e));
+    }
+  }
+
+  // Same buckets again to clear the counters
+  for (int t = 0; t < NUM_TABLES; t++) {
+    const int b = t*NUM_BUCKETS + d[t];
+    const unsigned int *e = entries_.data() + offsets_[b];
+    const unsigned int *end = entries_.data() + offsets_[b+1];
+    for (; e != end; e++)
+      counts[*e] = 0;
+  }
+}
+
+}  // namespace SD_SLAM
+
+#endif  // SD_SLAM_DESCRIPTORINDEX_H_
@@ -0,0 +1,106 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "FeatureGrid.h"
+
+using std::vector;
+
+namespace SD_SLAM {
+
+FeatureGrid::FeatureGrid(const vector<cv::KeyPoint> &keys, int levels, float minX, float minY, float maxX, float maxY):
+  levels_(std::max(1, levels)), min_x_(minX), min_y_(minY),
+  cell_width_inv_(static_cast<float>(FRAME_GRID_COLS)/(maxX-minX)),
+  cell_height_inv_(static_cast<float>(FRAME_GRID_ROWS)/(maxY-minY)) {
+  const int nCells = FRAME_GRID_COLS*FRAME_GRID_ROWS;
+  const int nBins = nCells*levels_;
+
+  // Counting sort by (cell, octave)
+  vector<int> bins(keys.size(), -1);
+  vector<unsigned int> counts(nBins+1, 0);
+  for (size_t i = 0; i < keys.size(); i++) {
+    int posX, posY;
+    if (!PosInGrid(keys[i].pt.x, keys[i].pt.y, posX, posY)) {
+      outside_.push_back(i);
+      continue;
+    }
+
+    const int octave = std::min(std::max(keys[i].octave, 0), levels_-1);
+    bins[i] = (posY*FRAME_GRID_COLS+posX)*levels_ + octave;
+    counts[bins[i]+1]++;
+  }
+
+  for (int b = 0; b < nBins; b++)
+    counts[b+1] += counts[b];
+
+  entries_.resize(counts[nBins]);
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (bins[i] < 0)
+      continue;
+
+    Entry &e = entries_[counts[bins[i]]++];
+    e.x = keys[i].pt.x;
+    e.y = keys[i].pt.y;
+    e.octave = std::min(std::max(keys[i].octave, 0), levels_-1);
+    e.index = i;
+  }
+
+  // After filling, counts[b] is the end of bin b, so cell c ends at counts[c*levels+levels-1]
+  offsets_.resize(nCells+1);
+  offsets_[0] = 0;
+  for (int c = 0; c < nCells; c++)
+    offsets_[c+1] = counts[c*levels_+levels_-1];
+}
+
+bool FeatureGrid::PosInGrid(float x, float y, int &posX, int &posY) const {
+  posX = round((x-min_x_)*cell_width_inv_);
+  posY = round((y-min_y_)*cell_height_inv_);
+
+  // Keypoint's coordinates are undistorted, which could cause to go out of the image
+  if (posX < 0 || posX >= FRAME_GRID_COLS || posY < 0 || posY >= FRAME_GRID_ROWS)
+    return false;
+
+  return true;
+}
+
+void FeatureGrid::GetFeaturesInArea(float x, float y, float r, int minLevel, int maxLevel, vector<size_t> &indices) const {
+  indices.clear();
+  ForEachInArea(x, y, r, minLevel, maxLevel, [&indices](size_t idx) { indices.push_back(idx); });
+}
+
+bool FeatureGrid::CellRange(float x, float y, float r, int &minCellX, int &maxCellX, int &minCellY, int &maxCellY) const {
+  minCellX = std::max(0, static_cast<int>(floor((x-min_x_-r)*cell_width_inv_)));
+  if (minCellX >= FRAME_GRID_COLS)
+    return false;
+
+  maxCellX = std::min(FRAME_GRID_COLS-1, static_cast<int>(ceil((x-min_x_+r)*cell_width_inv_)));
+  if (maxCellX < 0)
+    return false;
+
+  minCellY = std::max(0, static_cast<int>(floor((y-min_y_-r)*cell_height_inv_)));
+  if (minCellY >= FRAME_GRID_ROWS)
+    return false;
+
+  maxCellY = std::min(FRAME_GRID_ROWS-1, static_cast<int>(ceil((y-min_y_+r)*cell_height_inv_)));
+  if (maxCellY < 0)
+    return false;
+
+  return true;
+}
+
+}  // namespace SD_SLAM
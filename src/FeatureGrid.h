@@ -0,0 +1,194 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SD_SLAM_FEATUREGRID_H_
+#define SD_SLAM_FEATUREGRID_H_
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <opencv2/core/core.hpp>
+
+namespace SD_SLAM {
+
+#define FRAME_GRID_ROWS 48
+#define FRAME_GRID_COLS 64
+
+// Keypoints bucketed in a regular grid over the undistorted image, stored in
+// compressed rows: one offsets array per cell and one flat array of entries.
+// Entries of a cell are sorted by octave, so level ranges are contiguous.
+// The grid is immutable once built and shared between a frame and its keyframe.
+class FeatureGrid {
+ public:
+  struct Entry {
+    float x;
+    float y;
+    int octave;
+    unsigned int index;
+  };
+
+  // Assign undistorted keypoints to cells. Bounds are those of the undistorted image.
+  FeatureGrid(const std::vector<cv::KeyPoint> &keys, int levels, float minX, float minY, float maxX, float maxY);
+
+  // Compute the cell of a point (return false if outside the grid)
+  bool PosInGrid(float x, float y, int &posX, int &posY) const;
+
+  // Indices of keypoints inside the square area of size 2r centered in (x, y),
+  // with octave in [minLevel, maxLevel] (negative values disable each limit).
+  // Indices are written into a caller provided buffer, which is cleared first.
+  void GetFeaturesInArea(float x, float y, float r, int minLevel, int maxLevel, std::vector<size_t> &indices) const;
+
+  // Same query calling visit(index) for every keypoint found, without intermediate buffers
+  template<typename Visitor>
+  void ForEachInArea(float x, float y, float r, int minLevel, int maxLevel, Visitor &&visit) const;
+
+  // Call visit(index) for every keypoint closer than r to the line a*x+b*y+c = 0.
+  // Only cells crossed by the band are scanned. Keypoints outside the grid are always visited.
+  template<typename Visitor>
+  void ForEachNearLine(float a, float b, float c, float r, Visitor &&visit) const;
+
+  inline size_t size() const { return entries_.size(); }
+
+ private:
+  // Range of cells touched by the area. Return false if it lies outside the grid
+  bool CellRange(float x, float y, float r, int &minCellX, int &maxCellX, int &minCellY, int &maxCellY) const;
+
+  // Range of cells containing coordinates in [v0, v1] along one axis. Return false if it is empty
+  static inline bool AxisRange(float v0, float v1, float min, float inv, int cells, int &first, int &last) {
+    // Cells are assigned by rounding, so cell i spans [i-0.5, i+0.5)
+    const float f0 = floor((v0-min)*inv+0.5f);
+    const float f1 = floor((v1-min)*inv+0.5f);
+    if (!(f1 >= 0 && f0 < cells))
+      return false;
+
+    first = f0 > 0 ? static_cast<int>(f0) : 0;
+    last = f1 < cells-1 ? static_cast<int>(f1) : cells-1;
+    return true;
+  }
+
+  int levels_;
+  float min_x_;
+  float min_y_;
+  float cell_width_inv_;
+  float cell_height_inv_;
+
+  // Entries of cell (ix, iy) are in [offsets_[c], offsets_[c+1]) with c = iy*FRAME_GRID_COLS+ix
+  std::vector<unsigned int> offsets_;
+  std::vector<Entry> entries_;
+
+  // Keypoints outside the grid, only returned by line queries
+  std::vector<unsigned int> outside_;
+};
+
+template<typename Visitor>
+void FeatureGrid::ForEachInArea(float x, float y, float r, int minLevel, int maxLevel, Visitor &&visit) const {
+  int minCellX, maxCellX, minCellY, maxCellY;
+  if (!CellRange(x, y, r, minCellX, maxCellX, minCellY, maxCellY))
+    return;
+
+  const int minOctave = std::max(0, minLevel);
+  const int maxOctave = maxLevel >= 0 ? maxLevel : levels_;
+  const bool checkLevels = minOctave > 0 || maxOctave < levels_-1;
+
+  for (int iy = minCellY; iy <= maxCellY; iy++) {
+    const int row = iy*FRAME_GRID_COLS;
+
+    // Cells of a row are consecutive, so without level limits they are a single range
+    if (!checkLevels) {
+      const Entry *e = entries_.data() + offsets_[row+minCellX];
+      const Entry *end = entries_.data() + offsets_[row+maxCellX+1];
+      for (; e != end; e++) {
+        if (std::fabs(e->x-x) < r && std::fabs(e->y-y) < r)
+          visit(static_cast<size_t>(e->index));
+      }
+      continue;
+    }
+
+    for (int ix = minCellX; ix <= maxCellX; ix++) {
+      const Entry *e = entries_.data() + offsets_[row+ix];
+      const Entry *end = entries_.data() + offsets_[row+ix+1];
+      for (; e != end; e++) {
+        if (e->octave < minOctave)
+          continue;
+        if (e->octave > maxOctave)
+          break;
+
+        if (std::fabs(e->x-x) < r && std::fabs(e->y-y) < r)
+          visit(static_cast<size_t>(e->index));
+      }
+    }
+  }
+}
+
+template<typename Visitor>
+void FeatureGrid::ForEachNearLine(float a, float b, float c, float r, Visitor &&visit) const {
+  for (unsigned int idx : outside_)
+    visit(static_cast<size_t>(idx));
+
+  // Points of the band satisfy |a*x+b*y+c| < r*|(a, b)|
+  const float band = r*std::sqrt(a*a+b*b);
+  if (band == 0)
+    return;
+
+  const float cellWidth = 1.0f/cell_width_inv_;
+  const float cellHeight = 1.0f/cell_height_inv_;
+
+  // Rows crossed by the band inside the grid
+  int minCellY = 0, maxCellY = FRAME_GRID_ROWS-1;
+  if (b != 0) {
+    const float x0 = min_x_-0.5f*cellWidth;
+    const float x1 = x0+FRAME_GRID_COLS*cellWidth;
+    const float lo = std::min(-a*x0, -a*x1)-c-band;
+    const float hi = std::max(-a*x0, -a*x1)-c+band;
+    const float y0 = b > 0 ? lo/b : hi/b;
+    const float y1 = b > 0 ? hi/b : lo/b;
+    if (!AxisRange(y0, y1, min_y_, cell_height_inv_, FRAME_GRID_ROWS, minCellY, maxCellY))
+      return;
+  }
+
+  // Cells of a row are consecutive, so the band crosses each row in a single range
+  for (int iy = minCellY; iy <= maxCellY; iy++) {
+    const float y0 = min_y_+(iy-0.5f)*cellHeight;
+    const float y1 = y0+cellHeight;
+
+    // Range of a*x inside the band for y in [y0, y1]
+    const float lo = std::min(-b*y0, -b*y1)-c-band;
+    const float hi = std::max(-b*y0, -b*y1)-c+band;
+
+    int minCellX = 0, maxCellX = FRAME_GRID_COLS-1;
+    if (a != 0) {
+      const float x0 = a > 0 ? lo/a : hi/a;
+      const float x1 = a > 0 ? hi/a : lo/a;
+      if (!AxisRange(x0, x1, min_x_, cell_width_inv_, FRAME_GRID_COLS, minCellX, maxCellX))
+        continue;
+    }
+
+    const int row = iy*FRAME_GRID_COLS;
+    const Entry *e = entries_.data() + offsets_[row+minCellX];
+    const Entry *end = entries_.data() + offsets_[row+maxCellX+1];
+    for (; e != end; e++) {
+      if (std::fabs(a*e->x+b*e->y+c) < band)
+        visit(static_cast<size_t>(e->index));
+    }
+  }
+}
+
+}  // namespace SD_SLAM
+
+#endif  // SD_SLAM_FEATUREGRID_H_
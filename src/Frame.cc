@@ -26,51 +26,46 @@
 #include <thread>
 #include "ORBmatcher.h"
 #include "Converter.h"
+#include "KeyFrameDatabase.h"
+#include "extra/profiler.h"
 
 using std::vector;
 
 namespace SD_SLAM {
 
-long unsigned int Frame::nNextId = 0;
-bool Frame::mbInitialComputations = true;
-float Frame::cx, Frame::cy, Frame::fx, Frame::fy, Frame::invfx, Frame::invfy;
-float Frame::mnMinX, Frame::mnMinY, Frame::mnMaxX, Frame::mnMaxY;
-float Frame::mfGridElementWidthInv, Frame::mfGridElementHeightInv;
-
-Frame::Frame() {
+Frame::Frame(): fx(0), fy(0), cx(0), cy(0), invfx(0), invfy(0), mTimeStamp(0), mnId(0),
+  mnMinX(0), mnMaxX(0), mnMinY(0), mnMaxY(0), mDepthScale(1.0f) {
   mTcw.setZero();
 }
 
 // Copy Constructor
 Frame::Frame(const Frame &frame): mpORBextractorLeft(frame.mpORBextractorLeft),
-  mK(frame.mK), mDistCoef(frame.mDistCoef.clone()), mbf(frame.mbf), mb(frame.mb), mThDepth(frame.mThDepth),
+  mK(frame.mK), fx(frame.fx), fy(frame.fy), cx(frame.cx), cy(frame.cy), invfx(frame.invfx), invfy(frame.invfy),
+  mDistCoef(frame.mDistCoef.clone()), mpUndistorter(frame.mpUndistorter), mbf(frame.mbf), mb(frame.mb), mThDepth(frame.mThDepth),
   N(frame.N), mvKeys(frame.mvKeys), mvKeysUn(frame.mvKeysUn), mvuRight(frame.mvuRight), mvDepth(frame.mvDepth),
-  mDescriptors(frame.mDescriptors.clone()), mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier),
-  mnId(frame.mnId), mpReferenceKF(frame.mpReferenceKF), mnScaleLevels(frame.mnScaleLevels),
+  mDescriptors(frame.mDescriptors), mvWords(frame.mvWords), mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier),
+  mTimeStamp(frame.mTimeStamp), mnId(frame.mnId), mpReferenceKF(frame.mpReferenceKF), mnScaleLevels(frame.mnScaleLevels),
   mfScaleFactor(frame.mfScaleFactor), mfLogScaleFactor(frame.mfLogScaleFactor), mvScaleFactors(frame.mvScaleFactors),
   mvInvScaleFactors(frame.mvInvScaleFactors), mvLevelSigma2(frame.mvLevelSigma2),
-  mvInvLevelSigma2(frame.mvInvLevelSigma2) {
-  for (int i = 0; i < FRAME_GRID_COLS; i++)
-    for (int j = 0; j < FRAME_GRID_ROWS; j++)
-      mGrid[i][j] = frame.mGrid[i][j];
-
+  mvInvLevelSigma2(frame.mvInvLevelSigma2), mnMinX(frame.mnMinX), mnMaxX(frame.mnMaxX),
+  mnMinY(frame.mnMinY), mnMaxY(frame.mnMaxY), mDepthScale(frame.mDepthScale) {
   SetPose(frame.mTcw);
 
-  // Copy pyramid
-  int size = frame.mvImagePyramid.size();
-  mvImagePyramid.resize(size);
-  for (int i = 0; i < size; i++)
-    mvImagePyramid[i] = frame.mvImagePyramid[i].clone();
-
-  mDepthImage = frame.mDepthImage.clone();
+  // Share grid, pyramid and depth buffers
+  mpGrid = frame.mpGrid;
+  mvImagePyramid = frame.mvImagePyramid;
+  mDepthImage = frame.mDepthImage;
 }
 
 
 Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, ORBextractor* extractor,
-  const Eigen::Matrix3d &K, cv::Mat &distCoef, const float &bf, const float &thDepth) :
-  mpORBextractorLeft(extractor), mK(K), mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth) {
-  // Frame ID
-  mnId = nNextId++;
+  const Eigen::Matrix3d &K, cv::Mat &distCoef, const float &bf, const float &thDepth,
+  const std::shared_ptr<const Undistorter> &undistorter, float depthScale) :
+  mpORBextractorLeft(extractor), mK(K), mDistCoef(distCoef.clone()), mpUndistorter(undistorter), mbf(bf), mThDepth(thDepth),
+  mDepthScale(depthScale) {
+  // Frame ID and capture time (set by the tracking)
+  mnId = 0;
+  mTimeStamp = 0;
 
   mTcw.setZero();
 
@@ -83,6 +78,8 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, ORBextractor* extrac
   mvLevelSigma2 = mpORBextractorLeft->GetScaleSigmaSquares();
   mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
+  ComputeCalibration(imGray.size());
+
   // ORB extraction
   ExtractORB(imGray);
 
@@ -93,40 +90,23 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, ORBextractor* extrac
 
   UndistortKeyPoints();
 
-  ComputeStereoFromRGBD(imDepth);
-  mDepthImage = imDepth.clone();
+  ComputeStereoFromRGBD(imDepth, mDepthScale);
+  mDepthImage = imDepth;
 
   mvpMapPoints = vector<MapPoint*>(N, static_cast<MapPoint*>(NULL));
   mvbOutlier = vector<bool>(N, false);
 
-  // This is done only for the first Frame
-  if (mbInitialComputations) {
-    ComputeImageBounds(imGray);
-
-    mfGridElementWidthInv = static_cast<float>(FRAME_GRID_COLS)/static_cast<float>(mnMaxX-mnMinX);
-    mfGridElementHeightInv = static_cast<float>(FRAME_GRID_ROWS)/static_cast<float>(mnMaxY-mnMinY);
-
-    fx = K(0, 0);
-    fy = K(1, 1);
-    cx = K(0, 2);
-    cy = K(1, 2);
-    invfx = 1.0f/fx;
-    invfy = 1.0f/fy;
-
-    mbInitialComputations = false;
-  }
-
-  mb = mbf/fx;
-
   AssignFeaturesToGrid();
 }
 
 
 Frame::Frame(const cv::Mat &imGray, ORBextractor* extractor, const Eigen::Matrix3d &K,
-  cv::Mat &distCoef, const float &bf, const float &thDepth) :
-  mpORBextractorLeft(extractor), mK(K), mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth) {
-  // Frame ID
-  mnId=nNextId++;
+  cv::Mat &distCoef, const float &bf, const float &thDepth, const std::shared_ptr<const Undistorter> &undistorter) :
+  mpORBextractorLeft(extractor), mK(K), mDistCoef(distCoef.clone()), mpUndistorter(undistorter), mbf(bf), mThDepth(thDepth),
+  mDepthScale(1.0f) {
+  // Frame ID and capture time (set by the tracking)
+  mnId = 0;
+  mTimeStamp = 0;
 
   mTcw.setZero();
 
@@ -139,6 +119,8 @@ Frame::Frame(const cv::Mat &imGray, ORBextractor* extractor, const Eigen::Matrix
   mvLevelSigma2 = mpORBextractorLeft->GetScaleSigmaSquares();
   mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
+  ComputeCalibration(imGray.size());
+
   // ORB extraction
   ExtractORB(imGray);
 
@@ -156,47 +138,61 @@ Frame::Frame(const cv::Mat &imGray, ORBextractor* extractor, const Eigen::Matrix
   mvpMapPoints = vector<MapPoint*>(N, static_cast<MapPoint*>(NULL));
   mvbOutlier = vector<bool>(N, false);
 
-  // This is done only for the first Frame (or after a change in the calibration)
-  if (mbInitialComputations) {
-    ComputeImageBounds(imGray);
+  AssignFeaturesToGrid();
+}
 
-    mfGridElementWidthInv = static_cast<float>(FRAME_GRID_COLS)/static_cast<float>(mnMaxX-mnMinX);
-    mfGridElementHeightInv = static_cast<float>(FRAME_GRID_ROWS)/static_cast<float>(mnMaxY-mnMinY);
+Frame::Frame(const vector<cv::KeyPoint> &keys, const vector<cv::KeyPoint> &keysUn, const vector<float> &depth,
+  const cv::Mat &descriptors, const cv::Size &imSize, ORBextractor* extractor, const Eigen::Matrix3d &K,
+  cv::Mat &distCoef, const float &bf, const float &thDepth) :
+  mpORBextractorLeft(extractor), mK(K), mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth),
+  mvKeys(keys), mvKeysUn(keysUn), mvDepth(depth), mDescriptors(descriptors), mDepthScale(1.0f) {
+  // Frame ID and capture time (set by the tracking)
+  mnId = 0;
+  mTimeStamp = 0;
 
-    fx = K(0, 0);
-    fy = K(1, 1);
-    cx = K(0, 2);
-    cy = K(1, 2);
-    invfx = 1.0f/fx;
-    invfy = 1.0f/fy;
+  mTcw.setZero();
 
-    mbInitialComputations = false;
+  // Scale Level Info
+  mnScaleLevels = mpORBextractorLeft->GetLevels();
+  mfScaleFactor = mpORBextractorLeft->GetScaleFactor();
+  mfLogScaleFactor = log(mfScaleFactor);
+  mvScaleFactors = mpORBextractorLeft->GetScaleFactors();
+  mvInvScaleFactors = mpORBextractorLeft->GetInverseScaleFactors();
+  mvLevelSigma2 = mpORBextractorLeft->GetScaleSigmaSquares();
+  mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
+
+  ComputeCalibration(imSize);
+
+  N = mvKeys.size();
+
+  // Stereo coordinate from depth
+  mvuRight = vector<float>(N, -1);
+  for (int i = 0; i < N; i++) {
+    if (mvDepth[i] > 0)
+      mvuRight[i] = mvKeysUn[i].pt.x-mbf/mvDepth[i];
   }
 
-  mb = mbf/fx;
+  mvpMapPoints = vector<MapPoint*>(N, static_cast<MapPoint*>(NULL));
+  mvbOutlier = vector<bool>(N, false);
 
   AssignFeaturesToGrid();
 }
 
 void Frame::AssignFeaturesToGrid() {
-  int nReserve = 0.5f*N/(FRAME_GRID_COLS*FRAME_GRID_ROWS);
-  for (unsigned int i = 0; i < FRAME_GRID_COLS; i++)
-    for (unsigned int j = 0; j < FRAME_GRID_ROWS; j++)
-      mGrid[i][j].reserve(nReserve);
-
-  for (int i = 0; i < N; i++) {
-    const cv::KeyPoint &kp = mvKeysUn[i];
-
-    int nGridPosX, nGridPosY;
-    if (PosInGrid(kp, nGridPosX, nGridPosY))
-      mGrid[nGridPosX][nGridPosY].push_back(i);
-  }
+  mpGrid = std::make_shared<const FeatureGrid>(mvKeysUn, mnScaleLevels, mnMinX, mnMinY, mnMaxX, mnMaxY);
 }
 
 void Frame::ExtractORB(const cv::Mat &im) {
+  ScopedProfile profile(Profiler::EXTRACTION);
+
   (*mpORBextractorLeft)(im, cv::Mat(), mvKeys, mDescriptors, mvImagePyramid);
 }
 
+void Frame::ComputeWords() {
+  if (mvWords.empty())
+    KeyFrameDatabase::ComputeWords(mDescriptors, mvWords);
+}
+
 void Frame::SetPose(const Eigen::Matrix4d &Tcw) {
   Eigen::Matrix4d m = Tcw;  // Somehow it fixes problems with Eigen
   mTcw = m;
@@ -272,140 +268,85 @@ bool Frame::isInFrustum(MapPoint *pMP, float viewingCosLimit) {
 
 vector<size_t> Frame::GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel) const {
   vector<size_t> vIndices;
-  vIndices.reserve(N);
-
-  const int nMinCellX = std::max(0, static_cast<int>(floor((x-mnMinX-r)*mfGridElementWidthInv)));
-  if (nMinCellX >= FRAME_GRID_COLS)
-    return vIndices;
-
-  const int nMaxCellX = std::min(static_cast<int>(FRAME_GRID_COLS-1),
-                                 static_cast<int>(ceil((x-mnMinX+r)*mfGridElementWidthInv)));
-  if (nMaxCellX < 0)
-    return vIndices;
-
-  const int nMinCellY = std::max(0, static_cast<int>(floor((y-mnMinY-r)*mfGridElementHeightInv)));
-  if (nMinCellY >= FRAME_GRID_ROWS)
-    return vIndices;
-
-  const int nMaxCellY = std::min(static_cast<int>(FRAME_GRID_ROWS-1),
-                                 static_cast<int>(ceil((y-mnMinY+r)*mfGridElementHeightInv)));
-  if (nMaxCellY < 0)
-    return vIndices;
-
-  const bool bCheckLevels = (minLevel > 0) || (maxLevel >= 0);
-
-  for (int ix = nMinCellX; ix <= nMaxCellX; ix++) {
-    for (int iy = nMinCellY; iy <= nMaxCellY; iy++) {
-      const vector<size_t> vCell = mGrid[ix][iy];
-      if (vCell.empty())
-        continue;
-
-      for (size_t j = 0, jend=vCell.size(); j < jend; j++) {
-        const cv::KeyPoint &kpUn = mvKeysUn[vCell[j]];
-        if (bCheckLevels) {
-          if (kpUn.octave < minLevel)
-            continue;
-          if (maxLevel >= 0)
-            if (kpUn.octave > maxLevel)
-              continue;
-        }
-
-        const float distx = kpUn.pt.x-x;
-        const float disty = kpUn.pt.y-y;
-
-        if (fabs(distx) < r && fabs(disty) < r)
-          vIndices.push_back(vCell[j]);
-      }
-    }
-  }
-
+  GetFeaturesInArea(x, y, r, minLevel, maxLevel, vIndices);
   return vIndices;
 }
 
-bool Frame::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY) {
-  posX = round((kp.pt.x-mnMinX)*mfGridElementWidthInv);
-  posY = round((kp.pt.y-mnMinY)*mfGridElementHeightInv);
+void Frame::GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel,
+                              vector<size_t> &vIndices) const {
+  vIndices.clear();
+  if (mpGrid)
+    mpGrid->GetFeaturesInArea(x, y, r, minLevel, maxLevel, vIndices);
+}
 
-  // Keypoint's coordinates are undistorted, which could cause to go out of the image
-  if (posX < 0 || posX >= FRAME_GRID_COLS || posY < 0 || posY >= FRAME_GRID_ROWS)
+bool Frame::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY) {
+  if (!mpGrid)
     return false;
 
-  return true;
+  return mpGrid->PosInGrid(kp.pt.x, kp.pt.y, posX, posY);
 }
 
 
 void Frame::UndistortKeyPoints() {
-  if (mDistCoef.at<float>(0) == 0.0) {
-    mvKeysUn = mvKeys;
+  if (mpUndistorter) {
+    mpUndistorter->UndistortKeyPoints(mvKeys, mvKeysUn);
     return;
   }
 
-  // Fill matrix with points
-  cv::Mat mat(N, 2, CV_32F);
-  for (int i = 0; i < N; i++) {
-    mat.at<float>(i, 0) = mvKeys[i].pt.x;
-    mat.at<float>(i, 1) = mvKeys[i].pt.y;
-  }
+  mvKeysUn = mvKeys;
+  if (mDistCoef.at<float>(0) == 0.0)
+    return;
 
   // Undistort points
-  mat = mat.reshape(2);
-  cv::Mat mK_cv = Converter::toCvMat(mK);
-  cv::undistortPoints(mat, mat, mK_cv, mDistCoef, cv::Mat(), mK_cv);
-  mat = mat.reshape(1);
+  vector<cv::Point2f> points(N);
+  for (int i = 0; i < N; i++)
+    points[i] = mvKeys[i].pt;
+  Undistorter::UndistortPoints(mK, mDistCoef, points);
 
-  // Fill undistorted keypoint vector
-  mvKeysUn.resize(N);
-  for (int i = 0; i < N; i++) {
-    cv::KeyPoint kp = mvKeys[i];
-    kp.pt.x = mat.at<float>(i, 0);
-    kp.pt.y = mat.at<float>(i, 1);
-    mvKeysUn[i] = kp;
-  }
+  for (int i = 0; i < N; i++)
+    mvKeysUn[i].pt = points[i];
 }
 
-void Frame::ComputeImageBounds(const cv::Mat &imLeft) {
-  if (mDistCoef.at<float>(0) != 0.0) {
-    cv::Mat mat(4, 2, CV_32F);
-    mat.at<float>(0, 0) = 0.0;
-    mat.at<float>(0, 1) = 0.0;
-    mat.at<float>(1, 0) = imLeft.cols;
-    mat.at<float>(1, 1) = 0.0;
-    mat.at<float>(2, 0) = 0.0;
-    mat.at<float>(2, 1) = imLeft.rows;
-    mat.at<float>(3, 0) = imLeft.cols;
-    mat.at<float>(3, 1) = imLeft.rows;
-
-    // Undistort corners
-    mat = mat.reshape(2);
-    cv::Mat mK_cv = Converter::toCvMat(mK);
-    cv::undistortPoints(mat, mat, mK_cv, mDistCoef, cv::Mat(), mK_cv);
-    mat = mat.reshape(1);
-
-    mnMinX = std::min(mat.at<float>(0, 0), mat.at<float>(2, 0));
-    mnMaxX = std::max(mat.at<float>(1, 0), mat.at<float>(3, 0));
-    mnMinY = std::min(mat.at<float>(0, 1), mat.at<float>(1, 1));
-    mnMaxY = std::max(mat.at<float>(2, 1), mat.at<float>(3, 1));
-
+void Frame::ComputeImageBounds(const cv::Size &imSize) {
+  if (mpUndistorter) {
+    mnMinX = mpUndistorter->MinX();
+    mnMaxX = mpUndistorter->MaxX();
+    mnMinY = mpUndistorter->MinY();
+    mnMaxY = mpUndistorter->MaxY();
   } else {
-    mnMinX = 0.0f;
-    mnMaxX = imLeft.cols;
-    mnMinY = 0.0f;
-    mnMaxY = imLeft.rows;
+    Undistorter::ImageBounds(mK, mDistCoef, imSize, mnMinX, mnMaxX, mnMinY, mnMaxY);
   }
 }
 
-void Frame::ComputeStereoFromRGBD(const cv::Mat &imDepth) {
+void Frame::ComputeCalibration(const cv::Size &imSize) {
+  fx = mK(0, 0);
+  fy = mK(1, 1);
+  cx = mK(0, 2);
+  cy = mK(1, 2);
+  invfx = 1.0f/fx;
+  invfy = 1.0f/fy;
+
+  mb = mbf/fx;
+
+  ComputeImageBounds(imSize);
+}
+
+void Frame::ComputeStereoFromRGBD(const cv::Mat &imDepth, float depthScale) {
   mvuRight = vector<float>(N, -1);
   mvDepth = vector<float>(N, -1);
 
+  // Raw sensor depth is scaled at each keypoint instead of converting the whole image
+  const bool raw = imDepth.type() == CV_16U;
+  assert(raw || imDepth.type() == CV_32F);
+
   for (int i = 0; i < N; i++) {
     const cv::KeyPoint &kp = mvKeys[i];
     const cv::KeyPoint &kpU = mvKeysUn[i];
 
-    const float &v = kp.pt.y;
-    const float &u = kp.pt.x;
+    const int v = kp.pt.y;
+    const int u = kp.pt.x;
 
-    const float d = imDepth.at<float>(v, u);
+    const float d = (raw ? imDepth.at<ushort>(v, u) : imDepth.at<float>(v, u))*depthScale;
 
     if (d > 0) {
       mvDepth[i] = d;
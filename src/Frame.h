@@ -26,17 +26,17 @@
 #define SD_SLAM_FRAME_H
 
 #include <vector>
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include <Eigen/Dense>
 #include "MapPoint.h"
 #include "KeyFrame.h"
 #include "ORBextractor.h"
+#include "FeatureGrid.h"
+#include "Undistorter.h"
 
 namespace SD_SLAM {
 
-#define FRAME_GRID_ROWS 48
-#define FRAME_GRID_COLS 64
-
 class MapPoint;
 class KeyFrame;
 
@@ -44,18 +44,37 @@ class Frame {
  public:
   Frame();
 
-  // Copy constructor.
+  // Copy constructor. Image buffers are shared, not cloned.
   Frame(const Frame &frame);
 
-  // Constructor for RGB-D cameras.
-  Frame(const cv::Mat &imGray, const cv::Mat &imDepth, ORBextractor* extractor, const Eigen::Matrix3d &K, cv::Mat &distCoef, const float &bf, const float &thDepth);
+  // Move constructor and assignments.
+  Frame(Frame &&frame) = default;
+  Frame& operator=(const Frame &frame) = default;
+  Frame& operator=(Frame &&frame) = default;
+
+  // Constructor for RGB-D cameras. Depth buffer is shared, so it must not be modified afterwards.
+  // Depth can be raw sensor values (CV_16U) or float (CV_32F), and depthScale converts them to meters.
+  // Keypoints are undistorted with the undistorter if given (it must match the calibration
+  // and image size), or with cv::undistortPoints otherwise.
+  Frame(const cv::Mat &imGray, const cv::Mat &imDepth, ORBextractor* extractor, const Eigen::Matrix3d &K, cv::Mat &distCoef, const float &bf, const float &thDepth,
+        const std::shared_ptr<const Undistorter> &undistorter = nullptr, float depthScale = 1.0f);
 
   // Constructor for Monocular cameras.
-  Frame(const cv::Mat &imGray, ORBextractor* extractor, const Eigen::Matrix3d &K, cv::Mat &distCoef, const float &bf, const float &thDepth);
+  Frame(const cv::Mat &imGray, ORBextractor* extractor, const Eigen::Matrix3d &K, cv::Mat &distCoef, const float &bf, const float &thDepth,
+        const std::shared_ptr<const Undistorter> &undistorter = nullptr);
+
+  // Constructor from already extracted features (used to load maps). Depth is negative for monocular keypoints.
+  // Extractor only provides scale information.
+  Frame(const std::vector<cv::KeyPoint> &keys, const std::vector<cv::KeyPoint> &keysUn, const std::vector<float> &depth,
+        const cv::Mat &descriptors, const cv::Size &imSize, ORBextractor* extractor, const Eigen::Matrix3d &K,
+        cv::Mat &distCoef, const float &bf, const float &thDepth);
 
   // Extract ORB on the image
   void ExtractORB(const cv::Mat &im);
 
+  // Compute visual words used by the keyframe database. Called in relocalization.
+  void ComputeWords();
+
   // Set the camera pose.
   void SetPose(const Eigen::Matrix4d &Tcw);
 
@@ -91,8 +110,21 @@ class Frame {
 
   std::vector<size_t> GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel=-1, const int maxLevel=-1) const;
 
+  // Same as above writing into a reusable buffer, to avoid allocations in matching loops
+  void GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel,
+                         std::vector<size_t> &vIndices) const;
+
+  // Call visit(index) for each keypoint in the area, without intermediate buffers
+  template<typename Visitor>
+  inline void ForEachFeatureInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel,
+                                   Visitor &&visit) const {
+    if (mpGrid)
+      mpGrid->ForEachInArea(x, y, r, minLevel, maxLevel, std::forward<Visitor>(visit));
+  }
+
   // Associate a "right" coordinate to a keypoint if there is valid depth in the depthmap.
-  void ComputeStereoFromRGBD(const cv::Mat &imDepth);
+  // Depth is only read at keypoints, scaled to meters with depthScale.
+  void ComputeStereoFromRGBD(const cv::Mat &imDepth, float depthScale = 1.0f);
 
   // Backprojects a keypoint (if stereo/depth info available) into 3D world coordinates.
   Eigen::Vector3d UnprojectStereo(const int &i);
@@ -106,14 +138,17 @@ class Frame {
 
   // Calibration matrix and OpenCV distortion parameters.
   Eigen::Matrix3d mK;
-  static float fx;
-  static float fy;
-  static float cx;
-  static float cy;
-  static float invfx;
-  static float invfy;
+  float fx;
+  float fy;
+  float cx;
+  float cy;
+  float invfx;
+  float invfy;
   cv::Mat mDistCoef;
 
+  // Undistortion lookup of the camera, shared by all its frames (can be null).
+  std::shared_ptr<const Undistorter> mpUndistorter;
+
   // Stereo baseline multiplied by fx.
   float mbf;
 
@@ -140,6 +175,9 @@ class Frame {
   // ORB descriptor, each row associated to a keypoint.
   cv::Mat mDescriptors;
 
+  // Visual words (quantized descriptors).
+  std::vector<unsigned int> mvWords;
+
   // MapPoints associated to keypoints, NULL pointer if no association.
   std::vector<MapPoint*> mvpMapPoints;
 
@@ -147,16 +185,17 @@ class Frame {
   std::vector<bool> mvbOutlier;
 
   // Keypoints are assigned to cells in a grid to reduce matching complexity when projecting MapPoints.
-  static float mfGridElementWidthInv;
-  static float mfGridElementHeightInv;
-  std::vector<std::size_t> mGrid[FRAME_GRID_COLS][FRAME_GRID_ROWS];
+  // Grid is never modified after creation, so it is shared between copies and keyframes.
+  std::shared_ptr<const FeatureGrid> mpGrid;
 
   // Camera pose.
   Eigen::Matrix4d mTcw;
   Eigen::Matrix4d mTwc;
 
-  // Current and Next Frame id.
-  static long unsigned int nNextId;
+  // Capture time in seconds, used by the motion model.
+  double mTimeStamp;
+
+  // Frame id, assigned by the tracking from the ids of its map.
   long unsigned int mnId;
 
   // Reference Keyframe.
@@ -171,17 +210,19 @@ class Frame {
   std::vector<float> mvLevelSigma2;
   std::vector<float> mvInvLevelSigma2;
 
-  // Undistorted Image Bounds (computed once).
-  static float mnMinX;
-  static float mnMaxX;
-  static float mnMinY;
-  static float mnMaxY;
+  // Undistorted Image Bounds.
+  float mnMinX;
+  float mnMaxX;
+  float mnMinY;
+  float mnMaxY;
 
-  static bool mbInitialComputations;
-
-  // Image pyramid
+  // Image pyramid. Buffers are allocated for each frame and never modified
+  // afterwards, so they are shared between copies.
   std::vector<cv::Mat> mvImagePyramid;
+
+  // Depth as received (CV_16U or CV_32F) and the scale from its values to meters.
   cv::Mat mDepthImage;
+  float mDepthScale;
 
  private:
   // Undistort keypoints given OpenCV distortion parameters.
@@ -190,7 +231,11 @@ class Frame {
   void UndistortKeyPoints();
 
   // Computes image bounds for the undistorted image (called in the constructor).
-  void ComputeImageBounds(const cv::Mat &imLeft);
+  void ComputeImageBounds(const cv::Size &imSize);
+
+  // Camera parameters and image bounds from calibration (called in the constructor).
+  // They are kept in each frame so systems with different cameras can run in the same process.
+  void ComputeCalibration(const cv::Size &imSize);
 
   // Assign keypoints to the grid for speed up feature matching (called in the constructor).
   void AssignFeaturesToGrid();
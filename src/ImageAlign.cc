@@ -18,8 +18,10 @@
  */
 
 #include "ImageAlign.h"
+#include "Config.h"
 #include "extra/timer.h"
 #include "extra/log.h"
+#include "extra/profiler.h"
 
 using std::vector;
 using std::endl;
@@ -27,6 +29,20 @@ using std::set;
 
 namespace SD_SLAM {
 
+// Bilinear interpolation of 4 consecutive pixels starting at column x.
+// Weights are top-left, top-right, bottom-left and bottom-right.
+static inline Eigen::Array4f InterpolateRow(const uint8_t *row_ptr, const uint8_t *row_next_ptr, int x,
+                                            const Eigen::Array4f &w) {
+  const Eigen::Array4f tl(row_ptr[x], row_ptr[x+1], row_ptr[x+2], row_ptr[x+3]);
+  const Eigen::Array4f tr(row_ptr[x+1], row_ptr[x+2], row_ptr[x+3], row_ptr[x+4]);
+  const Eigen::Array4f bl(row_next_ptr[x], row_next_ptr[x+1], row_next_ptr[x+2], row_next_ptr[x+3]);
+  const Eigen::Array4f br(row_next_ptr[x+1], row_next_ptr[x+2], row_next_ptr[x+3], row_next_ptr[x+4]);
+  return w(0)*tl + w(1)*tr + w(2)*bl + w(3)*br;
+}
+
+const int ImageAlign::MIN_LEVEL = 2;
+const int ImageAlign::MAX_LEVEL = 4;
+
 ImageAlign::ImageAlign() {
   stop_ = false;
   chi2_ = 1e10;
@@ -34,16 +50,21 @@ ImageAlign::ImageAlign() {
   n_meas_ = 0;
 
   patch_size_ = 4;
-  max_level_ = 4;
-  min_level_ = 2;
+  max_level_ = MAX_LEVEL;
+  min_level_ = MIN_LEVEL;
   max_its_ = 30;
+
+  // Vectorized path works with 4x4 patches
+  use_float_ = Config::AlignFloat() && patch_size_ == 4;
 }
 
 ImageAlign::~ImageAlign() {
 }
 
 bool ImageAlign::ComputePose(Frame &CurrentFrame, const Frame &LastFrame) {
-  int size, patch_area, counter;
+  ScopedProfile profile(Profiler::IMAGE_ALIGN);
+
+  int size, counter;
   float scale;
   int max_points = 300;
 
@@ -77,17 +98,14 @@ bool ImageAlign::ComputePose(Frame &CurrentFrame, const Frame &LastFrame) {
     return false;
   }
 
-  patch_area = patch_size_*patch_size_;
-  patch_cache_ = cv::Mat(size, patch_area, CV_32F);
-  visible_pts_.resize(size, false);
-  jacobian_cache_.resize(Eigen::NoChange, size*patch_area);
+  ResizeCaches(size);
 
   // Initial displacement between frames.
   Eigen::Matrix4d current_se3 = CurrentFrame.GetPose() * LastFrame.GetPoseInverse();
   Eigen::Matrix4d last_pose = LastFrame.GetPose();
 
   for (int level = max_level_; level >= min_level_; level--) {
-    jacobian_cache_.setZero();
+    ResetJacobians();
 
     scale = CurrentFrame.mvInvScaleFactors[level];
     Optimize(CurrentFrame.mvImagePyramid[level], LastFrame.mvImagePyramid[level], last_pose, current_se3, scale);
@@ -104,7 +122,9 @@ bool ImageAlign::ComputePose(Frame &CurrentFrame, const Frame &LastFrame) {
 }
 
 bool ImageAlign::ComputePose(Frame &CurrentFrame, KeyFrame *LastKF, bool fast) {
-  int size, patch_area, counter;
+  ScopedProfile profile(Profiler::IMAGE_ALIGN);
+
+  int size, counter;
   float scale;
   int max_points;
 
@@ -141,20 +161,17 @@ bool ImageAlign::ComputePose(Frame &CurrentFrame, KeyFrame *LastKF, bool fast) {
     return false;
   }
 
-  patch_area = patch_size_*patch_size_;
-  patch_cache_ = cv::Mat(size, patch_area, CV_32F);
-  visible_pts_.resize(size, false);
-  jacobian_cache_.resize(Eigen::NoChange, size*patch_area);
+  ResizeCaches(size);
 
   // Initial displacement between frames.
   Eigen::Matrix4d current_se3 = CurrentFrame.GetPose() * LastKF->GetPoseInverse();
   Eigen::Matrix4d last_pose = LastKF->GetPose();
 
   for (int level = max_level_; level >= min_level_; level--) {
-    jacobian_cache_.setZero();
+    ResetJacobians();
 
     scale = CurrentFrame.mvInvScaleFactors[level];
-    Optimize(CurrentFrame.mvImagePyramid[level], LastKF->mvImagePyramid[level], last_pose, current_se3, scale);
+    Optimize(CurrentFrame.mvImagePyramid[level], LastKF->GetImage(level), last_pose, current_se3, scale);
 
     // High error in max level means frames are not close, skip other levels
     if (fast && error_ > 0.01) {
@@ -176,7 +193,9 @@ bool ImageAlign::ComputePose(Frame &CurrentFrame, KeyFrame *LastKF, bool fast) {
 }
 
 bool ImageAlign::ComputePose(KeyFrame *CurrentKF, KeyFrame *LastKF) {
-  int size, patch_area, counter;
+  ScopedProfile profile(Profiler::IMAGE_ALIGN);
+
+  int size, counter;
   float scale;
   int max_points = 100;
 
@@ -185,7 +204,7 @@ bool ImageAlign::ComputePose(KeyFrame *CurrentKF, KeyFrame *LastKF) {
   cam_cx_ = CurrentKF->cx;
   cam_cy_ = CurrentKF->cy;
 
-  if (static_cast<int>(CurrentKF->mvImagePyramid.size()) <= max_level_) {
+  if (CurrentKF->mnScaleLevels <= max_level_) {
     LOGE("Not enough pyramid levels");
     return false;
   }
@@ -206,10 +225,7 @@ bool ImageAlign::ComputePose(KeyFrame *CurrentKF, KeyFrame *LastKF) {
     return false;
   }
 
-  patch_area = patch_size_*patch_size_;
-  patch_cache_ = cv::Mat(size, patch_area, CV_32F);
-  visible_pts_.resize(size, false);
-  jacobian_cache_.resize(Eigen::NoChange, size*patch_area);
+  ResizeCaches(size);
 
   // Initial displacement between frames.
   Eigen::Matrix4d current_se3 = Eigen::Matrix4d::Identity();
@@ -217,10 +233,10 @@ bool ImageAlign::ComputePose(KeyFrame *CurrentKF, KeyFrame *LastKF) {
 
   // Only last level
   int level = max_level_;
-  jacobian_cache_.setZero();
+  ResetJacobians();
 
   scale = 1.0/CurrentKF->mvScaleFactors[level];
-  Optimize(CurrentKF->mvImagePyramid[level], LastKF->mvImagePyramid[level], last_pose, current_se3, scale);
+  Optimize(CurrentKF->GetImage(level), LastKF->GetImage(level), last_pose, current_se3, scale);
 
   // High error in max level means frames are not close, skip other levels
   if (error_ > 0.03) {
@@ -244,7 +260,11 @@ void ImageAlign::Optimize(const cv::Mat &src, const cv::Mat &last_img, const Eig
 
     // compute initial error
     n_meas_ = 0;
-    double new_chi2 = ComputeResiduals(src, last_img, last_pose, se3, scale, i == 0);
+    double new_chi2;
+    if (use_float_)
+      new_chi2 = ComputeResidualsFloat(src, last_img, last_pose, se3, scale, i == 0);
+    else
+      new_chi2 = ComputeResiduals(src, last_img, last_pose, se3, scale, i == 0);
     if (n_meas_ == 0)
       stop_ = true;
 
@@ -420,6 +440,158 @@ void ImageAlign::PrecomputePatches(const cv::Mat &src, const Eigen::Matrix4d &po
   }
 }
 
+double ImageAlign::ComputeResidualsFloat(const cv::Mat &src, const cv::Mat &last_img, const Eigen::Matrix4d &last_pose,
+                                         const Eigen::Matrix4d &se3, float scale, bool patches) {
+  Eigen::Vector2d p2d;
+  const int half_patch = 2;
+  const int border = half_patch+1;
+
+  // Compute patches only the first time
+  if (patches)
+    PrecomputePatchesFloat(last_img, last_pose, scale);
+
+  Eigen::Matrix4d pose = se3 * last_pose;
+  Eigen::Matrix3d R = pose.block<3, 3>(0, 0);
+  Eigen::Vector3d T = pose.block<3, 1>(0, 3);
+
+  Eigen::Matrix<float, 16, 1> res;
+  Eigen::Matrix<float, 6, 6> H;
+  Eigen::Matrix<float, 6, 1> Jres;
+  float chi2 = 0.0;
+  size_t counter = 0;
+  vector<bool>::iterator vit = visible_pts_.begin();
+
+  // Check each point detected in last image
+  for (auto it=points_.begin(); it != points_.end(); it++, counter++, vit++) {
+    // check if point is within image
+    if (!*vit)
+      continue;
+
+    // Project in current frame with candidate pose and check if it fits within image
+    if(!Project(R, T, *it, p2d))
+      continue;
+
+    const float u_cur = p2d(0)*scale;
+    const float v_cur = p2d(1)*scale;
+    const int u_last_i = floorf(u_cur);
+    const int v_last_i = floorf(v_cur);
+    if (u_last_i < 0 || v_last_i < 0 || u_last_i-border < 0 || v_last_i-border < 0 || u_last_i+border >= src.cols || v_last_i+border >= src.rows)
+      continue;
+
+    // compute bilateral interpolation weights for the current image
+    const float subpix_u_cur = u_cur-u_last_i;
+    const float subpix_v_cur = v_cur-v_last_i;
+    const Eigen::Array4f w((1.0f-subpix_u_cur) * (1.0f-subpix_v_cur), subpix_u_cur * (1.0f-subpix_v_cur),
+                           (1.0f-subpix_u_cur) * subpix_v_cur, subpix_u_cur * subpix_v_cur);
+
+    // Residuals of the whole patch, one row at a time
+    const float* patch_cache_ptr = reinterpret_cast<float*>(patch_cache_.data) + 16*counter;
+    const int x = u_last_i-half_patch;
+    for (int i = 0; i < 4; i++) {
+      const int y = v_last_i-half_patch+i;
+      res.segment<4>(4*i) = (InterpolateRow(src.ptr<uint8_t>(y), src.ptr<uint8_t>(y+1), x, w)
+                             - Eigen::Map<const Eigen::Array4f>(patch_cache_ptr+4*i)).matrix();
+    }
+
+    chi2 += res.squaredNorm();
+    n_meas_ += 16;
+
+    // Accumulate patch in single precision and add it to the system
+    const auto J = jacobian_float_.block<16, 6>(16*counter, 0);
+    H.noalias() = J.transpose()*J;
+    Jres.noalias() = J.transpose()*res;
+    H_ += H.cast<double>();
+    Jres_ -= Jres.cast<double>();
+  }
+
+  return chi2/n_meas_;
+}
+
+void ImageAlign::PrecomputePatchesFloat(const cv::Mat &src, const Eigen::Matrix4d &pose, float scale) {
+  Eigen::Vector2d p2d;
+  const int half_patch = 2;
+  const int border = half_patch+1;
+
+  Eigen::Matrix3d R = pose.block<3, 3>(0, 0);
+  Eigen::Vector3d T = pose.block<3, 1>(0, 3);
+
+  size_t counter = 0;
+  Eigen::Matrix<double, 2, 6> frame_jac;
+  vector<bool>::iterator vit = visible_pts_.begin();
+
+  // Check each point detected in last image
+  for (auto it=points_.begin(); it != points_.end(); it++, counter++, vit++) {
+    const Eigen::Vector3d &p = *it;
+
+    // Project in last frame and check if it fits within image
+    if(!Project(R, T, p, p2d))
+      continue;
+
+    const float u_ref = p2d(0)*scale;
+    const float v_ref = p2d(1)*scale;
+    const int u_first_i = floorf(u_ref);
+    const int v_first_i = floorf(v_ref);
+    if (u_first_i-border < 0 || v_first_i-border < 0 || u_first_i+border >= src.cols || v_first_i+border >= src.rows)
+      continue;
+    *vit = true;
+
+    // Evaluate projection jacobian
+    Eigen::Vector3d xyz = R*p+T;
+    Jacobian3DToPlane(xyz, &frame_jac);
+    const Eigen::Matrix<float, 2, 6> jac = (frame_jac*(cam_fx_*scale)).cast<float>();
+
+    // compute bilateral interpolation weights for reference image
+    const float subpix_u_ref = u_ref-u_first_i;
+    const float subpix_v_ref = v_ref-v_first_i;
+    const Eigen::Array4f w((1.0f-subpix_u_ref) * (1.0f-subpix_v_ref), subpix_u_ref * (1.0f-subpix_v_ref),
+                           (1.0f-subpix_u_ref) * subpix_v_ref, subpix_u_ref * subpix_v_ref);
+
+    // Interpolate rows from one above the patch to one below it, shifted one pixel to each side
+    const int x = u_first_i-half_patch;
+    Eigen::Array4f left[6], center[6], right[6];
+    for (int i = 0; i < 6; i++) {
+      const int y = v_first_i-half_patch-1+i;
+      const uint8_t* row_ptr = src.ptr<uint8_t>(y);
+      const uint8_t* row_next_ptr = src.ptr<uint8_t>(y+1);
+      left[i] = InterpolateRow(row_ptr, row_next_ptr, x-1, w);
+      center[i] = InterpolateRow(row_ptr, row_next_ptr, x, w);
+      right[i] = InterpolateRow(row_ptr, row_next_ptr, x+1, w);
+    }
+
+    float* cache_ptr = reinterpret_cast<float*>(patch_cache_.data) + 16*counter;
+    for (int i = 0; i < 4; i++) {
+      // precompute interpolated reference patch color
+      Eigen::Map<Eigen::Array4f>(cache_ptr+4*i) = center[i+1];
+
+      // we use the inverse compositional: thereby we can take the gradient always at the same position
+      const Eigen::Array4f dx = 0.5f*(right[i+1]-left[i+1]);
+      const Eigen::Array4f dy = 0.5f*(center[i+2]-center[i]);
+
+      // cache the jacobian
+      for (int j = 0; j < 6; j++)
+        jacobian_float_.col(j).segment<4>(16*counter+4*i) = (dx*jac(0, j) + dy*jac(1, j)).matrix();
+    }
+  }
+}
+
+void ImageAlign::ResizeCaches(int size) {
+  int patch_area = patch_size_*patch_size_;
+
+  patch_cache_ = cv::Mat(size, patch_area, CV_32F);
+  visible_pts_.resize(size, false);
+  if (use_float_)
+    jacobian_float_.resize(size*patch_area, Eigen::NoChange);
+  else
+    jacobian_cache_.resize(Eigen::NoChange, size*patch_area);
+}
+
+void ImageAlign::ResetJacobians() {
+  if (use_float_)
+    jacobian_float_.setZero();
+  else
+    jacobian_cache_.setZero();
+}
+
 bool ImageAlign::Project(const Eigen::Matrix3d &R, const Eigen::Vector3d &T,
                          const Eigen::Vector3d &p, Eigen::Vector2d &res) {
   Eigen::Vector3d x3Dc = R*p+T;
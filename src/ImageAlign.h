@@ -43,6 +43,15 @@ class ImageAlign {
 
   inline double GetError() { return error_; }
 
+  // Use single precision vectorized residuals instead of double precision ones.
+  // Must be set before computing a pose.
+  inline void SetFloat(bool use_float) { use_float_ = use_float; }
+  inline bool UseFloat() const { return use_float_; }
+
+  // Pyramid levels used in alignment. Keyframes only store these levels.
+  static const int MIN_LEVEL;
+  static const int MAX_LEVEL;
+
  private:
   // Optimize using Gauss Newton strategy
   void Optimize(const cv::Mat &src, const cv::Mat &last_img, const Eigen::Matrix4d &last_pose, Eigen::Matrix4d &se3, float scale);
@@ -51,9 +60,22 @@ class ImageAlign {
   double ComputeResiduals(const cv::Mat &src, const cv::Mat &last_img, const Eigen::Matrix4d &last_pose,
                           const Eigen::Matrix4d &se3, float scale, bool patches);
 
+  // Single precision version of ComputeResiduals. Patch size must be 4.
+  double ComputeResidualsFloat(const cv::Mat &src, const cv::Mat &last_img, const Eigen::Matrix4d &last_pose,
+                               const Eigen::Matrix4d &se3, float scale, bool patches);
+
   // Compute patches within a pyramid level
   void PrecomputePatches(const cv::Mat &src, const Eigen::Matrix4d &pose, float scale);
 
+  // Single precision version of PrecomputePatches
+  void PrecomputePatchesFloat(const cv::Mat &src, const Eigen::Matrix4d &pose, float scale);
+
+  // Resize caches for the number of points
+  void ResizeCaches(int size);
+
+  // Reset jacobian cache before a new pyramid level
+  void ResetJacobians();
+
   // Project point in image
   bool Project(const Eigen::Matrix3d &R, const Eigen::Vector3d &T,
                const Eigen::Vector3d &p, Eigen::Vector2d &res);
@@ -73,6 +95,7 @@ class ImageAlign {
   int min_level_;     // Min search level
   int max_level_;     // Max search level
   int max_its_;       // Max align iterations
+  bool use_float_;    // Single precision path
 
   double chi2_;
   size_t  n_meas_;    // Number of measurements
@@ -91,6 +114,10 @@ class ImageAlign {
   Eigen::Matrix<double, 6, 1>  Jres_;   // Store Jacobian residual
   Eigen::Matrix<double, 6, Eigen::Dynamic, Eigen::ColMajor> jacobian_cache_;
 
+  // Single precision jacobians. Each column stores one parameter for all pixels,
+  // so a patch is a contiguous block of rows.
+  Eigen::Matrix<float, Eigen::Dynamic, 6, Eigen::ColMajor> jacobian_float_;
+
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
@@ -23,7 +23,13 @@
  */
 
 #include "KeyFrame.h"
+#include <opencv2/highgui/highgui.hpp>
 #include "ORBmatcher.h"
+#include "KeyFrameDatabase.h"
+#include "KeyFrameImageStore.h"
+#include "ImageAlign.h"
+#include "Config.h"
+#include "Map.h"
 
 using std::vector;
 using std::set;
@@ -34,11 +40,7 @@ using std::unique_lock;
 
 namespace SD_SLAM {
 
-long unsigned int KeyFrame::nNextId = 0;
-
 KeyFrame::KeyFrame(Frame &F, Map *pMap):
-  mnGridCols(FRAME_GRID_COLS), mnGridRows(FRAME_GRID_ROWS),
-  mfGridElementWidthInv(F.mfGridElementWidthInv), mfGridElementHeightInv(F.mfGridElementHeightInv),
   mnTrackReferenceForFrame(0), mnFuseTargetForKF(0), mnBALocalForKF(0), mnBAFixedForKF(0),
   mnLoopQuery(0), mnLoopWords(0), mnRelocQuery(0), mnRelocWords(0), mnBAGlobalForKF(0),
   fx(F.fx), fy(F.fy), cx(F.cx), cy(F.cy), invfx(F.invfx), invfy(F.invfy),
@@ -47,32 +49,43 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap):
   mnScaleLevels(F.mnScaleLevels), mfScaleFactor(F.mfScaleFactor),
   mfLogScaleFactor(F.mfLogScaleFactor), mvScaleFactors(F.mvScaleFactors), mvLevelSigma2(F.mvLevelSigma2),
   mvInvLevelSigma2(F.mvInvLevelSigma2), mnMinX(F.mnMinX), mnMinY(F.mnMinY), mnMaxX(F.mnMaxX),
-  mnMaxY(F.mnMaxY), mK(F.mK), mvpMapPoints(F.mvpMapPoints),
+  mnMaxY(F.mnMaxY), mK(F.mK), mpUndistorter(F.mpUndistorter), mvpMapPoints(F.mvpMapPoints), mpGrid(F.mpGrid),
   mbFirstConnection(true), mpParent(NULL), mbNotErase(false),
   mbToBeErased(false), mbBad(false), mHalfBaseline(F.mb/2), mpMap(pMap) {
-  mnId=nNextId++;
+  mnId = mpMap->NewKeyFrameId();
 
-  mGrid.resize(mnGridCols);
-  for (int i = 0; i<mnGridCols; i++) {
-    mGrid[i].resize(mnGridRows);
-    for (int j = 0; j < mnGridRows; j++)
-      mGrid[i][j] = F.mGrid[i][j];
-  }
+  if (F.mvWords.empty())
+    KeyFrameDatabase::ComputeWords(mDescriptors, mvWords);
+  else
+    mvWords = F.mvWords;
 
   SetPose(F.mTcw);
 
-  // Copy pyramid
+  // Share full resolution, depth and alignment levels (not modified after frame creation)
   int size = F.mvImagePyramid.size();
   mvImagePyramid.resize(size);
-  for (int i = 0; i < size; i++)
-    mvImagePyramid[i] = F.mvImagePyramid[i].clone();
+  mvEncodedPyramid.resize(size);
+  for (int i = 0; i < size; i++) {
+    if (i == 0 || (i >= ImageAlign::MIN_LEVEL && i <= ImageAlign::MAX_LEVEL))
+      mvImagePyramid[i] = F.mvImagePyramid[i];
+  }
+
+  mDepthImage = F.mDepthImage;
+  mDepthScale = F.mDepthScale;
 
-  mDepthImage = F.mDepthImage.clone();
+  // Raw depth is already in sensor units
+  if (mDepthImage.type() == CV_16U) {
+    mDepthFactor = 1.0/mDepthScale;
+  } else {
+    mDepthFactor = Config::DepthMapFactor();
+    if (fabs(mDepthFactor) < 1e-5)
+      mDepthFactor = 1.0;
+  }
 }
 
 void KeyFrame::SetID(int n) {
   mnId = n;
-  nNextId = std::max(nNextId, mnId+1);
+  mpMap->ReserveKeyFrameId(mnId);
 }
 
 void KeyFrame::SetPose(const Eigen::Matrix4d &Tcw_) {
@@ -300,18 +313,16 @@ void KeyFrame::UpdateConnections(bool checkID) {
     if (pMP->isBad())
       continue;
 
-    map<KeyFrame*, size_t> observations = pMP->GetObservations();
-
-    for (map<KeyFrame*, size_t>::iterator mit=observations.begin(), mend=observations.end(); mit != mend; mit++) {
-      if (mit->first->mnId == mnId)
-        continue;
+    pMP->ForEachObservation([&](KeyFrame* pKFi, size_t) {
+      if (pKFi->mnId == mnId)
+        return;
 
       // Use only KFs previous to current KF
-      if (checkID && mit->first->mnId > mnId)
-        continue;
+      if (checkID && pKFi->mnId > mnId)
+        return;
 
-      KFcounter[mit->first]++;
-    }
+      KFcounter[pKFi]++;
+    });
   }
 
   // This should not happen
@@ -379,6 +390,7 @@ void KeyFrame::ChangeParent(KeyFrame *pKF) {
   // Avoid linking to itself
   if (pKF->GetID() != GetID()) {
     mpParent = pKF;
+    mbFirstConnection = false;
     pKF->AddChild(this);
   }
 }
@@ -504,6 +516,11 @@ void KeyFrame::SetBadFlag() {
     mbBad = true;
   }
 
+  {
+    unique_lock<mutex> lock(mMutexDescriptorIndex);
+    mpDescriptorIndex.reset();
+  }
+
   mpMap->EraseKeyFrame(this);
 }
 
@@ -526,49 +543,170 @@ void KeyFrame::EraseConnection(KeyFrame* pKF) {
     UpdateBestCovisibles();
 }
 
+std::shared_ptr<const DescriptorIndex> KeyFrame::GetDescriptorIndex() {
+  unique_lock<mutex> lock(mMutexDescriptorIndex);
+  if (!mpDescriptorIndex)
+    mpDescriptorIndex = std::make_shared<const DescriptorIndex>(mDescriptors);
+  return mpDescriptorIndex;
+}
+
+void KeyFrame::ReleaseDescriptorIndex() {
+  unique_lock<mutex> lock(mMutexDescriptorIndex);
+  mpDescriptorIndex.reset();
+}
+
 vector<size_t> KeyFrame::GetFeaturesInArea(const float &x, const float &y, const float &r) const
 {
   vector<size_t> vIndices;
-  vIndices.reserve(N);
-
-  const int nMinCellX = std::max(0,(int)floor((x-mnMinX-r)*mfGridElementWidthInv));
-  if (nMinCellX >= mnGridCols)
-    return vIndices;
-
-  const int nMaxCellX = std::min((int)mnGridCols-1,(int)ceil((x-mnMinX+r)*mfGridElementWidthInv));
-  if (nMaxCellX < 0)
-    return vIndices;
-
-  const int nMinCellY = std::max(0,(int)floor((y-mnMinY-r)*mfGridElementHeightInv));
-  if (nMinCellY >= mnGridRows)
-    return vIndices;
-
-  const int nMaxCellY = std::min((int)mnGridRows-1,(int)ceil((y-mnMinY+r)*mfGridElementHeightInv));
-  if (nMaxCellY < 0)
-    return vIndices;
-
-  for (int ix = nMinCellX; ix<=nMaxCellX; ix++) {
-    for (int iy = nMinCellY; iy<=nMaxCellY; iy++) {
-      const vector<size_t> vCell = mGrid[ix][iy];
-      for (size_t j = 0, jend=vCell.size(); j < jend; j++) {
-        const cv::KeyPoint &kpUn = mvKeysUn[vCell[j]];
-        const float distx = kpUn.pt.x-x;
-        const float disty = kpUn.pt.y-y;
-
-        if (fabs(distx)<r && fabs(disty)<r)
-          vIndices.push_back(vCell[j]);
-      }
-    }
-  }
-
+  GetFeaturesInArea(x, y, r, vIndices);
   return vIndices;
 }
 
+void KeyFrame::GetFeaturesInArea(const float &x, const float &y, const float &r, vector<size_t> &vIndices) const
+{
+  vIndices.clear();
+  if (mpGrid)
+    mpGrid->GetFeaturesInArea(x, y, r, -1, -1, vIndices);
+}
+
 bool KeyFrame::IsInImage(const float &x, const float &y) const
 {
   return (x >= mnMinX && x<mnMaxX && y >= mnMinY && y<mnMaxY);
 }
 
+cv::Mat KeyFrame::GetImage(int level) {
+  if (level < 0 || level >= static_cast<int>(mvImagePyramid.size()))
+    return cv::Mat();
+
+  size_t loadedBytes = 0;
+  cv::Mat image;
+  {
+    unique_lock<mutex> lock(mMutexImages);
+
+    if (!mvImagePyramid[level].empty()) {
+      image = mvImagePyramid[level];
+    } else if (!mvEncodedPyramid[level].empty()) {
+      image = cv::imdecode(mvEncodedPyramid[level], CV_LOAD_IMAGE_UNCHANGED);
+
+      // Full resolution image is not kept decoded
+      if (level != 0) {
+        mvImagePyramid[level] = image;
+        loadedBytes = image.total()*image.elemSize();
+      }
+    }
+  }
+
+  if (level != 0 && !image.empty())
+    mpMap->GetImageStore()->Touch(this, loadedBytes);
+
+  return image;
+}
+
+cv::Mat KeyFrame::GetDepthImage() {
+  unique_lock<mutex> lock(mMutexImages);
+
+  cv::Mat depth;
+  if (!mDepthImage.empty()) {
+    if (mDepthImage.type() == CV_32F && mDepthScale == 1.0f)
+      return mDepthImage;
+    mDepthImage.convertTo(depth, CV_32F, mDepthScale);
+  } else if (!mEncodedDepth.empty()) {
+    depth = cv::imdecode(mEncodedDepth, CV_LOAD_IMAGE_UNCHANGED);
+    depth.convertTo(depth, CV_32F, 1.0/mDepthFactor);
+  }
+
+  return depth;
+}
+
+void KeyFrame::CompressImages() {
+  unique_lock<mutex> lock(mMutexImages);
+
+  if (!mvImagePyramid.empty() && !mvImagePyramid[0].empty()) {
+    cv::imencode(".png", mvImagePyramid[0], mvEncodedPyramid[0]);
+    mvImagePyramid[0].release();
+  }
+
+  // Store depth in sensor units to encode it without loss
+  if (!mDepthImage.empty()) {
+    EncodeDepth(mEncodedDepth);
+    mDepthImage.release();
+  }
+}
+
+size_t KeyFrame::ReleaseAlignImages() {
+  unique_lock<mutex> lock(mMutexImages);
+  size_t bytes = 0;
+
+  for (size_t i = 1; i < mvImagePyramid.size(); i++) {
+    cv::Mat &image = mvImagePyramid[i];
+    if (image.empty())
+      continue;
+
+    // Images never change, so they are only encoded once
+    if (mvEncodedPyramid[i].empty())
+      cv::imencode(".png", image, mvEncodedPyramid[i]);
+
+    bytes += image.total()*image.elemSize();
+    image.release();
+  }
+
+  return bytes;
+}
+
+size_t KeyFrame::AlignImagesSize() {
+  unique_lock<mutex> lock(mMutexImages);
+  size_t bytes = 0;
+
+  for (size_t i = 1; i < mvImagePyramid.size(); i++)
+    bytes += mvImagePyramid[i].total()*mvImagePyramid[i].elemSize();
+
+  return bytes;
+}
+
+void KeyFrame::GetEncodedImages(vector<vector<uchar> > &pyramid, vector<uchar> &depth, float &depthFactor) {
+  unique_lock<mutex> lock(mMutexImages);
+
+  pyramid.clear();
+  pyramid.resize(mvImagePyramid.size());
+  for (size_t i = 0; i < mvImagePyramid.size(); i++) {
+    if (!mvEncodedPyramid[i].empty())
+      pyramid[i] = mvEncodedPyramid[i];
+    else if (!mvImagePyramid[i].empty())
+      cv::imencode(".png", mvImagePyramid[i], pyramid[i]);
+  }
+
+  depth.clear();
+  if (!mEncodedDepth.empty()) {
+    depth = mEncodedDepth;
+  } else if (!mDepthImage.empty()) {
+    EncodeDepth(depth);
+  }
+
+  depthFactor = mDepthFactor;
+}
+
+void KeyFrame::EncodeDepth(vector<uchar> &encoded) const {
+  // Raw depth is encoded as is
+  if (mDepthImage.type() == CV_16U) {
+    cv::imencode(".png", mDepthImage, encoded);
+    return;
+  }
+
+  cv::Mat depth;
+  mDepthImage.convertTo(depth, CV_16U, mDepthFactor*mDepthScale);
+  cv::imencode(".png", depth, encoded);
+}
+
+void KeyFrame::SetEncodedImages(const vector<vector<uchar> > &pyramid, const vector<uchar> &depth, float depthFactor) {
+  unique_lock<mutex> lock(mMutexImages);
+
+  mvEncodedPyramid = pyramid;
+  mvImagePyramid.assign(pyramid.size(), cv::Mat());
+  mEncodedDepth = depth;
+  mDepthImage.release();
+  mDepthFactor = depthFactor;
+}
+
 Eigen::Vector3d KeyFrame::UnprojectStereo(int i) {
   const float z = mvDepth[i];
   if (z > 0) {
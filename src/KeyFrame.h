@@ -27,8 +27,12 @@
 
 #include <map>
 #include <mutex>
+#include <memory>
 #include "MapPoint.h"
 #include "ORBextractor.h"
+#include "FeatureGrid.h"
+#include "Undistorter.h"
+#include "DescriptorIndex.h"
 #include "Frame.h"
 
 namespace SD_SLAM {
@@ -88,11 +92,47 @@ class KeyFrame {
 
   // KeyPoint functions
   std::vector<size_t> GetFeaturesInArea(const float &x, const float  &y, const float  &r) const;
+  void GetFeaturesInArea(const float &x, const float  &y, const float  &r, std::vector<size_t> &vIndices) const;
+
+  // Call visit(index) for keypoints that may lie closer than r to the line a*x+b*y+c = 0
+  template<typename Visitor>
+  inline void ForEachFeatureNearLine(float a, float b, float c, float r, Visitor &&visit) const {
+    if (mpGrid)
+      mpGrid->ForEachNearLine(a, b, c, r, std::forward<Visitor>(visit));
+  }
+
+  // Index over all descriptors, to match without a geometric prior (loop closing).
+  // Built on first use and kept until released or the keyframe is erased.
+  std::shared_ptr<const DescriptorIndex> GetDescriptorIndex();
+  void ReleaseDescriptorIndex();
+
   Eigen::Vector3d UnprojectStereo(int i);
 
   // Image
   bool IsInImage(const float &x, const float &y) const;
 
+  // Image pyramid level (only full resolution and levels used in image alignment are stored).
+  // Images released by the image store are decoded on demand.
+  cv::Mat GetImage(int level);
+
+  // Depth in meters (CV_32F). Raw sensor depth is only converted when requested.
+  cv::Mat GetDepthImage();
+
+  // Compress full resolution and depth images, only needed to save the map
+  void CompressImages();
+
+  // Release decoded images used in image alignment. Returns released bytes
+  size_t ReleaseAlignImages();
+
+  // Size in bytes of decoded images used in image alignment
+  size_t AlignImagesSize();
+
+  // PNG encoded pyramid (empty for levels not stored) and depth in sensor units (used to save maps)
+  void GetEncodedImages(std::vector<std::vector<uchar> > &pyramid, std::vector<uchar> &depth, float &depthFactor);
+
+  // Set images from their encoded version. They are decoded on demand (used to load maps)
+  void SetEncodedImages(const std::vector<std::vector<uchar> > &pyramid, const std::vector<uchar> &depth, float depthFactor);
+
   // Enable/Disable bad flag changes
   void SetNotErase();
   void SetErase();
@@ -114,15 +154,8 @@ class KeyFrame {
 
   // The following variables are accesed from only 1 thread or never change (no mutex needed).
  public:
-  static long unsigned int nNextId;
   long unsigned int mnId;
 
-  // Grid (to speed up feature matching)
-  const int mnGridCols;
-  const int mnGridRows;
-  const float mfGridElementWidthInv;
-  const float mfGridElementHeightInv;
-
   // Variables used by the tracking
   long unsigned int mnTrackReferenceForFrame;
   long unsigned int mnFuseTargetForKF;
@@ -139,6 +172,9 @@ class KeyFrame {
   int mnRelocWords;
   float mRelocScore;
 
+  // Visual words (quantized descriptors) used by the keyframe database
+  std::vector<unsigned int> mvWords;
+
   // Variables used by loop closing
   Eigen::Matrix4d mTcwGBA;
   Eigen::Matrix4d mTcwBefGBA;
@@ -172,12 +208,23 @@ class KeyFrame {
   const int mnMaxY;
   Eigen::Matrix3d mK;
 
-  // Image pyramid
-  std::vector<cv::Mat> mvImagePyramid;
-  cv::Mat mDepthImage;
+  // Undistortion of the camera, shared with the frame (null if the frame had none)
+  const std::shared_ptr<const Undistorter> mpUndistorter;
 
   // The following variables need to be accessed trough a mutex to be thread safe.
  protected:
+  // Image pyramid and its PNG encoded version
+  std::vector<cv::Mat> mvImagePyramid;
+  std::vector<std::vector<uchar> > mvEncodedPyramid;
+
+  // Depth as received by the frame (CV_16U or CV_32F) and scale from its values to meters
+  cv::Mat mDepthImage;
+  float mDepthScale;
+
+  // PNG encoded depth in sensor units, and sensor units per meter
+  std::vector<uchar> mEncodedDepth;
+  float mDepthFactor;
+
   // SE3 Pose and camera center
   Eigen::Matrix4d Tcw;
   Eigen::Matrix4d Twc;
@@ -186,8 +233,11 @@ class KeyFrame {
   // MapPoints associated to keypoints
   std::vector<MapPoint*> mvpMapPoints;
 
-  // Grid over the image to speed up feature matching
-  std::vector< std::vector <std::vector<size_t> > > mGrid;
+  // Grid over the image to speed up feature matching (shared with the frame)
+  std::shared_ptr<const FeatureGrid> mpGrid;
+
+  // Descriptor index, built on demand
+  std::shared_ptr<const DescriptorIndex> mpDescriptorIndex;
 
   std::map<KeyFrame*, int> mConnectedKeyFrameWeights;
   std::vector<KeyFrame*> mvpOrderedConnectedKeyFrames;
@@ -211,6 +261,11 @@ class KeyFrame {
   std::mutex mMutexPose;
   std::mutex mMutexConnections;
   std::mutex mMutexFeatures;
+  std::mutex mMutexImages;
+  std::mutex mMutexDescriptorIndex;
+
+  // Encode depth in sensor units as PNG (mMutexImages must be locked)
+  void EncodeDepth(std::vector<uchar> &encoded) const;
 
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
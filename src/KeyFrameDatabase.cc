@@ -0,0 +1,213 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "KeyFrameDatabase.h"
+#include <cmath>
+#include <algorithm>
+#include "KeyFrame.h"
+#include "Frame.h"
+
+using std::vector;
+using std::list;
+using std::set;
+using std::pair;
+using std::mutex;
+using std::unique_lock;
+
+namespace SD_SLAM {
+
+const int KeyFrameDatabase::WORD_BITS = 16;
+const int KeyFrameDatabase::NUM_TABLES = 2;
+
+KeyFrameDatabase::KeyFrameDatabase() {
+  mvInvertedFile.resize(NUM_TABLES << WORD_BITS);
+}
+
+void KeyFrameDatabase::add(KeyFrame *pKF) {
+  unique_lock<mutex> lock(mMutex);
+
+  for (vector<unsigned int>::const_iterator vit = pKF->mvWords.begin(), vend = pKF->mvWords.end(); vit != vend; vit++)
+    mvInvertedFile[*vit].push_back(pKF);
+}
+
+void KeyFrameDatabase::erase(KeyFrame* pKF) {
+  unique_lock<mutex> lock(mMutex);
+
+  // Erase elements in the Inverse File for the entry
+  for (vector<unsigned int>::const_iterator vit = pKF->mvWords.begin(), vend = pKF->mvWords.end(); vit != vend; vit++) {
+    list<KeyFrame*> &lKFs = mvInvertedFile[*vit];
+
+    for (list<KeyFrame*>::iterator lit = lKFs.begin(), lend = lKFs.end(); lit != lend; lit++) {
+      if (pKF == *lit) {
+        lKFs.erase(lit);
+        break;
+      }
+    }
+  }
+}
+
+void KeyFrameDatabase::clear() {
+  unique_lock<mutex> lock(mMutex);
+
+  mvInvertedFile.clear();
+  mvInvertedFile.resize(NUM_TABLES << WORD_BITS);
+}
+
+vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, int maxCandidates) {
+  set<KeyFrame*> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
+  list<KeyFrame*> lKFsSharingWords;
+
+  // Search all keyframes that share a word with current keyframes
+  // Discard keyframes connected to the query keyframe
+  {
+    unique_lock<mutex> lock(mMutex);
+
+    for (vector<unsigned int>::const_iterator vit = pKF->mvWords.begin(), vend = pKF->mvWords.end(); vit != vend; vit++) {
+      list<KeyFrame*> &lKFs = mvInvertedFile[*vit];
+
+      for (list<KeyFrame*>::iterator lit = lKFs.begin(), lend = lKFs.end(); lit != lend; lit++) {
+        KeyFrame* pKFi = *lit;
+        if (pKFi == pKF)
+          continue;
+
+        if (pKFi->mnLoopQuery != pKF->mnId) {
+          pKFi->mnLoopWords = 0;
+          if (!spConnectedKeyFrames.count(pKFi)) {
+            pKFi->mnLoopQuery = pKF->mnId;
+            lKFsSharingWords.push_back(pKFi);
+          }
+        }
+        pKFi->mnLoopWords++;
+      }
+    }
+  }
+
+  if (lKFsSharingWords.empty())
+    return vector<KeyFrame*>();
+
+  // Score keyframes by the cosine similarity of their word sets
+  vector<pair<float, KeyFrame*> > vScoreAndMatch;
+  vScoreAndMatch.reserve(lKFsSharingWords.size());
+  const float nQueryWords = pKF->mvWords.size();
+
+  for (list<KeyFrame*>::iterator lit = lKFsSharingWords.begin(), lend = lKFsSharingWords.end(); lit != lend; lit++) {
+    KeyFrame* pKFi = *lit;
+
+    if (pKFi->isBad())
+      continue;
+
+    pKFi->mLoopScore = pKFi->mnLoopWords/sqrt(nQueryWords*pKFi->mvWords.size());
+    vScoreAndMatch.push_back(std::make_pair(pKFi->mLoopScore, pKFi));
+  }
+
+  // Keep only the best candidates
+  const int nCandidates = std::min(maxCandidates, static_cast<int>(vScoreAndMatch.size()));
+  std::partial_sort(vScoreAndMatch.begin(), vScoreAndMatch.begin()+nCandidates, vScoreAndMatch.end(),
+                    [](const pair<float, KeyFrame*> &a, const pair<float, KeyFrame*> &b) { return a.first > b.first; });
+
+  vector<KeyFrame*> vpLoopCandidates;
+  vpLoopCandidates.reserve(nCandidates);
+  for (int i = 0; i < nCandidates; i++)
+    vpLoopCandidates.push_back(vScoreAndMatch[i].second);
+
+  return vpLoopCandidates;
+}
+
+vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F, int maxCandidates) {
+  list<KeyFrame*> lKFsSharingWords;
+
+  // Search all keyframes that share a word with current frame
+  {
+    unique_lock<mutex> lock(mMutex);
+
+    for (vector<unsigned int>::const_iterator vit = F->mvWords.begin(), vend = F->mvWords.end(); vit != vend; vit++) {
+      list<KeyFrame*> &lKFs = mvInvertedFile[*vit];
+
+      for (list<KeyFrame*>::iterator lit = lKFs.begin(), lend = lKFs.end(); lit != lend; lit++) {
+        KeyFrame* pKFi = *lit;
+        if (pKFi->mnRelocQuery != F->mnId) {
+          pKFi->mnRelocWords = 0;
+          pKFi->mnRelocQuery = F->mnId;
+          lKFsSharingWords.push_back(pKFi);
+        }
+        pKFi->mnRelocWords++;
+      }
+    }
+  }
+
+  if (lKFsSharingWords.empty())
+    return vector<KeyFrame*>();
+
+  // Score keyframes by the cosine similarity of their word sets
+  vector<pair<float, KeyFrame*> > vScoreAndMatch;
+  vScoreAndMatch.reserve(lKFsSharingWords.size());
+  const float nQueryWords = F->mvWords.size();
+
+  for (list<KeyFrame*>::iterator lit = lKFsSharingWords.begin(), lend = lKFsSharingWords.end(); lit != lend; lit++) {
+    KeyFrame* pKFi = *lit;
+
+    if (pKFi->isBad())
+      continue;
+
+    pKFi->mRelocScore = pKFi->mnRelocWords/sqrt(nQueryWords*pKFi->mvWords.size());
+    vScoreAndMatch.push_back(std::make_pair(pKFi->mRelocScore, pKFi));
+  }
+
+  // Keep only the best candidates
+  const int nCandidates = std::min(maxCandidates, static_cast<int>(vScoreAndMatch.size()));
+  std::partial_sort(vScoreAndMatch.begin(), vScoreAndMatch.begin()+nCandidates, vScoreAndMatch.end(),
+                    [](const pair<float, KeyFrame*> &a, const pair<float, KeyFrame*> &b) { return a.first > b.first; });
+
+  vector<KeyFrame*> vpRelocCandidates;
+  vpRelocCandidates.reserve(nCandidates);
+  for (int i = 0; i < nCandidates; i++)
+    vpRelocCandidates.push_back(vScoreAndMatch[i].second);
+
+  return vpRelocCandidates;
+}
+
+void KeyFrameDatabase::ComputeWords(const cv::Mat &descriptors, vector<unsigned int> &words) {
+  words.clear();
+  words.reserve(descriptors.rows*NUM_TABLES);
+
+  for (int i = 0; i < descriptors.rows; i++) {
+    const cv::Mat d = descriptors.row(i);
+    for (int t = 0; t < NUM_TABLES; t++)
+      words.push_back(DescriptorWord(d, t));
+  }
+
+  std::sort(words.begin(), words.end());
+  words.erase(std::unique(words.begin(), words.end()), words.end());
+}
+
+unsigned int KeyFrameDatabase::DescriptorWord(const cv::Mat &descriptor, int table) {
+  const uchar* d = descriptor.ptr<uchar>();
+
+  // Each table samples WORD_BITS bits spread over the 256 bits of the descriptor
+  unsigned int word = 0;
+  for (int b = 0; b < WORD_BITS; b++) {
+    const int byte = (2*b + table) % 32;
+    const int bit = b % 8;
+    word |= ((d[byte] >> bit) & 1) << b;
+  }
+
+  return (table << WORD_BITS) | word;
+}
+
+}  // namespace SD_SLAM
@@ -0,0 +1,70 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SD_SLAM_KEYFRAMEDATABASE_H_
+#define SD_SLAM_KEYFRAMEDATABASE_H_
+
+#include <vector>
+#include <list>
+#include <mutex>
+#include <opencv2/core/core.hpp>
+
+namespace SD_SLAM {
+
+class KeyFrame;
+class Frame;
+
+// Inverted index of visual words over the keyframes of the map.
+// Words are obtained hashing ORB descriptors, so no vocabulary is needed.
+class KeyFrameDatabase {
+ public:
+  KeyFrameDatabase();
+
+  void add(KeyFrame* pKF);
+  void erase(KeyFrame* pKF);
+  void clear();
+
+  // Return up to maxCandidates keyframes sharing most words with the query keyframe.
+  // Keyframes connected to the query in the covisibility graph are discarded.
+  std::vector<KeyFrame*> DetectLoopCandidates(KeyFrame* pKF, int maxCandidates);
+
+  // Return up to maxCandidates keyframes sharing most words with the frame.
+  // Frame words must have been computed before.
+  std::vector<KeyFrame*> DetectRelocalizationCandidates(Frame* F, int maxCandidates);
+
+  // Quantize descriptors into a sorted list of unique words
+  static void ComputeWords(const cv::Mat &descriptors, std::vector<unsigned int> &words);
+
+  // Word of a single descriptor in the given hash table
+  static unsigned int DescriptorWord(const cv::Mat &descriptor, int table);
+
+  // Number of bits sampled per word and number of hash tables
+  static const int WORD_BITS;
+  static const int NUM_TABLES;
+
+ protected:
+  // Inverted file (mvInvertedFile[word] has a list of all keyframes containing that word)
+  std::vector<std::list<KeyFrame*> > mvInvertedFile;
+
+  std::mutex mMutex;
+};
+
+}  // namespace SD_SLAM
+
+#endif  // SD_SLAM_KEYFRAMEDATABASE_H_
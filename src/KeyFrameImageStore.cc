@@ -0,0 +1,131 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "KeyFrameImageStore.h"
+#include <algorithm>
+#include "KeyFrame.h"
+#include "Config.h"
+#include "extra/log.h"
+
+using std::list;
+using std::mutex;
+using std::unique_lock;
+
+namespace SD_SLAM {
+
+KeyFrameImageStore::KeyFrameImageStore(): mnLoadedBytes(0), mnHits(0), mnMisses(0), mnEvictions(0) {
+  mnBudget = static_cast<size_t>(Config::KeyFrameImageBudget())*1024*1024;
+}
+
+void KeyFrameImageStore::add(KeyFrame* pKF) {
+  // Full resolution images are only needed to save the map. Without a budget
+  // they are kept raw and only encoded when the map is saved
+  if (mnBudget > 0)
+    pKF->CompressImages();
+
+  unique_lock<mutex> lock(mMutex);
+
+  if (mmLoaded.count(pKF))
+    return;
+
+  const size_t bytes = pKF->AlignImagesSize();
+  mlpLoaded.push_front(pKF);
+  mmLoaded[pKF] = LoadedEntry{mlpLoaded.begin(), bytes};
+  mnLoadedBytes += bytes;
+
+  EnforceBudget(pKF);
+}
+
+void KeyFrameImageStore::erase(KeyFrame* pKF) {
+  unique_lock<mutex> lock(mMutex);
+
+  auto it = mmLoaded.find(pKF);
+  if (it == mmLoaded.end())
+    return;
+
+  mnLoadedBytes -= std::min(it->second.bytes, mnLoadedBytes);
+  mlpLoaded.erase(it->second.it);
+  mmLoaded.erase(it);
+}
+
+void KeyFrameImageStore::clear() {
+  unique_lock<mutex> lock(mMutex);
+
+  mlpLoaded.clear();
+  mmLoaded.clear();
+  mnLoadedBytes = 0;
+}
+
+void KeyFrameImageStore::Touch(KeyFrame* pKF, size_t loadedBytes) {
+  unique_lock<mutex> lock(mMutex);
+
+  auto it = mmLoaded.find(pKF);
+
+  if (loadedBytes == 0) {
+    mnHits++;
+
+    // Move to front
+    if (it != mmLoaded.end())
+      mlpLoaded.splice(mlpLoaded.begin(), mlpLoaded, it->second.it);
+    return;
+  }
+
+  mnMisses++;
+
+  // Levels are decoded one at a time, so each one is counted
+  if (it != mmLoaded.end()) {
+    it->second.bytes += loadedBytes;
+    mlpLoaded.splice(mlpLoaded.begin(), mlpLoaded, it->second.it);
+  } else {
+    mlpLoaded.push_front(pKF);
+    mmLoaded[pKF] = LoadedEntry{mlpLoaded.begin(), loadedBytes};
+  }
+  mnLoadedBytes += loadedBytes;
+
+  EnforceBudget(pKF);
+}
+
+void KeyFrameImageStore::PrintStats() {
+  unique_lock<mutex> lock(mMutex);
+
+  LOGD("Keyframe images: %lu hits, %lu misses, %lu evictions, %lu keyframes loaded (%.2f MB)",
+       mnHits, mnMisses, mnEvictions, mlpLoaded.size(), mnLoadedBytes/(1024.0*1024.0));
+}
+
+void KeyFrameImageStore::EnforceBudget(KeyFrame* pKeep) {
+  if (mnBudget == 0)
+    return;
+
+  while (mnLoadedBytes > mnBudget && !mlpLoaded.empty()) {
+    KeyFrame* pKF = mlpLoaded.back();
+    if (pKF == pKeep)
+      break;
+
+    mlpLoaded.pop_back();
+    auto it = mmLoaded.find(pKF);
+    const size_t bytes = it->second.bytes;
+    mmLoaded.erase(it);
+
+    pKF->ReleaseAlignImages();
+    mnLoadedBytes -= std::min(bytes, mnLoadedBytes);
+    mnEvictions++;
+  }
+}
+
+}  // namespace SD_SLAM
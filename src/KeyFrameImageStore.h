@@ -0,0 +1,77 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SD_SLAM_KEYFRAMEIMAGESTORE_H_
+#define SD_SLAM_KEYFRAMEIMAGESTORE_H_
+
+#include <list>
+#include <map>
+#include <mutex>
+
+namespace SD_SLAM {
+
+class KeyFrame;
+
+// Keeps keyframe images used in image alignment within a memory budget.
+// Least recently used keyframes are compressed and decoded again on demand.
+// Without a budget nothing is compressed.
+class KeyFrameImageStore {
+ public:
+  KeyFrameImageStore();
+
+  void add(KeyFrame* pKF);
+  void erase(KeyFrame* pKF);
+  void clear();
+
+  // Inform that keyframe images were accessed. Loaded bytes is the size of the
+  // images that had to be decoded (0 if they were already loaded).
+  void Touch(KeyFrame* pKF, size_t loadedBytes);
+
+  // Print hits, misses and memory usage
+  void PrintStats();
+
+ protected:
+  // Compress least recently used keyframes until memory is under budget
+  void EnforceBudget(KeyFrame* pKeep);
+
+  // Memory budget in bytes (0 is unlimited)
+  size_t mnBudget;
+
+  // Position in the list and decoded bytes counted for a keyframe
+  struct LoadedEntry {
+    std::list<KeyFrame*>::iterator it;
+    size_t bytes;
+  };
+
+  // Keyframes with decoded images, most recently used first
+  std::list<KeyFrame*> mlpLoaded;
+  std::map<KeyFrame*, LoadedEntry> mmLoaded;
+  size_t mnLoadedBytes;
+
+  // Stats
+  size_t mnHits;
+  size_t mnMisses;
+  size_t mnEvictions;
+
+  std::mutex mMutex;
+};
+
+}  // namespace SD_SLAM
+
+#endif  // SD_SLAM_KEYFRAMEIMAGESTORE_H_
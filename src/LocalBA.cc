@@ -0,0 +1,369 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "LocalBA.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using std::vector;
+
+namespace SD_SLAM {
+
+const double LocalBA::kHuberMono = sqrt(5.991);
+const double LocalBA::kHuberStereo = sqrt(7.815);
+
+LocalBA::LocalBA(): mbRobust(true), mbStructure(false), mnFree(0) {
+  mvPointObs.push_back(0);
+}
+
+void LocalBA::reserve(size_t nPoses, size_t nPoints, size_t nObservations) {
+  mvPoses.reserve(nPoses);
+  mvPoseFixed.reserve(nPoses);
+  mvfx.reserve(nPoses);
+  mvfy.reserve(nPoses);
+  mvcx.reserve(nPoses);
+  mvcy.reserve(nPoses);
+  mvbf.reserve(nPoses);
+
+  mvPoints.reserve(nPoints);
+  mvPointObs.reserve(nPoints+1);
+
+  mvObsPose.reserve(nObservations);
+  mvObsU.reserve(nObservations);
+  mvObsV.reserve(nObservations);
+  mvObsUr.reserve(nObservations);
+  mvObsInfo.reserve(nObservations);
+  mvObsInlier.reserve(nObservations);
+}
+
+int LocalBA::AddPose(const Eigen::Matrix4d &Tcw, bool bFixed, double fx, double fy, double cx, double cy, double bf) {
+  mvPoses.push_back(g2o::SE3Quat(Tcw.block<3, 3>(0, 0), Tcw.block<3, 1>(0, 3)));
+  mvPoseFixed.push_back(bFixed);
+  mvfx.push_back(fx);
+  mvfy.push_back(fy);
+  mvcx.push_back(cx);
+  mvcy.push_back(cy);
+  mvbf.push_back(bf);
+  mbStructure = false;
+  return mvPoses.size()-1;
+}
+
+int LocalBA::AddPoint(const Eigen::Vector3d &Pos) {
+  mvPoints.push_back(Pos);
+  mvPointObs.push_back(mvObsPose.size());
+  mbStructure = false;
+  return mvPoints.size()-1;
+}
+
+int LocalBA::AddObservation(int pose, double u, double v, double ur, double invSigma2) {
+  mvObsPose.push_back(pose);
+  mvObsU.push_back(u);
+  mvObsV.push_back(v);
+  mvObsUr.push_back(ur);
+  mvObsInfo.push_back(invSigma2);
+  mvObsInlier.push_back(true);
+  mvPointObs.back() = mvObsPose.size();
+  mbStructure = false;
+  return mvObsPose.size()-1;
+}
+
+Eigen::Matrix4d LocalBA::GetPose(int pose) const {
+  return mvPoses[pose].to_homogeneous_matrix();
+}
+
+void LocalBA::BuildStructure() {
+  const int nPoses = mvPoses.size();
+  const int nPoints = mvPoints.size();
+
+  mvPoseIndex.resize(nPoses);
+  mnFree = 0;
+  for (int i = 0; i < nPoses; i++)
+    mvPoseIndex[i] = mvPoseFixed[i] ? -1 : mnFree++;
+
+  mvRotations.resize(nPoses);
+  mHpp.resize(6*mnFree, 6*mnFree);
+  mbp.resize(6*mnFree);
+  mS.resize(6*mnFree, 6*mnFree);
+  mrhs.resize(6*mnFree);
+  mdp.resize(6*mnFree);
+
+  mvHll.resize(nPoints);
+  mvbl.resize(nPoints);
+  mvHllInv.resize(nPoints);
+  mvdl.resize(nPoints);
+  mvW.resize(mvObsPose.size());
+
+  mbStructure = true;
+}
+
+void LocalBA::ComputeError(int obs, int point, Eigen::Vector3d &e, Eigen::Vector3d &Xc) const {
+  const int pose = mvObsPose[obs];
+  Xc = mvPoses[pose].map(mvPoints[point]);
+
+  const double invz = 1.0/Xc(2);
+  const double u = mvfx[pose]*Xc(0)*invz + mvcx[pose];
+  const double v = mvfy[pose]*Xc(1)*invz + mvcy[pose];
+
+  e(0) = mvObsU[obs] - u;
+  e(1) = mvObsV[obs] - v;
+  e(2) = mvObsUr[obs] < 0 ? 0.0 : mvObsUr[obs] - (u - mvbf[pose]*invz);
+}
+
+double LocalBA::Chi2(int obs) const {
+  const int point = std::upper_bound(mvPointObs.begin(), mvPointObs.end(), obs) - mvPointObs.begin() - 1;
+  Eigen::Vector3d e, Xc;
+  ComputeError(obs, point, e, Xc);
+  return mvObsInfo[obs]*e.squaredNorm();
+}
+
+bool LocalBA::IsDepthPositive(int obs) const {
+  const int point = std::upper_bound(mvPointObs.begin(), mvPointObs.end(), obs) - mvPointObs.begin() - 1;
+  return mvPoses[mvObsPose[obs]].map(mvPoints[point])(2) > 0.0;
+}
+
+double LocalBA::ComputeChi2() const {
+  double chi2 = 0.0;
+  Eigen::Vector3d e, Xc;
+
+  for (size_t i = 0; i < mvPoints.size(); i++) {
+    for (int j = mvPointObs[i]; j < mvPointObs[i+1]; j++) {
+      if (!mvObsInlier[j])
+        continue;
+
+      ComputeError(j, i, e, Xc);
+      const double chi = mvObsInfo[j]*e.squaredNorm();
+      const double delta = mvObsUr[j] < 0 ? kHuberMono : kHuberStereo;
+
+      if (mbRobust && chi > delta*delta)
+        chi2 += 2.0*sqrt(chi)*delta - delta*delta;
+      else
+        chi2 += chi;
+    }
+  }
+
+  return chi2;
+}
+
+double LocalBA::Linearize() {
+  double chi2 = 0.0;
+
+  for (size_t i = 0; i < mvPoses.size(); i++)
+    mvRotations[i] = mvPoses[i].rotation().toRotationMatrix();
+
+  mHpp.setZero();
+  mbp.setZero();
+
+  Eigen::Vector3d e, Xc;
+  Eigen::Matrix3d Jc, Jl;
+  Eigen::Matrix<double, 3, 6> Jp;
+
+  for (size_t i = 0; i < mvPoints.size(); i++) {
+    Eigen::Matrix3d &Hll = mvHll[i];
+    Eigen::Vector3d &bl = mvbl[i];
+    Hll.setZero();
+    bl.setZero();
+
+    for (int j = mvPointObs[i]; j < mvPointObs[i+1]; j++) {
+      if (!mvObsInlier[j])
+        continue;
+
+      const int pose = mvObsPose[j];
+      ComputeError(j, i, e, Xc);
+
+      // Huber weight as g2o::RobustKernelHuber, second order term ignored
+      double w = mvObsInfo[j];
+      const double chi = w*e.squaredNorm();
+      const double delta = mvObsUr[j] < 0 ? kHuberMono : kHuberStereo;
+
+      if (mbRobust && chi > delta*delta) {
+        const double sqrtchi = sqrt(chi);
+        chi2 += 2.0*sqrtchi*delta - delta*delta;
+        w *= delta/sqrtchi;
+      } else {
+        chi2 += chi;
+      }
+
+      // Jacobian of the error with respect to the point in camera coordinates
+      const double fx = mvfx[pose];
+      const double fy = mvfy[pose];
+      const double invz = 1.0/Xc(2);
+      const double invz2 = invz*invz;
+
+      Jc << -fx*invz, 0.0, fx*Xc(0)*invz2,
+            0.0, -fy*invz, fy*Xc(1)*invz2,
+            0.0, 0.0, 0.0;
+      if (mvObsUr[j] >= 0) {
+        Jc(2, 0) = Jc(0, 0);
+        Jc(2, 2) = Jc(0, 2) - mvbf[pose]*invz2;
+      }
+
+      Jl.noalias() = Jc*mvRotations[pose];
+      Hll.noalias() += w*Jl.transpose()*Jl;
+      bl.noalias() -= w*Jl.transpose()*e;
+
+      const int k = mvPoseIndex[pose];
+      if (k < 0)
+        continue;
+
+      // Left perturbation of the pose, rotation first as in g2o::SE3Quat
+      Jp.block<3, 3>(0, 0).noalias() = Jc*g2o::skew(-Xc);
+      Jp.block<3, 3>(0, 3) = Jc;
+
+      mHpp.block<6, 6>(6*k, 6*k).noalias() += w*Jp.transpose()*Jp;
+      mbp.segment<6>(6*k).noalias() -= w*Jp.transpose()*e;
+      mvW[j].noalias() = w*Jp.transpose()*Jl;
+    }
+  }
+
+  return chi2;
+}
+
+bool LocalBA::Solve(double lambda, double &scale) {
+  mS = mHpp;
+  mS.diagonal().array() += lambda;
+  mrhs = mbp;
+
+  // Eliminate points: S = Hpp - W Hll^-1 W^T, rhs = bp - W Hll^-1 bl
+  for (size_t i = 0; i < mvPoints.size(); i++) {
+    Eigen::Matrix3d Hll = mvHll[i];
+    Hll.diagonal().array() += lambda;
+    mvHllInv[i] = Hll.inverse();
+    const Eigen::Matrix3d &Hinv = mvHllInv[i];
+
+    for (int j = mvPointObs[i]; j < mvPointObs[i+1]; j++) {
+      const int ka = mvPoseIndex[mvObsPose[j]];
+      if (!mvObsInlier[j] || ka < 0)
+        continue;
+
+      const Eigen::Matrix<double, 6, 3> Y = mvW[j]*Hinv;
+      mrhs.segment<6>(6*ka).noalias() -= Y*mvbl[i];
+
+      for (int l = j; l < mvPointObs[i+1]; l++) {
+        const int kb = mvPoseIndex[mvObsPose[l]];
+        if (!mvObsInlier[l] || kb < 0)
+          continue;
+
+        const Eigen::Matrix<double, 6, 6> block = Y*mvW[l].transpose();
+        mS.block<6, 6>(6*ka, 6*kb) -= block;
+        if (kb != ka)
+          mS.block<6, 6>(6*kb, 6*ka) -= block.transpose();
+      }
+    }
+  }
+
+  if (mnFree > 0) {
+    mLDLT.compute(mS);
+    if (mLDLT.info() != Eigen::Success || !mLDLT.isPositive())
+      return false;
+    mdp = mLDLT.solve(mrhs);
+  }
+
+  scale = mdp.dot(lambda*mdp + mbp);
+
+  // Back substitute points: dl = Hll^-1 (bl - W^T dp)
+  for (size_t i = 0; i < mvPoints.size(); i++) {
+    Eigen::Vector3d r = mvbl[i];
+    for (int j = mvPointObs[i]; j < mvPointObs[i+1]; j++) {
+      const int k = mvPoseIndex[mvObsPose[j]];
+      if (mvObsInlier[j] && k >= 0)
+        r.noalias() -= mvW[j].transpose()*mdp.segment<6>(6*k);
+    }
+
+    mvdl[i].noalias() = mvHllInv[i]*r;
+    scale += mvdl[i].dot(lambda*mvdl[i] + mvbl[i]);
+  }
+
+  return true;
+}
+
+void LocalBA::Update() {
+  for (size_t i = 0; i < mvPoses.size(); i++) {
+    const int k = mvPoseIndex[i];
+    if (k >= 0)
+      mvPoses[i] = g2o::SE3Quat::exp(mdp.segment<6>(6*k))*mvPoses[i];
+  }
+
+  for (size_t i = 0; i < mvPoints.size(); i++)
+    mvPoints[i] += mvdl[i];
+}
+
+int LocalBA::Optimize(int nIterations, bool *pbStopFlag) {
+  if (!mbStructure)
+    BuildStructure();
+
+  double lambda = 0.0;
+  double ni = 2.0;
+  int nDone = 0;
+
+  for (int it = 0; it < nIterations; it++) {
+    if (pbStopFlag && *pbStopFlag)
+      break;
+    nDone++;
+
+    double currentChi = Linearize();
+
+    if (it == 0) {
+      double maxDiagonal = 0.0;
+      if (mnFree > 0)
+        maxDiagonal = mHpp.diagonal().cwiseAbs().maxCoeff();
+      for (size_t i = 0; i < mvHll.size(); i++)
+        maxDiagonal = std::max(maxDiagonal, mvHll[i].diagonal().cwiseAbs().maxCoeff());
+      lambda = 1e-5*maxDiagonal;
+      ni = 2.0;
+    }
+
+    // Levenberg-Marquardt step, retried with more damping while chi2 increases
+    double rho = 0.0;
+    int q = 0;
+    do {
+      mvPosesBackup = mvPoses;
+      mvPointsBackup = mvPoints;
+
+      double scale = 0.0;
+      double tempChi = std::numeric_limits<double>::max();
+      if (Solve(lambda, scale)) {
+        Update();
+        tempChi = ComputeChi2();
+      }
+
+      rho = (currentChi-tempChi)/(scale+1e-3);
+
+      if (rho > 0 && std::isfinite(tempChi)) {
+        const double alpha = std::min(1.0-pow(2*rho-1, 3), 2.0/3.0);
+        lambda *= std::max(1.0/3.0, alpha);
+        ni = 2.0;
+        currentChi = tempChi;
+      } else {
+        lambda *= ni;
+        ni *= 2.0;
+        mvPoses.swap(mvPosesBackup);
+        mvPoints.swap(mvPointsBackup);
+      }
+      q++;
+    } while (rho < 0 && q < 10 && !(pbStopFlag && *pbStopFlag));
+
+    if (q == 10 || rho == 0)
+      break;
+  }
+
+  return nDone;
+}
+
+}  // namespace SD_SLAM
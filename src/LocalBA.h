@@ -0,0 +1,134 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SD_SLAM_LOCALBA_H_
+#define SD_SLAM_LOCALBA_H_
+
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+#include "extra/g2o/types/se3quat.h"
+
+namespace SD_SLAM {
+
+// Bundle adjustment of keyframe poses and points specialized for local BA.
+// Observations are stored contiguously grouped by point, points are marginalized
+// with the Schur complement and the reduced camera system is solved densely,
+// which is cheaper than a generic sparse graph for the small windows of local mapping.
+// Poses are updated as g2o::VertexSE3Expmap and Levenberg-Marquardt follows
+// g2o::OptimizationAlgorithmLevenberg, so both backends give equivalent results.
+class LocalBA {
+ public:
+  LocalBA();
+
+  void reserve(size_t nPoses, size_t nPoints, size_t nObservations);
+
+  // Add a keyframe pose with its calibration. Fixed poses are not optimized.
+  int AddPose(const Eigen::Matrix4d &Tcw, bool bFixed, double fx, double fy, double cx, double cy, double bf);
+
+  // Add a point. Its observations must be added right after it.
+  int AddPoint(const Eigen::Vector3d &Pos);
+
+  // Add an observation of the last point from a pose. ur is negative for monocular observations.
+  int AddObservation(int pose, double u, double v, double ur, double invSigma2);
+
+  // Huber kernel on observations (enabled by default)
+  inline void SetRobust(bool bRobust) { mbRobust = bRobust; }
+
+  // Outlier observations are not used in the optimization
+  inline void SetInlier(int obs, bool bInlier) { mvObsInlier[obs] = bInlier; }
+
+  // Run up to nIterations, return the number of iterations done
+  int Optimize(int nIterations, bool *pbStopFlag = NULL);
+
+  // Squared error of an observation weighted by its information
+  double Chi2(int obs) const;
+  bool IsDepthPositive(int obs) const;
+  inline bool IsStereo(int obs) const { return mvObsUr[obs] >= 0; }
+
+  Eigen::Matrix4d GetPose(int pose) const;
+  inline Eigen::Vector3d GetPoint(int point) const { return mvPoints[point]; }
+
+  inline size_t NumObservations() const { return mvObsPose.size(); }
+
+ private:
+  // Assign reduced system indices to free poses and allocate buffers
+  void BuildStructure();
+
+  // Error of an observation (measurement minus projection) and point in camera coordinates
+  void ComputeError(int obs, int point, Eigen::Vector3d &e, Eigen::Vector3d &Xc) const;
+
+  // Robust chi2 of the inlier observations
+  double ComputeChi2() const;
+
+  // Hessian blocks and gradients at the current estimate, return the robust chi2
+  double Linearize();
+
+  // Solve the damped system with the Schur complement. Return false if it is not positive definite.
+  bool Solve(double lambda, double &scale);
+
+  // Apply the last increment
+  void Update();
+
+  static const double kHuberMono;
+  static const double kHuberStereo;
+
+  bool mbRobust;
+  bool mbStructure;
+
+  // Poses
+  std::vector<g2o::SE3Quat, Eigen::aligned_allocator<g2o::SE3Quat> > mvPoses;
+  std::vector<Eigen::Matrix3d, Eigen::aligned_allocator<Eigen::Matrix3d> > mvRotations;
+  std::vector<bool> mvPoseFixed;
+  std::vector<int> mvPoseIndex;  // Block in the reduced system, -1 if fixed
+  std::vector<double> mvfx, mvfy, mvcx, mvcy, mvbf;
+
+  // Points, with their observations in [mvPointObs[i], mvPointObs[i+1])
+  std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > mvPoints;
+  std::vector<int> mvPointObs;
+
+  // Observations
+  std::vector<int> mvObsPose;
+  std::vector<double> mvObsU, mvObsV, mvObsUr, mvObsInfo;
+  std::vector<bool> mvObsInlier;
+
+  // Linear system. W is the pose-point block of each observation.
+  int mnFree;
+  Eigen::MatrixXd mHpp;
+  Eigen::VectorXd mbp;
+  std::vector<Eigen::Matrix3d, Eigen::aligned_allocator<Eigen::Matrix3d> > mvHll;
+  std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > mvbl;
+  std::vector<Eigen::Matrix<double, 6, 3>, Eigen::aligned_allocator<Eigen::Matrix<double, 6, 3> > > mvW;
+
+  // Reduced camera system and increments, allocated once
+  Eigen::MatrixXd mS;
+  Eigen::VectorXd mrhs;
+  Eigen::VectorXd mdp;
+  Eigen::LDLT<Eigen::MatrixXd> mLDLT;
+  std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > mvdl;
+  std::vector<Eigen::Matrix3d, Eigen::aligned_allocator<Eigen::Matrix3d> > mvHllInv;
+
+  // Estimate before the last update, restored if it is rejected
+  std::vector<g2o::SE3Quat, Eigen::aligned_allocator<g2o::SE3Quat> > mvPosesBackup;
+  std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > mvPointsBackup;
+};
+
+}  // namespace SD_SLAM
+
+#endif  // SD_SLAM_LOCALBA_H_
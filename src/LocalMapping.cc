@@ -23,12 +23,12 @@
  */
 
 #include "LocalMapping.h"
-#include <unistd.h>
 #include "LoopClosing.h"
 #include "ORBmatcher.h"
 #include "Optimizer.h"
 #include "Converter.h"
 #include "extra/log.h"
+#include "extra/profiler.h"
 
 using std::vector;
 using std::list;
@@ -40,7 +40,7 @@ using std::endl;
 namespace SD_SLAM {
 
 LocalMapping::LocalMapping(Map *pMap, const float bMonocular):
-  mbMonocular(bMonocular), mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
+  mbMonocular(bMonocular), mbWakeUp(false), mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
   mbAbortBA(false), mbStopped(false), mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true) {
 
   mpLoopCloser = nullptr;
@@ -64,6 +64,8 @@ void LocalMapping::Run() {
 
     // Check if there are keyframes in the queue
     if (CheckNewKeyFrames()) {
+      ScopedProfile profile(Profiler::LOCAL_MAPPING);
+
       // Insertion in Map
       ProcessNewKeyFrame();
 
@@ -94,7 +96,7 @@ void LocalMapping::Run() {
     } else if (Stop()) {
       // Safe area to stop
       while (isStopped() && !CheckFinish()) {
-        usleep(3000);
+        WaitForWork();
       }
       if (CheckFinish())
         break;
@@ -108,16 +110,34 @@ void LocalMapping::Run() {
     if (CheckFinish())
       break;
 
-    usleep(3000);
+    if (!CheckNewKeyFrames())
+      WaitForWork();
   }
 
   SetFinish();
 }
 
 void LocalMapping::InsertKeyFrame(KeyFrame *pKF) {
-  unique_lock<mutex> lock(mMutexNewKFs);
-  mlNewKeyFrames.push_back(pKF);
-  mbAbortBA=true;
+  {
+    unique_lock<mutex> lock(mMutexNewKFs);
+    mlNewKeyFrames.push_back(pKF);
+    mlInsertionTimes.push_back(std::chrono::steady_clock::now());
+    mbAbortBA=true;
+  }
+
+  WakeUp();
+}
+
+void LocalMapping::WaitForWork() {
+  unique_lock<mutex> lock(mMutexWakeUp);
+  mCondWakeUp.wait(lock, [this] { return mbWakeUp; });
+  mbWakeUp = false;
+}
+
+void LocalMapping::WakeUp() {
+  unique_lock<mutex> lock(mMutexWakeUp);
+  mbWakeUp = true;
+  mCondWakeUp.notify_one();
 }
 
 
@@ -127,10 +147,20 @@ bool LocalMapping::CheckNewKeyFrames() {
 }
 
 void LocalMapping::ProcessNewKeyFrame() {
+  std::chrono::steady_clock::time_point insertionTime;
   {
     unique_lock<mutex> lock(mMutexNewKFs);
     mpCurrentKeyFrame = mlNewKeyFrames.front();
     mlNewKeyFrames.pop_front();
+    insertionTime = mlInsertionTimes.front();
+    mlInsertionTimes.pop_front();
+  }
+
+  // Time the keyframe waited in the queue
+  Profiler &profiler = Profiler::GetInstance();
+  if (profiler.Enabled()) {
+    auto elapsed = std::chrono::steady_clock::now() - insertionTime;
+    profiler.Add(Profiler::KEYFRAME_QUEUE_WAIT, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
   }
 
   // Associate MapPoints to the new keyframe and update normal and descriptor
@@ -188,6 +218,8 @@ void LocalMapping::MapPointCulling() {
 }
 
 void LocalMapping::CreateNewMapPoints() {
+  ScopedProfile profile(Profiler::CREATE_MAP_POINTS);
+
   // Retrieve neighbor keyframes in covisibility graph
   int nn = 10;
   if (mbMonocular)
@@ -511,16 +543,21 @@ Eigen::Matrix3d LocalMapping::ComputeF12(KeyFrame *&pKF1, KeyFrame *&pKF2) {
 }
 
 void LocalMapping::RequestStop() {
-  unique_lock<mutex> lock(mMutexStop);
-  mbStopRequested = true;
-  unique_lock<mutex> lock2(mMutexNewKFs);
-  mbAbortBA = true;
+  {
+    unique_lock<mutex> lock(mMutexStop);
+    mbStopRequested = true;
+    unique_lock<mutex> lock2(mMutexNewKFs);
+    mbAbortBA = true;
+  }
+
+  WakeUp();
 }
 
 bool LocalMapping::Stop() {
   unique_lock<mutex> lock(mMutexStop);
   if (mbStopRequested && !mbNotStop) {
     mbStopped = true;
+    mCondStop.notify_all();
     LOGD("Local Mapping STOP");
     return true;
   }
@@ -533,21 +570,31 @@ bool LocalMapping::isStopped() {
   return mbStopped;
 }
 
+void LocalMapping::WaitUntilStopped() {
+  unique_lock<mutex> lock(mMutexStop);
+  mCondStop.wait(lock, [this] { return mbStopped; });
+}
+
 bool LocalMapping::stopRequested() {
   unique_lock<mutex> lock(mMutexStop);
   return mbStopRequested;
 }
 
 void LocalMapping::Release() {
-  unique_lock<mutex> lock(mMutexStop);
-  unique_lock<mutex> lock2(mMutexFinish);
-  if (mbFinished)
-    return;
-  mbStopped = false;
-  mbStopRequested = false;
-  for (list<KeyFrame*>::iterator lit = mlNewKeyFrames.begin(), lend = mlNewKeyFrames.end(); lit!=lend; lit++)
-    delete *lit;
-  mlNewKeyFrames.clear();
+  {
+    unique_lock<mutex> lock(mMutexStop);
+    unique_lock<mutex> lock2(mMutexFinish);
+    if (mbFinished)
+      return;
+    mbStopped = false;
+    mbStopRequested = false;
+    for (list<KeyFrame*>::iterator lit = mlNewKeyFrames.begin(), lend = mlNewKeyFrames.end(); lit!=lend; lit++)
+      delete *lit;
+    mlNewKeyFrames.clear();
+    mlInsertionTimes.clear();
+  }
+
+  WakeUp();
 
   LOGD("Local Mapping RELEASE");
 }
@@ -560,15 +607,28 @@ bool LocalMapping::AcceptKeyFrames() {
 void LocalMapping::SetAcceptKeyFrames(bool flag) {
   unique_lock<mutex> lock(mMutexAccept);
   mbAcceptKeyFrames=flag;
+  if (flag)
+    mCondAccept.notify_all();
+}
+
+void LocalMapping::WaitUntilIdle() {
+  unique_lock<mutex> lock(mMutexAccept);
+  mCondAccept.wait(lock, [this] { return mbAcceptKeyFrames && KeyframesInQueue() == 0; });
 }
 
 bool LocalMapping::SetNotStop(bool flag) {
-  unique_lock<mutex> lock(mMutexStop);
+  {
+    unique_lock<mutex> lock(mMutexStop);
 
-  if (flag && mbStopped)
-    return false;
+    if (flag && mbStopped)
+      return false;
+
+    mbNotStop = flag;
+  }
 
-  mbNotStop = flag;
+  // A pending stop request can be served now
+  if (!flag)
+    WakeUp();
 
   return true;
 }
@@ -606,20 +666,15 @@ void LocalMapping::KeyFrameCulling() {
           nMPs++;
           if (pMP->Observations()>thObs) {
             const int &scaleLevel = pKF->mvKeysUn[i].octave;
-            const map<KeyFrame*, size_t> observations = pMP->GetObservations();
             int nObs = 0;
-            for (map<KeyFrame*, size_t>::const_iterator mit=observations.begin(), mend=observations.end(); mit != mend; mit++) {
-              KeyFrame* pKFi = mit->first;
-              if (pKFi == pKF)
-                continue;
-              const int &scaleLeveli = pKFi->mvKeysUn[mit->second].octave;
+            pMP->ForEachObservation([&](KeyFrame* pKFi, size_t idx) {
+              if (pKFi == pKF || nObs>=thObs)
+                return;
+              const int &scaleLeveli = pKFi->mvKeysUn[idx].octave;
 
-              if (scaleLeveli <= scaleLevel+1) {
+              if (scaleLeveli <= scaleLevel+1)
                 nObs++;
-                if (nObs>=thObs)
-                  break;
-              }
-            }
+            });
             if (nObs>=thObs) {
               nRedundantObservations++;
             }
@@ -645,28 +700,30 @@ void LocalMapping::RequestReset() {
     mbResetRequested = true;
   }
 
-  while (1) {
-    {
-      unique_lock<mutex> lock2(mMutexReset);
-      if (!mbResetRequested)
-        break;
-    }
-    usleep(3000);
-  }
+  WakeUp();
+
+  unique_lock<mutex> lock(mMutexReset);
+  mCondReset.wait(lock, [this] { return !mbResetRequested; });
 }
 
 void LocalMapping::ResetIfRequested() {
   unique_lock<mutex> lock(mMutexReset);
   if (mbResetRequested) {
     mlNewKeyFrames.clear();
+    mlInsertionTimes.clear();
     mlpRecentAddedMapPoints.clear();
     mbResetRequested=false;
+    mCondReset.notify_all();
   }
 }
 
 void LocalMapping::RequestFinish() {
-  unique_lock<mutex> lock(mMutexFinish);
-  mbFinishRequested = true;
+  {
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinishRequested = true;
+  }
+
+  WakeUp();
 }
 
 bool LocalMapping::CheckFinish() {
@@ -679,6 +736,7 @@ void LocalMapping::SetFinish() {
   mbFinished = true;
   unique_lock<mutex> lock2(mMutexStop);
   mbStopped = true;
+  mCondStop.notify_all();
 }
 
 bool LocalMapping::isFinished() {
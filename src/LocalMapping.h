@@ -26,6 +26,8 @@
 #define SD_SLAM_LOCALMAPPING_H
 
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include "KeyFrame.h"
 #include "Map.h"
 #include "LoopClosing.h"
@@ -61,6 +63,13 @@ class LocalMapping {
   void SetAcceptKeyFrames(bool flag);
   bool SetNotStop(bool flag);
 
+  // Block until local mapping has stopped after RequestStop (or finished)
+  void WaitUntilStopped();
+
+  // Block until queued keyframes are processed and new ones are accepted.
+  // If local mapping is stopped, it also waits until it is released.
+  void WaitUntilIdle();
+
   void InterruptBA();
 
   void RequestFinish();
@@ -87,9 +96,17 @@ class LocalMapping {
 
   bool mbMonocular;
 
+  // Block until there is something to do (new keyframes, stop, release, reset or finish request)
+  void WaitForWork();
+  void WakeUp();
+  bool mbWakeUp;
+  std::mutex mMutexWakeUp;
+  std::condition_variable mCondWakeUp;
+
   void ResetIfRequested();
   bool mbResetRequested;
   std::mutex mMutexReset;
+  std::condition_variable mCondReset;
 
   bool CheckFinish();
   void SetFinish();
@@ -104,6 +121,9 @@ class LocalMapping {
 
   std::list<KeyFrame*> mlNewKeyFrames;
 
+  // Insertion time of queued keyframes, to profile how long they wait in the queue
+  std::list<std::chrono::steady_clock::time_point> mlInsertionTimes;
+
   KeyFrame* mpCurrentKeyFrame;
 
   std::list<MapPoint*> mlpRecentAddedMapPoints;
@@ -116,9 +136,11 @@ class LocalMapping {
   bool mbStopRequested;
   bool mbNotStop;
   std::mutex mMutexStop;
+  std::condition_variable mCondStop;
 
   bool mbAcceptKeyFrames;
   std::mutex mMutexAccept;
+  std::condition_variable mCondAccept;
 };
 
 }  // namespace SD_SLAM
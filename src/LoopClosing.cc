@@ -24,13 +24,17 @@
 
 #include "LoopClosing.h"
 #include <thread>
-#include <unistd.h>
 #include "Sim3Solver.h"
 #include "Converter.h"
 #include "Optimizer.h"
 #include "ORBmatcher.h"
 #include "ImageAlign.h"
+#include "KeyFrameDatabase.h"
+#include "MapUpdate.h"
+#include "Config.h"
+#include "extra/timer.h"
 #include "extra/log.h"
+#include "extra/profiler.h"
 
 using std::mutex;
 using std::unique_lock;
@@ -43,10 +47,11 @@ using std::list;
 namespace SD_SLAM {
 
 LoopClosing::LoopClosing(Map *pMap, const bool bFixScale):
-  mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
+  mbWakeUp(false), mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
   mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
   mbStopGBA(false), mpThreadGBA(NULL), mbFixScale(bFixScale), mnFullBAIdx(0) {
   mnCovisibilityConsistencyTh = 3;
+  mnMaxLoopCandidates = 10;
 }
 
 void LoopClosing::SetTracker(Tracking *pTracker) {
@@ -80,16 +85,34 @@ void LoopClosing::Run() {
     if (CheckFinish())
       break;
 
-    usleep(5000);
+    if (!CheckNewKeyFrames())
+      WaitForWork();
   }
 
   SetFinish();
 }
 
 void LoopClosing::InsertKeyFrame(KeyFrame *pKF) {
-  unique_lock<mutex> lock(mMutexLoopQueue);
-  if (pKF->mnId != 0)
+  {
+    unique_lock<mutex> lock(mMutexLoopQueue);
+    if (pKF->mnId == 0)
+      return;
     mlpLoopKeyFrameQueue.push_back(pKF);
+  }
+
+  WakeUp();
+}
+
+void LoopClosing::WaitForWork() {
+  unique_lock<mutex> lock(mMutexWakeUp);
+  mCondWakeUp.wait(lock, [this] { return mbWakeUp; });
+  mbWakeUp = false;
+}
+
+void LoopClosing::WakeUp() {
+  unique_lock<mutex> lock(mMutexWakeUp);
+  mbWakeUp = true;
+  mCondWakeUp.notify_one();
 }
 
 bool LoopClosing::CheckNewKeyFrames() {
@@ -112,28 +135,22 @@ bool LoopClosing::DetectLoop() {
     return false;
   }
 
+  Timer total(true);
+  ScopedProfile profile(Profiler::LOOP_DETECTION);
+
+  // Retrieve the most similar keyframes not connected to the current one
   map<KeyFrame*, double> candidateKFs;
-  set<KeyFrame*> connectedKeyFrames = mpCurrentKF->GetConnectedKeyFrames();
-  vector<KeyFrame*> kfs = mpMap->GetAllKeyFrames();
+  vector<KeyFrame*> kfs = mpMap->GetKeyFrameDatabase()->DetectLoopCandidates(mpCurrentKF, mnMaxLoopCandidates);
   double error, best_error = 1e10;
 
   // Search candidates to be a loop
   for (size_t i = 0; i<kfs.size(); i++) {
     KeyFrame* kf = kfs[i];
 
-    if (kf->mnId == mpCurrentKF->mnId)
-      continue;
-
-    // Discard connected keyframes
-    if (connectedKeyFrames.count(kf))
-      continue;
-
     // Try to align keyframes
     ImageAlign image_align;
-    if (!image_align.ComputePose(mpCurrentKF, kf)) {
-      i++; // Skip some keyframes
+    if (!image_align.ComputePose(mpCurrentKF, kf))
       continue;
-    }
 
     error = image_align.GetError();
     candidateKFs.insert(std::make_pair(kf, error));
@@ -142,6 +159,9 @@ bool LoopClosing::DetectLoop() {
       best_error = error;
   }
 
+  total.Stop();
+  LOGD("Loop detection time is %.2fms (%lu candidates aligned)", total.GetMsTime(), kfs.size());
+
   // Select only the best candidates with score lower than 1.5*best
   vector<KeyFrame*> vpCandidateKFs;
   for (auto it=candidateKFs.begin(); it != candidateKFs.end(); it++) {
@@ -265,6 +285,10 @@ bool LoopClosing::ComputeSim3() {
     nCandidates++;
   }
 
+  // Indices are only needed to match each candidate once, don't keep them (128 bytes per feature)
+  for (int i = 0; i<nInitialCandidates; i++)
+    mvpEnoughConsistentCandidates[i]->ReleaseDescriptorIndex();
+
   // Perform alternatively RANSAC iterations for each candidate
   // until one is succesful or all fail
   while (nCandidates > 0 && !bMatch) {
@@ -368,6 +392,8 @@ bool LoopClosing::ComputeSim3() {
 }
 
 void LoopClosing::CorrectLoop() {
+  ScopedProfile profile(Profiler::LOOP_CORRECTION);
+
   LOGD("Loop detected!");
 
   // Send a stop signal to Local Mapping
@@ -388,9 +414,7 @@ void LoopClosing::CorrectLoop() {
   }
 
   // Wait until Local Mapping has effectively stopped
-  while (!mpLocalMapper->isStopped()) {
-    usleep(1000);
-  }
+  mpLocalMapper->WaitUntilStopped();
 
   // Ensure current keyframe is updated
   mpCurrentKF->UpdateConnections();
@@ -404,8 +428,7 @@ void LoopClosing::CorrectLoop() {
   Eigen::Matrix4d Twc = mpCurrentKF->GetPoseInverse();
 
   {
-    // Get Map Mutex
-    unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+    MapUpdate update;
 
     for (vector<KeyFrame*>::iterator vit = mvpCurrentConnectedKFs.begin(), vend = mvpCurrentConnectedKFs.end(); vit!=vend; vit++) {
       KeyFrame* pKFi = *vit;
@@ -451,10 +474,9 @@ void LoopClosing::CorrectLoop() {
         Eigen::Vector3d P3Dw = pMPi->GetWorldPos();
         Eigen::Vector3d CorrectedP3Dw = g2oCorrectedSwi.map(g2oSiw.map(P3Dw));
 
-        pMPi->SetWorldPos(CorrectedP3Dw);
+        update.SetWorldPos(pMPi, CorrectedP3Dw);
         pMPi->mnCorrectedByKF = mpCurrentKF->mnId;
         pMPi->mnCorrectedReference = pKFi->mnId;
-        pMPi->UpdateNormalAndDepth();
       }
 
       // Update keyframe pose with corrected Sim3. First transform Sim3 to SE3 (scale translation)
@@ -464,14 +486,18 @@ void LoopClosing::CorrectLoop() {
 
       eigt *=(1./s); //[R t/s;0 1]
 
-      pKFi->SetPose(Converter::toSE3(eigR,eigt));
-
-      // Make sure connections are updated
-      pKFi->UpdateConnections();
+      update.SetPose(pKFi, Converter::toSE3(eigR,eigt));
     }
 
+    update.Apply(mpMap);
+
+    // Make sure connections are updated
+    for (KeyFrameAndPose::iterator mit=CorrectedSim3.begin(), mend=CorrectedSim3.end(); mit != mend; mit++)
+      mit->first->UpdateConnections();
+
     // Start Loop Fusion
     // Update matched map points and replace if duplicated
+    unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
     for (size_t i = 0; i<mvpCurrentMatchedPoints.size(); i++) {
       if (mvpCurrentMatchedPoints[i]) {
         MapPoint* pLoopMP = mvpCurrentMatchedPoints[i];
@@ -524,7 +550,14 @@ void LoopClosing::CorrectLoop() {
   mbRunningGBA = true;
   mbFinishedGBA = false;
   mbStopGBA = false;
-  mpThreadGBA = new std::thread(&LoopClosing::RunGlobalBundleAdjustment, this, mpCurrentKF->mnId);
+  Config *config = &Config::GetInstance();
+  Profiler *profiler = &Profiler::GetInstance();
+  unsigned long nLoopKF = mpCurrentKF->mnId;
+  mpThreadGBA = new std::thread([this, config, profiler, nLoopKF] {
+    ConfigScope scope(config);
+    ProfilerScope profilerScope(profiler);
+    RunGlobalBundleAdjustment(nLoopKF);
+  });
 
   // Loop closed. Release Local Mapping.
   mpLocalMapper->Release();
@@ -563,14 +596,10 @@ void LoopClosing::RequestReset() {
     mbResetRequested = true;
   }
 
-  while (1) {
-    {
-    unique_lock<mutex> lock2(mMutexReset);
-    if (!mbResetRequested)
-      break;
-    }
-    usleep(5000);
-  }
+  WakeUp();
+
+  unique_lock<mutex> lock(mMutexReset);
+  mCondReset.wait(lock, [this] { return !mbResetRequested; });
 }
 
 void LoopClosing::ResetIfRequested() {
@@ -579,10 +608,13 @@ void LoopClosing::ResetIfRequested() {
     mlpLoopKeyFrameQueue.clear();
     mLastLoopKFid = 0;
     mbResetRequested=false;
+    mCondReset.notify_all();
   }
 }
 
 void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF) {
+  ScopedProfile profile(Profiler::GLOBAL_BA);
+
   LOGD("Starting Global Bundle Adjustment");
 
   int idx =  mnFullBAIdx;
@@ -601,69 +633,12 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF) {
       LOGD("Global Bundle Adjustment finished");
       LOGD("Updating map ...");
       mpLocalMapper->RequestStop();
-      // Wait until Local Mapping has effectively stopped
-
-      while (!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished()) {
-        usleep(1000);
-      }
+      // Wait until Local Mapping has effectively stopped (or finished)
+      mpLocalMapper->WaitUntilStopped();
 
-      // Get Map Mutex
-      unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
-
-      // Correct keyframes starting at map first keyframe
-      list<KeyFrame*> lpKFtoCheck(mpMap->mvpKeyFrameOrigins.begin(), mpMap->mvpKeyFrameOrigins.end());
-
-      while (!lpKFtoCheck.empty()) {
-        KeyFrame* pKF = lpKFtoCheck.front();
-        const set<KeyFrame*> sChilds = pKF->GetChilds();
-        Eigen::Matrix4d Twc = pKF->GetPoseInverse();
-        for (set<KeyFrame*>::const_iterator sit = sChilds.begin();sit != sChilds.end();sit++) {
-          KeyFrame* pChild = *sit;
-          if (pChild->mnBAGlobalForKF!=nLoopKF) {
-            Eigen::Matrix4d Tchildc = pChild->GetPose()*Twc;
-            pChild->mTcwGBA = Tchildc*pKF->mTcwGBA;
-            pChild->mnBAGlobalForKF=nLoopKF;
-          }
-          lpKFtoCheck.push_back(pChild);
-        }
-
-        pKF->mTcwBefGBA = pKF->GetPose();
-        pKF->SetPose(pKF->mTcwGBA);
-        lpKFtoCheck.pop_front();
-      }
-
-      // Correct MapPoints
-      const vector<MapPoint*> vpMPs = mpMap->GetAllMapPoints();
-
-      for (size_t i = 0; i < vpMPs.size(); i++) {
-        MapPoint* pMP = vpMPs[i];
-
-        if (pMP->isBad())
-          continue;
-
-        if (pMP->mnBAGlobalForKF==nLoopKF) {
-          // If optimized by Global BA, just update
-          pMP->SetWorldPos(pMP->mPosGBA);
-        } else {
-          // Update according to the correction of its reference keyframe
-          KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
-
-          if (pRefKF->mnBAGlobalForKF!=nLoopKF)
-            continue;
-
-          // Map to non-corrected camera
-          Eigen::Matrix3d Rcw = pRefKF->mTcwBefGBA.block<3, 3>(0, 0);
-          Eigen::Vector3d tcw = pRefKF->mTcwBefGBA.block<3, 1>(0, 3);
-          Eigen::Vector3d Xc = Rcw*pMP->GetWorldPos()+tcw;
-
-          // Backproject using corrected camera
-          Eigen::Matrix4d Twc = pRefKF->GetPoseInverse();
-          Eigen::Matrix3d Rwc = Twc.block<3, 3>(0, 0);
-          Eigen::Vector3d twc = Twc.block<3, 1>(0, 3);
-
-          pMP->SetWorldPos(Rwc*Xc+twc);
-        }
-      }
+      MapUpdate update;
+      MapUpdate::FromGlobalBA(mpMap, nLoopKF, update);
+      update.Apply(mpMap);
 
       mpMap->InformNewBigChange();
 
@@ -674,12 +649,22 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF) {
 
     mbFinishedGBA = true;
     mbRunningGBA = false;
+    mCondGBA.notify_all();
   }
 }
 
+void LoopClosing::WaitForGBA() {
+  unique_lock<mutex> lock(mMutexGBA);
+  mCondGBA.wait(lock, [this] { return !mbRunningGBA; });
+}
+
 void LoopClosing::RequestFinish() {
-  unique_lock<mutex> lock(mMutexFinish);
-  mbFinishRequested = true;
+  {
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinishRequested = true;
+  }
+
+  WakeUp();
 }
 
 bool LoopClosing::CheckFinish() {
@@ -27,6 +27,7 @@
 
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include "KeyFrame.h"
 #include "LocalMapping.h"
 #include "Map.h"
@@ -71,6 +72,9 @@ class LoopClosing {
     return mbFinishedGBA;
   }
 
+  // Block until the running Global Bundle Adjustment (if any) has finished
+  void WaitForGBA();
+
   void RequestFinish();
 
   bool isFinished();
@@ -86,9 +90,17 @@ class LoopClosing {
 
   void CorrectLoop();
 
+  // Block until there are new keyframes or a reset or finish request
+  void WaitForWork();
+  void WakeUp();
+  bool mbWakeUp;
+  std::mutex mMutexWakeUp;
+  std::condition_variable mCondWakeUp;
+
   void ResetIfRequested();
   bool mbResetRequested;
   std::mutex mMutexReset;
+  std::condition_variable mCondReset;
 
   bool CheckFinish();
   void SetFinish();
@@ -107,6 +119,7 @@ class LoopClosing {
 
   // Loop detector parameters
   float mnCovisibilityConsistencyTh;
+  int mnMaxLoopCandidates;
 
   // Loop detector variables
   KeyFrame* mpCurrentKF;
@@ -126,6 +139,7 @@ class LoopClosing {
   bool mbFinishedGBA;
   bool mbStopGBA;
   std::mutex mMutexGBA;
+  std::condition_variable mCondGBA;
   std::thread* mpThreadGBA;
 
   // Fix scale in the stereo/RGB-D case
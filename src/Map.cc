@@ -23,6 +23,9 @@
  */
 
 #include "Map.h"
+#include <algorithm>
+#include "KeyFrameDatabase.h"
+#include "KeyFrameImageStore.h"
 
 using std::mutex;
 using std::unique_lock;
@@ -31,14 +34,25 @@ using std::set;
 
 namespace SD_SLAM {
 
-Map::Map():mnMaxKFid(0), mnBigChangeIdx(0) {
+Map::Map(): mpKeyFrameDB(new KeyFrameDatabase()), mpImageStore(new KeyFrameImageStore()),
+  mnMaxKFid(0), mnNextFrameId(0), mnNextKFId(0), mnNextMPId(0), mnBigChangeIdx(0) {
+}
+
+// Defined here, where the database and the image store are complete types
+Map::~Map() {
 }
 
 void Map::AddKeyFrame(KeyFrame *pKF) {
-  unique_lock<mutex> lock(mMutexMap);
-  mspKeyFrames.insert(pKF);
-  if (pKF->mnId>mnMaxKFid)
-    mnMaxKFid=pKF->mnId;
+  {
+    unique_lock<mutex> lock(mMutexMap);
+    if (!mspKeyFrames.insert(pKF).second)
+      return;
+    if (pKF->mnId>mnMaxKFid)
+      mnMaxKFid=pKF->mnId;
+  }
+
+  mpKeyFrameDB->add(pKF);
+  mpImageStore->add(pKF);
 }
 
 void Map::AddMapPoint(MapPoint *pMP) {
@@ -55,8 +69,14 @@ void Map::EraseMapPoint(MapPoint *pMP) {
 }
 
 void Map::EraseKeyFrame(KeyFrame *pKF) {
-  unique_lock<mutex> lock(mMutexMap);
-  mspKeyFrames.erase(pKF);
+  {
+    unique_lock<mutex> lock(mMutexMap);
+    if (!mspKeyFrames.erase(pKF))
+      return;
+  }
+
+  mpKeyFrameDB->erase(pKF);
+  mpImageStore->erase(pKF);
 
   // TODO: This only erase the pointer.
   // Delete the MapPoint
@@ -124,7 +144,29 @@ long unsigned int Map::GetMaxKFid() {
   return mnMaxKFid;
 }
 
+long unsigned int Map::NewFrameId() {
+  unique_lock<mutex> lock(mMutexIds);
+  return mnNextFrameId++;
+}
+
+long unsigned int Map::NewKeyFrameId() {
+  unique_lock<mutex> lock(mMutexIds);
+  return mnNextKFId++;
+}
+
+long unsigned int Map::NewMapPointId() {
+  unique_lock<mutex> lock(mMutexIds);
+  return mnNextMPId++;
+}
+
+void Map::ReserveKeyFrameId(long unsigned int id) {
+  unique_lock<mutex> lock(mMutexIds);
+  mnNextKFId = std::max(mnNextKFId, id+1);
+}
+
 void Map::clear() {
+  mpImageStore->clear();
+
   for (set<MapPoint*>::iterator sit = mspMapPoints.begin(), send = mspMapPoints.end(); sit != send; sit++)
     delete *sit;
 
@@ -136,6 +178,11 @@ void Map::clear() {
   mnMaxKFid = 0;
   mvpReferenceMapPoints.clear();
   mvpKeyFrameOrigins.clear();
+  mpKeyFrameDB->clear();
+
+  unique_lock<mutex> lock(mMutexIds);
+  mnNextFrameId = 0;
+  mnNextKFId = 0;
 }
 
 }  // namespace SD_SLAM
@@ -27,6 +27,7 @@
 
 #include <set>
 #include <mutex>
+#include <memory>
 #include "MapPoint.h"
 #include "KeyFrame.h"
 
@@ -34,10 +35,13 @@ namespace SD_SLAM {
 
 class MapPoint;
 class KeyFrame;
+class KeyFrameDatabase;
+class KeyFrameImageStore;
 
 class Map {
  public:
   Map();
+  ~Map();
 
   void AddKeyFrame(KeyFrame* pKF);
   void AddMapPoint(MapPoint* pMP);
@@ -62,14 +66,29 @@ class Map {
 
   long unsigned int GetMaxKFid();
 
+  // Identifiers of new frames, keyframes and points. Each map has its own sequences,
+  // so several maps can be built at the same time.
+  long unsigned int NewFrameId();
+  long unsigned int NewKeyFrameId();
+  long unsigned int NewMapPointId();
+
+  // Next keyframe ids will be greater than the given one (used when keyframes are loaded)
+  void ReserveKeyFrameId(long unsigned int id);
+
+  // Index of keyframes to search loop candidates
+  inline KeyFrameDatabase* GetKeyFrameDatabase() { return mpKeyFrameDB.get(); }
+
+  // Keyframe images used in image alignment
+  inline KeyFrameImageStore* GetImageStore() { return mpImageStore.get(); }
+
   void clear();
 
   std::vector<KeyFrame*> mvpKeyFrameOrigins;
 
   std::mutex mMutexMapUpdate;
 
-  // This avoid that two points are created simultaneously in separate threads (id conflict)
-  std::mutex mMutexPointCreation;
+  // Point positions are not modified while pose optimization reads them
+  std::mutex mMutexPointPositions;
 
  protected:
   std::set<MapPoint*> mspMapPoints;
@@ -77,8 +96,18 @@ class Map {
 
   std::vector<MapPoint*> mvpReferenceMapPoints;
 
+  // Owned by the map
+  std::unique_ptr<KeyFrameDatabase> mpKeyFrameDB;
+  std::unique_ptr<KeyFrameImageStore> mpImageStore;
+
   long unsigned int mnMaxKFid;
 
+  // Next identifiers. Frame and keyframe ids start again when the map is cleared.
+  long unsigned int mnNextFrameId;
+  long unsigned int mnNextKFId;
+  long unsigned int mnNextMPId;
+  std::mutex mMutexIds;
+
   // Index related to a big change in the map (loop closure, global BA)
   int mnBigChangeIdx;
 
@@ -23,17 +23,19 @@
  */
 
 #include "MapPoint.h"
+#include <algorithm>
 #include "ORBmatcher.h"
 
 using std::mutex;
 using std::unique_lock;
-using std::map;
 using std::vector;
 
 namespace SD_SLAM {
 
-long unsigned int MapPoint::nNextId = 0;
-mutex MapPoint::mGlobalMutex;
+// Order of the observations
+static bool ObservationBefore(const MapPoint::Observation &obs, KeyFrame* pKF) {
+  return obs.first < pKF;
+}
 
 MapPoint::MapPoint(const Eigen::Vector3d &Pos, KeyFrame *pRefKF, Map* pMap):
   mnFirstKFid(pRefKF->mnId), nObs(0), mnTrackReferenceForFrame(0),
@@ -43,9 +45,8 @@ MapPoint::MapPoint(const Eigen::Vector3d &Pos, KeyFrame *pRefKF, Map* pMap):
   mWorldPos = Pos;
   mNormalVector.setZero();
 
-  // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
-  unique_lock<mutex> lock(mpMap->mMutexPointCreation);
-  mnId=nNextId++;
+  // MapPoints can be created from Tracking and Local Mapping, ids are given by the map
+  mnId = mpMap->NewMapPointId();
 }
 
 MapPoint::MapPoint(const Eigen::Vector3d &Pos, Map* pMap, Frame* pFrame, const int &idxF):
@@ -69,13 +70,12 @@ MapPoint::MapPoint(const Eigen::Vector3d &Pos, Map* pMap, Frame* pFrame, const i
 
   pFrame->mDescriptors.row(idxF).copyTo(mDescriptor);
 
-  // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
-  unique_lock<mutex> lock(mpMap->mMutexPointCreation);
-  mnId=nNextId++;
+  // MapPoints can be created from Tracking and Local Mapping, ids are given by the map
+  mnId = mpMap->NewMapPointId();
 }
 
 void MapPoint::SetWorldPos(const Eigen::Vector3d &Pos) {
-  unique_lock<mutex> lock2(mGlobalMutex);
+  unique_lock<mutex> lock2(mpMap->mMutexPointPositions);
   unique_lock<mutex> lock(mMutexPos);
   mWorldPos = Pos;
 }
@@ -95,11 +95,19 @@ KeyFrame* MapPoint::GetReferenceKeyFrame() {
   return mpRefKF;
 }
 
+vector<MapPoint::Observation>::iterator MapPoint::FindObservation(KeyFrame* pKF) {
+  vector<Observation>::iterator it = std::lower_bound(mObservations.begin(), mObservations.end(), pKF, ObservationBefore);
+  if (it != mObservations.end() && it->first == pKF)
+    return it;
+  return mObservations.end();
+}
+
 void MapPoint::AddObservation(KeyFrame* pKF, size_t idx) {
   unique_lock<mutex> lock(mMutexFeatures);
-  if (mObservations.count(pKF))
+  vector<Observation>::iterator it = std::lower_bound(mObservations.begin(), mObservations.end(), pKF, ObservationBefore);
+  if (it != mObservations.end() && it->first == pKF)
     return;
-  mObservations[pKF]=idx;
+  mObservations.insert(it, Observation(pKF, idx));
 
   if (pKF->mvuRight[idx] >= 0)
     nObs+=2;
@@ -111,16 +119,17 @@ void MapPoint::EraseObservation(KeyFrame* pKF) {
   bool bBad=false;
   {
     unique_lock<mutex> lock(mMutexFeatures);
-    if (mObservations.count(pKF)) {
-      int idx = mObservations[pKF];
+    vector<Observation>::iterator it = FindObservation(pKF);
+    if (it != mObservations.end()) {
+      int idx = it->second;
       if (pKF->mvuRight[idx] >= 0)
         nObs-=2;
       else
         nObs--;
 
-      mObservations.erase(pKF);
+      mObservations.erase(it);
 
-      if (mpRefKF==pKF)
+      if (mpRefKF==pKF && !mObservations.empty())
         mpRefKF = mObservations.begin()->first;
 
       // If only 2 observations or less, discard point
@@ -133,7 +142,7 @@ void MapPoint::EraseObservation(KeyFrame* pKF) {
     SetBadFlag();
 }
 
-map<KeyFrame*, size_t> MapPoint::GetObservations() {
+vector<MapPoint::Observation> MapPoint::GetObservations() {
   unique_lock<mutex> lock(mMutexFeatures);
   return mObservations;
 }
@@ -144,15 +153,14 @@ int MapPoint::Observations() {
 }
 
 void MapPoint::SetBadFlag() {
-  map<KeyFrame*, size_t> obs;
+  vector<Observation> obs;
   {
     unique_lock<mutex> lock1(mMutexFeatures);
     unique_lock<mutex> lock2(mMutexPos);
     mbBad=true;
-    obs = mObservations;
-    mObservations.clear();
+    obs.swap(mObservations);
   }
-  for (map<KeyFrame*, size_t>::iterator mit=obs.begin(), mend=obs.end(); mit != mend; mit++) {
+  for (vector<Observation>::iterator mit=obs.begin(), mend=obs.end(); mit != mend; mit++) {
     KeyFrame* pKF = mit->first;
     pKF->EraseMapPointMatch(mit->second);
   }
@@ -171,19 +179,18 @@ void MapPoint::Replace(MapPoint* pMP) {
     return;
 
   int nvisible, nfound;
-  map<KeyFrame*, size_t> obs;
+  vector<Observation> obs;
   {
     unique_lock<mutex> lock1(mMutexFeatures);
     unique_lock<mutex> lock2(mMutexPos);
-    obs = mObservations;
-    mObservations.clear();
+    obs.swap(mObservations);
     mbBad=true;
     nvisible = mnVisible;
     nfound = mnFound;
     mpReplaced = pMP;
   }
 
-  for (map<KeyFrame*, size_t>::iterator mit=obs.begin(), mend=obs.end(); mit != mend; mit++) {
+  for (vector<Observation>::iterator mit=obs.begin(), mend=obs.end(); mit != mend; mit++) {
     // Replace measurement in keyframe
     KeyFrame* pKF = mit->first;
 
@@ -226,7 +233,7 @@ void MapPoint::ComputeDistinctiveDescriptors() {
   // Retrieve all observed descriptors
   vector<cv::Mat> vDescriptors;
 
-  map<KeyFrame*, size_t> observations;
+  vector<Observation> observations;
 
   {
     unique_lock<mutex> lock1(mMutexFeatures);
@@ -240,7 +247,7 @@ void MapPoint::ComputeDistinctiveDescriptors() {
 
   vDescriptors.reserve(observations.size());
 
-  for (map<KeyFrame*, size_t>::iterator mit=observations.begin(), mend=observations.end(); mit != mend; mit++) {
+  for (vector<Observation>::iterator mit=observations.begin(), mend=observations.end(); mit != mend; mit++) {
     KeyFrame* pKF = mit->first;
 
     if (!pKF->isBad())
@@ -290,20 +297,22 @@ cv::Mat MapPoint::GetDescriptor() {
 
 int MapPoint::GetIndexInKeyFrame(KeyFrame *pKF) {
   unique_lock<mutex> lock(mMutexFeatures);
-  if (mObservations.count(pKF))
-    return mObservations[pKF];
+  vector<Observation>::iterator it = FindObservation(pKF);
+  if (it != mObservations.end())
+    return it->second;
   else
     return -1;
 }
 
 bool MapPoint::IsInKeyFrame(KeyFrame *pKF) {
   unique_lock<mutex> lock(mMutexFeatures);
-  return (mObservations.count(pKF));
+  return FindObservation(pKF) != mObservations.end();
 }
 
 void MapPoint::UpdateNormalAndDepth() {
-  map<KeyFrame*, size_t> observations;
+  vector<Observation> observations;
   KeyFrame* pRefKF;
+  size_t refIdx = 0;
   Eigen::Vector3d Pos;
   {
     unique_lock<mutex> lock1(mMutexFeatures);
@@ -313,6 +322,10 @@ void MapPoint::UpdateNormalAndDepth() {
     observations = mObservations;
     pRefKF = mpRefKF;
     Pos = mWorldPos;
+
+    vector<Observation>::iterator it = FindObservation(pRefKF);
+    if (it != mObservations.end())
+      refIdx = it->second;
   }
 
   if (observations.empty())
@@ -320,7 +333,7 @@ void MapPoint::UpdateNormalAndDepth() {
 
   Eigen::Vector3d normal(0, 0, 0);
   int n = 0;
-  for (map<KeyFrame*, size_t>::iterator mit=observations.begin(), mend=observations.end(); mit != mend; mit++) {
+  for (vector<Observation>::iterator mit=observations.begin(), mend=observations.end(); mit != mend; mit++) {
     KeyFrame* pKF = mit->first;
     Eigen::Vector3d Owi = pKF->GetCameraCenter();
     Eigen::Vector3d normali = mWorldPos - Owi;
@@ -330,7 +343,7 @@ void MapPoint::UpdateNormalAndDepth() {
 
   Eigen::Vector3d PC = Pos - pRefKF->GetCameraCenter();
   const float dist = PC.norm();
-  const int level = pRefKF->mvKeysUn[observations[pRefKF]].octave;
+  const int level = pRefKF->mvKeysUn[refIdx].octave;
   const float levelScaleFactor =  pRefKF->mvScaleFactors[level];
   const int nLevels = pRefKF->mnScaleLevels;
 
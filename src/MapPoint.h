@@ -26,6 +26,8 @@
 #define SD_SLAM_MAPPOINT_H
 
 #include <mutex>
+#include <vector>
+#include <utility>
 #include <opencv2/core/core.hpp>
 #include <Eigen/Dense>
 #include "KeyFrame.h"
@@ -40,6 +42,9 @@ class Frame;
 
 class MapPoint {
  public:
+  // Keyframe observing the point and index of the keypoint in it
+  typedef std::pair<KeyFrame*, size_t> Observation;
+
   MapPoint(const Eigen::Vector3d &Pos, KeyFrame* pRefKF, Map* pMap);
   MapPoint(const Eigen::Vector3d &Pos,  Map* pMap, Frame* pFrame, const int &idxF);
 
@@ -49,9 +54,19 @@ class MapPoint {
   Eigen::Vector3d GetNormal();
   KeyFrame* GetReferenceKeyFrame();
 
-  std::map<KeyFrame*, size_t> GetObservations();
+  // Copy of the observations, sorted by keyframe
+  std::vector<Observation> GetObservations();
   int Observations();
 
+  // Call visit(pKF, idx) for each observation without copying them. The point is locked
+  // meanwhile, so visit must not call back into it nor lock keyframe features.
+  template<typename Visitor>
+  inline void ForEachObservation(Visitor &&visit) {
+    std::unique_lock<std::mutex> lock(mMutexFeatures);
+    for (const Observation &obs : mObservations)
+      visit(obs.first, obs.second);
+  }
+
   void AddObservation(KeyFrame* pKF, size_t idx);
   void EraseObservation(KeyFrame* pKF);
 
@@ -84,7 +99,6 @@ class MapPoint {
 
  public:
   long unsigned int mnId;
-  static long unsigned int nNextId;
   long int mnFirstKFid;
   int nObs;
 
@@ -109,15 +123,13 @@ class MapPoint {
   Eigen::Vector3d mPosGBA;
   long unsigned int mnBAGlobalForKF;
 
-
-  static std::mutex mGlobalMutex;
-
  protected:
    // Position in absolute coordinates
    Eigen::Vector3d mWorldPos;
 
-   // Keyframes observing the point and associated index in keyframe
-   std::map<KeyFrame*, size_t> mObservations;
+   // Keyframes observing the point and associated index in keyframe.
+   // Flat and sorted by keyframe, points are observed by a few keyframes.
+   std::vector<Observation> mObservations;
 
    // Mean viewing direction
    Eigen::Vector3d mNormalVector;
@@ -145,6 +157,9 @@ class MapPoint {
    std::mutex mMutexPos;
    std::mutex mMutexFeatures;
 
+   // Observation of a keyframe, or end if not observed (mMutexFeatures must be locked)
+   std::vector<Observation>::iterator FindObservation(KeyFrame* pKF);
+
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
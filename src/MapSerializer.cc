@@ -0,0 +1,514 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "MapSerializer.h"
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "Frame.h"
+#include "ORBextractor.h"
+#include "Config.h"
+#include "extra/timer.h"
+#include "extra/log.h"
+
+using std::vector;
+using std::string;
+using std::set;
+
+namespace SD_SLAM {
+
+const uint32_t MapSerializer::VERSION = 1;
+
+namespace {
+
+const char MAGIC[8] = {'S', 'D', 'S', 'L', 'A', 'M', 'A', 'P'};
+
+// Keypoint as stored in file
+struct KeyPointRecord {
+  float x, y, size, angle, response;
+  int32_t octave;
+};
+
+// Sequential writer over an output file
+class Writer {
+ public:
+  explicit Writer(std::ofstream &f): f_(f) {}
+
+  template<typename T> void Put(const T &v) {
+    f_.write(reinterpret_cast<const char*>(&v), sizeof(T));
+  }
+
+  template<typename T> void PutArray(const vector<T> &v) {
+    Put<uint32_t>(v.size());
+    if (!v.empty())
+      f_.write(reinterpret_cast<const char*>(v.data()), v.size()*sizeof(T));
+  }
+
+ private:
+  std::ofstream &f_;
+};
+
+// Sequential reader over a file loaded in memory. Reads out of bounds set the error flag.
+class Reader {
+ public:
+  explicit Reader(const vector<char> &data): data_(data), pos_(0), ok_(true) {}
+
+  inline bool ok() const { return ok_; }
+
+  void Read(void *dst, size_t bytes) {
+    if (!ok_ || bytes > data_.size()-pos_) {
+      ok_ = false;
+      return;
+    }
+    memcpy(dst, data_.data()+pos_, bytes);
+    pos_ += bytes;
+  }
+
+  template<typename T> T Get() {
+    T v = T();
+    Read(&v, sizeof(T));
+    return v;
+  }
+
+  template<typename T> void GetArray(vector<T> &v) {
+    uint32_t n = Get<uint32_t>();
+    if (!ok_ || n > (data_.size()-pos_)/sizeof(T)) {
+      ok_ = false;
+      v.clear();
+      return;
+    }
+    v.resize(n);
+    Read(v.data(), n*sizeof(T));
+  }
+
+ private:
+  const vector<char> &data_;
+  size_t pos_;
+  bool ok_;
+};
+
+vector<KeyPointRecord> ToRecords(const vector<cv::KeyPoint> &keys) {
+  vector<KeyPointRecord> records(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    const cv::KeyPoint &kp = keys[i];
+    records[i] = {kp.pt.x, kp.pt.y, kp.size, kp.angle, kp.response, kp.octave};
+  }
+  return records;
+}
+
+vector<cv::KeyPoint> FromRecords(const vector<KeyPointRecord> &records) {
+  vector<cv::KeyPoint> keys(records.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    const KeyPointRecord &r = records[i];
+    keys[i] = cv::KeyPoint(r.x, r.y, r.size, r.angle, r.response, r.octave);
+  }
+  return keys;
+}
+
+// Keyframe links are solved once all keyframes are loaded
+struct KeyFrameLinks {
+  KeyFrame* pKF;
+  int64_t parent;
+  vector<uint64_t> connections;
+  vector<int32_t> weights;
+  vector<uint64_t> loops;
+};
+
+}  // namespace
+
+MapSerializer::MapSerializer(Map *pMap): mpMap(pMap) {
+}
+
+bool MapSerializer::Save(const string &filename) {
+  Timer total(true);
+
+  std::ofstream f(filename.c_str(), std::ios::binary);
+  if (!f.is_open()) {
+    LOGE("Failed to open file: %s", filename.c_str());
+    return false;
+  }
+
+  vector<KeyFrame*> vpAllKFs = mpMap->GetAllKeyFrames();
+  sort(vpAllKFs.begin(), vpAllKFs.end(), KeyFrame::lId);
+
+  vector<KeyFrame*> vpKFs;
+  set<KeyFrame*> spKFs;
+  for (KeyFrame* pKF : vpAllKFs) {
+    if (pKF->isBad())
+      continue;
+    vpKFs.push_back(pKF);
+    spKFs.insert(pKF);
+  }
+
+  Writer w(f);
+
+  // Header
+  f.write(MAGIC, sizeof(MAGIC));
+  w.Put<uint32_t>(VERSION);
+
+  cv::Size imSize;
+  Eigen::Matrix3d K;
+  int nLevels = Config::NumLevels();
+  float scaleFactor = Config::ScaleFactor();
+  if (!vpKFs.empty()) {
+    // Keyframe images are not decoded only to get their size
+    if (vpKFs[0]->mpUndistorter)
+      imSize = vpKFs[0]->mpUndistorter->ImageSize();
+    else
+      imSize = cv::Size(Config::Width(), Config::Height());
+    K = vpKFs[0]->mK;
+    nLevels = vpKFs[0]->mnScaleLevels;
+    scaleFactor = vpKFs[0]->mfScaleFactor;
+  } else {
+    K << Config::fx(), 0.0, Config::cx(), 0.0, Config::fy(), Config::cy(), 0.0, 0.0, 1.0;
+  }
+
+  w.Put<double>(K(0, 0));
+  w.Put<double>(K(1, 1));
+  w.Put<double>(K(0, 2));
+  w.Put<double>(K(1, 2));
+  w.Put<double>(Config::k1());
+  w.Put<double>(Config::k2());
+  w.Put<double>(Config::p1());
+  w.Put<double>(Config::p2());
+  w.Put<double>(Config::k3());
+  w.Put<int32_t>(imSize.width);
+  w.Put<int32_t>(imSize.height);
+  w.Put<int32_t>(nLevels);
+  w.Put<float>(scaleFactor);
+  w.Put<float>(vpKFs.empty() ? 0.0f : vpKFs[0]->mbf);
+  w.Put<float>(vpKFs.empty() ? 0.0f : vpKFs[0]->mThDepth);
+
+  // Keyframes
+  w.Put<uint32_t>(vpKFs.size());
+  for (KeyFrame* pKF : vpKFs) {
+    w.Put<uint64_t>(pKF->mnId);
+
+    Eigen::Matrix4d pose = pKF->GetPose();
+    for (int i = 0; i < 16; i++)
+      w.Put<double>(pose.data()[i]);
+
+    // Features
+    w.PutArray(ToRecords(pKF->mvKeys));
+    w.PutArray(ToRecords(pKF->mvKeysUn));
+    w.PutArray(pKF->mvDepth);
+    w.Put<int32_t>(pKF->mDescriptors.cols);
+    cv::Mat desc = pKF->mDescriptors.isContinuous() ? pKF->mDescriptors : pKF->mDescriptors.clone();
+    w.PutArray(vector<uchar>(desc.data, desc.data + desc.total()*desc.elemSize()));
+
+    // Spanning tree, covisibility and loop edges
+    KeyFrame* pParent = pKF->GetParent();
+    w.Put<int64_t>(pParent && spKFs.count(pParent) ? static_cast<int64_t>(pParent->mnId) : -1);
+
+    vector<uint64_t> connections;
+    vector<int32_t> weights;
+    for (KeyFrame* pKFi : pKF->GetConnectedKeyFrames()) {
+      if (!spKFs.count(pKFi))
+        continue;
+      connections.push_back(pKFi->mnId);
+      weights.push_back(pKF->GetWeight(pKFi));
+    }
+    w.PutArray(connections);
+    w.PutArray(weights);
+
+    vector<uint64_t> loops;
+    for (KeyFrame* pKFi : pKF->GetLoopEdges()) {
+      if (spKFs.count(pKFi))
+        loops.push_back(pKFi->mnId);
+    }
+    w.PutArray(loops);
+
+    // Images
+    vector<vector<uchar> > pyramid;
+    vector<uchar> depth;
+    float depthFactor;
+    pKF->GetEncodedImages(pyramid, depth, depthFactor);
+    w.Put<uint32_t>(pyramid.size());
+    for (const vector<uchar> &level : pyramid)
+      w.PutArray(level);
+    w.PutArray(depth);
+    w.Put<float>(depthFactor);
+  }
+
+  // Map points
+  vector<MapPoint*> vpMPs;
+  for (MapPoint* pMP : mpMap->GetAllMapPoints()) {
+    if (!pMP->isBad())
+      vpMPs.push_back(pMP);
+  }
+
+  w.Put<uint32_t>(vpMPs.size());
+  for (MapPoint* pMP : vpMPs) {
+    Eigen::Vector3d pos = pMP->GetWorldPos();
+    w.Put<double>(pos(0));
+    w.Put<double>(pos(1));
+    w.Put<double>(pos(2));
+
+    vector<uint64_t> kfs;
+    vector<uint32_t> indices;
+    std::vector<MapPoint::Observation> observations = pMP->GetObservations();
+    for (auto mit = observations.begin(), mend = observations.end(); mit != mend; mit++) {
+      if (!spKFs.count(mit->first))
+        continue;
+      kfs.push_back(mit->first->mnId);
+      indices.push_back(mit->second);
+    }
+
+    KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+    if (!pRefKF || !spKFs.count(pRefKF))
+      w.Put<int64_t>(kfs.empty() ? -1 : static_cast<int64_t>(kfs[0]));
+    else
+      w.Put<int64_t>(pRefKF->mnId);
+
+    w.PutArray(kfs);
+    w.PutArray(indices);
+  }
+
+  f.close();
+  if (f.fail()) {
+    LOGE("Failed to write file: %s", filename.c_str());
+    return false;
+  }
+
+  total.Stop();
+  LOGD("Map saved in %.2fms (%lu keyframes, %lu points)", total.GetMsTime(), vpKFs.size(), vpMPs.size());
+  return true;
+}
+
+bool MapSerializer::Load(const string &filename) {
+  Timer total(true);
+
+  if (mpMap->KeyFramesInMap() > 0) {
+    LOGE("Map must be empty to load a map");
+    return false;
+  }
+
+  // Read whole file at once
+  std::ifstream f(filename.c_str(), std::ios::binary | std::ios::ate);
+  if (!f.is_open()) {
+    LOGE("Failed to open file: %s", filename.c_str());
+    return false;
+  }
+
+  vector<char> data(static_cast<size_t>(f.tellg()));
+  f.seekg(0);
+  f.read(data.data(), data.size());
+  if (!f) {
+    LOGE("Failed to read file: %s", filename.c_str());
+    return false;
+  }
+  f.close();
+
+  Reader r(data);
+
+  // Header
+  char magic[sizeof(MAGIC)];
+  r.Read(magic, sizeof(magic));
+  if (!r.ok() || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+    LOGE("Not a map file: %s", filename.c_str());
+    return false;
+  }
+
+  uint32_t version = r.Get<uint32_t>();
+  if (version != VERSION) {
+    LOGE("Map version %u not supported (expected %u)", version, VERSION);
+    return false;
+  }
+
+  Eigen::Matrix3d K = Eigen::Matrix3d::Identity();
+  K(0, 0) = r.Get<double>();
+  K(1, 1) = r.Get<double>();
+  K(0, 2) = r.Get<double>();
+  K(1, 2) = r.Get<double>();
+
+  cv::Mat distCoef(4, 1, CV_32F);
+  for (int i = 0; i < 4; i++)
+    distCoef.at<float>(i) = r.Get<double>();
+  const float k3 = r.Get<double>();
+  if (k3 != 0) {
+    distCoef.resize(5);
+    distCoef.at<float>(4) = k3;
+  }
+
+  cv::Size imSize;
+  imSize.width = r.Get<int32_t>();
+  imSize.height = r.Get<int32_t>();
+  const int nLevels = r.Get<int32_t>();
+  const float scaleFactor = r.Get<float>();
+  const float bf = r.Get<float>();
+  const float thDepth = r.Get<float>();
+
+  if (!r.ok()) {
+    LOGE("Map header is not valid");
+    return false;
+  }
+
+  if (fabs(K(0, 0)-Config::fx()) > 1e-3 || fabs(K(1, 1)-Config::fy()) > 1e-3) {
+    LOGE("Warning: map was created with a different calibration");
+  }
+
+  // Only provides scale information to frames
+  ORBextractor extractor(Config::NumFeatures(), scaleFactor, nLevels, Config::ThresholdFAST());
+
+  // Keyframes
+  uint32_t nKFs = r.Get<uint32_t>();
+  std::map<uint64_t, KeyFrame*> mKFs;
+  vector<KeyFrameLinks> vLinks;
+
+  vector<KeyPointRecord> keys, keysUn;
+  vector<float> depths;
+  vector<uchar> descriptors;
+  vector<vector<uchar> > pyramid;
+  vector<uchar> depth;
+
+  for (uint32_t i = 0; i < nKFs && r.ok(); i++) {
+    KeyFrameLinks links;
+    uint64_t id = r.Get<uint64_t>();
+
+    Eigen::Matrix4d pose;
+    for (int j = 0; j < 16; j++)
+      pose.data()[j] = r.Get<double>();
+
+    r.GetArray(keys);
+    r.GetArray(keysUn);
+    r.GetArray(depths);
+    int descSize = r.Get<int32_t>();
+    r.GetArray(descriptors);
+
+    links.parent = r.Get<int64_t>();
+    r.GetArray(links.connections);
+    r.GetArray(links.weights);
+    r.GetArray(links.loops);
+
+    uint32_t nImages = r.Get<uint32_t>();
+    if (!r.ok() || nImages > static_cast<uint32_t>(nLevels))
+      break;
+    pyramid.assign(nImages, vector<uchar>());
+    for (uint32_t j = 0; j < nImages; j++)
+      r.GetArray(pyramid[j]);
+    r.GetArray(depth);
+    float depthFactor = r.Get<float>();
+
+    const size_t N = keys.size();
+    if (!r.ok() || keysUn.size() != N || depths.size() != N || descSize < 0 || descriptors.size() != N*descSize ||
+        links.connections.size() != links.weights.size())
+      break;
+
+    cv::Mat desc;
+    if (N > 0)
+      desc = cv::Mat(descriptors, true).reshape(1, N);
+    Frame frame(FromRecords(keys), FromRecords(keysUn), depths, desc, imSize, &extractor, K, distCoef, bf, thDepth);
+    frame.SetPose(pose);
+
+    KeyFrame* pKF = new KeyFrame(frame, mpMap);
+    pKF->SetID(id);
+    pKF->SetEncodedImages(pyramid, depth, depthFactor);
+
+    links.pKF = pKF;
+    mKFs[id] = pKF;
+    vLinks.push_back(std::move(links));
+  }
+
+  if (!r.ok() || vLinks.size() != nKFs) {
+    LOGE("Map keyframes are not valid");
+    for (KeyFrameLinks &links : vLinks)
+      delete links.pKF;
+    return false;
+  }
+
+  // Restore spanning tree, covisibility graph and loop edges
+  for (KeyFrameLinks &links : vLinks) {
+    KeyFrame* pKF = links.pKF;
+
+    for (size_t j = 0; j < links.connections.size(); j++) {
+      auto it = mKFs.find(links.connections[j]);
+      if (it != mKFs.end())
+        pKF->AddConnection(it->second, links.weights[j]);
+    }
+
+    auto pit = links.parent >= 0 ? mKFs.find(links.parent) : mKFs.end();
+    if (pit != mKFs.end())
+      pKF->ChangeParent(pit->second);
+
+    for (uint64_t loop : links.loops) {
+      auto it = mKFs.find(loop);
+      if (it != mKFs.end())
+        pKF->AddLoopEdge(it->second);
+    }
+
+    mpMap->AddKeyFrame(pKF);
+  }
+
+  if (!vLinks.empty())
+    mpMap->mvpKeyFrameOrigins.push_back(vLinks[0].pKF);
+
+  // Map points
+  uint32_t nMPs = r.Get<uint32_t>();
+  uint32_t nLoaded = 0;
+  vector<uint64_t> kfs;
+  vector<uint32_t> indices;
+
+  for (uint32_t i = 0; i < nMPs && r.ok(); i++) {
+    Eigen::Vector3d pos;
+    pos(0) = r.Get<double>();
+    pos(1) = r.Get<double>();
+    pos(2) = r.Get<double>();
+    int64_t refId = r.Get<int64_t>();
+    r.GetArray(kfs);
+    r.GetArray(indices);
+
+    if (!r.ok() || kfs.size() != indices.size())
+      break;
+
+    auto rit = refId >= 0 ? mKFs.find(refId) : mKFs.end();
+    if (rit == mKFs.end())
+      continue;
+
+    MapPoint* pMP = new MapPoint(pos, rit->second, mpMap);
+
+    for (size_t j = 0; j < kfs.size(); j++) {
+      auto it = mKFs.find(kfs[j]);
+      if (it == mKFs.end() || indices[j] >= static_cast<uint32_t>(it->second->N))
+        continue;
+      it->second->AddMapPoint(pMP, indices[j]);
+      pMP->AddObservation(it->second, indices[j]);
+    }
+
+    pMP->ComputeDistinctiveDescriptors();
+    pMP->UpdateNormalAndDepth();
+    mpMap->AddMapPoint(pMP);
+    nLoaded++;
+  }
+
+  if (!r.ok()) {
+    LOGE("Map points are not valid, %u of %u loaded", nLoaded, nMPs);
+  }
+
+  total.Stop();
+  LOGD("Map loaded in %.2fms (%lu keyframes, %u points)", total.GetMsTime(), vLinks.size(), nLoaded);
+
+  return r.ok();
+}
+
+}  // namespace SD_SLAM
@@ -0,0 +1,58 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SD_SLAM_MAPSERIALIZER_H_
+#define SD_SLAM_MAPSERIALIZER_H_
+
+#include <string>
+#include <cstdint>
+
+namespace SD_SLAM {
+
+class Map;
+
+// Versioned binary map format. Keyframes are stored with their features, descriptors,
+// pose, covisibility and encoded images, and map points with their observations,
+// so maps are loaded without extracting features again.
+//
+// Layout (native byte order, all arrays prefixed by their size):
+//  - Header: magic, version, camera calibration, image size, scale pyramid, depth factor.
+//  - Keyframes: id, pose, keypoints, undistorted keypoints, depths, descriptors,
+//    parent, covisibility weights, loop edges and PNG encoded images.
+//  - Map points: position, reference keyframe and observations (keyframe id, keypoint index).
+class MapSerializer {
+ public:
+  explicit MapSerializer(Map *pMap);
+
+  // Save good keyframes and map points. Returns false if file couldn't be written.
+  bool Save(const std::string &filename);
+
+  // Load map from file into an empty map. Returns false if file is not valid.
+  bool Load(const std::string &filename);
+
+  // Current format version
+  static const uint32_t VERSION;
+
+ private:
+  Map* mpMap;
+};
+
+}  // namespace SD_SLAM
+
+#endif  // SD_SLAM_MAPSERIALIZER_H_
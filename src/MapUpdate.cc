@@ -0,0 +1,130 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "MapUpdate.h"
+#include <list>
+#include <set>
+#include <mutex>
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+
+using std::vector;
+using std::list;
+using std::set;
+using std::mutex;
+using std::unique_lock;
+
+namespace SD_SLAM {
+
+void MapUpdate::reserve(size_t nKFs, size_t nMPs, size_t nErased) {
+  poses_.reserve(nKFs);
+  positions_.reserve(nMPs);
+  erased_.reserve(nErased);
+}
+
+void MapUpdate::SetPose(KeyFrame *pKF, const Eigen::Matrix4d &Tcw) {
+  poses_.push_back(std::make_pair(pKF, Tcw));
+}
+
+void MapUpdate::SetWorldPos(MapPoint *pMP, const Eigen::Vector3d &Pos) {
+  positions_.push_back(std::make_pair(pMP, Pos));
+}
+
+void MapUpdate::EraseObservation(KeyFrame *pKF, MapPoint *pMP) {
+  erased_.push_back(std::make_pair(pKF, pMP));
+}
+
+void MapUpdate::Apply(Map *pMap) const {
+  unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+
+  for (size_t i = 0; i < erased_.size(); i++) {
+    erased_[i].first->EraseMapPointMatch(erased_[i].second);
+    erased_[i].second->EraseObservation(erased_[i].first);
+  }
+
+  for (size_t i = 0; i < poses_.size(); i++)
+    poses_[i].first->SetPose(poses_[i].second);
+
+  // Tracking must not see moved points with their previous normal and scale range
+  for (size_t i = 0; i < positions_.size(); i++) {
+    positions_[i].first->SetWorldPos(positions_[i].second);
+    positions_[i].first->UpdateNormalAndDepth();
+  }
+}
+
+void MapUpdate::FromGlobalBA(Map *pMap, unsigned long nLoopKF, MapUpdate &update) {
+  update.reserve(pMap->KeyFramesInMap(), pMap->MapPointsInMap());
+
+  // Correct keyframes starting at map first keyframe
+  list<KeyFrame*> lpKFtoCheck(pMap->mvpKeyFrameOrigins.begin(), pMap->mvpKeyFrameOrigins.end());
+
+  while (!lpKFtoCheck.empty()) {
+    KeyFrame* pKF = lpKFtoCheck.front();
+    const set<KeyFrame*> sChilds = pKF->GetChilds();
+    Eigen::Matrix4d Twc = pKF->GetPoseInverse();
+    for (set<KeyFrame*>::const_iterator sit = sChilds.begin(); sit != sChilds.end(); sit++) {
+      KeyFrame* pChild = *sit;
+      if (pChild->mnBAGlobalForKF != nLoopKF) {
+        Eigen::Matrix4d Tchildc = pChild->GetPose()*Twc;
+        pChild->mTcwGBA = Tchildc*pKF->mTcwGBA;
+        pChild->mnBAGlobalForKF = nLoopKF;
+      }
+      lpKFtoCheck.push_back(pChild);
+    }
+
+    pKF->mTcwBefGBA = pKF->GetPose();
+    update.SetPose(pKF, pKF->mTcwGBA);
+    lpKFtoCheck.pop_front();
+  }
+
+  // Correct MapPoints
+  const vector<MapPoint*> vpMPs = pMap->GetAllMapPoints();
+
+  for (size_t i = 0; i < vpMPs.size(); i++) {
+    MapPoint* pMP = vpMPs[i];
+
+    if (pMP->isBad())
+      continue;
+
+    if (pMP->mnBAGlobalForKF == nLoopKF) {
+      // If optimized by Global BA, just update
+      update.SetWorldPos(pMP, pMP->mPosGBA);
+    } else {
+      // Update according to the correction of its reference keyframe
+      KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+
+      if (pRefKF->mnBAGlobalForKF != nLoopKF)
+        continue;
+
+      // Map to non-corrected camera
+      Eigen::Matrix3d Rcw = pRefKF->mTcwBefGBA.block<3, 3>(0, 0);
+      Eigen::Vector3d tcw = pRefKF->mTcwBefGBA.block<3, 1>(0, 3);
+      Eigen::Vector3d Xc = Rcw*pMP->GetWorldPos()+tcw;
+
+      // Backproject using corrected camera
+      Eigen::Matrix3d Rwc = pRefKF->mTcwGBA.block<3, 3>(0, 0).transpose();
+      Eigen::Vector3d twc = -Rwc*pRefKF->mTcwGBA.block<3, 1>(0, 3);
+
+      update.SetWorldPos(pMP, Rwc*Xc+twc);
+    }
+  }
+}
+
+}  // namespace SD_SLAM
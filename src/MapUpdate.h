@@ -0,0 +1,75 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SD_SLAM_MAPUPDATE_H_
+#define SD_SLAM_MAPUPDATE_H_
+
+#include <vector>
+#include <utility>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+namespace SD_SLAM {
+
+class Map;
+class KeyFrame;
+class MapPoint;
+
+// Keyframe poses and point positions computed by the back-end (loop correction,
+// essential graph, global BA) without holding the map update mutex.
+// They are published all at once, so tracking never sees a half corrected map
+// and it is only blocked while the new values are copied and moved points
+// get their normals updated.
+class MapUpdate {
+ public:
+  MapUpdate() {}
+
+  void reserve(size_t nKFs, size_t nMPs, size_t nErased = 0);
+
+  // Stage new values
+  void SetPose(KeyFrame *pKF, const Eigen::Matrix4d &Tcw);
+  void SetWorldPos(MapPoint *pMP, const Eigen::Vector3d &Pos);
+
+  // Stage removal of an outlier observation
+  void EraseObservation(KeyFrame *pKF, MapPoint *pMP);
+
+  inline bool empty() const { return poses_.empty() && positions_.empty() && erased_.empty(); }
+  inline size_t KeyFrames() const { return poses_.size(); }
+  inline size_t MapPoints() const { return positions_.size(); }
+
+  // Erase staged observations, copy staged values to the map and update normals
+  // and depths of moved points in the same critical section of its update mutex.
+  void Apply(Map *pMap) const;
+
+  // Correction of a global BA (see Optimizer::GlobalBundleAdjustemnt with nLoopKF > 0).
+  // Keyframes not included in the BA are corrected through the spanning tree and
+  // points not included are moved with their reference keyframe.
+  // Local mapping must be stopped, keyframe and point poses are only read.
+  static void FromGlobalBA(Map *pMap, unsigned long nLoopKF, MapUpdate &update);
+
+ private:
+  std::vector<std::pair<KeyFrame*, Eigen::Matrix4d>,
+    Eigen::aligned_allocator<std::pair<KeyFrame*, Eigen::Matrix4d> > > poses_;
+  std::vector<std::pair<MapPoint*, Eigen::Vector3d> > positions_;
+  std::vector<std::pair<KeyFrame*, MapPoint*> > erased_;
+};
+
+}  // namespace SD_SLAM
+
+#endif  // SD_SLAM_MAPUPDATE_H_
@@ -403,8 +403,10 @@ static int bit_pattern_31_[256*4] =
   -1,-6, 0,-11/*mean (0.127148), correlation (0.547401)*/
 };
 
-ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels, int _thFAST):
-  nfeatures(_nfeatures), scaleFactor(_scaleFactor), nlevels(_nlevels), thFAST(_thFAST) {
+ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels, int _thFAST, int _nthreads):
+  nfeatures(_nfeatures), scaleFactor(_scaleFactor), nlevels(_nlevels), thFAST(_thFAST),
+  mpPool(new ThreadPool(std::max(_nthreads, 1))) {
+
   mvScaleFactor.resize(nlevels);
   mvLevelSigma2.resize(nlevels);
   mvScaleFactor[0]=1.0f;
@@ -468,11 +470,16 @@ void ORBextractor::ComputeKeyPoints(vector<std::vector<KeyPoint>> &allKeypoints,
 
   float imageRatio = (float)imagePyramid[0].cols/imagePyramid[0].rows;
 
+  // Split each level in cells
+  vector<LevelCells> levels(nlevels);
+  vector<pair<int, int> > cells;
+
   for (int level = 0; level < nlevels; ++level) {
+    LevelCells &lc = levels[level];
     const int nDesiredFeatures = mnFeaturesPerLevel[level];
 
-    const int levelCols = sqrt((float)nDesiredFeatures/(5*imageRatio));
-    const int levelRows = imageRatio*levelCols;
+    lc.levelCols = sqrt((float)nDesiredFeatures/(5*imageRatio));
+    lc.levelRows = imageRatio*lc.levelCols;
 
     const int minBorderX = EDGE_THRESHOLD;
     const int minBorderY = minBorderX;
@@ -481,30 +488,21 @@ void ORBextractor::ComputeKeyPoints(vector<std::vector<KeyPoint>> &allKeypoints,
 
     const int W = maxBorderX - minBorderX;
     const int H = maxBorderY - minBorderY;
-    const int cellW = ceil((float)W/levelCols);
-    const int cellH = ceil((float)H/levelRows);
-
-    const int nCells = levelRows*levelCols;
-    const int nfeaturesCell = ceil((float)nDesiredFeatures/nCells);
-
-    vector<vector<vector<KeyPoint> > > cellKeyPoints(levelRows, vector<vector<KeyPoint> >(levelCols));
-
-    vector<vector<int> > nToRetain(levelRows, vector<int>(levelCols, 0));
-    vector<vector<int> > nTotal(levelRows, vector<int>(levelCols, 0));
-    vector<vector<bool> > bNoMore(levelRows, vector<bool>(levelCols, false));
-    vector<int> iniXCol(levelCols);
-    vector<int> iniYRow(levelRows);
-    int nNoMore = 0;
-    int nToDistribute = 0;
+    const int cellW = ceil((float)W/lc.levelCols);
+    const int cellH = ceil((float)H/lc.levelRows);
 
+    lc.iniXCol.resize(lc.levelCols);
+    lc.iniYRow.resize(lc.levelRows);
+    lc.cellRects.resize(lc.levelRows*lc.levelCols);
+    lc.cellKeyPoints.resize(lc.levelRows*lc.levelCols);
 
     float hY = cellH + 6;
 
-    for (int i = 0; i<levelRows; i++) {
+    for (int i = 0; i<lc.levelRows; i++) {
       const float iniY = minBorderY + i*cellH - 3;
-      iniYRow[i] = iniY;
+      lc.iniYRow[i] = iniY;
 
-      if (i == levelRows-1) {
+      if (i == lc.levelRows-1) {
         hY = maxBorderY+3-iniY;
         if (hY <= 0)
           continue;
@@ -512,101 +510,133 @@ void ORBextractor::ComputeKeyPoints(vector<std::vector<KeyPoint>> &allKeypoints,
 
       float hX = cellW + 6;
 
-      for (int j = 0; j < levelCols; j++) {
-        float iniX;
-
-        if (i == 0) {
-          iniX = minBorderX + j*cellW - 3;
-          iniXCol[j] = iniX;
-        } else {
-          iniX = iniXCol[j];
-        }
+      for (int j = 0; j < lc.levelCols; j++) {
+        const float iniX = minBorderX + j*cellW - 3;
+        lc.iniXCol[j] = iniX;
 
-
-        if (j == levelCols-1) {
+        if (j == lc.levelCols-1) {
           hX = maxBorderX+3-iniX;
           if (hX <= 0)
             continue;
         }
 
-        Mat cellImage = imagePyramid[level].rowRange(iniY, iniY+hY).colRange(iniX, iniX+hX);
+        lc.cellRects[i*lc.levelCols+j] = Rect(lc.iniXCol[j], lc.iniYRow[i],
+                                              static_cast<int>(iniX+hX)-lc.iniXCol[j],
+                                              static_cast<int>(iniY+hY)-lc.iniYRow[i]);
+        cells.push_back(std::make_pair(level, i*lc.levelCols+j));
+      }
+    }
+  }
 
-        cellKeyPoints[i][j].reserve(nfeaturesCell*5);
+  // Detect FAST corners in every cell
+  mpPool->ParallelFor(cells.size(), [&](int c) {
+    const int level = cells[c].first;
+    const int cell = cells[c].second;
+    LevelCells &lc = levels[level];
 
-        FAST(cellImage, cellKeyPoints[i][j], thFAST, true);
+    const int nCells = lc.levelRows*lc.levelCols;
+    const int nfeaturesCell = ceil((float)mnFeaturesPerLevel[level]/nCells);
 
-        const int nKeys = cellKeyPoints[i][j].size();
-        nTotal[i][j] = nKeys;
+    Mat cellImage = imagePyramid[level](lc.cellRects[cell]);
 
-        if (nKeys>nfeaturesCell) {
-          nToRetain[i][j] = nfeaturesCell;
-          bNoMore[i][j] = false;
-        } else {
-          nToRetain[i][j] = nKeys;
-          nToDistribute += nfeaturesCell-nKeys;
-          bNoMore[i][j] = true;
-          nNoMore++;
-        }
+    lc.cellKeyPoints[cell].reserve(nfeaturesCell*5);
 
-      }
-    }
+    FAST(cellImage, lc.cellKeyPoints[cell], thFAST, true);
+  });
 
-    // Retain by score
-
-    while (nToDistribute > 0 && nNoMore<nCells) {
-      int nNewFeaturesCell = nfeaturesCell + ceil((float)nToDistribute/(nCells-nNoMore));
-      nToDistribute = 0;
-
-      for (int i = 0; i<levelRows; i++) {
-        for (int j = 0; j < levelCols; j++) {
-          if (!bNoMore[i][j]) {
-            if (nTotal[i][j]>nNewFeaturesCell) {
-              nToRetain[i][j] = nNewFeaturesCell;
-              bNoMore[i][j] = false;
-            } else {
-              nToRetain[i][j] = nTotal[i][j];
-              nToDistribute += nNewFeaturesCell-nTotal[i][j];
-              bNoMore[i][j] = true;
-              nNoMore++;
-            }
-          }
-        }
+  // Distribute keypoints among cells and compute orientations
+  mpPool->ParallelFor(nlevels, [&](int level) {
+    RetainKeyPoints(levels[level], level, allKeypoints[level]);
+    computeOrientation(imagePyramid[level], allKeypoints[level], umax);
+  });
+}
+
+void ORBextractor::RetainKeyPoints(LevelCells &lc, int level, vector<KeyPoint> &keypoints) {
+  const int nDesiredFeatures = mnFeaturesPerLevel[level];
+  const int levelRows = lc.levelRows;
+  const int levelCols = lc.levelCols;
+
+  const int nCells = levelRows*levelCols;
+  const int nfeaturesCell = ceil((float)nDesiredFeatures/nCells);
+
+  vector<vector<int> > nToRetain(levelRows, vector<int>(levelCols, 0));
+  vector<vector<int> > nTotal(levelRows, vector<int>(levelCols, 0));
+  vector<vector<bool> > bNoMore(levelRows, vector<bool>(levelCols, false));
+  int nNoMore = 0;
+  int nToDistribute = 0;
+
+  for (int i = 0; i<levelRows; i++) {
+    for (int j = 0; j < levelCols; j++) {
+      // Skip cells out of the image
+      if (lc.cellRects[i*levelCols+j].area() == 0)
+        continue;
+
+      const int nKeys = lc.cellKeyPoints[i*levelCols+j].size();
+      nTotal[i][j] = nKeys;
+
+      if (nKeys>nfeaturesCell) {
+        nToRetain[i][j] = nfeaturesCell;
+        bNoMore[i][j] = false;
+      } else {
+        nToRetain[i][j] = nKeys;
+        nToDistribute += nfeaturesCell-nKeys;
+        bNoMore[i][j] = true;
+        nNoMore++;
       }
     }
+  }
 
-    vector<KeyPoint> & keypoints = allKeypoints[level];
-    keypoints.reserve(nDesiredFeatures*2);
+  // Retain by score
 
-    const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
+  while (nToDistribute > 0 && nNoMore<nCells) {
+    int nNewFeaturesCell = nfeaturesCell + ceil((float)nToDistribute/(nCells-nNoMore));
+    nToDistribute = 0;
 
-    // Retain by score and transform coordinates
     for (int i = 0; i<levelRows; i++) {
       for (int j = 0; j < levelCols; j++) {
-        vector<KeyPoint> &keysCell = cellKeyPoints[i][j];
-        KeyPointsFilter::retainBest(keysCell,nToRetain[i][j]);
-        if ((int)keysCell.size()>nToRetain[i][j])
-          keysCell.resize(nToRetain[i][j]);
-
-
-        for (size_t k = 0, kend=keysCell.size(); k<kend; k++) {
-          keysCell[k].pt.x+=iniXCol[j];
-          keysCell[k].pt.y+=iniYRow[i];
-          keysCell[k].octave=level;
-          keysCell[k].size = scaledPatchSize;
-          keypoints.push_back(keysCell[k]);
+        if (!bNoMore[i][j]) {
+          if (nTotal[i][j]>nNewFeaturesCell) {
+            nToRetain[i][j] = nNewFeaturesCell;
+            bNoMore[i][j] = false;
+          } else {
+            nToRetain[i][j] = nTotal[i][j];
+            nToDistribute += nNewFeaturesCell-nTotal[i][j];
+            bNoMore[i][j] = true;
+            nNoMore++;
+          }
         }
       }
     }
+  }
+
+  keypoints.clear();
+  keypoints.reserve(nDesiredFeatures*2);
+
+  const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
 
-    if ((int)keypoints.size()>nDesiredFeatures) {
-      KeyPointsFilter::retainBest(keypoints,nDesiredFeatures);
-      keypoints.resize(nDesiredFeatures);
+  // Retain by score and transform coordinates
+  for (int i = 0; i<levelRows; i++) {
+    for (int j = 0; j < levelCols; j++) {
+      vector<KeyPoint> &keysCell = lc.cellKeyPoints[i*levelCols+j];
+      KeyPointsFilter::retainBest(keysCell,nToRetain[i][j]);
+      if ((int)keysCell.size()>nToRetain[i][j])
+        keysCell.resize(nToRetain[i][j]);
+
+
+      for (size_t k = 0, kend=keysCell.size(); k<kend; k++) {
+        keysCell[k].pt.x+=lc.iniXCol[j];
+        keysCell[k].pt.y+=lc.iniYRow[i];
+        keysCell[k].octave=level;
+        keysCell[k].size = scaledPatchSize;
+        keypoints.push_back(keysCell[k]);
+      }
     }
   }
 
-  // and compute orientations
-  for (int level = 0; level < nlevels; ++level)
-    computeOrientation(imagePyramid[level], allKeypoints[level], umax);
+  if ((int)keypoints.size()>nDesiredFeatures) {
+    KeyPointsFilter::retainBest(keypoints,nDesiredFeatures);
+    keypoints.resize(nDesiredFeatures);
+  }
 }
 
 static void computeDescriptors(const Mat& image, vector<KeyPoint>& keypoints, Mat& descriptors,
@@ -644,27 +674,26 @@ void ORBextractor::operator()(InputArray _image, InputArray _mask, vector<KeyPoi
     descriptors = _descriptors.getMat();
   }
 
-  _keypoints.clear();
-  _keypoints.reserve(nkeypoints);
+  // Offset of each level in descriptors
+  vector<int> offsets(nlevels, 0);
+  for (int level = 1; level < nlevels; ++level)
+    offsets[level] = offsets[level-1] + (int)allKeypoints[level-1].size();
 
-  int offset = 0;
-  for (int level = 0; level < nlevels; ++level) {
+  mpPool->ParallelFor(nlevels, [&](int level) {
     vector<KeyPoint>& keypoints = allKeypoints[level];
     int nkeypointsLevel = (int)keypoints.size();
 
     if (nkeypointsLevel == 0)
-      continue;
+      return;
 
     // preprocess the resized image
     Mat workingMat = imagePyramid[level].clone();
     GaussianBlur(workingMat, workingMat, Size(7, 7), 2, 2, BORDER_REFLECT_101);
 
     // Compute the descriptors
-    Mat desc = descriptors.rowRange(offset, offset + nkeypointsLevel);
+    Mat desc = descriptors.rowRange(offsets[level], offsets[level] + nkeypointsLevel);
     computeDescriptors(workingMat, keypoints, desc, pattern);
 
-    offset += nkeypointsLevel;
-
     // Scale keypoint coordinates
     if (level != 0) {
       float scale = mvScaleFactor[level]; //getScale(level, firstLevel, scaleFactor);
@@ -672,9 +701,13 @@ void ORBextractor::operator()(InputArray _image, InputArray _mask, vector<KeyPoi
          keypointEnd = keypoints.end(); keypoint != keypointEnd; ++keypoint)
         keypoint->pt *= scale;
     }
-    // And add the keypoints to the output
-    _keypoints.insert(_keypoints.end(), keypoints.begin(), keypoints.end());
-  }
+  });
+
+  // And add the keypoints to the output
+  _keypoints.clear();
+  _keypoints.reserve(nkeypoints);
+  for (int level = 0; level < nlevels; ++level)
+    _keypoints.insert(_keypoints.end(), allKeypoints[level].begin(), allKeypoints[level].end());
 }
 
 void ORBextractor::ComputePyramid(cv::Mat image, vector<cv::Mat> &imagePyramid) {
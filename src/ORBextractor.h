@@ -27,7 +27,9 @@
 
 #include <vector>
 #include <list>
+#include <memory>
 #include <opencv/cv.h>
+#include "extra/thread_pool.h"
 
 namespace SD_SLAM {
 
@@ -35,9 +37,8 @@ class ORBextractor {
  public:
   enum {HARRIS_SCORE = 0, FAST_SCORE=1 };
 
-  ORBextractor(int nfeatures, float scaleFactor, int nlevels, int thFAST);
-
-  ~ORBextractor(){}
+  // Levels and grid cells are processed by nthreads threads, results don't depend on it.
+  ORBextractor(int nfeatures, float scaleFactor, int nlevels, int thFAST, int nthreads = 1);
 
   // Compute the ORB features and descriptors on an image.
   // ORB are dispersed on the image using an octree.
@@ -72,6 +73,20 @@ class ORBextractor {
  protected:
   void ComputePyramid(cv::Mat image, std::vector<cv::Mat> &imagePyramid);
   void ComputeKeyPoints(std::vector<std::vector<cv::KeyPoint> >& allKeypoints, std::vector<cv::Mat> &imagePyramid);
+
+  // Grid of cells where FAST is computed in a pyramid level
+  struct LevelCells {
+    int levelRows;
+    int levelCols;
+    std::vector<int> iniXCol;
+    std::vector<int> iniYRow;
+    std::vector<cv::Rect> cellRects;  // Empty if out of the image
+    std::vector<std::vector<cv::KeyPoint> > cellKeyPoints;
+  };
+
+  // Distribute keypoints found in a level among its cells
+  void RetainKeyPoints(LevelCells &lc, int level, std::vector<cv::KeyPoint> &keypoints);
+
   std::vector<cv::Point> pattern;
 
   int nfeatures;
@@ -87,6 +102,8 @@ class ORBextractor {
   std::vector<float> mvInvScaleFactor;
   std::vector<float> mvLevelSigma2;
   std::vector<float> mvInvLevelSigma2;
+
+  std::unique_ptr<ThreadPool> mpPool;
 };
 
 }  // namespace SD_SLAM
@@ -27,7 +27,15 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/features2d/features2d.hpp>
 #include <stdint-gcc.h>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__POPCNT__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
 #include "extra/timer.h"
+#include "extra/profiler.h"
+#include "KeyFrameDatabase.h"
+#include "Config.h"
 
 using namespace std;
 
@@ -37,14 +45,48 @@ const int ORBmatcher::TH_HIGH = 100;
 const int ORBmatcher::TH_LOW = 50;
 const int ORBmatcher::HISTO_LENGTH = 30;
 
+// Hamming distance between two 256 bits descriptors
+static inline int HammingDistance(const uchar *a, const uchar *b) {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  uint8x16_t c0 = vcntq_u8(veorq_u8(vld1q_u8(a), vld1q_u8(b)));
+  uint8x16_t c1 = vcntq_u8(veorq_u8(vld1q_u8(a+16), vld1q_u8(b+16)));
+  uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vaddq_u8(c0, c1))));
+  return static_cast<int>(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+#elif defined(__POPCNT__) && defined(__x86_64__)
+  const uint64_t *pa = reinterpret_cast<const uint64_t*>(a);
+  const uint64_t *pb = reinterpret_cast<const uint64_t*>(b);
+  return _mm_popcnt_u64(pa[0] ^ pb[0]) + _mm_popcnt_u64(pa[1] ^ pb[1]) +
+         _mm_popcnt_u64(pa[2] ^ pb[2]) + _mm_popcnt_u64(pa[3] ^ pb[3]);
+#else
+  const uint32_t *pa = reinterpret_cast<const uint32_t*>(a);
+  const uint32_t *pb = reinterpret_cast<const uint32_t*>(b);
+
+  int dist = 0;
+
+  for (int i = 0; i<8; i++, pa++, pb++) {
+    unsigned  int v = *pa ^ *pb;
+    v = v - ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
+  }
+
+  return dist;
+#endif
+}
+
 ORBmatcher::ORBmatcher(float nnratio, bool checkOri): mfNNratio(nnratio), mbCheckOrientation(checkOri) {
 }
 
 int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoints, const float th) {
+  ScopedProfile profile(Profiler::SEARCH_PROJECTION);
+
   int nmatches = 0;
 
   const bool bFactor = th!=1.0;
 
+  vector<size_t> vCandidates;
+  vector<int> vDists;
+
   for (size_t iMP = 0; iMP<vpMapPoints.size(); iMP++) {
     MapPoint* pMP = vpMapPoints[iMP];
     if (!pMP->mbTrackInView)
@@ -61,10 +103,26 @@ int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoint
     if (bFactor)
       r*=th;
 
-    const vector<size_t> vIndices =
-        F.GetFeaturesInArea(pMP->mTrackProjX,pMP->mTrackProjY, r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel);
+    const float radius = r*F.mvScaleFactors[nPredictedLevel];
 
-    if (vIndices.empty())
+    // Select near keypoints not matched yet
+    vCandidates.clear();
+    F.ForEachFeatureInArea(pMP->mTrackProjX, pMP->mTrackProjY, radius, nPredictedLevel-1, nPredictedLevel,
+                           [&](size_t idx) {
+      if (F.mvpMapPoints[idx])
+        if (F.mvpMapPoints[idx]->Observations() > 0)
+          return;
+
+      if (F.mvuRight[idx] > 0) {
+        const float er = fabs(pMP->mTrackProjXR-F.mvuRight[idx]);
+        if (er > radius)
+          return;
+      }
+
+      vCandidates.push_back(idx);
+    });
+
+    if (vCandidates.empty())
       continue;
 
     const cv::Mat MPdescriptor = pMP->GetDescriptor();
@@ -75,23 +133,12 @@ int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoint
     int bestLevel2 = -1;
     int bestIdx =-1 ;
 
-    // Get best and second matches with near keypoints
-    for (vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++) {
-      const size_t idx = *vit;
+    DescriptorDistances(MPdescriptor.ptr<uchar>(), F.mDescriptors, vCandidates, vDists);
 
-      if (F.mvpMapPoints[idx])
-        if (F.mvpMapPoints[idx]->Observations() > 0)
-          continue;
-
-      if (F.mvuRight[idx] > 0) {
-        const float er = fabs(pMP->mTrackProjXR-F.mvuRight[idx]);
-        if (er>r*F.mvScaleFactors[nPredictedLevel])
-          continue;
-      }
-
-      const cv::Mat &d = F.mDescriptors.row(idx);
-
-      const int dist = DescriptorDistance(MPdescriptor,d);
+    // Get best and second matches with near keypoints
+    for (size_t k = 0; k < vCandidates.size(); k++) {
+      const size_t idx = vCandidates[k];
+      const int dist = vDists[k];
 
       if (dist<bestDist) {
         bestDist2=bestDist;
@@ -164,6 +211,8 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, const Eigen::Matrix4d &Scw, co
   int nmatches = 0;
 
   // For each Candidate MapPoint Project and Match
+  vector<size_t> vIndices;
+
   for (int iMP = 0, iendMP=vpPoints.size(); iMP<iendMP; iMP++) {
     MapPoint* pMP = vpPoints[iMP];
 
@@ -213,7 +262,7 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, const Eigen::Matrix4d &Scw, co
     // Search in a radius
     const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
 
-    const vector<size_t> vIndices = pKF->GetFeaturesInArea(u, v, radius);
+    pKF->GetFeaturesInArea(u, v, radius, vIndices);
 
     if (vIndices.empty())
       continue;
@@ -265,13 +314,15 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
   vector<int> vMatchedDistance(F2.mvKeysUn.size(),INT_MAX);
   vector<int> vnMatches21(F2.mvKeysUn.size(),-1);
 
+  vector<size_t> vIndices2;
+
   for (size_t i1 = 0, iend1=F1.mvKeysUn.size(); i1<iend1; i1++) {
     cv::KeyPoint kp1 = F1.mvKeysUn[i1];
     int level1 = kp1.octave;
     if (level1 > 0)
       continue;
 
-    vector<size_t> vIndices2 = F2.GetFeaturesInArea(vbPrevMatched[i1].x, vbPrevMatched[i1].y, windowSize,level1,level1);
+    F2.GetFeaturesInArea(vbPrevMatched[i1].x, vbPrevMatched[i1].y, windowSize, level1, level1, vIndices2);
 
     if (vIndices2.empty())
       continue;
@@ -381,6 +432,9 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, const Eig
   const vector<MapPoint*> vpMapPoints1 = pKF1->GetMapPointMatches();
   const vector<MapPoint*> vpMapPoints2 = pKF2->GetMapPointMatches();
 
+  // Widest band accepted by CheckDistEpipolarLine (reached at the last level), plus one pixel for rounding
+  const float maxDistEpipolar = sqrt(3.84*pKF2->mvLevelSigma2.back())+1.0f;
+
   for (int idx1 = 0; idx1<pKF1->N; idx1++) {
     MapPoint* pMP1 = vpMapPoints1[idx1];
 
@@ -390,41 +444,47 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, const Eig
 
     const bool bStereo1 = pKF1->mvuRight[idx1] >= 0;
     const cv::KeyPoint &kp1 = pKF1->mvKeysUn[idx1];
-    const cv::Mat &d1 = pKF1->mDescriptors.row(idx1);
+    const uchar *d1 = pKF1->mDescriptors.ptr<uchar>(idx1);
+
+    // Epipolar line in second image l = x1'F12 = [a b c]
+    const float a = kp1.pt.x*F12(0, 0)+kp1.pt.y*F12(1, 0)+F12(2, 0);
+    const float b = kp1.pt.x*F12(0, 1)+kp1.pt.y*F12(1, 1)+F12(2, 1);
+    const float c = kp1.pt.x*F12(0, 2)+kp1.pt.y*F12(1, 2)+F12(2, 2);
 
     int bestDist = TH_LOW;
     int bestIdx2 = -1;
 
-    for (int idx2 = 0; idx2<pKF2->N; idx2++) {
+    // Only keypoints in the cells crossed by the epipolar band are candidates
+    pKF2->ForEachFeatureNearLine(a, b, c, maxDistEpipolar, [&](size_t idx2) {
       MapPoint* pMP2 = vpMapPoints2[idx2];
 
       // If we have already matched or there is a MapPoint skip
       if (vbMatched2[idx2] || pMP2)
-        continue;
+        return;
 
       const bool bStereo2 = pKF2->mvuRight[idx2] >= 0;
 
       const cv::KeyPoint &kp2 = pKF2->mvKeysUn[idx2];
       if (!CheckDistEpipolarLine(kp1, kp2, F12, pKF2))
-        continue;
-
-      const cv::Mat &d2 = pKF2->mDescriptors.row(idx2);
+        return;
 
-      const int dist = DescriptorDistance(d1,d2);
+      const int dist = DescriptorDistance(d1, pKF2->mDescriptors.ptr<uchar>(idx2));
 
-      if (dist>TH_LOW || dist>bestDist)
-        continue;
+      // Candidates are not visited in index order: on ties keep the highest index,
+      // as the exhaustive search did
+      if (dist>TH_LOW || dist>bestDist || (dist == bestDist && static_cast<int>(idx2) < bestIdx2))
+        return;
 
       if (!bStereo1 && !bStereo2) {
         const float distex = ex-kp2.pt.x;
         const float distey = ey-kp2.pt.y;
         if (distex*distex+distey*distey<100*pKF2->mvScaleFactors[kp2.octave])
-          continue;
+          return;
       }
 
       bestIdx2 = idx2;
       bestDist = dist;
-    }
+    });
 
     if (bestIdx2 >= 0) {
       const cv::KeyPoint &kp2 = pKF2->mvKeysUn[bestIdx2];
@@ -490,6 +550,8 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
 
   const int nMPs = vpMapPoints.size();
 
+  vector<size_t> vIndices;
+
   for (int i = 0; i<nMPs; i++) {
     MapPoint* pMP = vpMapPoints[i];
 
@@ -539,7 +601,7 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
     // Search in a radius
     const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
 
-    const vector<size_t> vIndices = pKF->GetFeaturesInArea(u, v, radius);
+    pKF->GetFeaturesInArea(u, v, radius, vIndices);
 
     if (vIndices.empty())
       continue;
@@ -636,6 +698,8 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const Eigen::Matrix4d &Scw, const vector<Map
   const int nPoints = vpPoints.size();
 
   // For each candidate MapPoint project and match
+  vector<size_t> vIndices;
+
   for (int iMP = 0; iMP<nPoints; iMP++) {
     MapPoint* pMP = vpPoints[iMP];
 
@@ -686,7 +750,7 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const Eigen::Matrix4d &Scw, const vector<Map
     // Search in a radius
     const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
 
-    const vector<size_t> vIndices = pKF->GetFeaturesInArea(u, v, radius);
+    pKF->GetFeaturesInArea(u, v, radius, vIndices);
 
     if (vIndices.empty())
       continue;
@@ -774,6 +838,8 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
   vector<int> vnMatch2(N2, -1);
 
   // Transform from KF1 to KF2 and search
+  vector<size_t> vIndices;
+
   for (int i1 = 0; i1<N1; i1++) {
     MapPoint* pMP = vpMapPoints1[i1];
 
@@ -816,7 +882,7 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
     // Search in a radius
     const float radius = th*pKF2->mvScaleFactors[nPredictedLevel];
 
-    const vector<size_t> vIndices = pKF2->GetFeaturesInArea(u, v, radius);
+    pKF2->GetFeaturesInArea(u, v, radius, vIndices);
 
     if (vIndices.empty())
       continue;
@@ -892,7 +958,7 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
     // Search in a radius of 2.5*sigma(ScaleLevel)
     const float radius = th*pKF1->mvScaleFactors[nPredictedLevel];
 
-    const vector<size_t> vIndices = pKF1->GetFeaturesInArea(u, v, radius);
+    pKF1->GetFeaturesInArea(u, v, radius, vIndices);
 
     if (vIndices.empty())
       continue;
@@ -944,6 +1010,8 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
 }
 
 int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono) {
+  ScopedProfile profile(Profiler::SEARCH_PROJECTION);
+
   int nmatches = 0;
 
   // Rotation Histogram (to check rotation consistency)
@@ -952,6 +1020,9 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
     rotHist[i].reserve(500);
   const float factor = 1.0f/HISTO_LENGTH;
 
+  vector<size_t> vCandidates;
+  vector<int> vDists;
+
   Eigen::Matrix3d Rcw = CurrentFrame.GetPose().block<3, 3>(0, 0);
   Eigen::Vector3d tcw = CurrentFrame.GetPose().block<3, 1>(0, 3);
 
@@ -965,6 +1036,8 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
   const bool bForward = tlc(2) > CurrentFrame.mb && !bMono;
   const bool bBackward = -tlc(2) > CurrentFrame.mb && !bMono;
 
+  vector<size_t> vIndices2;
+
   for (int i = 0; i<LastFrame.N; i++) {
     MapPoint* pMP = LastFrame.mvpMapPoints[i];
 
@@ -994,14 +1067,12 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
         // Search in a window. Size depends on scale
         float radius = th*CurrentFrame.mvScaleFactors[nLastOctave];
 
-        vector<size_t> vIndices2;
-
         if (bForward)
-          vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, nLastOctave);
+          CurrentFrame.GetFeaturesInArea(u, v, radius, nLastOctave, -1, vIndices2);
         else if (bBackward)
-          vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, 0, nLastOctave);
+          CurrentFrame.GetFeaturesInArea(u, v, radius, 0, nLastOctave, vIndices2);
         else
-          vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, nLastOctave-1, nLastOctave+1);
+          CurrentFrame.GetFeaturesInArea(u, v, radius, nLastOctave-1, nLastOctave+1, vIndices2);
 
         if (vIndices2.empty())
           continue;
@@ -1011,6 +1082,7 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
         int bestDist = 256;
         int bestIdx2 = -1;
 
+        vCandidates.clear();
         for (vector<size_t>::const_iterator vit=vIndices2.begin(), vend=vIndices2.end(); vit!=vend; vit++) {
           const size_t i2 = *vit;
           if (CurrentFrame.mvpMapPoints[i2])
@@ -1024,9 +1096,14 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
               continue;
           }
 
-          const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
+          vCandidates.push_back(i2);
+        }
 
-          const int dist = DescriptorDistance(dMP,d);
+        DescriptorDistances(dMP.ptr<uchar>(), CurrentFrame.mDescriptors, vCandidates, vDists);
+
+        for (size_t k = 0; k < vCandidates.size(); k++) {
+          const size_t i2 = vCandidates[k];
+          const int dist = vDists[k];
 
           if (dist<bestDist) {
             bestDist=dist;
@@ -1075,6 +1152,8 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
 }
 
 int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame* pKF, const float th, const bool bMono) {
+  ScopedProfile profile(Profiler::SEARCH_PROJECTION);
+
   int nmatches = 0;
 
   // Rotation Histogram (to check rotation consistency)
@@ -1083,6 +1162,9 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame* pKF, const flo
     rotHist[i].reserve(500);
   const float factor = 1.0f/HISTO_LENGTH;
 
+  vector<size_t> vCandidates;
+  vector<int> vDists;
+
   Eigen::Matrix3d Rcw = CurrentFrame.GetPose().block<3, 3>(0, 0);
   Eigen::Vector3d tcw = CurrentFrame.GetPose().block<3, 1>(0, 3);
 
@@ -1098,6 +1180,8 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame* pKF, const flo
   const bool bBackward = -tlc(2)>CurrentFrame.mb && !bMono;
 
   const vector<MapPoint*> vpMapPointMatches = pKF->GetMapPointMatches();
+  vector<size_t> vIndices2;
+
   for (size_t i = 0; i < vpMapPointMatches.size(); i++) {
     MapPoint* pMP = vpMapPointMatches[i];
     if (pMP) {
@@ -1126,14 +1210,12 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame* pKF, const flo
         // Search in a window. Size depends on scale
         float radius = th*CurrentFrame.mvScaleFactors[nLastOctave];
 
-        vector<size_t> vIndices2;
-
         if (bForward)
-          vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, nLastOctave);
+          CurrentFrame.GetFeaturesInArea(u, v, radius, nLastOctave, -1, vIndices2);
         else if (bBackward)
-          vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, 0, nLastOctave);
+          CurrentFrame.GetFeaturesInArea(u, v, radius, 0, nLastOctave, vIndices2);
         else
-          vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, nLastOctave-1, nLastOctave+1);
+          CurrentFrame.GetFeaturesInArea(u, v, radius, nLastOctave-1, nLastOctave+1, vIndices2);
 
         if (vIndices2.empty())
           continue;
@@ -1143,6 +1225,7 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame* pKF, const flo
         int bestDist = 256;
         int bestIdx2 = -1;
 
+        vCandidates.clear();
         for (vector<size_t>::const_iterator vit=vIndices2.begin(), vend=vIndices2.end(); vit!=vend; vit++) {
           const size_t i2 = *vit;
           if (CurrentFrame.mvpMapPoints[i2])
@@ -1156,9 +1239,14 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame* pKF, const flo
               continue;
           }
 
-          const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
+          vCandidates.push_back(i2);
+        }
 
-          const int dist = DescriptorDistance(dMP,d);
+        DescriptorDistances(dMP.ptr<uchar>(), CurrentFrame.mDescriptors, vCandidates, vDists);
+
+        for (size_t k = 0; k < vCandidates.size(); k++) {
+          const size_t i2 = vCandidates[k];
+          const int dist = vDists[k];
 
           if (dist<bestDist) {
             bestDist=dist;
@@ -1226,6 +1314,14 @@ int ORBmatcher::SearchByPoints(KeyFrame* currentKF, KeyFrame* pKF, vector<MapPoi
   matches = vector<MapPoint*>(vpMapPoints1.size(), static_cast<MapPoint*>(NULL));
   vector<bool> vbMatched2(vpMapPoints2.size(), false);
 
+  // Optionally, only descriptors sharing some bytes with the query are compared (approximate search)
+  std::shared_ptr<const DescriptorIndex> pIndex;
+  vector<unsigned char> vCounts;
+  if (Config::IndexedLoopSearch()) {
+    pIndex = pKF->GetDescriptorIndex();
+    vCounts.resize(pIndex->size(), 0);
+  }
+
   for (size_t idx1 = 0; idx1<vpMapPoints1.size(); idx1++) {
     MapPoint* pMP1 = vpMapPoints1[idx1];
     if (!pMP1)
@@ -1234,23 +1330,22 @@ int ORBmatcher::SearchByPoints(KeyFrame* currentKF, KeyFrame* pKF, vector<MapPoi
     if (pMP1->isBad())
       continue;
 
-    const cv::Mat &d1 = Descriptors1.row(idx1);
+    const uchar *d1 = Descriptors1.ptr<uchar>(idx1);
 
     int bestDist1=256;
     int bestIdx2 =-1 ;
     int bestDist2=256;
 
-    for (size_t idx2 = 0; idx2<vpMapPoints2.size(); idx2++) {
+    // Ties in the best distance always fail the ratio test, so visiting order doesn't matter
+    auto compare = [&](size_t idx2) {
       MapPoint* pMP2 = vpMapPoints2[idx2];
       if (!pMP2 || vbMatched2[idx2])
-        continue;
+        return;
 
       if (pMP2->isBad())
-        continue;
+        return;
 
-      const cv::Mat &d2 = Descriptors2.row(idx2);
-
-      int dist = DescriptorDistance(d1,d2);
+      int dist = DescriptorDistance(d1, Descriptors2.ptr<uchar>(idx2));
 
       if (dist<bestDist1) {
         bestDist2=bestDist1;
@@ -1259,6 +1354,22 @@ int ORBmatcher::SearchByPoints(KeyFrame* currentKF, KeyFrame* pKF, vector<MapPoi
       } else if (dist<bestDist2) {
         bestDist2=dist;
       }
+    };
+
+    if (pIndex) {
+      pIndex->ForEachCandidate(d1, DescriptorIndex::MIN_SHARED, vCounts, compare);
+
+      // The second best is missed more often than the best, so a match is confirmed
+      // against every descriptor sharing a single byte before the ratio test
+      if (bestDist1<TH_LOW && static_cast<float>(bestDist1)<mfNNratio*static_cast<float>(bestDist2)) {
+        bestDist1=256;
+        bestIdx2=-1;
+        bestDist2=256;
+        pIndex->ForEachCandidate(d1, 1, vCounts, compare);
+      }
+    } else {
+      for (size_t idx2 = 0; idx2<vpMapPoints2.size(); idx2++)
+        compare(idx2);
     }
 
     if (bestDist1<TH_LOW) {
@@ -1303,6 +1414,112 @@ int ORBmatcher::SearchByPoints(KeyFrame* currentKF, KeyFrame* pKF, vector<MapPoi
   return nmatches;
 }
 
+int ORBmatcher::SearchByWords(KeyFrame* pKF, Frame &F, vector<MapPoint*> &vpMapPointMatches) {
+  int nmatches = 0;
+
+  const vector<MapPoint*> vpMapPointsKF = pKF->GetMapPointMatches();
+  vpMapPointMatches = vector<MapPoint*>(F.N, static_cast<MapPoint*>(NULL));
+
+  // Rotation Histogram (to check rotation consistency)
+  vector<int> rotHist[HISTO_LENGTH];
+  for (int i = 0; i<HISTO_LENGTH; i++)
+    rotHist[i].reserve(500);
+  const float factor = 1.0f/HISTO_LENGTH;
+
+  // Index frame keypoints by word
+  vector<pair<unsigned int, int> > vFrameWords;
+  vFrameWords.reserve(F.N*KeyFrameDatabase::NUM_TABLES);
+  for (int i = 0; i < F.N; i++) {
+    const cv::Mat d = F.mDescriptors.row(i);
+    for (int t = 0; t < KeyFrameDatabase::NUM_TABLES; t++)
+      vFrameWords.push_back(make_pair(KeyFrameDatabase::DescriptorWord(d, t), i));
+  }
+  sort(vFrameWords.begin(), vFrameWords.end());
+
+  vector<bool> vbMatchedF(F.N, false);
+
+  for (size_t idxKF = 0; idxKF < vpMapPointsKF.size(); idxKF++) {
+    MapPoint* pMP = vpMapPointsKF[idxKF];
+    if (!pMP)
+      continue;
+
+    if (pMP->isBad())
+      continue;
+
+    const cv::Mat &dKF = pKF->mDescriptors.row(idxKF);
+
+    int bestDist1=256;
+    int bestIdxF =-1 ;
+    int bestDist2=256;
+
+    // Only compare against frame keypoints sharing a word in any table
+    for (int t = 0; t < KeyFrameDatabase::NUM_TABLES; t++) {
+      const unsigned int word = KeyFrameDatabase::DescriptorWord(dKF, t);
+      auto range = equal_range(vFrameWords.begin(), vFrameWords.end(), make_pair(word, 0),
+                               [](const pair<unsigned int, int> &a, const pair<unsigned int, int> &b) { return a.first < b.first; });
+
+      for (auto it = range.first; it != range.second; it++) {
+        const int realIdxF = it->second;
+
+        // Same keypoint may be found in several tables
+        if (vbMatchedF[realIdxF] || realIdxF == bestIdxF)
+          continue;
+
+        const cv::Mat &dF = F.mDescriptors.row(realIdxF);
+
+        const int dist = DescriptorDistance(dKF, dF);
+
+        if (dist<bestDist1) {
+          bestDist2=bestDist1;
+          bestDist1=dist;
+          bestIdxF=realIdxF;
+        } else if (dist<bestDist2) {
+          bestDist2=dist;
+        }
+      }
+    }
+
+    if (bestDist1<=TH_LOW) {
+      if (static_cast<float>(bestDist1)<mfNNratio*static_cast<float>(bestDist2)) {
+        vpMapPointMatches[bestIdxF]=pMP;
+        vbMatchedF[bestIdxF] = true;
+
+        if (mbCheckOrientation) {
+          float rot = pKF->mvKeysUn[idxKF].angle-F.mvKeys[bestIdxF].angle;
+          if (rot < 0.0)
+            rot+=360.0f;
+          int bin = round(rot*factor);
+          if (bin==HISTO_LENGTH)
+            bin = 0;
+          assert(bin >= 0 && bin<HISTO_LENGTH);
+          rotHist[bin].push_back(bestIdxF);
+        }
+        nmatches++;
+      }
+    }
+  }
+
+  //Apply rotation consistency
+  if (mbCheckOrientation) {
+    int ind1=-1;
+    int ind2=-1;
+    int ind3=-1;
+
+    ComputeThreeMaxima(rotHist,HISTO_LENGTH, ind1, ind2, ind3);
+
+    for (int i = 0; i<HISTO_LENGTH; i++) {
+      if (i == ind1 || i == ind2 || i == ind3)
+        continue;
+      for (size_t j = 0, jend=rotHist[i].size(); j < jend; j++) {
+        vpMapPointMatches[rotHist[i][j]] = static_cast<MapPoint*>(NULL);
+        nmatches--;
+      }
+    }
+  }
+
+  return nmatches;
+}
+
 int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set<MapPoint*> &sAlreadyFound, const float th , const int ORBdist) {
   int nmatches = 0;
 
@@ -1318,6 +1535,8 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
 
   const vector<MapPoint*> vpMPs = pKF->GetMapPointMatches();
 
+  vector<size_t> vIndices2;
+
   for (size_t i = 0, iend=vpMPs.size(); i < iend; i++) {
     MapPoint* pMP = vpMPs[i];
 
@@ -1355,7 +1574,7 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
         // Search in a window
         const float radius = th*CurrentFrame.mvScaleFactors[nPredictedLevel];
 
-        const vector<size_t> vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, nPredictedLevel-1, nPredictedLevel+1);
+        CurrentFrame.GetFeaturesInArea(u, v, radius, nPredictedLevel-1, nPredictedLevel+1, vIndices2);
 
         if (vIndices2.empty())
           continue;
@@ -1457,19 +1676,22 @@ void ORBmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
 // Bit set count operation from
 // http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
 int ORBmatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b) {
-  const int *pa = a.ptr<int32_t>();
-  const int *pb = b.ptr<int32_t>();
+  return HammingDistance(a.ptr<uchar>(), b.ptr<uchar>());
+}
 
-  int dist = 0;
+int ORBmatcher::DescriptorDistance(const uchar *a, const uchar *b) {
+  return HammingDistance(a, b);
+}
 
-  for (int i = 0; i<8; i++, pa++, pb++) {
-    unsigned  int v = *pa ^ *pb;
-    v = v - ((v >> 1) & 0x55555555);
-    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-    dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
-  }
+void ORBmatcher::DescriptorDistances(const uchar *a, const cv::Mat &descriptors,
+                                     const vector<size_t> &indices, vector<int> &dists) {
+  const uchar *data = descriptors.data;
+  const size_t step = descriptors.step[0];
+  const size_t n = indices.size();
 
-  return dist;
+  dists.resize(n);
+  for (size_t i = 0; i < n; i++)
+    dists[i] = HammingDistance(a, data + indices[i]*step);
 }
 
 }  // namespace SD_SLAM
@@ -41,6 +41,12 @@ class ORBmatcher {
 
   // Computes the Hamming distance between two ORB descriptors
   static int DescriptorDistance(const cv::Mat &a, const cv::Mat &b);
+  static int DescriptorDistance(const uchar *a, const uchar *b);
+
+  // Computes the Hamming distance between a descriptor and the rows of descriptors selected by indices.
+  // Distances are stored in the same order as indices.
+  static void DescriptorDistances(const uchar *a, const cv::Mat &descriptors,
+                                  const std::vector<size_t> &indices, std::vector<int> &dists);
 
   // Search matches between Frame keypoints and projected MapPoints. Returns number of matches
   // Used to track the local map (Tracking)
@@ -55,6 +61,10 @@ class ORBmatcher {
   // Used to search loops (LoopClosing)
   int SearchByPoints(KeyFrame* currentKF, KeyFrame* pKF, std::vector<MapPoint*> &matches);
 
+  // Match MapPoints seen in KeyFrame with Frame keypoints sharing the same visual word.
+  // Used in relocalisation (Tracking)
+  int SearchByWords(KeyFrame* pKF, Frame &F, std::vector<MapPoint*> &vpMapPointMatches);
+
   // Project MapPoints seen in KeyFrame into the Frame and search matches.
   // Used in relocalisation (Tracking)
   int SearchByProjection(Frame &CurrentFrame, KeyFrame* pKF, const std::set<MapPoint*> &sAlreadyFound, const float th, const int ORBdist);
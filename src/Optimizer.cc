@@ -24,8 +24,13 @@
 
 #include "Optimizer.h"
 #include <mutex>
+#include <unordered_map>
 #include <Eigen/StdVector>
 #include "Converter.h"
+#include "MapUpdate.h"
+#include "LocalBA.h"
+#include "PoseOptimizer.h"
+#include "Config.h"
 #include "extra/g2o/core/block_solver.h"
 #include "extra/g2o/core/optimization_algorithm_levenberg.h"
 #include "extra/g2o/solvers/linear_solver_eigen.h"
@@ -33,11 +38,13 @@
 #include "extra/g2o/core/robust_kernel_impl.h"
 #include "extra/g2o/solvers/linear_solver_dense.h"
 #include "extra/g2o/types/types_seven_dof_expmap.h"
+#include "extra/profiler.h"
 
 using std::map;
 using std::set;
 using std::vector;
 using std::list;
+using std::unordered_map;
 using std::mutex;
 using std::unique_lock;
 
@@ -99,11 +106,11 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
     vPoint->setMarginalized(true);
     optimizer.addVertex(vPoint);
 
-     const map<KeyFrame*, size_t> observations = pMP->GetObservations();
+     const vector<MapPoint::Observation> observations = pMP->GetObservations();
 
     int nEdges = 0;
     //SET EDGES
-    for (map<KeyFrame*, size_t>::const_iterator mit=observations.begin(); mit!=observations.end(); mit++) {
+    for (vector<MapPoint::Observation>::const_iterator mit=observations.begin(); mit!=observations.end(); mit++) {
 
       KeyFrame* pKF = mit->first;
       if (pKF->isBad() || pKF->mnId>maxKFid)
@@ -218,203 +225,54 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
 
 }
 
-int Optimizer::PoseOptimization(Frame *pFrame) {
-  g2o::SparseOptimizer optimizer;
-  g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
-
-  linearSolver = new g2o::LinearSolverDense<g2o::BlockSolver_6_3::PoseMatrixType>();
-
-  g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
-
-  g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
-  optimizer.setAlgorithm(solver);
+int Optimizer::PoseOptimization(Frame *pFrame, Map *pMap) {
+  ScopedProfile profile(Profiler::POSE_OPTIMIZATION);
 
-  int nInitialCorrespondences = 0;
+  // Buffers are kept between frames of the same tracking thread
+  static thread_local PoseOptimizer optimizer;
+  optimizer.Reset(pFrame->GetPose(), pFrame->fx, pFrame->fy, pFrame->cx, pFrame->cy, pFrame->mbf);
 
-  // Set Frame vertex
-  g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
-  vSE3->setEstimate(Converter::toSE3Quat(pFrame->GetPose()));
-  vSE3->setId(0);
-  vSE3->setFixed(false);
-  optimizer.addVertex(vSE3);
-
-  // Set MapPoint vertices
   const int N = pFrame->N;
 
-  vector<g2o::EdgeSE3ProjectXYZOnlyPose*> vpEdgesMono;
-  vector<size_t> vnIndexEdgeMono;
-  vpEdgesMono.reserve(N);
-  vnIndexEdgeMono.reserve(N);
-
-  vector<g2o::EdgeStereoSE3ProjectXYZOnlyPose*> vpEdgesStereo;
-  vector<size_t> vnIndexEdgeStereo;
-  vpEdgesStereo.reserve(N);
-  vnIndexEdgeStereo.reserve(N);
-
-  const float deltaMono = sqrt(5.991);
-  const float deltaStereo = sqrt(7.815);
-
+  static thread_local vector<int> vnIndexObs;
+  vnIndexObs.clear();
+  vnIndexObs.reserve(N);
 
   {
-  unique_lock<mutex> lock(MapPoint::mGlobalMutex);
+  unique_lock<mutex> lock(pMap->mMutexPointPositions);
 
   for (int i = 0; i < N; i++) {
     MapPoint* pMP = pFrame->mvpMapPoints[i];
     if (pMP) {
-      // Monocular observation
-      if (pFrame->mvuRight[i] < 0) {
-        nInitialCorrespondences++;
-        pFrame->mvbOutlier[i] = false;
-
-        Eigen::Matrix<double, 2, 1> obs;
-        const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
-        obs << kpUn.pt.x, kpUn.pt.y;
-
-        g2o::EdgeSE3ProjectXYZOnlyPose* e = new g2o::EdgeSE3ProjectXYZOnlyPose();
-
-        e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
-        e->setMeasurement(obs);
-        const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-        e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
-
-        g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-        e->setRobustKernel(rk);
-        rk->setDelta(deltaMono);
-
-        e->fx = pFrame->fx;
-        e->fy = pFrame->fy;
-        e->cx = pFrame->cx;
-        e->cy = pFrame->cy;
-        Eigen::Vector3d Xw = pMP->GetWorldPos();
-        e->Xw[0] = Xw(0);
-        e->Xw[1] = Xw(1);
-        e->Xw[2] = Xw(2);
-
-        optimizer.addEdge(e);
-
-        vpEdgesMono.push_back(e);
-        vnIndexEdgeMono.push_back(i);
-      } else  {  // Stereo observation
-        nInitialCorrespondences++;
-        pFrame->mvbOutlier[i] = false;
-
-        //SET EDGE
-        Eigen::Matrix<double, 3, 1> obs;
-        const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
-        const float &kp_ur = pFrame->mvuRight[i];
-        obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
-
-        g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = new g2o::EdgeStereoSE3ProjectXYZOnlyPose();
-
-        e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
-        e->setMeasurement(obs);
-        const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-        Eigen::Matrix3d Info = Eigen::Matrix3d::Identity()*invSigma2;
-        e->setInformation(Info);
-
-        g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-        e->setRobustKernel(rk);
-        rk->setDelta(deltaStereo);
-
-        e->fx = pFrame->fx;
-        e->fy = pFrame->fy;
-        e->cx = pFrame->cx;
-        e->cy = pFrame->cy;
-        e->bf = pFrame->mbf;
-        Eigen::Vector3d Xw = pMP->GetWorldPos();
-        e->Xw[0] = Xw(0);
-        e->Xw[1] = Xw(1);
-        e->Xw[2] = Xw(2);
+      pFrame->mvbOutlier[i] = false;
 
-        optimizer.addEdge(e);
-
-        vpEdgesStereo.push_back(e);
-        vnIndexEdgeStereo.push_back(i);
-      }
+      // Negative right coordinate for monocular observations
+      const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
+      optimizer.AddObservation(pMP->GetWorldPos(), kpUn.pt.x, kpUn.pt.y, pFrame->mvuRight[i],
+                               pFrame->mvInvLevelSigma2[kpUn.octave]);
+      vnIndexObs.push_back(i);
     }
-
   }
   }
 
-
+  const int nInitialCorrespondences = vnIndexObs.size();
   if (nInitialCorrespondences<3)
     return 0;
 
-  // We perform 4 optimizations, after each optimization we classify observation as inlier/outlier
-  // At the next optimization, outliers are not included, but at the end they can be classified as inliers again.
-  const float chi2Mono[4]={5.991, 5.991, 5.991, 5.991};
-  const float chi2Stereo[4]={7.815, 7.815, 7.815, 7.815};
-  const int its[4]={10, 10, 10, 10};
-
-  int nBad = 0;
-  for (size_t it = 0; it<4; it++) {
-
-    vSE3->setEstimate(Converter::toSE3Quat(pFrame->GetPose()));
-    optimizer.initializeOptimization(0);
-    optimizer.optimize(its[it]);
-
-    nBad = 0;
-    for (size_t i = 0, iend=vpEdgesMono.size(); i < iend; i++) {
-      g2o::EdgeSE3ProjectXYZOnlyPose* e = vpEdgesMono[i];
-
-      const size_t idx = vnIndexEdgeMono[i];
-
-      if (pFrame->mvbOutlier[idx]) {
-        e->computeError();
-      }
+  const int nInliers = optimizer.Optimize();
 
-      const float chi2 = e->chi2();
-
-      if (chi2>chi2Mono[it]) {
-        pFrame->mvbOutlier[idx]=true;
-        e->setLevel(1);
-        nBad++;
-      } else {
-        pFrame->mvbOutlier[idx]=false;
-        e->setLevel(0);
-      }
-
-      if (it==2)
-        e->setRobustKernel(0);
-    }
-
-    for (size_t i = 0, iend=vpEdgesStereo.size(); i < iend; i++) {
-      g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = vpEdgesStereo[i];
-
-      const size_t idx = vnIndexEdgeStereo[i];
-
-      if (pFrame->mvbOutlier[idx]) {
-        e->computeError();
-      }
-
-      const float chi2 = e->chi2();
-
-      if (chi2>chi2Stereo[it]) {
-        pFrame->mvbOutlier[idx]=true;
-        e->setLevel(1);
-        nBad++;
-      } else {
-        e->setLevel(0);
-        pFrame->mvbOutlier[idx]=false;
-      }
-
-      if (it==2)
-        e->setRobustKernel(0);
-    }
-
-    if (optimizer.edges().size()<10)
-      break;
-  }
+  for (int i = 0; i < nInitialCorrespondences; i++)
+    pFrame->mvbOutlier[vnIndexObs[i]] = optimizer.IsOutlier(i);
 
   // Recover optimized pose and return number of inliers
-  g2o::VertexSE3Expmap* vSE3_recov = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(0));
-  g2o::SE3Quat SE3quat_recov = vSE3_recov->estimate();
-  pFrame->SetPose(Converter::toMatrix4d(SE3quat_recov));
+  pFrame->SetPose(optimizer.GetPose());
 
-  return nInitialCorrespondences-nBad;
+  return nInliers;
 }
 
 void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap) {
+  ScopedProfile profile(Profiler::LOCAL_BA);
+
   // Local KeyFrames: First Breath Search from Current Keyframe
   list<KeyFrame*> lLocalKeyFrames;
 
@@ -447,16 +305,18 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
   // Fixed Keyframes. Keyframes that see Local MapPoints but that are not Local Keyframes
   list<KeyFrame*> lFixedCameras;
   for (list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++) {
-    map<KeyFrame*, size_t> observations = (*lit)->GetObservations();
-    for (map<KeyFrame*, size_t>::iterator mit=observations.begin(), mend=observations.end(); mit != mend; mit++) {
-      KeyFrame* pKFi = mit->first;
-
+    (*lit)->ForEachObservation([&](KeyFrame* pKFi, size_t) {
       if (pKFi->mnBALocalForKF!=pKF->mnId && pKFi->mnBAFixedForKF!=pKF->mnId) {
         pKFi->mnBAFixedForKF=pKF->mnId;
         if (!pKFi->isBad())
           lFixedCameras.push_back(pKFi);
       }
-    }
+    });
+  }
+
+  if (Config::SchurLocalBA()) {
+    SchurLocalBundleAdjustment(lLocalKeyFrames, lFixedCameras, lLocalMapPoints, pbStopFlag, pMap);
+    return;
   }
 
   // Setup optimizer
@@ -532,10 +392,10 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
     vPoint->setMarginalized(true);
     optimizer.addVertex(vPoint);
 
-    const map<KeyFrame*, size_t> observations = pMP->GetObservations();
+    const vector<MapPoint::Observation> observations = pMP->GetObservations();
 
     //Set edges
-    for (map<KeyFrame*, size_t>::const_iterator mit=observations.begin(), mend=observations.end(); mit != mend; mit++) {
+    for (vector<MapPoint::Observation>::const_iterator mit=observations.begin(), mend=observations.end(); mit != mend; mit++) {
       KeyFrame* pKFi = mit->first;
 
       if (!pKFi->isBad()) {
@@ -682,35 +542,128 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
     }
   }
 
-  // Get Map Mutex
-  unique_lock<mutex> lock(pMap->mMutexMapUpdate);
-
-  if (!vToErase.empty()) {
-    for (size_t i = 0; i < vToErase.size(); i++) {
-      KeyFrame* pKFi = vToErase[i].first;
-      MapPoint* pMPi = vToErase[i].second;
-      pKFi->EraseMapPointMatch(pMPi);
-      pMPi->EraseObservation(pKFi);
-    }
-  }
-
   // Recover optimized data
+  MapUpdate update;
+  update.reserve(lLocalKeyFrames.size(), lLocalMapPoints.size(), vToErase.size());
 
   //Keyframes
   for (list<KeyFrame*>::iterator lit=lLocalKeyFrames.begin(), lend=lLocalKeyFrames.end(); lit!=lend; lit++) {
     KeyFrame* pKF = *lit;
     g2o::VertexSE3Expmap* vSE3 = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(pKF->mnId));
     g2o::SE3Quat SE3quat = vSE3->estimate();
-    pKF->SetPose(Converter::toMatrix4d(SE3quat));
+    update.SetPose(pKF, Converter::toMatrix4d(SE3quat));
   }
 
   //Points
   for (list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++) {
     MapPoint* pMP = *lit;
     g2o::VertexSBAPointXYZ* vPoint = static_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex(pMP->mnId+maxKFid+1));
-    pMP->SetWorldPos(vPoint->estimate());
-    pMP->UpdateNormalAndDepth();
+    update.SetWorldPos(pMP, vPoint->estimate());
   }
+
+  // Outliers are erased in the same critical section as the new poses are published
+  for (size_t i = 0; i < vToErase.size(); i++)
+    update.EraseObservation(vToErase[i].first, vToErase[i].second);
+
+  update.Apply(pMap);
+}
+
+void Optimizer::SchurLocalBundleAdjustment(const list<KeyFrame*> &lLocalKeyFrames, const list<KeyFrame*> &lFixedCameras,
+                                           const list<MapPoint*> &lLocalMapPoints, bool *pbStopFlag, Map *pMap) {
+  LocalBA ba;
+  ba.reserve(lLocalKeyFrames.size()+lFixedCameras.size(), lLocalMapPoints.size(),
+             (lLocalKeyFrames.size()+lFixedCameras.size())*lLocalMapPoints.size()/4);
+
+  // Local keyframes go first, so their pose index is their position in the list
+  unordered_map<KeyFrame*, int> poseIndex;
+  poseIndex.reserve(lLocalKeyFrames.size()+lFixedCameras.size());
+
+  for (list<KeyFrame*>::const_iterator lit=lLocalKeyFrames.begin(), lend=lLocalKeyFrames.end(); lit!=lend; lit++) {
+    KeyFrame* pKFi = *lit;
+    poseIndex[pKFi] = ba.AddPose(pKFi->GetPose(), pKFi->mnId == 0, pKFi->fx, pKFi->fy, pKFi->cx, pKFi->cy, pKFi->mbf);
+  }
+
+  for (list<KeyFrame*>::const_iterator lit=lFixedCameras.begin(), lend=lFixedCameras.end(); lit!=lend; lit++) {
+    KeyFrame* pKFi = *lit;
+    poseIndex[pKFi] = ba.AddPose(pKFi->GetPose(), true, pKFi->fx, pKFi->fy, pKFi->cx, pKFi->cy, pKFi->mbf);
+  }
+
+  // Points and their observations, with the keyframe and point of each observation
+  vector<KeyFrame*> vpEdgeKF;
+  vector<MapPoint*> vpMapPointEdge;
+
+  for (list<MapPoint*>::const_iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++) {
+    MapPoint* pMP = *lit;
+    ba.AddPoint(pMP->GetWorldPos());
+
+    const vector<MapPoint::Observation> observations = pMP->GetObservations();
+    for (vector<MapPoint::Observation>::const_iterator mit=observations.begin(), mend=observations.end(); mit != mend; mit++) {
+      KeyFrame* pKFi = mit->first;
+      if (pKFi->isBad())
+        continue;
+
+      // Observations added after the keyframes were collected have no pose
+      unordered_map<KeyFrame*, int>::const_iterator pit = poseIndex.find(pKFi);
+      if (pit == poseIndex.end())
+        continue;
+
+      const cv::KeyPoint &kpUn = pKFi->mvKeysUn[mit->second];
+      ba.AddObservation(pit->second, kpUn.pt.x, kpUn.pt.y, pKFi->mvuRight[mit->second],
+                        pKFi->mvInvLevelSigma2[kpUn.octave]);
+      vpEdgeKF.push_back(pKFi);
+      vpMapPointEdge.push_back(pMP);
+    }
+  }
+
+  if (pbStopFlag)
+    if (*pbStopFlag)
+      return;
+
+  ba.Optimize(5, pbStopFlag);
+
+  if (!pbStopFlag || !*pbStopFlag) {
+    // Optimize again without the outliers
+    for (size_t i = 0, iend=vpEdgeKF.size(); i < iend; i++) {
+      if (vpMapPointEdge[i]->isBad())
+        continue;
+
+      if (ba.Chi2(i) > (ba.IsStereo(i) ? 7.815 : 5.991) || !ba.IsDepthPositive(i))
+        ba.SetInlier(i, false);
+    }
+
+    ba.SetRobust(false);
+    ba.Optimize(10, pbStopFlag);
+  }
+
+  vector<std::pair<KeyFrame*,MapPoint*> > vToErase;
+
+  for (size_t i = 0, iend=vpEdgeKF.size(); i < iend; i++) {
+    MapPoint* pMP = vpMapPointEdge[i];
+
+    if (pMP->isBad())
+      continue;
+
+    if (ba.Chi2(i) > (ba.IsStereo(i) ? 7.815 : 5.991) || !ba.IsDepthPositive(i))
+      vToErase.push_back(std::make_pair(vpEdgeKF[i], pMP));
+  }
+
+  // Recover optimized data
+  MapUpdate update;
+  update.reserve(lLocalKeyFrames.size(), lLocalMapPoints.size(), vToErase.size());
+
+  int idx = 0;
+  for (list<KeyFrame*>::const_iterator lit=lLocalKeyFrames.begin(), lend=lLocalKeyFrames.end(); lit!=lend; lit++, idx++)
+    update.SetPose(*lit, ba.GetPose(idx));
+
+  idx = 0;
+  for (list<MapPoint*>::const_iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++, idx++)
+    update.SetWorldPos(*lit, ba.GetPoint(idx));
+
+  // Outliers are erased in the same critical section as the new poses are published
+  for (size_t i = 0; i < vToErase.size(); i++)
+    update.EraseObservation(vToErase[i].first, vToErase[i].second);
+
+  update.Apply(pMap);
 }
 
 
@@ -908,7 +861,8 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
   optimizer.initializeOptimization();
   optimizer.optimize(20);
 
-  unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+  MapUpdate update;
+  update.reserve(vpKFs.size(), vpMPs.size());
 
   // SE3 Pose Recovering. Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
   for (size_t i = 0; i < vpKFs.size(); i++) {
@@ -925,7 +879,7 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
 
     eigt *=(1./s); //[R t/s;0 1]
 
-    pKFi->SetPose(Converter::toSE3(eigR,eigt));
+    update.SetPose(pKFi, Converter::toSE3(eigR,eigt));
   }
 
   // Correct points. Transform to "non-optimized" reference keyframe pose and transform back with optimized pose
@@ -949,10 +903,10 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
 
     Eigen::Vector3d P3Dw = pMP->GetWorldPos();
     Eigen::Vector3d CorrectedP3Dw = correctedSwr.map(Srw.map(P3Dw));
-    pMP->SetWorldPos(CorrectedP3Dw);
-
-    pMP->UpdateNormalAndDepth();
+    update.SetWorldPos(pMP, CorrectedP3Dw);
   }
+
+  update.Apply(pMap);
 }
 
 int Optimizer::OptimizeSim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &vpMatches1, g2o::Sim3 &g2oS12, const float th2, const bool bFixScale) {
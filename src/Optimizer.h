@@ -25,6 +25,7 @@
 #ifndef SD_SLAM_OPTIMIZER_H
 #define SD_SLAM_OPTIMIZER_H
 
+#include <list>
 #include "Map.h"
 #include "MapPoint.h"
 #include "KeyFrame.h"
@@ -44,7 +45,7 @@ class Optimizer {
   void static GlobalBundleAdjustemnt(Map* pMap, int nIterations=5, bool *pbStopFlag=NULL,
                      const unsigned long nLoopKF = 0, const bool bRobust = true);
   void static LocalBundleAdjustment(KeyFrame* pKF, bool *pbStopFlag, Map *pMap);
-  int static PoseOptimization(Frame* pFrame);
+  int static PoseOptimization(Frame* pFrame, Map* pMap);
 
   // if bFixScale is true, 6DoF optimization (stereo, rgbd), 7DoF otherwise (mono)
   void static OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
@@ -56,6 +57,12 @@ class Optimizer {
   // if bFixScale is true, optimize SE3 (stereo, rgbd), Sim3 otherwise (mono)
   static int OptimizeSim3(KeyFrame* pKF1, KeyFrame* pKF2, std::vector<MapPoint *> &vpMatches1,
               g2o::Sim3 &g2oS12, const float th2, const bool bFixScale);
+
+ private:
+  // Local BA with the specialized solver (see LocalBA), selected with LocalBA.Schur
+  void static SchurLocalBundleAdjustment(const std::list<KeyFrame*> &lLocalKeyFrames,
+                     const std::list<KeyFrame*> &lFixedCameras, const std::list<MapPoint*> &lLocalMapPoints,
+                     bool *pbStopFlag, Map *pMap);
 };
 
 }  // namespace SD_SLAM
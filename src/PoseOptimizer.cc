@@ -0,0 +1,247 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "PoseOptimizer.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace SD_SLAM {
+
+const double PoseOptimizer::kChi2Mono = 5.991;
+const double PoseOptimizer::kChi2Stereo = 7.815;
+
+PoseOptimizer::PoseOptimizer(): mfx(0), mfy(0), mcx(0), mcy(0), mbf(0), mbRobust(true) {
+}
+
+void PoseOptimizer::Reset(const Eigen::Matrix4d &Tcw, double fx, double fy, double cx, double cy, double bf) {
+  mInitialPose = g2o::SE3Quat(Tcw.block<3, 3>(0, 0), Tcw.block<3, 1>(0, 3));
+  mPose = mInitialPose;
+  mfx = fx;
+  mfy = fy;
+  mcx = cx;
+  mcy = cy;
+  mbf = bf;
+
+  // Keep capacity
+  mvXw.clear();
+  mvU.clear();
+  mvV.clear();
+  mvUr.clear();
+  mvInfo.clear();
+  mvInlier.clear();
+}
+
+int PoseOptimizer::AddObservation(const Eigen::Vector3d &Xw, double u, double v, double ur, double invSigma2) {
+  mvXw.push_back(Xw);
+  mvU.push_back(u);
+  mvV.push_back(v);
+  mvUr.push_back(ur);
+  mvInfo.push_back(invSigma2);
+  mvInlier.push_back(true);
+  return mvU.size()-1;
+}
+
+double PoseOptimizer::Chi2(int obs, const Eigen::Matrix3d &Rcw, const Eigen::Vector3d &tcw) const {
+  const Eigen::Vector3d Xc = Rcw*mvXw[obs] + tcw;
+  const double invz = 1.0/Xc(2);
+  const double u = mfx*Xc(0)*invz + mcx;
+  const double eu = mvU[obs] - u;
+  const double ev = mvV[obs] - (mfy*Xc(1)*invz + mcy);
+  double e2 = eu*eu + ev*ev;
+
+  if (mvUr[obs] >= 0) {
+    const double er = mvUr[obs] - (u - mbf*invz);
+    e2 += er*er;
+  }
+
+  return mvInfo[obs]*e2;
+}
+
+double PoseOptimizer::ComputeChi2(const g2o::SE3Quat &pose) const {
+  const Eigen::Matrix3d Rcw = pose.rotation().toRotationMatrix();
+  const Eigen::Vector3d &tcw = pose.translation();
+  double chi2 = 0.0;
+
+  for (size_t i = 0; i < mvU.size(); i++) {
+    if (!mvInlier[i])
+      continue;
+
+    const double chi = Chi2(i, Rcw, tcw);
+    const double delta2 = mvUr[i] < 0 ? kChi2Mono : kChi2Stereo;
+
+    if (mbRobust && chi > delta2)
+      chi2 += 2.0*sqrt(chi*delta2) - delta2;
+    else
+      chi2 += chi;
+  }
+
+  return chi2;
+}
+
+double PoseOptimizer::Linearize() {
+  const Eigen::Matrix3d Rcw = mPose.rotation().toRotationMatrix();
+  const Eigen::Vector3d &tcw = mPose.translation();
+  double chi2 = 0.0;
+
+  mH.setZero();
+  mb.setZero();
+
+  Eigen::Matrix<double, 2, 6> J;
+  Eigen::Matrix<double, 1, 6> Jr;
+
+  for (size_t i = 0; i < mvU.size(); i++) {
+    if (!mvInlier[i])
+      continue;
+
+    const Eigen::Vector3d Xc = Rcw*mvXw[i] + tcw;
+    const double x = Xc(0);
+    const double y = Xc(1);
+    const double invz = 1.0/Xc(2);
+    const double invz2 = invz*invz;
+
+    const double u = mfx*x*invz + mcx;
+    const Eigen::Vector2d e(mvU[i] - u, mvV[i] - (mfy*y*invz + mcy));
+    const bool bStereo = mvUr[i] >= 0;
+    const double er = bStereo ? mvUr[i] - (u - mbf*invz) : 0.0;
+
+    // Huber weight as g2o::RobustKernelHuber, second order term ignored
+    double w = mvInfo[i];
+    const double chi = w*(e.squaredNorm() + er*er);
+    const double delta2 = bStereo ? kChi2Stereo : kChi2Mono;
+
+    if (mbRobust && chi > delta2) {
+      const double sqrtchi = sqrt(chi);
+      chi2 += 2.0*sqrtchi*sqrt(delta2) - delta2;
+      w *= sqrt(delta2)/sqrtchi;
+    } else {
+      chi2 += chi;
+    }
+
+    // Jacobian of the error for a left perturbation of the pose, rotation first
+    J << mfx*x*y*invz2, -mfx*(1.0+x*x*invz2), mfx*y*invz, -mfx*invz, 0.0, mfx*x*invz2,
+         mfy*(1.0+y*y*invz2), -mfy*x*y*invz2, -mfy*x*invz, 0.0, -mfy*invz, mfy*y*invz2;
+
+    mH.noalias() += (w*J.transpose())*J;
+    mb.noalias() -= (w*J.transpose())*e;
+
+    // Right coordinate
+    if (bStereo) {
+      Jr = J.row(0);
+      Jr(0) -= mbf*y*invz2;
+      Jr(1) += mbf*x*invz2;
+      Jr(5) -= mbf*invz2;
+
+      mH.noalias() += (w*Jr.transpose())*Jr;
+      mb.noalias() -= (w*er)*Jr.transpose();
+    }
+  }
+
+  return chi2;
+}
+
+void PoseOptimizer::Levenberg(int nIterations) {
+  double lambda = 0.0;
+  double ni = 2.0;
+
+  for (int it = 0; it < nIterations; it++) {
+    double currentChi = Linearize();
+
+    if (it == 0) {
+      lambda = 1e-5*mH.diagonal().cwiseAbs().maxCoeff();
+      ni = 2.0;
+    }
+
+    // Levenberg-Marquardt step, retried with more damping while chi2 increases
+    double rho = 0.0;
+    int q = 0;
+    do {
+      Eigen::Matrix<double, 6, 6> H = mH;
+      H.diagonal().array() += lambda;
+      mLDLT.compute(H);
+
+      double tempChi = std::numeric_limits<double>::max();
+      Eigen::Matrix<double, 6, 1> dx = Eigen::Matrix<double, 6, 1>::Zero();
+      g2o::SE3Quat pose = mPose;
+
+      if (mLDLT.isPositive()) {
+        dx = mLDLT.solve(mb);
+        pose = g2o::SE3Quat::exp(dx)*mPose;
+        tempChi = ComputeChi2(pose);
+      }
+
+      rho = (currentChi-tempChi)/(dx.dot(lambda*dx + mb)+1e-3);
+
+      if (rho > 0 && std::isfinite(tempChi)) {
+        const double alpha = std::min(1.0-pow(2*rho-1, 3), 2.0/3.0);
+        lambda *= std::max(1.0/3.0, alpha);
+        ni = 2.0;
+        currentChi = tempChi;
+        mPose = pose;
+      } else {
+        lambda *= ni;
+        ni *= 2.0;
+      }
+      q++;
+    } while (rho < 0 && q < 10);
+
+    if (q == 10 || rho == 0)
+      break;
+  }
+}
+
+int PoseOptimizer::Optimize() {
+  const int N = mvU.size();
+  const int its[4] = {10, 10, 10, 10};
+
+  mbRobust = true;
+  int nBad = 0;
+
+  for (int it = 0; it < 4; it++) {
+    mPose = mInitialPose;
+
+    int nInliers = 0;
+    for (int i = 0; i < N; i++)
+      nInliers += mvInlier[i];
+
+    if (nInliers > 0)
+      Levenberg(its[it]);
+
+    const Eigen::Matrix3d Rcw = mPose.rotation().toRotationMatrix();
+    const Eigen::Vector3d &tcw = mPose.translation();
+
+    nBad = 0;
+    for (int i = 0; i < N; i++) {
+      const double th = mvUr[i] < 0 ? kChi2Mono : kChi2Stereo;
+      mvInlier[i] = Chi2(i, Rcw, tcw) <= th;
+      if (!mvInlier[i])
+        nBad++;
+    }
+
+    if (it == 2)
+      mbRobust = false;
+
+    if (N < 10)
+      break;
+  }
+
+  return N-nBad;
+}
+
+}  // namespace SD_SLAM
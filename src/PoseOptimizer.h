@@ -0,0 +1,92 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SD_SLAM_POSEOPTIMIZER_H_
+#define SD_SLAM_POSEOPTIMIZER_H_
+
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+#include "extra/g2o/types/se3quat.h"
+
+namespace SD_SLAM {
+
+// Motion-only optimization of a camera pose from 3D-2D correspondences.
+// Points and observations are stored in plain arrays whose capacity is kept
+// between frames, so once warmed up no memory is allocated per call.
+// Updates and Levenberg-Marquardt steps follow g2o::VertexSE3Expmap and
+// g2o::OptimizationAlgorithmLevenberg, as the g2o version it replaces.
+class PoseOptimizer {
+ public:
+  PoseOptimizer();
+
+  // Start a new problem with the initial pose and camera calibration
+  void Reset(const Eigen::Matrix4d &Tcw, double fx, double fy, double cx, double cy, double bf);
+
+  // Add a correspondence. ur is negative for monocular observations.
+  int AddObservation(const Eigen::Vector3d &Xw, double u, double v, double ur, double invSigma2);
+
+  // Optimize in 4 rounds from the initial pose. After each round observations
+  // are classified as inliers/outliers and outliers are not used in the next one,
+  // but they can be classified as inliers again. Huber kernel is used in the first 3 rounds.
+  // Return the number of inliers.
+  int Optimize();
+
+  inline bool IsOutlier(int obs) const { return !mvInlier[obs]; }
+  inline Eigen::Matrix4d GetPose() const { return mPose.to_homogeneous_matrix(); }
+  inline size_t NumObservations() const { return mvU.size(); }
+
+ private:
+  // Squared error of an observation weighted by its information
+  double Chi2(int obs, const Eigen::Matrix3d &Rcw, const Eigen::Vector3d &tcw) const;
+
+  // Robust chi2 of the inliers
+  double ComputeChi2(const g2o::SE3Quat &pose) const;
+
+  // Hessian and gradient of the inliers, return the robust chi2
+  double Linearize();
+
+  // Levenberg-Marquardt iterations on the inliers
+  void Levenberg(int nIterations);
+
+  static const double kChi2Mono;
+  static const double kChi2Stereo;
+
+  g2o::SE3Quat mInitialPose;
+  g2o::SE3Quat mPose;
+  double mfx, mfy, mcx, mcy, mbf;
+  bool mbRobust;
+
+  // Correspondences
+  std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > mvXw;
+  std::vector<double> mvU, mvV, mvUr, mvInfo;
+  std::vector<char> mvInlier;
+
+  // Normal equations
+  Eigen::Matrix<double, 6, 6> mH;
+  Eigen::Matrix<double, 6, 1> mb;
+  Eigen::LDLT<Eigen::Matrix<double, 6, 6> > mLDLT;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+}  // namespace SD_SLAM
+
+#endif  // SD_SLAM_POSEOPTIMIZER_H_
@@ -24,10 +24,13 @@
 
 #include "System.h"
 #include <iomanip>
+#include <algorithm>
 #include <fstream>
-#include <unistd.h>
+#include <chrono>
 #include <sys/stat.h>
 #include "Config.h"
+#include "KeyFrameImageStore.h"
+#include "MapSerializer.h"
 #include "extra/timer.h"
 #include "extra/log.h"
 
@@ -40,9 +43,21 @@ using std::endl;
 
 namespace SD_SLAM {
 
-System::System(const eSensor sensor, bool loopClosing): mSensor(sensor), mbReset(false),
-               mbActivateLocalizationMode(false), mbDeactivateLocalizationMode(false),
-               stopRequested_(false) {
+// Timestamp for frames given without capture time
+static double CurrentTime() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+System::System(const eSensor sensor, bool loopClosing): System(sensor, Config::GetInstance(), loopClosing) {
+}
+
+System::System(const eSensor sensor, const Config &config, bool loopClosing): mSensor(sensor), config_(config),
+               mbReset(false), mbActivateLocalizationMode(false), mbDeactivateLocalizationMode(false),
+               mnLastBigChangeIdx(0), stopRequested_(false), extraction_thread_(nullptr), tracking_thread_(nullptr),
+               steady_(false), stop_pipeline_(false) {
+  ConfigScope scope(&config_);
+  ProfilerScope profilerScope(&profiler_);
+
   if (mSensor==MONOCULAR) {
     LOGD("Input sensor was set to Monocular");
   } else if (mSensor==RGBD) {
@@ -51,6 +66,8 @@ System::System(const eSensor sensor, bool loopClosing): mSensor(sensor), mbReset
     LOGD("Input sensor was set to Monocular-IMU");
   }
 
+  profiler_.SetEnabled(Config::ProfilerEnabled());
+
   // Create the Map
   mpMap = new Map();
 
@@ -59,13 +76,21 @@ System::System(const eSensor sensor, bool loopClosing): mSensor(sensor), mbReset
 
   // Initialize the Local Mapping thread and launch
   mpLocalMapper = new LocalMapping(mpMap, mSensor!=RGBD);
-  mptLocalMapping = new std::thread(&SD_SLAM::LocalMapping::Run, mpLocalMapper);
+  mptLocalMapping = new std::thread([this] {
+    ConfigScope scope(&config_);
+    ProfilerScope profilerScope(&profiler_);
+    mpLocalMapper->Run();
+  });
 
   // Initialize the Loop Closing thread and launch
   if (loopClosing) {
     LOGD("Loop closing activated");
     mpLoopCloser = new LoopClosing(mpMap, mSensor==RGBD);
-    mptLoopClosing = new std::thread(&SD_SLAM::LoopClosing::Run, mpLoopCloser);
+    mptLoopClosing = new std::thread([this] {
+      ConfigScope scope(&config_);
+      ProfilerScope profilerScope(&profiler_);
+      mpLoopCloser->Run();
+    });
   } else {
     LOGD("Loop closing not activated");
     mpLoopCloser = nullptr;
@@ -85,6 +110,13 @@ System::System(const eSensor sensor, bool loopClosing): mSensor(sensor), mbReset
 }
 
 Eigen::Matrix4d System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const std::string filename) {
+  return TrackRGBD(im, depthmap, CurrentTime(), filename);
+}
+
+Eigen::Matrix4d System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, double timestamp, const std::string filename) {
+  ConfigScope scope(&config_);
+  ProfilerScope profilerScope(&profiler_);
+
   LOGD("Track RGBD image");
 
   if (mSensor!=RGBD) {
@@ -92,53 +124,30 @@ Eigen::Matrix4d System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, co
     exit(-1);
   }
 
-  // Check mode change
-  {
-    unique_lock<mutex> lock(mMutexMode);
-    if(mbActivateLocalizationMode) {
-      mpLocalMapper->RequestStop();
-
-      // Wait until Local Mapping has effectively stopped
-      while(!mpLocalMapper->isStopped()) {
-        usleep(1000);
-      }
-
-      mpTracker->InformOnlyTracking(true);
-      mbActivateLocalizationMode = false;
-    }
-    if(mbDeactivateLocalizationMode) {
-      mpTracker->InformOnlyTracking(false);
-      mpLocalMapper->Release();
-      mbDeactivateLocalizationMode = false;
-    }
-  }
-
-  // Check reset
-  {
-    unique_lock<mutex> lock(mMutexReset);
-    if (mbReset) {
-      mpTracker->Reset();
-      mbReset = false;
-    }
-  }
+  CheckModeChange();
+  CheckReset();
 
   Timer total(true);
 
-  Eigen::Matrix4d Tcw = mpTracker->GrabImageRGBD(im, depthmap, filename);
+  Eigen::Matrix4d Tcw = mpTracker->GrabImageRGBD(im, depthmap, timestamp, filename);
 
   total.Stop();
   LOGD("Tracking time is %.2fms", total.GetMsTime());
 
   LOGD("Pose: [%.4f, %.4f, %.4f]", Tcw(0, 3), Tcw(1, 3), Tcw(2, 3));
 
-  unique_lock<mutex> lock2(mMutexState);
-  mTrackingState = mpTracker->GetState();
-  mTrackedMapPoints = mpTracker->GetCurrentFrame().mvpMapPoints;
-  mTrackedKeyPointsUn = mpTracker->GetCurrentFrame().mvKeysUn;
+  UpdateTrackingState();
   return Tcw;
 }
 
 Eigen::Matrix4d System::TrackMonocular(const cv::Mat &im, const std::string filename) {
+  return TrackMonocular(im, CurrentTime(), filename);
+}
+
+Eigen::Matrix4d System::TrackMonocular(const cv::Mat &im, double timestamp, const std::string filename) {
+  ConfigScope scope(&config_);
+  ProfilerScope profilerScope(&profiler_);
+
   LOGD("Track monocular image");
 
   if (mSensor!=MONOCULAR) {
@@ -146,54 +155,32 @@ Eigen::Matrix4d System::TrackMonocular(const cv::Mat &im, const std::string file
     exit(-1);
   }
 
-  // Check mode change
-  {
-    unique_lock<mutex> lock(mMutexMode);
-    if(mbActivateLocalizationMode) {
-      mpLocalMapper->RequestStop();
-
-      // Wait until Local Mapping has effectively stopped
-      while(!mpLocalMapper->isStopped()) {
-        usleep(1000);
-      }
-
-      mpTracker->InformOnlyTracking(true);
-      mbActivateLocalizationMode = false;
-    }
-    if(mbDeactivateLocalizationMode) {
-      mpTracker->InformOnlyTracking(false);
-      mpLocalMapper->Release();
-      mbDeactivateLocalizationMode = false;
-    }
-  }
-
-  // Check reset
-  {
-    unique_lock<mutex> lock(mMutexReset);
-    if (mbReset) {
-      mpTracker->Reset();
-      mbReset = false;
-    }
-  }
+  CheckModeChange();
+  CheckReset();
 
   Timer total(true);
 
-  Eigen::Matrix4d Tcw = mpTracker->GrabImageMonocular(im, filename);
+  Eigen::Matrix4d Tcw = mpTracker->GrabImageMonocular(im, timestamp, filename);
 
   total.Stop();
   LOGD("Tracking time is %.2fms", total.GetMsTime());
 
   LOGD("Pose: [%.4f, %.4f, %.4f]", Tcw(0, 3), Tcw(1, 3), Tcw(2, 3));
 
-  unique_lock<mutex> lock2(mMutexState);
-  mTrackingState = mpTracker->GetState();
-  mTrackedMapPoints = mpTracker->GetCurrentFrame().mvpMapPoints;
-  mTrackedKeyPointsUn = mpTracker->GetCurrentFrame().mvKeysUn;
+  UpdateTrackingState();
 
   return Tcw;
 }
 
 Eigen::Matrix4d System::TrackFusion(const cv::Mat &im, const vector<double> &measurements, const std::string filename) {
+  return TrackFusion(im, measurements, CurrentTime(), filename);
+}
+
+Eigen::Matrix4d System::TrackFusion(const cv::Mat &im, const vector<double> &measurements, double timestamp,
+                                    const std::string filename) {
+  ConfigScope scope(&config_);
+  ProfilerScope profilerScope(&profiler_);
+
   LOGD("Track monocular image with other sensor measurements");
 
   if (mSensor!=MONOCULAR_IMU) {
@@ -201,31 +188,249 @@ Eigen::Matrix4d System::TrackFusion(const cv::Mat &im, const vector<double> &mea
     exit(-1);
   }
 
-  // Check reset
-  {
-    unique_lock<mutex> lock(mMutexReset);
-    if (mbReset) {
-      mpTracker->Reset();
-      mbReset = false;
-    }
-  }
+  CheckReset();
 
   Timer total(true);
 
   mpTracker->SetMeasurements(measurements);
-  Eigen::Matrix4d Tcw = mpTracker->GrabImageMonocular(im, filename);
+  Eigen::Matrix4d Tcw = mpTracker->GrabImageMonocular(im, timestamp, filename);
 
   total.Stop();
   LOGD("Tracking time is %.2fms", total.GetMsTime());
 
   LOGD("Pose: [%.4f, %.4f, %.4f]", Tcw(0, 3), Tcw(1, 3), Tcw(2, 3));
 
-  unique_lock<mutex> lock2(mMutexState);
+  UpdateTrackingState();
+
+  return Tcw;
+}
+
+std::future<System::Pose> System::SubmitRGBD(const cv::Mat &im, const cv::Mat &depthmap, const std::string filename) {
+  return SubmitRGBD(im, depthmap, CurrentTime(), filename);
+}
+
+std::future<System::Pose> System::SubmitRGBD(const cv::Mat &im, const cv::Mat &depthmap, double timestamp,
+                                             const std::string filename) {
+  if (mSensor!=RGBD) {
+    LOGE("Called SubmitRGBD but input sensor was not set to RGBD");
+    exit(-1);
+  }
+
+  return Submit(im, depthmap, timestamp, filename);
+}
+
+std::future<System::Pose> System::SubmitMonocular(const cv::Mat &im, const std::string filename) {
+  return SubmitMonocular(im, CurrentTime(), filename);
+}
+
+std::future<System::Pose> System::SubmitMonocular(const cv::Mat &im, double timestamp, const std::string filename) {
+  if (mSensor!=MONOCULAR) {
+    LOGE("Called SubmitMonocular but input sensor was not set to Monocular");
+    exit(-1);
+  }
+
+  return Submit(im, cv::Mat(), timestamp, filename);
+}
+
+std::future<System::Pose> System::Submit(const cv::Mat &im, const cv::Mat &depthmap, double timestamp,
+                                         const std::string &filename) {
+  ConfigScope scope(&config_);
+  ProfilerScope profilerScope(&profiler_);
+
+  // Image must be in gray scale
+  assert(im.channels() == 1);
+
+  FrameJob *job = new FrameJob();
+  job->im = im;
+  job->depth = depthmap;
+  job->filename = filename;
+  job->timestamp = timestamp;
+  job->built = false;
+  job->started = false;
+  job->resetCount = -1;
+  std::future<Pose> pose = job->pose.get_future();
+
+  unique_lock<mutex> lock(mutex_jobs_);
+
+  // Launch pipeline with first frame
+  if (!extraction_thread_ && !stop_pipeline_) {
+    extraction_thread_ = new std::thread(&SD_SLAM::System::RunExtraction, this);
+    tracking_thread_ = new std::thread(&SD_SLAM::System::RunTracking, this);
+  }
+
+  int queueSize = std::max(Config::QueueSize(), 1);
+  cond_space_.wait(lock, [&] { return stop_pipeline_ || static_cast<int>(jobs_.size()) < queueSize; });
+
+  // No thread would process the frame after the pipeline is stopped
+  if (stop_pipeline_) {
+    LOGE("Frame submitted after the pipeline was stopped");
+    job->pose.set_value(Pose::Zero());
+    delete job;
+    return pose;
+  }
+
+  jobs_.push_back(job);
+  cond_extract_.notify_one();
+
+  return pose;
+}
+
+void System::BuildFrame(FrameJob *job, bool steady) {
+  job->resetCount = mpTracker->GetResetCount();
+
+  if (mSensor==RGBD)
+    job->frame = mpTracker->CreateFrame(job->im, job->depth);
+  else if (steady)
+    job->frame = mpTracker->CreateFrame(job->im);
+  else
+    job->frame = mpTracker->CreateFrameMonocular(job->im);
+  job->frame.mTimeStamp = job->timestamp;
+}
+
+void System::RunExtraction() {
+  ConfigScope scope(&config_);
+  ProfilerScope profilerScope(&profiler_);
+
+  unique_lock<mutex> lock(mutex_jobs_);
+
+  while (true) {
+    FrameJob *job = nullptr;
+    bool steady = false;
+
+    cond_extract_.wait(lock, [&] {
+      // Tracking thread is idle, extract current frame
+      if (!jobs_.empty() && !jobs_[0]->built) {
+        job = jobs_[0];
+        return true;
+      }
+
+      // Extract next frame while current one is tracked
+      if (jobs_.size() > 1 && jobs_[0]->started && !jobs_[1]->built && steady_) {
+        job = jobs_[1];
+        steady = true;
+        return true;
+      }
+
+      return stop_pipeline_ && jobs_.empty();
+    });
+
+    if (!job)
+      break;
+
+    lock.unlock();
+
+    Timer extraction(true);
+    BuildFrame(job, steady);
+    extraction.Stop();
+    LOGD("Extraction time is %.2fms", extraction.GetMsTime());
+
+    lock.lock();
+    job->built = true;
+    cond_track_.notify_one();
+  }
+}
+
+void System::RunTracking() {
+  ConfigScope scope(&config_);
+  ProfilerScope profilerScope(&profiler_);
+
+  while (true) {
+    FrameJob *job;
+
+    {
+      unique_lock<mutex> lock(mutex_jobs_);
+      cond_track_.wait(lock, [&] { return (!jobs_.empty() && jobs_[0]->built) || (stop_pipeline_ && jobs_.empty()); });
+      if (jobs_.empty())
+        break;
+      job = jobs_[0];
+    }
+
+    CheckModeChange();
+    CheckReset();
+
+    // Frame was extracted before a reset, create it again. Extraction thread is idle
+    // until this job is started, so ids and extractor are the same as in synchronous mode.
+    if (job->resetCount != mpTracker->GetResetCount())
+      BuildFrame(job, false);
+
+    {
+      unique_lock<mutex> lock(mutex_jobs_);
+      job->started = true;
+      cond_extract_.notify_one();
+    }
+
+    Timer total(true);
+
+    Eigen::Matrix4d Tcw = mpTracker->TrackFrame(job->frame);
+
+    total.Stop();
+    LOGD("Tracking time is %.2fms", total.GetMsTime());
+
+    LOGD("Pose: [%.4f, %.4f, %.4f]", Tcw(0, 3), Tcw(1, 3), Tcw(2, 3));
+
+    UpdateTrackingState();
+
+    {
+      unique_lock<mutex> lock(mutex_jobs_);
+      int state = mpTracker->GetState();
+      steady_ = mSensor==RGBD || state==Tracking::OK || state==Tracking::LOST;
+      jobs_.pop_front();
+      cond_space_.notify_one();
+      cond_extract_.notify_one();
+    }
+
+    job->pose.set_value(Tcw);
+    delete job;
+  }
+}
+
+void System::StopPipeline() {
+  {
+    unique_lock<mutex> lock(mutex_jobs_);
+    stop_pipeline_ = true;
+    if (!extraction_thread_)
+      return;
+    cond_extract_.notify_one();
+    cond_track_.notify_one();
+    cond_space_.notify_all();
+  }
+
+  // Pending frames are processed before exiting
+  extraction_thread_->join();
+  tracking_thread_->join();
+}
+
+void System::CheckModeChange() {
+  unique_lock<mutex> lock(mMutexMode);
+  if(mbActivateLocalizationMode) {
+    mpLocalMapper->RequestStop();
+
+    // Wait until Local Mapping has effectively stopped
+    mpLocalMapper->WaitUntilStopped();
+
+    mpTracker->InformOnlyTracking(true);
+    mbActivateLocalizationMode = false;
+  }
+  if(mbDeactivateLocalizationMode) {
+    mpTracker->InformOnlyTracking(false);
+    mpLocalMapper->Release();
+    mbDeactivateLocalizationMode = false;
+  }
+}
+
+void System::CheckReset() {
+  unique_lock<mutex> lock(mMutexReset);
+  if (mbReset) {
+    mpTracker->Reset();
+    mbReset = false;
+  }
+}
+
+void System::UpdateTrackingState() {
+  unique_lock<mutex> lock(mMutexState);
   mTrackingState = mpTracker->GetState();
   mTrackedMapPoints = mpTracker->GetCurrentFrame().mvpMapPoints;
   mTrackedKeyPointsUn = mpTracker->GetCurrentFrame().mvKeysUn;
-
-  return Tcw;
 }
 
 void System::ActivateLocalizationMode() {
@@ -239,10 +444,9 @@ void System::DeactivateLocalizationMode() {
 }
 
 bool System::MapChanged() {
-  static int n = 0;
   int curn = mpMap->GetLastBigChangeIdx();
-  if (n<curn) {
-    n=curn;
+  if (mnLastBigChangeIdx<curn) {
+    mnLastBigChangeIdx=curn;
     return true;
   } else
     return false;
@@ -254,27 +458,46 @@ void System::Reset() {
 }
 
 void System::Shutdown() {
-  bool waitLoop = false;
+  ConfigScope scope(&config_);
+  ProfilerScope profilerScope(&profiler_);
+
+  StopPipeline();
 
   mpLocalMapper->RequestFinish();
-  if (mpLoopCloser) {
+  if (mpLoopCloser)
     mpLoopCloser->RequestFinish();
-    waitLoop = true;
-  }
-
-  // Wait until all thread have effectively stopped
-  while (!mpLocalMapper->isFinished() || waitLoop) {
-    usleep(5000);
-    if (mpLoopCloser)
-      waitLoop = !mpLoopCloser->isFinished() || mpLoopCloser->isRunningGBA();
-  }
 
+  // Wait until all threads have effectively stopped
   mptLocalMapping->join();
-  if (mptLoopClosing)
+  if (mptLoopClosing) {
     mptLoopClosing->join();
+    mpLoopCloser->WaitForGBA();
+  }
+
+  mpMap->GetImageStore()->PrintStats();
+
+  profiler_.PrintStats();
+  if (!Config::ProfilerOutput().empty())
+    SaveProfile(Config::ProfilerOutput());
+}
+
+Profiler::Stats System::GetStageStats(Profiler::Stage stage) {
+  return profiler_.GetStats(stage);
+}
+
+bool System::SaveProfile(const std::string &filename) {
+  LOGD("Saving stage latencies to %s", filename.c_str());
+
+  if (filename.size() > 5 && filename.compare(filename.size()-5, 5, ".json") == 0)
+    return profiler_.SaveJSON(filename);
+  else
+    return profiler_.SaveCSV(filename);
 }
 
 void System::SaveTrajectory(const std::string &filename, const std::string &foldername) {
+  ConfigScope scope(&config_);
+  ProfilerScope profilerScope(&profiler_);
+
 #ifndef ANDROID
   int counter;
   std::string output = "%YAML:1.0\n";
@@ -320,14 +543,15 @@ void System::SaveTrajectory(const std::string &filename, const std::string &fold
     // Save images
     string imgname, depthname;
     imgname = foldername + "/" + std::to_string(pKF->mnId) + ".png";
-    cv::imwrite(imgname, pKF->mvImagePyramid[0]);
+    cv::imwrite(imgname, pKF->GetImage(0));
 
     if (mSensor==RGBD) {
       float depthFactor = 1.0/mpTracker->GetDepthFactor();
       depthname = foldername + "/" + std::to_string(pKF->mnId) + "_depth.png";
       // Restore initial depth image
-      pKF->mDepthImage.convertTo(pKF->mDepthImage, CV_16U, depthFactor);
-      cv::imwrite(depthname, pKF->mDepthImage);
+      cv::Mat depth;
+      pKF->GetDepthImage().convertTo(depth, CV_16U, depthFactor);
+      cv::imwrite(depthname, depth);
     }
 
     output += "  - id: " + std::to_string(pKF->mnId) + "\n";
@@ -362,9 +586,9 @@ void System::SaveTrajectory(const std::string &filename, const std::string &fold
     output += "    observations:\n";
 
     // Observations
-    std::map<KeyFrame*, size_t> observations = vpMPs[i]->GetObservations();
+    std::vector<MapPoint::Observation> observations = vpMPs[i]->GetObservations();
 
-    for (std::map<KeyFrame*, size_t>::iterator mit=observations.begin(), mend=observations.end(); mit != mend; mit++) {
+    for (std::vector<MapPoint::Observation>::iterator mit=observations.begin(), mend=observations.end(); mit != mend; mit++) {
       KeyFrame* kf = mit->first;
       const cv::KeyPoint &kp = kf->mvKeys[mit->second];
 
@@ -385,6 +609,9 @@ void System::SaveTrajectory(const std::string &filename, const std::string &fold
 
 // Load saved trajectory
 bool System::LoadTrajectory(const std::string &filename) {
+  ConfigScope scope(&config_);
+  ProfilerScope profilerScope(&profiler_);
+
 #ifndef ANDROID
   cv::FileStorage fs;
   cv::Mat im, imD;
@@ -534,6 +761,36 @@ bool System::LoadTrajectory(const std::string &filename) {
   return true;
 }
 
+bool System::SaveMap(const std::string &filename) {
+  ConfigScope scope(&config_);
+  ProfilerScope profilerScope(&profiler_);
+
+  MapSerializer serializer(mpMap);
+
+  LOGD("Saving map to %s", filename.c_str());
+  return serializer.Save(filename);
+}
+
+bool System::LoadMap(const std::string &filename) {
+  ConfigScope scope(&config_);
+  ProfilerScope profilerScope(&profiler_);
+
+  MapSerializer serializer(mpMap);
+
+  LOGD("Loading map from %s", filename.c_str());
+  if (!serializer.Load(filename))
+    return false;
+
+  KeyFrame* kf = mpMap->GetKeyFrame(mpMap->GetMaxKFid());
+  if (kf)
+    mpTracker->SetReferenceKeyFrame(kf);
+
+  // Force relocalization inside loaded map
+  mpTracker->ForceRelocalization();
+
+  return true;
+}
+
 int System::GetTrackingState() {
   unique_lock<mutex> lock(mMutexState);
   return mTrackingState;
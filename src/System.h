@@ -27,11 +27,16 @@
 
 #include <thread>
 #include <vector>
+#include <deque>
+#include <future>
+#include <condition_variable>
 #include <opencv2/core/core.hpp>
 #include "Tracking.h"
 #include "Map.h"
 #include "LocalMapping.h"
 #include "LoopClosing.h"
+#include "Config.h"
+#include "extra/profiler.h"
 
 namespace SD_SLAM {
 
@@ -49,32 +54,58 @@ class System {
     MONOCULAR_IMU = 2
   };
 
+  // Camera pose returned by asynchronous calls. Unaligned so it can be stored in a std::future.
+  typedef Eigen::Matrix<double, 4, 4, Eigen::DontAlign> Pose;
+
  public:
   // Initialize the SLAM system. It launches the Local Mapping and Loop Closing.
+  // Parameters are copied from the configuration of the calling thread.
   System(const eSensor sensor, bool loopClosing = true);
 
+  // Initialize the SLAM system with its own parameters. Several systems can run
+  // in the same process, each one with a different configuration.
+  System(const eSensor sensor, const Config &config, bool loopClosing = true);
+
   inline Map * GetMap() { return mpMap; }
   inline Tracking * GetTracker() { return mpTracker; }
+  inline Profiler * GetProfiler() { return &profiler_; }
 
   inline void RequestStop() { stopRequested_ = true; }
   inline bool StopRequested() const { return stopRequested_; }
 
   // Process the given rgbd frame. Depthmap must be registered to the RGB frame.
   // Input image: Grayscale (CV_8U).
-  // Input depthmap: Float (CV_32F).
+  // Input depthmap: Raw sensor values (CV_16U) or float (CV_32F), scaled with DepthMapFactor.
+  // Depthmap buffer is kept by reference, so it must not be modified afterwards.
+  // Input timestamp: capture time in seconds, used by the motion model.
   // Returns the camera pose (empty if tracking fails).
+  // Without timestamp, frames are stamped with the time of the call.
   Eigen::Matrix4d TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const std::string filename = "");
+  Eigen::Matrix4d TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, double timestamp, const std::string filename = "");
 
   // Proccess the given monocular frame
   // Input images: Grayscale (CV_8U).
   // Returns the camera pose (empty if tracking fails).
   Eigen::Matrix4d TrackMonocular(const cv::Mat &im, const std::string filename = "");
+  Eigen::Matrix4d TrackMonocular(const cv::Mat &im, double timestamp, const std::string filename = "");
 
   // Proccess the given monocular frame and sensor measurements
   // Input images: Grayscale (CV_8U).
   // Input measurements: Float (CV_32F).
   // Returns the camera pose (empty if tracking fails).
   Eigen::Matrix4d TrackFusion(const cv::Mat &im, const std::vector<double> &measurements, const std::string filename = "");
+  Eigen::Matrix4d TrackFusion(const cv::Mat &im, const std::vector<double> &measurements, double timestamp,
+                              const std::string filename = "");
+
+  // Asynchronous versions of TrackRGBD and TrackMonocular. Frames are processed in order:
+  // features of the next frame are extracted in a separate thread while the current one is tracked.
+  // Blocks while the queue is full. Returned future holds the camera pose.
+  // Frames submitted after Shutdown are rejected with an empty pose.
+  // Do not mix them with the synchronous calls.
+  std::future<Pose> SubmitRGBD(const cv::Mat &im, const cv::Mat &depthmap, const std::string filename = "");
+  std::future<Pose> SubmitRGBD(const cv::Mat &im, const cv::Mat &depthmap, double timestamp, const std::string filename = "");
+  std::future<Pose> SubmitMonocular(const cv::Mat &im, const std::string filename = "");
+  std::future<Pose> SubmitMonocular(const cv::Mat &im, double timestamp, const std::string filename = "");
 
   // This stops local mapping thread (map building) and performs only camera tracking.
   void ActivateLocalizationMode();
@@ -99,16 +130,69 @@ class System {
   std::vector<MapPoint*> GetTrackedMapPoints();
   std::vector<cv::KeyPoint> GetTrackedKeyPointsUn();
 
+  // Latency statistics of a stage (see Profiler)
+  Profiler::Stats GetStageStats(Profiler::Stage stage);
+
+  // Save stage latency histograms. Format depends on extension (.json or .csv)
+  bool SaveProfile(const std::string &filename);
+
   // Save trajectory calculated
   void SaveTrajectory(const std::string &filename, const std::string &foldername);
 
   // Load saved trajectory
   bool LoadTrajectory(const std::string &filename);
 
+  // Save map in binary format (see MapSerializer)
+  bool SaveMap(const std::string &filename);
+
+  // Load map saved in binary format. Features are not extracted again.
+  bool LoadMap(const std::string &filename);
+
  private:
+  // Frame submitted asynchronously
+  struct FrameJob {
+    cv::Mat im;
+    cv::Mat depth;
+    std::string filename;
+    double timestamp;
+    std::promise<Pose> pose;
+    Frame frame;
+    bool built;          // Features extracted
+    bool started;        // Tracking started
+    int resetCount;      // Tracker reset count when frame was built
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  // Apply requested localization mode change
+  void CheckModeChange();
+
+  // Apply requested reset
+  void CheckReset();
+
+  // Save information from most recent processed frame
+  void UpdateTrackingState();
+
+  // Queue a frame for asynchronous processing
+  std::future<Pose> Submit(const cv::Mat &im, const cv::Mat &depthmap, double timestamp, const std::string &filename);
+
+  // Create frame of a submitted job
+  void BuildFrame(FrameJob *job, bool steady);
+
+  // Asynchronous pipeline threads
+  void RunExtraction();
+  void RunTracking();
+  void StopPipeline();
+
   // Input sensor
   eSensor mSensor;
 
+  // Parameters of this system, bound to all its threads
+  Config config_;
+
+  // Stage latencies of this system, bound to all its threads
+  Profiler profiler_;
+
   // Map structure that stores the pointers to all KeyFrames and MapPoints.
   Map* mpMap;
 
@@ -138,12 +222,27 @@ class System {
   bool mbActivateLocalizationMode;
   bool mbDeactivateLocalizationMode;
 
+  // Last map change reported by MapChanged
+  int mnLastBigChangeIdx;
+
   // Tracking state
   int mTrackingState;
   std::vector<MapPoint*> mTrackedMapPoints;
   std::vector<cv::KeyPoint> mTrackedKeyPointsUn;
   std::mutex mMutexState;
   bool stopRequested_;          // True if stop is requested
+
+  // Asynchronous pipeline. Frames are extracted ahead only when tracking is steady,
+  // otherwise extractor would depend on the result of the frame being tracked.
+  std::deque<FrameJob*> jobs_;
+  std::mutex mutex_jobs_;
+  std::condition_variable cond_extract_;
+  std::condition_variable cond_track_;
+  std::condition_variable cond_space_;
+  std::thread* extraction_thread_;
+  std::thread* tracking_thread_;
+  bool steady_;                 // Next frame can be extracted before current one is tracked
+  bool stop_pipeline_;
 };
 
 }  // namespace SD_SLAM
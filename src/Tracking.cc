@@ -30,8 +30,12 @@
 #include "Converter.h"
 #include "Optimizer.h"
 #include "ImageAlign.h"
+#include "PnPsolver.h"
+#include "KeyFrameDatabase.h"
 #include "Config.h"
 #include "extra/log.h"
+#include "extra/timer.h"
+#include "extra/profiler.h"
 #include "sensors/ConstantVelocity.h"
 #include "sensors/IMU.h"
 
@@ -66,6 +70,9 @@ Tracking::Tracking(System *pSys, Map *pMap, const int sensor):
   }
   DistCoef.copyTo(mDistCoef);
 
+  // Undistortion lookup shared by all frames with the configured image size
+  mpUndistorter = std::make_shared<const Undistorter>(mK, mDistCoef, cv::Size(Config::Width(), Config::Height()));
+
   mbf = Config::bf();
 
   float fps = Config::fps();
@@ -87,6 +94,8 @@ Tracking::Tracking(System *pSys, Map *pMap, const int sensor):
     cout << "- k3: " << DistCoef.at<float>(4) << endl;
   cout << "- p1: " << DistCoef.at<float>(2) << endl;
   cout << "- p2: " << DistCoef.at<float>(3) << endl;
+  if (mpUndistorter->UsesGrid())
+    cout << "- undistortion grid: " << mpUndistorter->Step() << " px, max error " << mpUndistorter->MaxInterpolationError() << " px" << endl;
   cout << "- fps: " << fps << endl;
 
   // Load ORB parameters
@@ -94,17 +103,19 @@ Tracking::Tracking(System *pSys, Map *pMap, const int sensor):
   float fScaleFactor = Config::ScaleFactor();
   int nLevels = Config::NumLevels();
   int fThFAST = Config::ThresholdFAST();
+  int nThreads = Config::ExtractorThreads();
 
-  mpORBextractorLeft = new ORBextractor(nFeatures, fScaleFactor,nLevels, fThFAST);
+  mpORBextractorLeft = new ORBextractor(nFeatures, fScaleFactor,nLevels, fThFAST, nThreads);
 
   if (sensor!=System::RGBD)
-    mpIniORBextractor = new ORBextractor(2*nFeatures, fScaleFactor,nLevels, fThFAST);
+    mpIniORBextractor = new ORBextractor(2*nFeatures, fScaleFactor,nLevels, fThFAST, nThreads);
 
   cout << endl  << "ORB Extractor Parameters: " << endl;
   cout << "- Number of Features: " << nFeatures << endl;
   cout << "- Scale Levels: " << nLevels << endl;
   cout << "- Scale Factor: " << fScaleFactor << endl;
   cout << "- Fast Threshold: " << fThFAST << endl;
+  cout << "- Threads: " << nThreads << endl;
 
   if (sensor==System::RGBD) {
     mThDepth = mbf*(float)Config::ThDepth()/fx;
@@ -118,6 +129,8 @@ Tracking::Tracking(System *pSys, Map *pMap, const int sensor):
   }
 
   threshold_ = 8;
+  reloc_candidates_ = 5;
+  reset_count_ = 0;
   usePattern = Config::UsePattern();
   align_image_ = true;
 
@@ -130,59 +143,79 @@ Tracking::Tracking(System *pSys, Map *pMap, const int sensor):
   lastRelativePose_.setZero();
 
   // Set motion model
-  Sensor * sensor_model;
   if (sensor == System::MONOCULAR_IMU)
-    sensor_model = new IMU();
+    motion_model_ = new EKF<IMU>();
   else
-    sensor_model = new ConstantVelocity();
-  motion_model_ = new EKF(sensor_model);
+    motion_model_ = new EKF<ConstantVelocity>();
 }
 
-Eigen::Matrix4d Tracking::GrabImageRGBD(const cv::Mat &im, const cv::Mat &imD, const std::string filename) {
-  cv::Mat imDepth = imD;
-
+Eigen::Matrix4d Tracking::GrabImageRGBD(const cv::Mat &im, const cv::Mat &imD, double timestamp, const std::string filename) {
   // Image must be in gray scale
   assert(im.channels() == 1);
 
-  if ((fabs(mDepthMapFactor-1.0f) > 1e-5) || imD.type() != CV_32F)
-    imDepth.convertTo(imDepth, CV_32F, mDepthMapFactor);
-
-  mCurrentFrame = Frame(im, imDepth, mpORBextractorLeft, mK, mDistCoef, mbf, mThDepth);
-
-  Track();
+  Frame frame = CreateFrame(im, imD);
+  frame.mTimeStamp = timestamp;
 
-  return mCurrentFrame.GetPose();
+  return TrackFrame(frame);
 }
 
 
-Eigen::Matrix4d Tracking::GrabImageMonocular(const cv::Mat &im, const std::string filename) {
+Eigen::Matrix4d Tracking::GrabImageMonocular(const cv::Mat &im, double timestamp, const std::string filename) {
   // Image must be in gray scale
   assert(im.channels() == 1);
 
-  if (mState==NOT_INITIALIZED || mState==NO_IMAGES_YET)
-    mCurrentFrame = Frame(im, mpIniORBextractor, mK, mDistCoef, mbf, mThDepth);
-  else
-    mCurrentFrame = Frame(im, mpORBextractorLeft, mK, mDistCoef, mbf, mThDepth);
+  Frame frame = CreateFrameMonocular(im);
+  frame.mTimeStamp = timestamp;
+
+  return TrackFrame(frame);
+}
+
+Eigen::Matrix4d Tracking::TrackFrame(Frame &frame) {
+  mCurrentFrame = std::move(frame);
+  mCurrentFrame.mnId = mpMap->NewFrameId();
 
   Track();
 
+  // Keyframe decisions of next frame won't depend on local mapping speed
+  if (Config::SynchronousMapping() && !mbOnlyTracking && mpLocalMapper)
+    mpLocalMapper->WaitUntilIdle();
+
   return mCurrentFrame.GetPose();
 }
 
 Frame Tracking::CreateFrame(const cv::Mat &im) {
-  return Frame(im, mpORBextractorLeft, mK, mDistCoef, mbf, mThDepth);
+  return Frame(im, mpORBextractorLeft, mK, mDistCoef, mbf, mThDepth, GetUndistorter(im));
+}
+
+Frame Tracking::CreateFrameMonocular(const cv::Mat &im) {
+  if (mState==NOT_INITIALIZED || mState==NO_IMAGES_YET)
+    return Frame(im, mpIniORBextractor, mK, mDistCoef, mbf, mThDepth, GetUndistorter(im));
+  else
+    return Frame(im, mpORBextractorLeft, mK, mDistCoef, mbf, mThDepth, GetUndistorter(im));
 }
 
 Frame Tracking::CreateFrame(const cv::Mat &im, const cv::Mat &imD) {
-  cv::Mat imDepth = imD;
+  // Raw and float depth are kept by reference and scaled to meters only at keypoints.
+  // Other types are converted once.
+  if (imD.type() == CV_16U || imD.type() == CV_32F)
+    return Frame(im, imD, mpORBextractorLeft, mK, mDistCoef, mbf, mThDepth, GetUndistorter(im), mDepthMapFactor);
+
+  cv::Mat imDepth;
+  imD.convertTo(imDepth, CV_32F, mDepthMapFactor);
+  return Frame(im, imDepth, mpORBextractorLeft, mK, mDistCoef, mbf, mThDepth, GetUndistorter(im));
+}
 
-  if ((fabs(mDepthMapFactor-1.0f) > 1e-5) || imD.type() != CV_32F)
-    imDepth.convertTo(imDepth, CV_32F, mDepthMapFactor);
+std::shared_ptr<const Undistorter> Tracking::GetUndistorter(const cv::Mat &im) const {
+  // Images with other size than configured are undistorted without lookup
+  if (im.size() != mpUndistorter->ImageSize())
+    return nullptr;
 
-  return Frame(im, imDepth, mpORBextractorLeft, mK, mDistCoef, mbf, mThDepth);
+  return mpUndistorter;
 }
 
 void Tracking::Track() {
+  ScopedProfile profile(Profiler::TRACKING);
+
   if (mState==NO_IMAGES_YET)
     mState = NOT_INITIALIZED;
 
@@ -242,7 +275,7 @@ void Tracking::Track() {
 
       // Update motion sensor
       if (!mLastFrame.GetPose().isZero())
-        motion_model_->Update(mCurrentFrame.GetPose(), measurements_);
+        motion_model_->Update(mCurrentFrame.GetPose(), measurements_, mCurrentFrame.mTimeStamp);
       else
         motion_model_->Restart();
 
@@ -289,7 +322,7 @@ void Tracking::Track() {
     if (!mCurrentFrame.mpReferenceKF)
       mCurrentFrame.mpReferenceKF = mpReferenceKF;
 
-    mLastFrame = Frame(mCurrentFrame);
+    mLastFrame = mCurrentFrame;
   }
 
   // Store relative pose
@@ -338,7 +371,7 @@ void Tracking::StereoInitialization() {
     mpReferenceKF = pKFini;
     mCurrentFrame.mpReferenceKF = pKFini;
 
-    mLastFrame = Frame(mCurrentFrame);
+    mLastFrame = mCurrentFrame;
 
     mpMap->SetReferenceMapPoints(mvpLocalMapPoints);
 
@@ -352,8 +385,8 @@ void Tracking::MonocularInitialization() {
   if (!mpInitializer) {
     // Set Reference Frame
     if (mCurrentFrame.mvKeys.size()>100) {
-      mInitialFrame = Frame(mCurrentFrame);
-      mLastFrame = Frame(mCurrentFrame);
+      mInitialFrame = mCurrentFrame;
+      mLastFrame = mCurrentFrame;
       mvbPrevMatched.resize(mCurrentFrame.mvKeysUn.size());
       for (size_t i = 0; i<mCurrentFrame.mvKeysUn.size(); i++)
         mvbPrevMatched[i] = mCurrentFrame.mvKeysUn[i].pt;
@@ -494,7 +527,7 @@ void Tracking::CreateInitialMapMonocular() {
   mpReferenceKF = pKFcur;
   mCurrentFrame.mpReferenceKF = pKFcur;
 
-  mLastFrame = Frame(mCurrentFrame);
+  mLastFrame = mCurrentFrame;
 
   mpMap->SetReferenceMapPoints(mvpLocalMapPoints);
 
@@ -556,7 +589,7 @@ void Tracking::PatternInitialization() {
     mpReferenceKF = pKFini;
     mCurrentFrame.mpReferenceKF = pKFini;
 
-    mLastFrame = Frame(mCurrentFrame);
+    mLastFrame = mCurrentFrame;
 
     mpMap->SetReferenceMapPoints(mvpLocalMapPoints);
 
@@ -616,7 +649,7 @@ bool Tracking::TrackReferenceKeyFrame() {
   }
 
   // Optimize frame pose with all matches
-  Optimizer::PoseOptimization(&mCurrentFrame);
+  Optimizer::PoseOptimization(&mCurrentFrame, mpMap);
 
   // Discard outliers
   int nmatchesMap = 0;
@@ -658,7 +691,7 @@ bool Tracking::TrackWithMotionModel() {
   UpdateLastFrame();
 
   // Predict initial pose with motion model
-  Eigen::Matrix4d predicted_pose = motion_model_->Predict(mLastFrame.GetPose());
+  Eigen::Matrix4d predicted_pose = motion_model_->Predict(mLastFrame.GetPose(), mCurrentFrame.mTimeStamp);
   mCurrentFrame.SetPose(predicted_pose);
 
   LOGD("Predicted pose: [%.4f, %.4f, %.4f]", predicted_pose(0, 3), predicted_pose(1, 3), predicted_pose(2, 3));
@@ -690,7 +723,7 @@ bool Tracking::TrackWithMotionModel() {
   }
 
   // Optimize frame pose with all matches
-  Optimizer::PoseOptimization(&mCurrentFrame);
+  Optimizer::PoseOptimization(&mCurrentFrame, mpMap);
 
   // Discard outliers
   int nmatchesMap = 0;
@@ -718,6 +751,8 @@ bool Tracking::TrackWithMotionModel() {
 }
 
 bool Tracking::TrackLocalMap() {
+  ScopedProfile profile(Profiler::TRACK_LOCAL_MAP);
+
   // We have an estimation of the camera pose and some map points tracked in the frame.
   // We retrieve the local map and try to find matches to points in the local map.
 
@@ -726,7 +761,7 @@ bool Tracking::TrackLocalMap() {
   SearchLocalPoints();
 
   // Optimize Pose
-  Optimizer::PoseOptimization(&mCurrentFrame);
+  Optimizer::PoseOptimization(&mCurrentFrame, mpMap);
   mnMatchesInliers = 0;
 
   // Update MapPoints Statistics
@@ -826,6 +861,8 @@ bool Tracking::NeedNewKeyFrame() {
 }
 
 void Tracking::CreateNewKeyFrame() {
+  ScopedProfile profile(Profiler::KEYFRAME_INSERTION);
+
   if (!mpLocalMapper->SetNotStop(true))
     return;
 
@@ -977,9 +1014,7 @@ void Tracking::UpdateLocalKeyFrames() {
     if (mCurrentFrame.mvpMapPoints[i]) {
       MapPoint* pMP = mCurrentFrame.mvpMapPoints[i];
       if (!pMP->isBad()) {
-        const map<KeyFrame*, size_t> observations = pMP->GetObservations();
-        for (map<KeyFrame*, size_t>::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; it++)
-          keyframeCounter[it->first]++;
+        pMP->ForEachObservation([&](KeyFrame* pKF, size_t) { keyframeCounter[pKF]++; });
       } else {
         mCurrentFrame.mvpMapPoints[i]=NULL;
       }
@@ -1062,37 +1097,63 @@ void Tracking::UpdateLocalKeyFrames() {
 }
 
 bool Tracking::Relocalization() {
+  ScopedProfile profile(Profiler::RELOCALIZATION);
+
   ORBmatcher matcher(0.75, true);
   int nmatches, nGood;
+  Timer total(true);
 
-  // Compare to all keyframes starting from the last one
-  vector<KeyFrame*> kfs = mpMap->GetAllKeyFrames();
-  for (auto it=kfs.rbegin(); it != kfs.rend(); it++) {
-    KeyFrame* kf = *it;
+  // Retrieve keyframes similar to current frame
+  mCurrentFrame.ComputeWords();
+  vector<KeyFrame*> kfs = mpMap->GetKeyFrameDatabase()->DetectRelocalizationCandidates(&mCurrentFrame, reloc_candidates_);
+
+  for (KeyFrame* kf : kfs) {
+    if (kf->isBad())
+      continue;
 
     mCurrentFrame.SetPose(kf->GetPose());
 
     // Try to align current frame and candidate keyframe
     ImageAlign image_align;
-    if (!image_align.ComputePose(mCurrentFrame, kf, true))
-      continue;
+    if (!image_align.ComputePose(mCurrentFrame, kf, true)) {
+      // Alignment failed, estimate pose from descriptor matches with PnP
+      vector<MapPoint*> vpMapPointMatches;
+      nmatches = matcher.SearchByWords(kf, mCurrentFrame, vpMapPointMatches);
+      if (nmatches < 15)
+        continue;
+
+      PnPsolver pSolver(mCurrentFrame, vpMapPointMatches);
+      pSolver.SetRansacParameters(0.99, 10, 300, 4, 0.5, 5.991);
+
+      vector<bool> vbInliers;
+      int nInliers;
+      cv::Mat Tcw = pSolver.find(vbInliers, nInliers);
+      if (Tcw.empty())
+        continue;
+
+      mCurrentFrame.SetPose(Converter::toMatrix4d(Tcw));
+    }
 
     fill(mCurrentFrame.mvpMapPoints.begin(), mCurrentFrame.mvpMapPoints.end(), static_cast<MapPoint*>(NULL));
 
-    // Project points seen in previous frame
+    // Project points seen in candidate keyframe
     nmatches = matcher.SearchByProjection(mCurrentFrame, kf, threshold_, mSensor!=System::RGBD);
     if (nmatches < 20)
       continue;
 
     // Optimize frame pose with all matches
-    nGood = Optimizer::PoseOptimization(&mCurrentFrame);
+    nGood = Optimizer::PoseOptimization(&mCurrentFrame, mpMap);
     if (nGood < 10)
       continue;
 
     mnLastRelocFrameId = mCurrentFrame.mnId;
+    total.Stop();
+    LOGD("Relocalization time is %.2fms (%lu candidates)", total.GetMsTime(), kfs.size());
     return true;
   }
 
+  total.Stop();
+  LOGD("Relocalization failed in %.2fms (%lu candidates)", total.GetMsTime(), kfs.size());
   return false;
 }
 
@@ -1113,8 +1174,6 @@ void Tracking::Reset() {
   // Clear Map (this erase MapPoints and KeyFrames)
   mpMap->clear();
 
-  KeyFrame::nNextId = 0;
-  Frame::nNextId = 0;
   mState = NO_IMAGES_YET;
 
   if (mpInitializer) {
@@ -1124,6 +1183,7 @@ void Tracking::Reset() {
 
   lastRelativePose_.setZero();
   motion_model_->Restart();
+  reset_count_++;
 }
 
 void Tracking::InformOnlyTracking(const bool &flag) {
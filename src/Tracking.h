@@ -26,9 +26,11 @@
 #define SD_SLAM_TRACKING_H
 
 #include <mutex>
+#include <atomic>
 #include <string>
 #include <list>
 #include <vector>
+#include <memory>
 #include <opencv2/core/core.hpp>
 #include <Eigen/Dense>
 #include "Map.h"
@@ -63,13 +65,20 @@ class Tracking {
   Tracking(System* pSys, Map* pMap, const int sensor);
 
   // Preprocess the input and call Track(). Extract features and performs stereo matching.
-  Eigen::Matrix4d GrabImageRGBD(const cv::Mat &im, const cv::Mat &imD, const std::string filename);
-  Eigen::Matrix4d GrabImageMonocular(const cv::Mat &im, const std::string filename);
+  // Timestamp is the capture time in seconds.
+  Eigen::Matrix4d GrabImageRGBD(const cv::Mat &im, const cv::Mat &imD, double timestamp, const std::string filename);
+  Eigen::Matrix4d GrabImageMonocular(const cv::Mat &im, double timestamp, const std::string filename);
+
+  // Track a frame already created. Frame is moved into current frame and gets its id from the map.
+  Eigen::Matrix4d TrackFrame(Frame &frame);
 
   // Create new frame and extract features
   Frame CreateFrame(const cv::Mat &im);
   Frame CreateFrame(const cv::Mat &im, const cv::Mat &imD);
 
+  // Create new monocular frame, using initialization extractor if the map is not initialized
+  Frame CreateFrameMonocular(const cv::Mat &im);
+
   inline void SetLocalMapper(LocalMapping* pLocalMapper) {
     mpLocalMapper = pLocalMapper;
   }
@@ -99,6 +108,9 @@ class Tracking {
 
   inline std::vector<int> GetInitialMatches() { return mvIniMatches; }
 
+  // Number of resets performed. Frames created before a reset are not valid after it.
+  inline int GetResetCount() const { return reset_count_; }
+
   void Reset();
 
   // Use this function if you have deactivated local mapping and you only want to localize the camera.
@@ -135,6 +147,9 @@ class Tracking {
   bool NeedNewKeyFrame();
   void CreateNewKeyFrame();
 
+  // Undistortion lookup if it matches the image size, null otherwise
+  std::shared_ptr<const Undistorter> GetUndistorter(const cv::Mat &im) const;
+
   // Other Thread Pointers
   LocalMapping* mpLocalMapper;
   LoopClosing* mpLoopClosing;
@@ -173,6 +188,9 @@ class Tracking {
   cv::Mat mDistCoef;
   float mbf;
 
+  // Undistortion lookup for the configured image size
+  std::shared_ptr<const Undistorter> mpUndistorter;
+
   // New KeyFrame rules (according to fps)
   int mMinFrames;
   int mMaxFrames;
@@ -195,12 +213,15 @@ class Tracking {
   unsigned int mnLastRelocFrameId;
 
   // Sensor model
-  EKF* motion_model_;
+  MotionModel* motion_model_;
   std::vector<double> measurements_;
 
   std::list<MapPoint*> mlpTemporalPoints;
   int threshold_;
 
+  // Number of keyframes retrieved from the database during relocalization
+  int reloc_candidates_;
+
   // Initialization Variables (Monocular)
   std::vector<int> mvIniLastMatches;
   std::vector<int> mvIniMatches;
@@ -219,6 +240,10 @@ class Tracking {
   // Image align
   bool align_image_;
 
+  // Number of resets performed
+  // Read by the extraction thread of the asynchronous pipeline
+  std::atomic<int> reset_count_;
+
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
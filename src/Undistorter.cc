@@ -0,0 +1,147 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "Undistorter.h"
+#include <cmath>
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+#include "Converter.h"
+
+using std::vector;
+
+namespace SD_SLAM {
+
+const float Undistorter::MAX_ERROR = 0.05f;
+const int Undistorter::MAX_STEP;
+const int Undistorter::MIN_STEP;
+
+Undistorter::Undistorter(const Eigen::Matrix3d &K, const cv::Mat &distCoef, const cv::Size &imSize):
+  identity_(distCoef.at<float>(0) == 0.0), image_size_(imSize), K_(K), dist_coef_(distCoef.clone()),
+  min_x_(0), max_x_(imSize.width), min_y_(0), max_y_(imSize.height),
+  step_(0), inv_step_(0), cols_(0), rows_(0), max_error_(0) {
+  if (identity_)
+    return;
+
+  ImageBounds(K, distCoef, imSize, min_x_, max_x_, min_y_, max_y_);
+
+  for (int step = MAX_STEP; step >= MIN_STEP; step /= 2) {
+    max_error_ = BuildGrid(K, distCoef, step);
+    if (max_error_ <= MAX_ERROR)
+      return;
+  }
+
+  // Interpolation is not accurate enough
+  nodes_.clear();
+}
+
+float Undistorter::BuildGrid(const Eigen::Matrix3d &K, const cv::Mat &distCoef, int step) {
+  step_ = step;
+  inv_step_ = 1.0f/step;
+  cols_ = (image_size_.width+step-1)/step;
+  rows_ = (image_size_.height+step-1)/step;
+
+  // Nodes followed by cell centers, undistorted in a single call
+  const int nNodes = (cols_+1)*(rows_+1);
+  vector<cv::Point2f> points;
+  points.reserve(nNodes+cols_*rows_);
+  for (int iy = 0; iy <= rows_; iy++) {
+    for (int ix = 0; ix <= cols_; ix++)
+      points.push_back(cv::Point2f(ix*step, iy*step));
+  }
+  for (int iy = 0; iy < rows_; iy++) {
+    for (int ix = 0; ix < cols_; ix++)
+      points.push_back(cv::Point2f((ix+0.5f)*step, (iy+0.5f)*step));
+  }
+
+  UndistortPoints(K, distCoef, points);
+
+  nodes_.resize(2*nNodes);
+  for (int i = 0; i < nNodes; i++) {
+    nodes_[2*i] = points[i].x;
+    nodes_[2*i+1] = points[i].y;
+  }
+
+  // Error at cell centers
+  float maxError = 0;
+  for (int iy = 0; iy < rows_; iy++) {
+    for (int ix = 0; ix < cols_; ix++) {
+      float xu, yu;
+      Lookup((ix+0.5f)*step, (iy+0.5f)*step, xu, yu);
+      const cv::Point2f &p = points[nNodes+iy*cols_+ix];
+      maxError = std::max(maxError, std::sqrt((xu-p.x)*(xu-p.x)+(yu-p.y)*(yu-p.y)));
+    }
+  }
+
+  return maxError;
+}
+
+void Undistorter::UndistortKeyPoints(const vector<cv::KeyPoint> &keys, vector<cv::KeyPoint> &keysUn) const {
+  keysUn = keys;
+  if (identity_)
+    return;
+
+  if (UsesGrid()) {
+    for (size_t i = 0, n = keys.size(); i < n; i++)
+      Lookup(keys[i].pt.x, keys[i].pt.y, keysUn[i].pt.x, keysUn[i].pt.y);
+    return;
+  }
+
+  vector<cv::Point2f> points(keys.size());
+  for (size_t i = 0; i < keys.size(); i++)
+    points[i] = keys[i].pt;
+  UndistortPoints(K_, dist_coef_, points);
+
+  for (size_t i = 0; i < keys.size(); i++)
+    keysUn[i].pt = points[i];
+}
+
+void Undistorter::ImageBounds(const Eigen::Matrix3d &K, const cv::Mat &distCoef, const cv::Size &imSize,
+                              float &minX, float &maxX, float &minY, float &maxY) {
+  if (distCoef.at<float>(0) == 0.0) {
+    minX = 0.0f;
+    maxX = imSize.width;
+    minY = 0.0f;
+    maxY = imSize.height;
+    return;
+  }
+
+  // Undistort corners
+  vector<cv::Point2f> corners(4);
+  corners[0] = cv::Point2f(0, 0);
+  corners[1] = cv::Point2f(imSize.width, 0);
+  corners[2] = cv::Point2f(0, imSize.height);
+  corners[3] = cv::Point2f(imSize.width, imSize.height);
+  UndistortPoints(K, distCoef, corners);
+
+  minX = std::min(corners[0].x, corners[2].x);
+  maxX = std::max(corners[1].x, corners[3].x);
+  minY = std::min(corners[0].y, corners[1].y);
+  maxY = std::max(corners[2].y, corners[3].y);
+}
+
+void Undistorter::UndistortPoints(const Eigen::Matrix3d &K, const cv::Mat &distCoef, vector<cv::Point2f> &points) {
+  if (points.empty())
+    return;
+
+  cv::Mat mat(static_cast<int>(points.size()), 1, CV_32FC2, points.data());
+  cv::Mat K_cv = Converter::toCvMat(K);
+  cv::undistortPoints(mat, mat, K_cv, distCoef, cv::Mat(), K_cv);
+}
+
+}  // namespace SD_SLAM
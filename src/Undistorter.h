@@ -0,0 +1,113 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SD_SLAM_UNDISTORTER_H_
+#define SD_SLAM_UNDISTORTER_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <Eigen/Dense>
+
+namespace SD_SLAM {
+
+// Keypoint undistortion bound to a camera calibration. The undistorted position of
+// each node of a regular grid over the image is computed once with cv::undistortPoints,
+// and keypoints are undistorted by bilinear interpolation between nodes. Grid step is
+// halved until the interpolation error at cell centers (the worst point of each cell)
+// is below MAX_ERROR. If it can't be reached (e.g. strong distortion where the model
+// is not invertible) keypoints are undistorted with cv::undistortPoints.
+// Image bounds are also computed once.
+// Immutable once built, so it is shared between all frames of a camera.
+class Undistorter {
+ public:
+  // Maximum interpolation error (pixels) and grid steps tried
+  static const float MAX_ERROR;
+  static const int MAX_STEP = 16;
+  static const int MIN_STEP = 2;
+
+  Undistorter(const Eigen::Matrix3d &K, const cv::Mat &distCoef, const cv::Size &imSize);
+
+  // Undistort all keypoints, only coordinates are modified
+  void UndistortKeyPoints(const std::vector<cv::KeyPoint> &keys, std::vector<cv::KeyPoint> &keysUn) const;
+
+  // Bounds of the undistorted image
+  static void ImageBounds(const Eigen::Matrix3d &K, const cv::Mat &distCoef, const cv::Size &imSize,
+                          float &minX, float &maxX, float &minY, float &maxY);
+
+  // Exact undistortion (iterative) of a set of points, in place
+  static void UndistortPoints(const Eigen::Matrix3d &K, const cv::Mat &distCoef, std::vector<cv::Point2f> &points);
+
+  // Calibration without distortion, keypoints are copied
+  inline bool IsIdentity() const { return identity_; }
+
+  inline const cv::Size& ImageSize() const { return image_size_; }
+
+  // Undistorted image bounds
+  inline float MinX() const { return min_x_; }
+  inline float MaxX() const { return max_x_; }
+  inline float MinY() const { return min_y_; }
+  inline float MaxY() const { return max_y_; }
+
+  // Grid step and interpolation error measured against cv::undistortPoints
+  inline bool UsesGrid() const { return !nodes_.empty(); }
+  inline int Step() const { return step_; }
+  inline float MaxInterpolationError() const { return max_error_; }
+
+ private:
+  // Fill the grid with the given step and return the interpolation error
+  float BuildGrid(const Eigen::Matrix3d &K, const cv::Mat &distCoef, int step);
+
+  // Bilinear interpolation of the grid
+  inline void Lookup(float x, float y, float &xu, float &yu) const {
+    const float gx = x*inv_step_;
+    const float gy = y*inv_step_;
+    const int ix = std::min(std::max(static_cast<int>(gx), 0), cols_-1);
+    const int iy = std::min(std::max(static_cast<int>(gy), 0), rows_-1);
+    const float ax = gx-ix;
+    const float ay = gy-iy;
+
+    const float *p00 = &nodes_[2*(iy*(cols_+1)+ix)];
+    const float *p10 = p00+2*(cols_+1);
+    const float w00 = (1-ax)*(1-ay), w01 = ax*(1-ay), w10 = (1-ax)*ay, w11 = ax*ay;
+    xu = w00*p00[0] + w01*p00[2] + w10*p10[0] + w11*p10[2];
+    yu = w00*p00[1] + w01*p00[3] + w10*p10[1] + w11*p10[3];
+  }
+
+  bool identity_;
+  cv::Size image_size_;
+  Eigen::Matrix3d K_;
+  cv::Mat dist_coef_;
+
+  float min_x_;
+  float max_x_;
+  float min_y_;
+  float max_y_;
+
+  // Grid of cols_ x rows_ cells, nodes stored by rows as interleaved (x, y)
+  int step_;
+  float inv_step_;
+  int cols_;
+  int rows_;
+  std::vector<float> nodes_;
+  float max_error_;
+};
+
+}  // namespace SD_SLAM
+
+#endif  // SD_SLAM_UNDISTORTER_H_
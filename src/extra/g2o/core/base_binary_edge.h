@@ -90,6 +90,8 @@ namespace g2o {
 
       virtual void constructQuadraticForm() ;
 
+      virtual void constructQuadraticFormForVertex(int i);
+
       virtual void mapHessianMemory(double* d, int i, int j, bool rowMajor);
 
       using BaseEdge<D, E>::resize;
@@ -119,6 +119,47 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::constructQuadraticForm()
   }
 }
 
+template <int D, typename E, typename VertexXiType, typename VertexXjType>
+void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::constructQuadraticFormForVertex(int i)
+{
+  VertexXiType* from = static_cast<VertexXiType*>(_vertices[0]);
+  VertexXjType* to   = static_cast<VertexXjType*>(_vertices[1]);
+
+  bool fromNotFixed = !(from->fixed());
+  bool toNotFixed = !(to->fixed());
+  if ((i == 0 && !fromNotFixed) || (i == 1 && !toNotFixed))
+    return;
+
+  const JacobianXiOplusType& A = jacobianOplusXi();
+  const JacobianXjOplusType& B = jacobianOplusXj();
+
+  InformationType omega = _information;
+  Matrix<double, D, 1> omega_r = - _information * _error;
+  if (this->robustKernel()) {
+    Eigen::Vector3d rho;
+    this->robustKernel()->robustify(this->chi2(), rho);
+    omega = this->robustInformation(rho);
+    omega_r *= rho[1];
+  }
+
+  if (i == 0) {
+    from->b().noalias() += A.transpose() * omega_r;
+    from->A().noalias() += A.transpose() * omega * A;
+  } else {
+    to->b().noalias() += B.transpose() * omega_r;
+    to->A().noalias() += B.transpose() * omega * B;
+  }
+
+  // off diagonal block is written by the vertex with lower hessian index
+  bool ownsBlock = i == 0 ? from->hessianIndex() < to->hessianIndex() : to->hessianIndex() < from->hessianIndex();
+  if (fromNotFixed && toNotFixed && ownsBlock) {
+    if (_hessianRowMajor) // we have to write to the block as transposed
+      _hessianTransposed.noalias() += B.transpose() * omega * A;
+    else
+      _hessian.noalias() += A.transpose() * omega * B;
+  }
+}
+
 template <int D, typename E, typename VertexXiType, typename VertexXjType>
 void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::linearizeOplus(JacobianWorkspace& jacobianWorkspace)
 {
@@ -140,8 +181,11 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::linearizeOplus()
     return;
 
 #ifdef G2O_OPENMP
-  vi->lockQuadraticForm();
-  vj->lockQuadraticForm();
+  // lock in address order, other edges can connect the same vertices in the opposite direction
+  OptimizableGraph::Vertex* lockFirst = std::min<OptimizableGraph::Vertex*>(vi, vj);
+  OptimizableGraph::Vertex* lockSecond = std::max<OptimizableGraph::Vertex*>(vi, vj);
+  lockFirst->lockQuadraticForm();
+  lockSecond->lockQuadraticForm();
 #endif
 
   const double delta = 1e-9;
@@ -199,8 +243,8 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::linearizeOplus()
 
   _error = errorBeforeNumeric;
 #ifdef G2O_OPENMP
-  vj->unlockQuadraticForm();
-  vi->unlockQuadraticForm();
+  lockSecond->unlockQuadraticForm();
+  lockFirst->unlockQuadraticForm();
 #endif
 }
 
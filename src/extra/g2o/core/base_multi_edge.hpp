@@ -48,6 +48,52 @@ void BaseMultiEdge<D, E>::constructQuadraticForm()
 }
 
 
+template <int D, typename E>
+void BaseMultiEdge<D, E>::constructQuadraticFormForVertex(int i)
+{
+  OptimizableGraph::Vertex* from = static_cast<OptimizableGraph::Vertex*>(_vertices[i]);
+  if (from->fixed())
+    return;
+
+  InformationType omega = _information;
+  ErrorVector weightedError = - _information * _error;
+  if (this->robustKernel()) {
+    Eigen::Vector3d rho;
+    this->robustKernel()->robustify(this->chi2(), rho);
+    omega = this->robustInformation(rho);
+    weightedError *= rho[1];
+  }
+
+  const MatrixXd& A = _jacobianOplus[i];
+  int fromDim = from->dimension();
+  assert(fromDim >= 0);
+  Eigen::Map<MatrixXd> fromMap(from->hessianData(), fromDim, fromDim);
+  Eigen::Map<VectorXd> fromB(from->bData(), fromDim);
+  fromMap.noalias() += A.transpose() * omega * A;
+  fromB.noalias() += A.transpose() * weightedError;
+
+  // off diagonal blocks are written by the vertex with lower hessian index
+  for (size_t j = 0; j < _vertices.size(); ++j) {
+    OptimizableGraph::Vertex* to = static_cast<OptimizableGraph::Vertex*>(_vertices[j]);
+    if ((int)j == i || to->fixed() || to->hessianIndex() < from->hessianIndex())
+      continue;
+
+    // blocks are stored for vertex pairs in the edge order
+    size_t a = std::min((size_t)i, j);
+    size_t b = std::max((size_t)i, j);
+    const MatrixXd& Ja = _jacobianOplus[a];
+    const MatrixXd& Jb = _jacobianOplus[b];
+    int idx = internal::computeUpperTriangleIndex(a, b);
+    assert(idx < (int)_hessian.size());
+    HessianHelper& hhelper = _hessian[idx];
+    if (hhelper.transposed) { // we have to write to the block as transposed
+      hhelper.matrix.noalias() += Jb.transpose() * omega * Ja;
+    } else {
+      hhelper.matrix.noalias() += Ja.transpose() * omega * Jb;
+    }
+  }
+}
+
 template <int D, typename E>
 void BaseMultiEdge<D, E>::linearizeOplus(JacobianWorkspace& jacobianWorkspace)
 {
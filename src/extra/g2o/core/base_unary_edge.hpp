@@ -71,6 +71,30 @@ void BaseUnaryEdge<D, E, VertexXiType>::constructQuadraticForm()
   }
 }
 
+template <int D, typename E, typename VertexXiType>
+void BaseUnaryEdge<D, E, VertexXiType>::constructQuadraticFormForVertex(int i)
+{
+  VertexXiType* from = static_cast<VertexXiType*>(_vertices[0]);
+  if (i != 0 || from->fixed())
+    return;
+
+  const JacobianXiOplusType& A = jacobianOplusXi();
+  const InformationType& omega = _information;
+
+  if (this->robustKernel()) {
+    double error = this->chi2();
+    Eigen::Vector3d rho;
+    this->robustKernel()->robustify(error, rho);
+    InformationType weightedOmega = this->robustInformation(rho);
+
+    from->b().noalias() -= rho[1] * A.transpose() * omega * _error;
+    from->A().noalias() += A.transpose() * weightedOmega * A;
+  } else {
+    from->b().noalias() -= A.transpose() * omega * _error;
+    from->A().noalias() += A.transpose() * omega * A;
+  }
+}
+
 template <int D, typename E, typename VertexXiType>
 void BaseUnaryEdge<D, E, VertexXiType>::linearizeOplus(JacobianWorkspace& jacobianWorkspace)
 {
@@ -32,6 +32,7 @@
 #include "sparse_block_matrix.h"
 #include "sparse_block_matrix_diagonal.h"
 #include "openmp_mutex.h"
+#include "optimizable_graph.h"
 #include "../config.h"
 
 namespace g2o {
@@ -164,6 +165,18 @@ namespace g2o {
 
 #    ifdef G2O_OPENMP
       std::vector<OpenMPMutex> _coefficientsMutex;
+
+      /**
+       * active edges of each vertex (by hessian index) and memory for the Jacobians of all
+       * the edges, so the system can be linearized and assembled in parallel without locks
+       */
+      void buildVertexEdges();
+      bool _vertexEdgesValid;
+      std::vector<int> _vertexEdgeOffsets;
+      std::vector<std::pair<OptimizableGraph::Edge*, int> > _vertexEdges;
+      int _edgeJacobianStride;
+      int _vertexJacobianStride;
+      VectorXd _edgeJacobians;
 #    endif
 
       bool _doSchur;
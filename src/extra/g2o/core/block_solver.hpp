@@ -59,6 +59,11 @@ BlockSolver<Traits>::BlockSolver(LinearSolverType* linearSolver) :
   _sizePoses = 0;
   _sizeLandmarks = 0;
   _doSchur=true;
+# ifdef G2O_OPENMP
+  _vertexEdgesValid = false;
+  _edgeJacobianStride = 0;
+  _vertexJacobianStride = 0;
+# endif
 }
 
 template <typename Traits>
@@ -144,6 +149,10 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
 {
   assert(_optimizer);
 
+# ifdef G2O_OPENMP
+  _vertexEdgesValid = false;
+# endif
+
   size_t sparseDim = 0;
   _numPoses = 0;
   _numLandmarks = 0;
@@ -297,6 +306,9 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
 template <typename Traits>
 bool BlockSolver<Traits>::updateStructure(const std::vector<HyperGraph::Vertex*>& vset, const HyperGraph::EdgeSet& edges)
 {
+# ifdef G2O_OPENMP
+  _vertexEdgesValid = false;
+# endif
   for (std::vector<HyperGraph::Vertex*>::const_iterator vit = vset.begin(); vit != vset.end(); ++vit) {
     OptimizableGraph::Vertex* v = static_cast<OptimizableGraph::Vertex*>(*vit);
     int dim = v->dimension();
@@ -518,14 +530,41 @@ bool BlockSolver<Traits>::buildSystem()
 
   // resetting the terms for the pairwise constraints
   // built up the current system by storing the Hessian blocks in the edges and vertices
-# ifndef G2O_OPENMP
-  // no threading, we do not need to copy the workspace
-  JacobianWorkspace& jacobianWorkspace = _optimizer->jacobianWorkspace();
-# else
-  // if running with threads need to produce copies of the workspace for each thread
-  JacobianWorkspace jacobianWorkspace = _optimizer->jacobianWorkspace();
-# pragma omp parallel for default (shared) firstprivate(jacobianWorkspace) if (_optimizer->activeEdges().size() > 100)
+# ifdef G2O_OPENMP
+  if (_optimizer->activeEdges().size() > 100) {
+    if (! _vertexEdgesValid)
+      buildVertexEdges();
+
+    // each edge is linearized into its own memory, so its Jacobians are kept for the assembly
+#   pragma omp parallel for default (shared) schedule (static)
+    for (int k = 0; k < static_cast<int>(_optimizer->activeEdges().size()); ++k) {
+      OptimizableGraph::Edge* e = _optimizer->activeEdges()[k];
+      JacobianWorkspace jacobianWorkspace;
+      jacobianWorkspace.setExternalMemory(_edgeJacobians.data() + static_cast<size_t>(k) * _edgeJacobianStride, _vertexJacobianStride);
+      e->linearizeOplus(jacobianWorkspace); // jacobian of the nodes' oplus (manifold)
+#    ifndef NDEBUG
+      for (size_t i = 0; i < e->vertices().size(); ++i) {
+        const OptimizableGraph::Vertex* v = static_cast<const OptimizableGraph::Vertex*>(e->vertex(i));
+        if (! v->fixed()) {
+          bool hasANan = arrayHasNaN(jacobianWorkspace.workspaceForVertex(i), e->dimension() * v->dimension());
+          if (hasANan) {
+            cerr << "buildSystem(): NaN within Jacobian for edge " << e << " for vertex " << i << endl;
+            break;
+          }
+        }
+      }
+#    endif
+    }
+
+    // each vertex accumulates its own blocks, so no locks are needed
+#   pragma omp parallel for default (shared) schedule (dynamic, 16)
+    for (int i = 0; i < static_cast<int>(_optimizer->indexMapping().size()); ++i) {
+      for (int k = _vertexEdgeOffsets[i]; k < _vertexEdgeOffsets[i+1]; ++k)
+        _vertexEdges[k].first->constructQuadraticFormForVertex(_vertexEdges[k].second);
+    }
+  } else {
 # endif
+  JacobianWorkspace& jacobianWorkspace = _optimizer->jacobianWorkspace();
   for (int k = 0; k < static_cast<int>(_optimizer->activeEdges().size()); ++k) {
     OptimizableGraph::Edge* e = _optimizer->activeEdges()[k];
     e->linearizeOplus(jacobianWorkspace); // jacobian of the nodes' oplus (manifold)
@@ -543,6 +582,9 @@ bool BlockSolver<Traits>::buildSystem()
     }
 #  endif
   }
+# ifdef G2O_OPENMP
+  }
+# endif
 
   // flush the current system in a sparse block matrix
 # ifdef G2O_OPENMP
@@ -560,6 +602,46 @@ bool BlockSolver<Traits>::buildSystem()
 }
 
 
+# ifdef G2O_OPENMP
+template <typename Traits>
+void BlockSolver<Traits>::buildVertexEdges()
+{
+  const SparseOptimizer::EdgeContainer& edges = _optimizer->activeEdges();
+  const int numVertices = static_cast<int>(_optimizer->indexMapping().size());
+
+  // count edges of each vertex, then fill them in CSR order
+  _vertexEdgeOffsets.assign(numVertices + 1, 0);
+  for (size_t k = 0; k < edges.size(); ++k) {
+    for (size_t i = 0; i < edges[k]->vertices().size(); ++i) {
+      int idx = static_cast<OptimizableGraph::Vertex*>(edges[k]->vertex(i))->hessianIndex();
+      if (idx >= 0)
+        _vertexEdgeOffsets[idx+1]++;
+    }
+  }
+  for (int i = 0; i < numVertices; ++i)
+    _vertexEdgeOffsets[i+1] += _vertexEdgeOffsets[i];
+
+  _vertexEdges.resize(_vertexEdgeOffsets[numVertices]);
+  std::vector<int> next(_vertexEdgeOffsets.begin(), _vertexEdgeOffsets.end() - 1);
+  for (size_t k = 0; k < edges.size(); ++k) {
+    for (size_t i = 0; i < edges[k]->vertices().size(); ++i) {
+      int idx = static_cast<OptimizableGraph::Vertex*>(edges[k]->vertex(i))->hessianIndex();
+      if (idx >= 0)
+        _vertexEdges[next[idx]++] = std::make_pair(edges[k], static_cast<int>(i));
+    }
+  }
+
+  // Jacobian memory of each edge, blocks rounded to keep the alignment required by the fixed size maps
+  const JacobianWorkspace& workspace = _optimizer->jacobianWorkspace();
+  _vertexJacobianStride = (std::max(workspace.maxDimension(), 1) + 7) & ~7;
+  _edgeJacobianStride = std::max(workspace.maxNumVertices(), 1) * _vertexJacobianStride;
+  _edgeJacobians.resize(static_cast<size_t>(edges.size()) * _edgeJacobianStride);
+  _edgeJacobians.setZero();
+
+  _vertexEdgesValid = true;
+}
+# endif
+
 template <typename Traits>
 bool BlockSolver<Traits>::setLambda(double lambda, bool backup)
 {
@@ -81,12 +81,29 @@ namespace g2o {
        */
       double* workspaceForVertex(int vertexIndex)
       {
+        if (_external)
+          return _external + vertexIndex * _externalStride;
         assert(vertexIndex >= 0 && (size_t)vertexIndex < _workspace.size() && "Index out of bounds");
         return _workspace[vertexIndex].data();
       }
 
+      /**
+       * use the given memory instead of the allocated workspace, stride elements per vertex.
+       * Allows to keep the Jacobians of an edge after linearizing other edges.
+       */
+      void setExternalMemory(double* memory, int stride)
+      {
+        _external = memory;
+        _externalStride = stride;
+      }
+
+      int maxNumVertices() const { return _maxNumVertices;}
+      int maxDimension() const { return _maxDimension;}
+
     protected:
       WorkspaceVector _workspace;   ///< the memory pre-allocated for computing the Jacobians
+      double* _external;            ///< external memory used instead of the workspace (not owned)
+      int _externalStride;          ///< elements per vertex in the external memory
       int _maxNumVertices;          ///< the maximum number of vertices connected by a hyper-edge
       int _maxDimension;            ///< the maximum dimension (number of elements) for a Jacobian
   };
@@ -437,6 +437,15 @@ namespace g2o {
          */
         virtual void constructQuadraticForm() = 0;
 
+        /**
+         * Same as above, but only for the i-th vertex: its parameter vector b,
+         * its hessian block and the off diagonal blocks with vertices of higher
+         * hessian index. Calling it for every vertex gives the same system, and
+         * different vertices can be processed in parallel without locks.
+         * The Jacobians must still be valid (see linearizeOplus).
+         */
+        virtual void constructQuadraticFormForVertex(int i) = 0;
+
         /**
          * maps the internal matrix to some external memory location,
          * you need to provide the memory before calling constructQuadraticForm
@@ -0,0 +1,277 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "profiler.h"
+#include <fstream>
+#include <algorithm>
+#include "log.h"
+
+using std::vector;
+using std::string;
+using std::mutex;
+using std::unique_lock;
+using std::memory_order_relaxed;
+
+namespace SD_SLAM {
+
+namespace {
+
+const char* const kStageNames[Profiler::NUM_STAGES] = {
+  "Extraction",
+  "ImageAlign",
+  "SearchByProjection",
+  "PoseOptimization",
+  "TrackLocalMap",
+  "KeyFrameInsertion",
+  "Relocalization",
+  "Tracking",
+  "LocalMapping",
+  "CreateNewMapPoints",
+  "LocalBA",
+  "KeyFrameQueueWait",
+  "LoopDetection",
+  "LoopCorrection",
+  "GlobalBA"
+};
+
+// Increment a counter only written by the thread holding its buffer
+inline void Increment(std::atomic<uint64_t> &counter, uint64_t value) {
+  counter.store(counter.load(memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+}  // namespace
+
+thread_local Profiler *Profiler::current_ = nullptr;
+thread_local Profiler::ThreadBuffer *Profiler::current_buffer_ = nullptr;
+
+Profiler::Profiler() : enabled_(true) {
+}
+
+Profiler::~Profiler() {
+  for (ThreadBuffer* buffer : buffers_)
+    delete buffer;
+}
+
+void Profiler::Add(Stage stage, uint64_t us) {
+  if (current_ == this && current_buffer_) {
+    Record(current_buffer_, stage, us);
+    return;
+  }
+
+  // Thread not bound to this profiler, lease a buffer only for this sample
+  ThreadBuffer* buffer = Acquire();
+  Record(buffer, stage, us);
+  Release(buffer);
+}
+
+void Profiler::Record(ThreadBuffer* buffer, Stage stage, uint64_t us) {
+  StageCounters &counters = buffer->stages[stage];
+
+  Increment(counters.count, 1);
+  Increment(counters.total, us);
+  Increment(counters.buckets[Bucket(us)], 1);
+  if (us > counters.max.load(memory_order_relaxed))
+    counters.max.store(us, memory_order_relaxed);
+}
+
+Profiler::ThreadBuffer* Profiler::Acquire() {
+  unique_lock<mutex> lock(mutex_);
+
+  if (!free_buffers_.empty()) {
+    ThreadBuffer* buffer = free_buffers_.back();
+    free_buffers_.pop_back();
+    return buffer;
+  }
+
+  ThreadBuffer* buffer = new ThreadBuffer();
+  for (int s = 0; s < NUM_STAGES; s++) {
+    StageCounters &counters = buffer->stages[s];
+    counters.count.store(0);
+    counters.total.store(0);
+    counters.max.store(0);
+    for (int b = 0; b < NUM_BUCKETS; b++)
+      counters.buckets[b].store(0);
+  }
+
+  buffers_.push_back(buffer);
+  return buffer;
+}
+
+void Profiler::Release(ThreadBuffer* buffer) {
+  unique_lock<mutex> lock(mutex_);
+  free_buffers_.push_back(buffer);
+}
+
+Profiler::Stats Profiler::GetStats(Stage stage) {
+  Stats stats;
+  uint64_t total = 0, max = 0;
+
+  stats.count = 0;
+  stats.histogram.assign(NUM_BUCKETS, 0);
+
+  {
+    unique_lock<mutex> lock(mutex_);
+    for (ThreadBuffer* buffer : buffers_) {
+      const StageCounters &counters = buffer->stages[stage];
+      stats.count += counters.count.load(memory_order_relaxed);
+      total += counters.total.load(memory_order_relaxed);
+      max = std::max(max, counters.max.load(memory_order_relaxed));
+      for (int b = 0; b < NUM_BUCKETS; b++)
+        stats.histogram[b] += counters.buckets[b].load(memory_order_relaxed);
+    }
+  }
+
+  stats.total = total/1000.0;
+  stats.max = max/1000.0;
+  stats.mean = stats.count > 0 ? stats.total/stats.count : 0.0;
+
+  // Percentiles are the upper limit of the bucket containing them
+  double *percentiles[3] = {&stats.p50, &stats.p90, &stats.p99};
+  const double ranks[3] = {0.5, 0.9, 0.99};
+  for (int i = 0; i < 3; i++) {
+    uint64_t target = static_cast<uint64_t>(ranks[i]*stats.count + 0.5), accum = 0;
+    double lower, upper = 0.0;
+    for (int b = 0; b < NUM_BUCKETS && stats.count > 0; b++) {
+      accum += stats.histogram[b];
+      if (accum >= target && accum > 0) {
+        BucketLimits(b, lower, upper);
+        break;
+      }
+    }
+    *percentiles[i] = std::min(upper, stats.max);
+  }
+
+  return stats;
+}
+
+void Profiler::Reset() {
+  unique_lock<mutex> lock(mutex_);
+
+  for (ThreadBuffer* buffer : buffers_) {
+    for (int s = 0; s < NUM_STAGES; s++) {
+      StageCounters &counters = buffer->stages[s];
+      counters.count.store(0, memory_order_relaxed);
+      counters.total.store(0, memory_order_relaxed);
+      counters.max.store(0, memory_order_relaxed);
+      for (int b = 0; b < NUM_BUCKETS; b++)
+        counters.buckets[b].store(0, memory_order_relaxed);
+    }
+  }
+}
+
+void Profiler::PrintStats() {
+  for (int s = 0; s < NUM_STAGES; s++) {
+    Stats stats = GetStats(static_cast<Stage>(s));
+    if (stats.count == 0)
+      continue;
+
+    LOGD("%s: %lu calls, mean %.2fms, p50 %.2fms, p90 %.2fms, p99 %.2fms, max %.2fms",
+         kStageNames[s], static_cast<unsigned long>(stats.count), stats.mean, stats.p50, stats.p90, stats.p99, stats.max);
+  }
+}
+
+bool Profiler::SaveCSV(const string &filename) {
+  std::ofstream f(filename.c_str());
+  if (!f.is_open()) {
+    LOGE("Failed to open file: %s", filename.c_str());
+    return false;
+  }
+
+  f << "stage,lower_ms,upper_ms,count\n";
+  for (int s = 0; s < NUM_STAGES; s++) {
+    Stats stats = GetStats(static_cast<Stage>(s));
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+      if (stats.histogram[b] == 0)
+        continue;
+
+      double lower, upper;
+      BucketLimits(b, lower, upper);
+      f << kStageNames[s] << "," << lower << "," << upper << "," << stats.histogram[b] << "\n";
+    }
+  }
+
+  return f.good();
+}
+
+bool Profiler::SaveJSON(const string &filename) {
+  std::ofstream f(filename.c_str());
+  if (!f.is_open()) {
+    LOGE("Failed to open file: %s", filename.c_str());
+    return false;
+  }
+
+  f << "{\n  \"stages\": [";
+  for (int s = 0; s < NUM_STAGES; s++) {
+    Stats stats = GetStats(static_cast<Stage>(s));
+
+    f << (s > 0 ? ",\n" : "\n");
+    f << "    {\"name\": \"" << kStageNames[s] << "\", \"count\": " << stats.count
+      << ", \"total_ms\": " << stats.total << ", \"mean_ms\": " << stats.mean
+      << ", \"p50_ms\": " << stats.p50 << ", \"p90_ms\": " << stats.p90
+      << ", \"p99_ms\": " << stats.p99 << ", \"max_ms\": " << stats.max << ", \"histogram\": [";
+
+    bool first = true;
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+      if (stats.histogram[b] == 0)
+        continue;
+
+      double lower, upper;
+      BucketLimits(b, lower, upper);
+      f << (first ? "" : ", ") << "[" << lower << ", " << upper << ", " << stats.histogram[b] << "]";
+      first = false;
+    }
+    f << "]}";
+  }
+  f << "\n  ]\n}\n";
+
+  return f.good();
+}
+
+void Profiler::BucketLimits(int bucket, double &lower, double &upper) {
+  uint64_t lo, hi;
+
+  if (bucket < 4) {
+    lo = bucket;
+    hi = bucket+1;
+  } else {
+    const int e = bucket/4 + 1;
+    const int sub = bucket%4;
+    lo = static_cast<uint64_t>(4+sub) << (e-2);
+    hi = static_cast<uint64_t>(5+sub) << (e-2);
+  }
+
+  lower = lo/1000.0;
+  upper = hi/1000.0;
+}
+
+const char* Profiler::StageName(Stage stage) {
+  return kStageNames[stage];
+}
+
+int Profiler::Bucket(uint64_t us) {
+  if (us < 4)
+    return us;
+
+  // Power of two and its two next bits
+  const int e = 63 - __builtin_clzll(us);
+  const int sub = (us >> (e-2)) & 3;
+  return std::min(4*(e-1) + sub, NUM_BUCKETS-1);
+}
+
+}  // namespace SD_SLAM
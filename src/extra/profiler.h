@@ -0,0 +1,210 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SD_SLAM_PROFILER_H_
+#define SD_SLAM_PROFILER_H_
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace SD_SLAM {
+
+// Latency histograms of the main stages of the system.
+// Each System has its own profiler, bound to its threads with ProfilerScope. A bound thread
+// records in a buffer leased for the scope without locks, and buffers are merged when
+// statistics are read. Buffers are reused by later scopes and freed with the profiler.
+class Profiler {
+ public:
+  enum Stage {
+    EXTRACTION = 0,        // ORB extraction of a frame
+    IMAGE_ALIGN,           // Image alignment against a frame or keyframe
+    SEARCH_PROJECTION,     // Search by projection in tracking
+    POSE_OPTIMIZATION,     // Pose optimization
+    TRACK_LOCAL_MAP,       // Local map tracking
+    KEYFRAME_INSERTION,    // Keyframe creation in tracking
+    RELOCALIZATION,        // Relocalization of a frame in the map
+    TRACKING,              // Whole tracking of a frame
+    LOCAL_MAPPING,         // Processing of a keyframe in local mapping
+    CREATE_MAP_POINTS,     // Triangulation of new points with neighbor keyframes
+    LOCAL_BA,              // Local bundle adjustment
+    KEYFRAME_QUEUE_WAIT,   // From keyframe insertion until local mapping takes it from the queue
+    LOOP_DETECTION,        // Loop candidates detection
+    LOOP_CORRECTION,       // Loop fusion and pose graph optimization
+    GLOBAL_BA,             // Global bundle adjustment
+    NUM_STAGES
+  };
+
+  // Aggregated statistics of a stage (times in milliseconds)
+  struct Stats {
+    uint64_t count;
+    double total;
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+    std::vector<uint64_t> histogram;   // Counts per bucket, see BucketLimits
+  };
+
+  Profiler();
+  ~Profiler();
+
+  // Profiler of the calling thread: the one bound with ProfilerScope,
+  // or the process-wide instance if none is bound.
+  static Profiler& GetInstance() {
+    return current_ ? *current_ : Global();
+  }
+
+  // Process-wide instance
+  static Profiler& Global() {
+    static Profiler instance;
+    return instance;
+  }
+
+  inline bool Enabled() const { return enabled_.load(std::memory_order_relaxed); }
+  inline void SetEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+  // Record a stage duration in microseconds
+  void Add(Stage stage, uint64_t us);
+
+  // Merge thread buffers for a stage
+  Stats GetStats(Stage stage);
+
+  // Clear all recorded durations
+  void Reset();
+
+  // Print summary of each stage
+  void PrintStats();
+
+  // Save histograms as CSV (one row per non empty bucket) or JSON (summary and histogram per stage)
+  bool SaveCSV(const std::string &filename);
+  bool SaveJSON(const std::string &filename);
+
+  // Limits in milliseconds of a histogram bucket
+  static void BucketLimits(int bucket, double &lower, double &upper);
+
+  static const char* StageName(Stage stage);
+
+  // Buckets are exact below 4us and split each power of two in 4 above it
+  static const int NUM_BUCKETS = 144;
+
+ private:
+  // Written only by its thread
+  struct StageCounters {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> buckets[NUM_BUCKETS];
+  };
+
+  // Written by one thread at a time
+  struct ThreadBuffer {
+    StageCounters stages[NUM_STAGES];
+  };
+
+  friend class ProfilerScope;
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  // Lease a free buffer (created if there is none) and give it back
+  ThreadBuffer* Acquire();
+  void Release(ThreadBuffer* buffer);
+
+  static void Record(ThreadBuffer* buffer, Stage stage, uint64_t us);
+
+  static int Bucket(uint64_t us);
+
+  // Profiler bound to the calling thread and its leased buffer
+  static thread_local Profiler *current_;
+  static thread_local ThreadBuffer *current_buffer_;
+
+  std::atomic<bool> enabled_;
+  std::vector<ThreadBuffer*> buffers_;       // All buffers, owned by the profiler
+  std::vector<ThreadBuffer*> free_buffers_;  // Buffers not leased
+  std::mutex mutex_;
+};
+
+// Bind a profiler to the calling thread while the scope is alive, as ConfigScope
+// does with the configuration. Samples of the thread go to a buffer leased for the scope.
+class ProfilerScope {
+ public:
+  explicit ProfilerScope(Profiler *profiler): profiler_(profiler), previous_(Profiler::current_),
+                                              previous_buffer_(Profiler::current_buffer_), buffer_(nullptr) {
+    // Nested scopes of the same profiler keep the outer buffer
+    if (profiler != previous_) {
+      buffer_ = profiler->Acquire();
+      Profiler::current_buffer_ = buffer_;
+    }
+    Profiler::current_ = profiler;
+  }
+
+  ~ProfilerScope() {
+    if (buffer_)
+      profiler_->Release(buffer_);
+    Profiler::current_ = previous_;
+    Profiler::current_buffer_ = previous_buffer_;
+  }
+
+ private:
+  Profiler *profiler_;
+  Profiler *previous_;
+  Profiler::ThreadBuffer *previous_buffer_;
+  Profiler::ThreadBuffer *buffer_;
+};
+
+// Measures the time between its creation (or Start) and its destruction (or Stop)
+class ScopedProfile {
+ public:
+  explicit ScopedProfile(Profiler::Stage stage) : profiler_(Profiler::GetInstance()), stage_(stage), running_(false) {
+    Start();
+  }
+
+  ~ScopedProfile() {
+    Stop();
+  }
+
+  inline void Start() {
+    running_ = profiler_.Enabled();
+    if (running_)
+      start_ = std::chrono::steady_clock::now();
+  }
+
+  inline void Stop() {
+    if (!running_)
+      return;
+    running_ = false;
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    profiler_.Add(stage_, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+  }
+
+ private:
+  Profiler &profiler_;
+  Profiler::Stage stage_;
+  bool running_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace SD_SLAM
+
+#endif  // SD_SLAM_PROFILER_H_
@@ -0,0 +1,202 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SD_SLAM_REPLAY_H_
+#define SD_SLAM_REPLAY_H_
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <opencv2/opencv.hpp>
+
+namespace SD_SLAM {
+
+// Decode the images of a recorded sequence ahead of the tracking with a pool of threads.
+// Each item has an image and an optional second one (e.g. a depthmap).
+// At most ahead items are kept decoded, and they must be retrieved in order.
+class ImageLoader {
+ public:
+  ImageLoader(const std::vector<std::string> &files, int flags,
+              const std::vector<std::string> &files2, int flags2, int nthreads, int ahead)
+    : files_(files), files2_(files2), flags_(flags), flags2_(flags2),
+      ahead_(std::max(ahead, 1)), next_(0), consumed_(0), stop_(false) {
+    slots_.resize(ahead_);
+    for (int i = 0; i < std::max(nthreads, 1); i++)
+      workers_.push_back(std::thread(&ImageLoader::Run, this));
+  }
+
+  ImageLoader(const std::vector<std::string> &files, int flags, int nthreads, int ahead)
+    : ImageLoader(files, flags, std::vector<std::string>(), 0, nthreads, ahead) {
+  }
+
+  ~ImageLoader() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cond_space_.notify_all();
+
+    for (auto &t : workers_)
+      t.join();
+  }
+
+  inline int Size() const {
+    return files_.size();
+  }
+
+  // Wait until item i is decoded. Returns false if the first image couldn't be read.
+  bool Get(int i, cv::Mat &im, cv::Mat &im2) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Slot &slot = slots_[i % ahead_];
+    cond_ready_.wait(lock, [&] { return slot.ready && slot.index == i; });
+
+    im = slot.im;
+    im2 = slot.im2;
+    slot.ready = false;
+    slot.im.release();
+    slot.im2.release();
+    consumed_ = i+1;
+    lock.unlock();
+    cond_space_.notify_all();
+
+    return !im.empty();
+  }
+
+  bool Get(int i, cv::Mat &im) {
+    cv::Mat im2;
+    return Get(i, im, im2);
+  }
+
+ private:
+  struct Slot {
+    Slot() : index(-1), ready(false) {}
+    int index;
+    bool ready;
+    cv::Mat im;
+    cv::Mat im2;
+  };
+
+  void Run() {
+    const int n = files_.size();
+
+    while (true) {
+      int i;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_space_.wait(lock, [&] { return stop_ || next_ >= n || next_ < consumed_+ahead_; });
+        if (stop_ || next_ >= n)
+          return;
+        i = next_++;
+      }
+
+      // Slot i%ahead was already consumed, so decoding runs without lock
+      cv::Mat im = cv::imread(files_[i], flags_);
+      cv::Mat im2;
+      if (i < static_cast<int>(files2_.size()))
+        im2 = cv::imread(files2_[i], flags2_);
+
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        Slot &slot = slots_[i % ahead_];
+        slot.index = i;
+        slot.im = im;
+        slot.im2 = im2;
+        slot.ready = true;
+      }
+      cond_ready_.notify_all();
+    }
+  }
+
+  const std::vector<std::string> files_;
+  const std::vector<std::string> files2_;
+  const int flags_;
+  const int flags2_;
+  const int ahead_;
+
+  std::vector<Slot> slots_;
+  int next_;        // Next item to decode
+  int consumed_;    // Items already retrieved
+  bool stop_;
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable cond_ready_;
+  std::condition_variable cond_space_;
+};
+
+// Throughput and per frame latency of a replayed sequence
+class ReplayStats {
+ public:
+  ReplayStats() : start_(std::chrono::steady_clock::now()) {}
+
+  // Add latency (s) of a frame
+  inline void Add(double latency) {
+    latencies_.push_back(latency*1000.0);
+  }
+
+  void Print() {
+    const double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    const int n = latencies_.size();
+    if (n == 0)
+      return;
+
+    std::sort(latencies_.begin(), latencies_.end());
+    double sum = 0.0;
+    for (double l : latencies_)
+      sum += l;
+
+    printf("[INFO] Replayed %d frames in %.2fs (%.1f fps)\n", n, total, n/total);
+    printf("[INFO] Frame latency (ms): mean %.2f, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n", sum/n,
+           Percentile(0.5), Percentile(0.9), Percentile(0.99), latencies_.back());
+  }
+
+ private:
+  inline double Percentile(double p) const {
+    return latencies_[std::min(static_cast<int>(p*latencies_.size()), static_cast<int>(latencies_.size())-1)];
+  }
+
+  std::chrono::steady_clock::time_point start_;
+  std::vector<double> latencies_;  // ms
+};
+
+// Remove --replay from the command line arguments. Returns true if it was given.
+inline bool ParseReplay(int &argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--replay") {
+      std::copy(argv+i+1, argv+argc, argv+i);
+      argc--;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Number of decoding threads for replay, leaving cores to the SLAM threads
+inline int ReplayThreads() {
+  return std::max(static_cast<int>(std::thread::hardware_concurrency())/2, 1);
+}
+
+}  // namespace SD_SLAM
+
+#endif  // SD_SLAM_REPLAY_H_
@@ -0,0 +1,124 @@
+/**
+ *
+ *  Copyright (C) 2018 Eduardo Perdices <eperdices at gsyc dot es>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SD_SLAM_THREAD_POOL_H_
+#define SD_SLAM_THREAD_POOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace SD_SLAM {
+
+// Persistent pool of worker threads. The calling thread also runs tasks.
+// ParallelFor must be called from one thread at a time.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int nthreads) : task_(nullptr), n_(0), next_(0), active_(0), generation_(0), stop_(false) {
+    for (int i = 1; i < nthreads; i++)
+      workers_.push_back(std::thread(&ThreadPool::Run, this));
+  }
+
+  ~ThreadPool() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+
+    for (auto &t : workers_)
+      t.join();
+  }
+
+  inline int GetThreads() const {
+    return workers_.size()+1;
+  }
+
+  // Run f(i) for every i in [0, n) and wait until all of them finish
+  void ParallelFor(int n, const std::function<void(int)> &f) {
+    if (workers_.empty() || n <= 1) {
+      for (int i = 0; i < n; i++)
+        f(i);
+      return;
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_ = &f;
+      n_ = n;
+      next_ = 0;
+      active_ = workers_.size();
+      generation_++;
+    }
+    cond_.notify_all();
+
+    Work();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cond_.wait(lock, [this] { return active_ == 0; });
+    task_ = nullptr;
+  }
+
+ private:
+  void Run() {
+    unsigned int generation = 0;
+
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&] { return stop_ || generation_ != generation; });
+        if (stop_)
+          return;
+        generation = generation_;
+      }
+
+      Work();
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (--active_ == 0)
+        done_cond_.notify_one();
+    }
+  }
+
+  void Work() {
+    int i;
+    while ((i = next_++) < n_)
+      (*task_)(i);
+  }
+
+  std::vector<std::thread> workers_;
+
+  const std::function<void(int)> *task_;
+  int n_;
+  std::atomic<int> next_;
+  int active_;
+  unsigned int generation_;
+  bool stop_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::condition_variable done_cond_;
+};
+
+}  // namespace SD_SLAM
+
+#endif  // SD_SLAM_THREAD_POOL_H_
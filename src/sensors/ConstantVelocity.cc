@@ -23,15 +23,13 @@ namespace SD_SLAM {
 
 using std::vector;
 
-ConstantVelocity::ConstantVelocity() : Sensor() {
-  state_size_ = 6;
-  measurement_size_ = 6;
+ConstantVelocity::ConstantVelocity() : SensorModel() {
 }
 
 ConstantVelocity::~ConstantVelocity() {
 }
 
-void ConstantVelocity::Init(Eigen::VectorXd &X, Eigen::MatrixXd &P) {
+void ConstantVelocity::Init(StateVector &X, StateMatrix &P) {
   Eigen::Vector3d v;
   Eigen::Vector3d w;
 
@@ -41,24 +39,20 @@ void ConstantVelocity::Init(Eigen::VectorXd &X, Eigen::MatrixXd &P) {
   X.segment<3>(0) = v;
   X.segment<3>(3) = w;
 
-  P.block<3, 3>(0, 0) = Eigen::MatrixXd::Identity(3, 3) * Sensor::COV_V_2;
-  P.block<3, 3>(3, 3) = Eigen::MatrixXd::Identity(4, 4) * Sensor::COV_W_2;
+  P.setZero();
+  P.block<3, 3>(0, 0) = Eigen::Matrix3d::Identity() * Sensor::COV_V_2;
+  P.block<3, 3>(3, 3) = Eigen::Matrix3d::Identity() * Sensor::COV_W_2;
 }
 
-void ConstantVelocity::InitState(Eigen::VectorXd &X, const Eigen::VectorXd &z) {
+void ConstantVelocity::InitState(StateVector &X, const MeasurementVector &z) {
   X.setZero();
 }
 
-Eigen::Matrix4d ConstantVelocity::GetPose(const Eigen::VectorXd &X) {
-  Eigen::Matrix<double, 6, 1> vel = X.segment<6>(0);
-  return Exp(vel) * last_pose_;
+Eigen::Matrix4d ConstantVelocity::GetPose(const StateVector &X) {
+  return Exp(X) * last_pose_;
 }
 
-Eigen::VectorXd ConstantVelocity::PoseToVector(const Eigen::Matrix4d &pose) {
-  return Log(pose);
-}
-
-void ConstantVelocity::F(Eigen::VectorXd &X, double time) {
+void ConstantVelocity::F(StateVector &X, double time) {
   Eigen::Vector3d v = X.segment<3>(0);
   Eigen::Vector3d w = X.segment<3>(3);
 
@@ -69,8 +63,8 @@ void ConstantVelocity::F(Eigen::VectorXd &X, double time) {
   X.segment<3>(3) = w;
 }
 
-Eigen::MatrixXd ConstantVelocity::jF(const Eigen::VectorXd &X, double time) {
-  Eigen::MatrixXd jF(state_size_, state_size_);
+ConstantVelocity::StateMatrix ConstantVelocity::jF(const StateVector &X, double time) {
+  StateMatrix jF;
 
   // Jacobian F
   // dv/dv   dv/dw  =   I       0
@@ -80,32 +74,21 @@ Eigen::MatrixXd ConstantVelocity::jF(const Eigen::VectorXd &X, double time) {
   return jF;
 }
 
-Eigen::MatrixXd ConstantVelocity::Q(const Eigen::VectorXd &X, double time) {
-  Eigen::MatrixXd Q(state_size_, state_size_);
-  int noise_size = 6;
-
+ConstantVelocity::StateMatrix ConstantVelocity::Q(const StateVector &X, double time) {
   // Noise matrix
-  Eigen::MatrixXd  P_n(noise_size, noise_size);
-  P_n.setZero();
-  P_n.block<3, 3>(0, 0) = Eigen::MatrixXd::Identity(3, 3) * Sensor::SIGMA_V * Sensor::SIGMA_V * time * time;
-  P_n.block<3, 3>(3, 3) = Eigen::MatrixXd::Identity(3, 3) * Sensor::SIGMA_W * Sensor::SIGMA_W * time * time;
-
-  // Jacobian G
-  // dv/dv   dv/dw   =   I     0
-  // dw/dv   dw/dw       0     I
-  Eigen::MatrixXd G(state_size_, noise_size);
-  G.setIdentity();
-
-  // Q = G * P_n * G'
-  Q = G * P_n * G.transpose();
+  // Jacobian G is the identity (dv/dv = I, dw/dw = I), so Q = G * P_n * G' = P_n
+  StateMatrix Q;
+  Q.setZero();
+  Q.block<3, 3>(0, 0) = Eigen::Matrix3d::Identity() * Sensor::SIGMA_V * Sensor::SIGMA_V * time * time;
+  Q.block<3, 3>(3, 3) = Eigen::Matrix3d::Identity() * Sensor::SIGMA_W * Sensor::SIGMA_W * time * time;
 
   return Q;
 }
 
-Eigen::VectorXd ConstantVelocity::Z(const Eigen::Matrix4d &pose, const vector<double> &params, double time) {
-  Eigen::VectorXd Z(measurement_size_);
+ConstantVelocity::MeasurementVector ConstantVelocity::Z(const Eigen::Matrix4d &pose, const vector<double> &params, double time) {
+  MeasurementVector Z;
 
-  assert(6 + static_cast<int>(params.size()) == measurement_size_);
+  assert(params.empty());
 
   // Get last pose inverse
   Eigen::Matrix4d last_pose_i;
@@ -116,13 +99,13 @@ Eigen::VectorXd ConstantVelocity::Z(const Eigen::Matrix4d &pose, const vector<do
   last_pose_i.block<3, 1>(0, 3) = -rot*last_pose_.block<3, 1>(0, 3);
 
   Eigen::Matrix4d se3 = pose * last_pose_i;
-  Z.segment<6>(0) = PoseToVector(se3);
+  Z = Log(se3);
 
   return Z;
 }
 
-Eigen::VectorXd ConstantVelocity::H(const Eigen::VectorXd &X, double time) {
-  Eigen::VectorXd H(measurement_size_);
+ConstantVelocity::MeasurementVector ConstantVelocity::H(const StateVector &X, double time) {
+  MeasurementVector H;
   H.setZero();
 
   Eigen::Vector3d v = X.segment<3>(0);
@@ -137,8 +120,8 @@ Eigen::VectorXd ConstantVelocity::H(const Eigen::VectorXd &X, double time) {
   return H;
 }
 
-Eigen::MatrixXd ConstantVelocity::jH(const Eigen::VectorXd &X, double time) {
-  Eigen::MatrixXd jH(measurement_size_, state_size_);
+ConstantVelocity::MeasurementJacobian ConstantVelocity::jH(const StateVector &X, double time) {
+  MeasurementJacobian jH;
 
   // Jacobian H
   // dv/dv   dv/dw       I     0
@@ -148,12 +131,12 @@ Eigen::MatrixXd ConstantVelocity::jH(const Eigen::VectorXd &X, double time) {
   return jH;
 }
 
-Eigen::MatrixXd ConstantVelocity::R(const Eigen::VectorXd &X, double time) {
-  Eigen::MatrixXd R(measurement_size_, measurement_size_);
+ConstantVelocity::MeasurementMatrix ConstantVelocity::R(const StateVector &X, double time) {
+  MeasurementMatrix R;
 
   R.setZero();
-  R.block<3, 3>(0, 0) = Eigen::MatrixXd::Identity(3, 3) * Sensor::SIGMA_V * Sensor::SIGMA_V * time * time;
-  R.block<3, 3>(3, 3) = Eigen::MatrixXd::Identity(4, 4) * Sensor::SIGMA_W * Sensor::SIGMA_W * time * time;
+  R.block<3, 3>(0, 0) = Eigen::Matrix3d::Identity() * Sensor::SIGMA_V * Sensor::SIGMA_V * time * time;
+  R.block<3, 3>(3, 3) = Eigen::Matrix3d::Identity() * Sensor::SIGMA_W * Sensor::SIGMA_W * time * time;
 
   return R;
 }
@@ -28,25 +28,24 @@ namespace SD_SLAM {
 
 const double SMALL_EPS = 1e-10;
 
-class ConstantVelocity : public Sensor {
+class ConstantVelocity : public SensorModel<6, 6> {
  public:
   ConstantVelocity();
   ~ConstantVelocity();
 
-  void Init(Eigen::VectorXd &X, Eigen::MatrixXd &P);
-  void InitState(Eigen::VectorXd &X, const Eigen::VectorXd &Z);
+  void Init(StateVector &X, StateMatrix &P);
+  void InitState(StateVector &X, const MeasurementVector &Z);
 
-  Eigen::Matrix4d GetPose(const Eigen::VectorXd &X);
-  Eigen::VectorXd PoseToVector(const Eigen::Matrix4d &pose);
+  Eigen::Matrix4d GetPose(const StateVector &X);
 
-  void F(Eigen::VectorXd &X, double time);
-  Eigen::MatrixXd jF(const Eigen::VectorXd &X, double time);
-  Eigen::MatrixXd Q(const Eigen::VectorXd &X, double time);
+  void F(StateVector &X, double time);
+  StateMatrix jF(const StateVector &X, double time);
+  StateMatrix Q(const StateVector &X, double time);
 
-  Eigen::VectorXd Z(const Eigen::Matrix4d &pose, const std::vector<double> &params, double time);
-  Eigen::VectorXd H(const Eigen::VectorXd &X, double time);
-  Eigen::MatrixXd jH(const Eigen::VectorXd &X, double time);
-  Eigen::MatrixXd R(const Eigen::VectorXd &X, double time);
+  MeasurementVector Z(const Eigen::Matrix4d &pose, const std::vector<double> &params, double time);
+  MeasurementVector H(const StateVector &X, double time);
+  MeasurementJacobian jH(const StateVector &X, double time);
+  MeasurementMatrix R(const StateVector &X, double time);
 
  private:
   Eigen::Matrix4d Exp(const Eigen::Matrix<double, 6, 1> &update);
@@ -18,94 +18,102 @@
  */
 
 #include "EKF.h"
+#include "ConstantVelocity.h"
+#include "IMU.h"
 
 using std::vector;
 
 namespace SD_SLAM {
 
-EKF::EKF(Sensor *sensor) : timer_(false) {
-  sensor_ = sensor;
+template<class SensorT>
+EKF<SensorT>::EKF() {
   it_time_ = 0.0;
+  last_timestamp_ = 0.0;
 
-  const int size_s = sensor_->GetStateSize();
-
-  X_.resize(size_s, 1);
   X_.setZero();
-  P_.resize(size_s, size_s);
   P_.setZero();
 
   updated_ = false;
-  sensor_->Init(X_, P_);
+  sensor_.Init(X_, P_);
 }
 
-EKF::~EKF() {
+template<class SensorT>
+EKF<SensorT>::~EKF() {
 }
 
-Eigen::Matrix4d EKF::Predict(const Eigen::Matrix4d &pose) {
-  if (updated_) {
-    timer_.Stop();
-    it_time_ = timer_.GetTime();
-  } else {
-    it_time_ = 0.0;
-  }
+template<class SensorT>
+Eigen::Matrix4d EKF<SensorT>::Predict(const Eigen::Matrix4d &pose, double timestamp) {
+  it_time_ = ElapsedTime(timestamp);
 
   // Save last pose
-  sensor_->SetLastPose(pose);
+  sensor_.SetLastPose(pose);
 
   // Get matrices before predict
-  Eigen::MatrixXd jF = sensor_->jF(X_, it_time_);
-  Eigen::MatrixXd Q = sensor_->Q(X_, it_time_);
+  const StateMatrix jF = sensor_.jF(X_, it_time_);
+  const StateMatrix Q = sensor_.Q(X_, it_time_);
 
   // X_0 = f(X_0)
-  sensor_->F(X_, it_time_);
+  sensor_.F(X_, it_time_);
 
   // P_0 = jF * P_0 * jF' + Q
   P_ = jF * P_ * jF.transpose() + Q;
 
-  return sensor_->GetPose(X_);
+  return sensor_.GetPose(X_);
 }
 
-void EKF::Update(const Eigen::Matrix4d &pose, const vector<double> &params) {
-  Eigen::VectorXd Y;
-  Eigen::MatrixXd S, K;
+template<class SensorT>
+void EKF<SensorT>::Update(const Eigen::Matrix4d &pose, const vector<double> &params, double timestamp) {
+  it_time_ = ElapsedTime(timestamp);
 
   // Set measurements vector
-  Eigen::VectorXd Z = sensor_->Z(pose, params, it_time_);
+  const MeasurementVector Z = sensor_.Z(pose, params, it_time_);
 
   if (!updated_) {
     // Set initial state
-    sensor_->InitState(X_, Z);
+    sensor_.InitState(X_, Z);
   } else {
     // Get matrices before update
-    Eigen::VectorXd H = sensor_->H(X_, it_time_);
-    Eigen::MatrixXd jH = sensor_->jH(X_, it_time_);
-    Eigen::MatrixXd R = sensor_->R(X_, it_time_);
+    const MeasurementVector H = sensor_.H(X_, it_time_);
+    const MeasurementJacobian jH = sensor_.jH(X_, it_time_);
+    const MeasurementMatrix R = sensor_.R(X_, it_time_);
 
     // Y = Z - h(X_0)
-    Y = Z - H;
+    const MeasurementVector Y = Z - H;
 
     // S = jH * P_0 * jH' + R
-    S = jH * P_ * jH.transpose() + R;
+    const GainMatrix PjHt = P_ * jH.transpose();
+    const MeasurementMatrix S = jH * PjHt + R;
 
     // K = P_0 * jH' * S^-1
-    K = P_ * jH.transpose() * S.inverse();
+    const GainMatrix K = PjHt * S.inverse();
 
     // X = X_0 + K * Y
-    X_ = X_ + K * Y;
+    X_ += K * Y;
 
     // P = P_0 - K * S * K'
-    P_ = P_ - K * S *  K.transpose();
+    P_ -= K * S * K.transpose();
     //P_ = 0.5 * P_ + 0.5 * P_.transpose().eval(); //Enforce covariance symmetry
   }
 
-  // Start timer for next iteration
+  // Save time for next iteration
   updated_ = true;
-  timer_.Start();
+  last_timestamp_ = timestamp;
 }
 
-void EKF::Restart() {
+template<class SensorT>
+void EKF<SensorT>::Restart() {
   updated_ = false;
-  sensor_->Init(X_, P_);
+  sensor_.Init(X_, P_);
 }
 
+template<class SensorT>
+double EKF<SensorT>::ElapsedTime(double timestamp) const {
+  if (!updated_ || timestamp < last_timestamp_)
+    return 0.0;
+  return timestamp - last_timestamp_;
+}
+
+template class EKF<ConstantVelocity>;
+template class EKF<IMU>;
+
 }  // namespace SD_SLAM
@@ -21,38 +21,69 @@
 #define SD_SLAM_EKF_H_
 
 #include <iostream>
+#include <vector>
 #include <Eigen/Dense>
 #include "Sensor.h"
-#include "extra/timer.h"
 
 namespace SD_SLAM {
 
-class EKF {
+// Motion model interface used by the tracking.
+// Timestamps are capture times in seconds, so predictions don't depend on processing speed.
+class MotionModel {
  public:
-  EKF(Sensor *sensor);
+  virtual ~MotionModel() {}
+
+  virtual bool Started() = 0;
+
+  // Predict pose at timestamp, given the pose of the last frame
+  virtual Eigen::Matrix4d Predict(const Eigen::Matrix4d &pose, double timestamp) = 0;
+
+  // Update with the pose estimated at timestamp and extra sensor measurements
+  virtual void Update(const Eigen::Matrix4d &pose, const std::vector<double> &params, double timestamp) = 0;
+
+  // Restart filter
+  virtual void Restart() = 0;
+};
+
+// Extended Kalman filter over a SensorModel. State and covariances have
+// fixed sizes, so no memory is allocated in Predict or Update.
+template<class SensorT>
+class EKF : public MotionModel {
+ public:
+  typedef typename SensorT::StateVector StateVector;
+  typedef typename SensorT::StateMatrix StateMatrix;
+  typedef typename SensorT::MeasurementVector MeasurementVector;
+  typedef typename SensorT::MeasurementMatrix MeasurementMatrix;
+  typedef typename SensorT::MeasurementJacobian MeasurementJacobian;
+  typedef typename SensorT::GainMatrix GainMatrix;
+
+  EKF();
   ~EKF();
 
   inline bool Started() { return updated_; }
 
   // Predict EKF and return 3D Pose
-  Eigen::Matrix4d Predict(const Eigen::Matrix4d &pose);
+  Eigen::Matrix4d Predict(const Eigen::Matrix4d &pose, double timestamp);
 
   // Update EKF
-  void Update(const Eigen::Matrix4d &pose, const std::vector<double> &params);
+  void Update(const Eigen::Matrix4d &pose, const std::vector<double> &params, double timestamp);
 
   // Restart filter
   void Restart();
 
  private:
-  Sensor* sensor_;    // Motion sensor
+  // Time (s) elapsed since last update
+  double ElapsedTime(double timestamp) const;
+
+  SensorT sensor_;              // Motion sensor
 
-  bool updated_;      // True if EKF has been updated at least once
-  Timer timer_;       // Measure time since last iteration
-  double it_time_;    // Time (s) since last iteration
+  bool updated_;            // True if EKF has been updated at least once
+  double last_timestamp_;   // Timestamp of last update
+  double it_time_;          // Time (s) since last iteration
 
   // State and covariance
-  Eigen::VectorXd X_;
-  Eigen::MatrixXd P_;
+  StateVector X_;
+  StateMatrix P_;
 
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
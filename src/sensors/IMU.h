@@ -26,22 +26,24 @@
 
 namespace SD_SLAM {
 
-class IMU : public Sensor {
+class IMU : public SensorModel<16, 13> {
  public:
   IMU();
   ~IMU();
 
-  void Init(Eigen::VectorXd &X, Eigen::MatrixXd &P);
-  void InitState(Eigen::VectorXd &X, const Eigen::VectorXd &Z);
+  void Init(StateVector &X, StateMatrix &P);
+  void InitState(StateVector &X, const MeasurementVector &Z);
 
-  void F(Eigen::VectorXd &X, double time);
-  Eigen::MatrixXd jF(const Eigen::VectorXd &X, double time);
-  Eigen::MatrixXd Q(const Eigen::VectorXd &X, double time);
+  Eigen::Matrix4d GetPose(const StateVector &X);
 
-  Eigen::VectorXd Z(const Eigen::Matrix4d &pose, const std::vector<double> &params, double time);
-  Eigen::VectorXd H(const Eigen::VectorXd &X, double time);
-  Eigen::MatrixXd jH(const Eigen::VectorXd &X, double time);
-  Eigen::MatrixXd R(const Eigen::VectorXd &X, double time);
+  void F(StateVector &X, double time);
+  StateMatrix jF(const StateVector &X, double time);
+  StateMatrix Q(const StateVector &X, double time);
+
+  MeasurementVector Z(const Eigen::Matrix4d &pose, const std::vector<double> &params, double time);
+  MeasurementVector H(const StateVector &X, double time);
+  MeasurementJacobian jH(const StateVector &X, double time);
+  MeasurementMatrix R(const StateVector &X, double time);
 
  private:
   // Calculate gravity from IMU
@@ -32,32 +32,14 @@ const double Sensor::SIGMA_V = 4.0;   // m/s^2
 const double Sensor::SIGMA_W = 6.0;   // rad/s^2
 
 Sensor::Sensor() {
-  state_size_ = 0;
-  measurement_size_ = 0;
   last_pose_.setZero();
 }
 
 Sensor::~Sensor() {
 }
 
-Eigen::Matrix4d Sensor::GetPose(const Eigen::VectorXd &X) {
-  Eigen::Matrix4d pose;
-
-  Eigen::Vector3d x = X.segment<3>(0);
-  Eigen::Vector4d q = X.segment<4>(3);
-
-  Eigen::Quaterniond qt(q(0), q(1), q(2), q(3));
-  qt.normalize();
-
-  pose.setIdentity();
-  pose.block<3, 3>(0, 0) = qt.toRotationMatrix();
-  pose.block<3, 1>(0, 3) = x;
-
-  return pose;
-}
-
-Eigen::VectorXd Sensor::PoseToVector(const Eigen::Matrix4d &pose) {
-  Eigen::VectorXd v(7);
+Eigen::Matrix<double, 7, 1> Sensor::PoseToVector(const Eigen::Matrix4d &pose) {
+  Eigen::Matrix<double, 7, 1> v;
 
   Eigen::Matrix3d rot = pose.block<3, 3>(0, 0);
   Eigen::Quaterniond q(rot);
@@ -131,8 +113,8 @@ Eigen::Matrix<double, 4, 3> Sensor::dq_by_dw(const Eigen::Quaterniond &q, const
   Eigen::Matrix<double, 4, 3> mdw;
 
   if (modw == 0) {
-    res.block(0, 0, 1, 3).setZero();
-    res.block(1, 0, 3, 3) = Eigen::MatrixXd::Identity(3, 3) * time / 2.0;
+    res.block<1, 3>(0, 0).setZero();
+    res.block<3, 3>(1, 0) = Eigen::Matrix3d::Identity() * time / 2.0;
   } else {
     mdw(0, 0) = (-time / 2.0) * sin(beta) * w(0) / modw;
     mdw(0, 1) = (-time / 2.0) * sin(beta) * w(1) / modw;
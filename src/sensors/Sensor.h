@@ -28,50 +28,18 @@
 
 namespace SD_SLAM {
 
+// Pose helpers and noise parameters shared by all sensor models
 class Sensor {
  public:
   Sensor();
   ~Sensor();
 
-  inline int GetStateSize() { return state_size_; }
-  inline int GetMeasurementSize() { return measurement_size_; }
-
   inline void SetLastPose(const Eigen::Matrix4d &pose) {
     last_pose_ = pose;
   }
 
-  // Return current pose calculated from sensor
-  virtual Eigen::Matrix4d GetPose(const Eigen::VectorXd &X);
-
   // Get input pose and convert to position and quaternion
-  virtual Eigen::VectorXd PoseToVector(const Eigen::Matrix4d &pose);
-
-  // Init sensor with default values
-  virtual void Init(Eigen::VectorXd &X, Eigen::MatrixXd &P) = 0;
-
-  // Set initial state
-  virtual void InitState(Eigen::VectorXd &X, const Eigen::VectorXd &Z) = 0;
-
-  // Predict state
-  virtual void F(Eigen::VectorXd &X, double time) = 0;
-
-  // Prediction jacobian
-  virtual Eigen::MatrixXd jF(const Eigen::VectorXd &X, double time) = 0;
-
-  // Process noise covariance
-  virtual Eigen::MatrixXd Q(const Eigen::VectorXd &X, double time) = 0;
-
-  // Get measurement
-  virtual Eigen::VectorXd Z(const Eigen::Matrix4d &pose, const std::vector<double> &params, double time) = 0;
-
-  // Get predicted measurement
-  virtual Eigen::VectorXd H(const Eigen::VectorXd &X, double time) = 0;
-
-  // Measurement jacobian
-  virtual Eigen::MatrixXd jH(const Eigen::VectorXd &X, double time) = 0;
-
-  // Measurement noise covariance
-  virtual Eigen::MatrixXd R(const Eigen::VectorXd &X, double time) = 0;
+  Eigen::Matrix<double, 7, 1> PoseToVector(const Eigen::Matrix4d &pose);
 
  protected:
   // Calculate quaternion from angular velocity
@@ -84,9 +52,6 @@ class Sensor {
   // Jacobian dw/dq
   Eigen::Matrix<double, 4, 3> dq_by_dw(const Eigen::Quaterniond &q, const Eigen::Vector3d &w, double time);
 
-  int state_size_;
-  int measurement_size_;
-
   // Pose information
   Eigen::Matrix4d last_pose_;
 
@@ -106,6 +71,49 @@ class Sensor {
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
 
+// Sensor model with fixed state and measurement sizes, so the filter
+// works on stack allocated matrices.
+template<int StateSize, int MeasurementSize>
+class SensorModel : public Sensor {
+ public:
+  typedef Eigen::Matrix<double, StateSize, 1> StateVector;
+  typedef Eigen::Matrix<double, StateSize, StateSize> StateMatrix;
+  typedef Eigen::Matrix<double, MeasurementSize, 1> MeasurementVector;
+  typedef Eigen::Matrix<double, MeasurementSize, MeasurementSize> MeasurementMatrix;
+  typedef Eigen::Matrix<double, MeasurementSize, StateSize> MeasurementJacobian;
+  typedef Eigen::Matrix<double, StateSize, MeasurementSize> GainMatrix;
+
+  // Init sensor with default values
+  virtual void Init(StateVector &X, StateMatrix &P) = 0;
+
+  // Set initial state
+  virtual void InitState(StateVector &X, const MeasurementVector &Z) = 0;
+
+  // Return current pose calculated from sensor
+  virtual Eigen::Matrix4d GetPose(const StateVector &X) = 0;
+
+  // Predict state
+  virtual void F(StateVector &X, double time) = 0;
+
+  // Prediction jacobian
+  virtual StateMatrix jF(const StateVector &X, double time) = 0;
+
+  // Process noise covariance
+  virtual StateMatrix Q(const StateVector &X, double time) = 0;
+
+  // Get measurement
+  virtual MeasurementVector Z(const Eigen::Matrix4d &pose, const std::vector<double> &params, double time) = 0;
+
+  // Get predicted measurement
+  virtual MeasurementVector H(const StateVector &X, double time) = 0;
+
+  // Measurement jacobian
+  virtual MeasurementJacobian jH(const StateVector &X, double time) = 0;
+
+  // Measurement noise covariance
+  virtual MeasurementMatrix R(const StateVector &X, double time) = 0;
+};
+
 }  // namespace SD_SLAM
 
 #endif  // SD_SLAM_SENSOR_H_